@@ -0,0 +1,570 @@
+// Benchmarks behind the figures quoted for the compiler's passes and
+// back ends.
+//
+//   benchmark -front N   N generated functions through each pass, with
+//                        the time each takes and its rate per node or
+//                        instruction
+//   benchmark -run N     bubble sort of N ints and N evaluations of two
+//                        polynomials under the interpreter, the VM after
+//                        each combination of -inline, -loops and -O, and
+//                        the Moon simulator on the int program
+//
+// Without arguments both run, at 10000 functions and N = 1000. Sources are
+// cut into tokens by a small scanner for the generated text rather than by
+// the Tokenizer, whose regular expressions would take minutes on the larger
+// inputs and are not what is measured. Times are the best of -repeat runs
+// (3 by default); build with -DCMAKE_BUILD_TYPE=Release, since the default
+// build is not optimized.
+#include "../tests/moon_simulator.h"
+#include "../include/ast.h"
+#include "../include/ast_builder.h"
+#include "../include/ast_walker.h"
+#include "../include/bytecode_vm.h"
+#include "../include/constant_fold.h"
+#include "../include/flat_ast.h"
+#include "../include/interpreter.h"
+#include "../include/ir_builder.h"
+#include "../include/ir_inline.h"
+#include "../include/ir_loops.h"
+#include "../include/ir_ssa.h"
+#include "../include/moon_codegen.h"
+#include "../include/moon_peephole.h"
+#include "../include/semantic_check.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+unsigned repeats = 3;
+
+// Best time of repeats runs of f, in seconds; setup runs before each
+double best(const std::function<void()>& setup, const std::function<void()>& f) {
+    double fastest = 0;
+    for (unsigned r = 0; r < repeats; ++r) {
+        setup();
+        auto started = std::chrono::steady_clock::now();
+        f();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        fastest = r == 0 ? seconds : std::min(fastest, seconds);
+    }
+    return fastest;
+}
+
+// Tokens of generated source, typed as the Tokenizer types them
+std::vector<token::Token> scan(const std::string& source) {
+    static const char* const reserved[] = {"function", "local", "int", "float", "void", "return", "not", "and",
+                                           "or", "write", "read", "if", "then", "else", "while", "class",
+                                           "implementation", "isa", "public", "private", "attribute"};
+    static const char* const pairs[] = {":=", "=>", "<=", ">=", "<>", "=="};
+    std::vector<token::Token> tokens;
+    std::size_t i = 0;
+    while (i < source.size()) {
+        std::uint32_t offset = static_cast<std::uint32_t>(i);
+        char c = source[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (std::isalpha(static_cast<unsigned char>(c))) {
+            std::size_t j = i;
+            while (j < source.size() && (std::isalnum(static_cast<unsigned char>(source[j])) || source[j] == '_')) {
+                ++j;
+            }
+            std::string word = source.substr(i, j - i);
+            bool isReserved = std::any_of(std::begin(reserved), std::end(reserved),
+                                          [&](const char* r) { return word == r; });
+            tokens.push_back({isReserved ? "reserved" : "id", word, offset});
+            i = j;
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            std::size_t j = i;
+            bool fraction = false;
+            while (j < source.size() && (std::isdigit(static_cast<unsigned char>(source[j])) || source[j] == '.')) {
+                fraction = fraction || source[j] == '.';
+                ++j;
+            }
+            tokens.push_back({fraction ? "float" : "integer", source.substr(i, j - i), offset});
+            i = j;
+        } else {
+            std::size_t length = 1;
+            for (const char* pair : pairs) {
+                if (source.compare(i, 2, pair) == 0) {
+                    length = 2;
+                }
+            }
+            tokens.push_back({"operator", source.substr(i, length), offset});
+            i += length;
+        }
+    }
+    return tokens;
+}
+
+// A program of int functions, each with a loop, a conditional, arithmetic
+// on its locals, an array and a call to the function before it
+std::string frontProgram(int functions) {
+    std::string text;
+    for (int f = 0; f < functions; ++f) {
+        std::string k = std::to_string(f % 97 + 1);
+        text += "function f" + std::to_string(f) + "(p: int, q: int) => int {\n"
+                "  local a: int; local b: int; local i: int; local v: int[8];\n"
+                "  a := p * " + k + " + q; b := (a - 3) * (q + " + k + ");\n"
+                "  i := 0;\n"
+                "  while (i < 8) {\n"
+                "    v[i] := a * i + b;\n"
+                "    if (v[i] > " + k + "00) then b := b - v[i] / 2; else a := a + i * " + k + ";;\n"
+                "    i := i + 1;\n"
+                "  };\n";
+        if (f > 0) {
+            text += "  a := a + f" + std::to_string(f - 1) + "(b, i);\n";
+        }
+        text += "  return (a + v[3] * 2 - b);\n}\n";
+    }
+    text += "function main() => void {\n  write(f" + std::to_string(functions - 1) + "(1, 2));\n}\n";
+    return text;
+}
+
+std::string sortProgram(int n) {
+    std::string size = std::to_string(n);
+    return R"(
+function fill(arr: int[], size: int, seed: int) => void {
+  local i: int; local x: int;
+  i := 0; x := seed;
+  while (i < size) { x := x * 1103 + 12345; x := x - (x / 65536) * 65536; arr[i] := x; i := i + 1; };
+}
+function bubbleSort(arr: int[], size: int) => void {
+  local i: int; local j: int; local temp: int;
+  i := 0;
+  while (i < size - 1) {
+    j := 0;
+    while (j < size - i - 1) {
+      if (arr[j] > arr[j + 1]) then { temp := arr[j]; arr[j] := arr[j + 1]; arr[j + 1] := temp; } else ;
+      j := j + 1;
+    };
+    i := i + 1;
+  };
+}
+function checksum(arr: int[], size: int) => int {
+  local i: int; local s: int;
+  i := 0; s := 0;
+  while (i < size) { s := s + arr[i] * (i + 1); s := s - (s / 1000003) * 1000003; i := i + 1; };
+  return (s);
+}
+function main() => void {
+  local arr: int[)" + size + R"(];
+  fill(arr, )" + size + R"(, 7);
+  bubbleSort(arr, )" + size + R"();
+  write(checksum(arr, )" + size + R"());
+}
+)";
+}
+
+std::string polynomialProgram(int n) {
+    return R"(
+class POLYNOMIAL { public function evaluate(x: float) => float; };
+class QUADRATIC isa POLYNOMIAL {
+  private attribute a: float; private attribute b: float; private attribute c: float;
+  public function build(A: float, B: float, C: float) => QUADRATIC;
+  public function evaluate(x: float) => float;
+};
+implementation POLYNOMIAL { function evaluate(x: float) => float { return (0.0); } }
+implementation QUADRATIC {
+  function evaluate(x: float) => float {
+    local result: float;
+    result := a; result := result * x + b; result := result * x + c;
+    return (result);
+  }
+  function build(A: float, B: float, C: float) => QUADRATIC {
+    local f: QUADRATIC;
+    f.a := A; f.b := B; f.c := C;
+    return (f);
+  }
+}
+function horner(coef: float[], degree: int, x: float) => float {
+  local i: int; local r: float;
+  r := coef[degree]; i := degree - 1;
+  while (i >= 0) { r := r * x + coef[i]; i := i - 1; };
+  return (r);
+}
+function main() => void {
+  local q: QUADRATIC; local coef: float[8]; local i: int; local x: float; local s: float; local t: float; local fi: float;
+  q := q.build(-2.0, 1.0, 0.5);
+  i := 0; fi := 1.0;
+  while (i < 8) { coef[i] := 1.0 / fi; fi := fi + 1.0; i := i + 1; };
+  i := 0; x := 0.0; s := 0.0; t := 0.0;
+  while (i < )" + std::to_string(n) + R"() {
+    s := s + q.evaluate(x);
+    t := t + horner(coef, 7, x);
+    x := x + 0.0001;
+    if (x > 1.0) then x := x - 1.0; else ;
+    i := i + 1;
+  };
+  write(s); write(t);
+}
+)";
+}
+
+// The same trivial pass, counting nodes, dispatched both ways: through
+// ASTVisitor's virtual calls, recursing on the native stack, and through
+// ASTWalker's switch on NodeKind
+class VirtualCounter : public ASTVisitor {
+public:
+    std::size_t nodes = 0;
+
+    void count(ASTNode* node) {
+        if (node) {
+            node->accept(*this);
+        }
+    }
+
+    void visit(Program& node) override {
+        ++nodes;
+        for (ASTNode* decl : node.declarations) {
+            count(decl);
+        }
+    }
+    void visit(ClassDecl& node) override {
+        ++nodes;
+        for (Type* parent : node.parents) {
+            count(parent);
+        }
+        for (ASTNode* member : node.members) {
+            count(member);
+        }
+    }
+    void visit(ImplDecl& node) override {
+        ++nodes;
+        for (FuncDecl* func : node.functions) {
+            count(func);
+        }
+    }
+    void visit(FuncDecl& node) override {
+        ++nodes;
+        for (VarDecl* param : node.params) {
+            count(param);
+        }
+        count(node.returnType);
+        count(node.body);
+    }
+    void visit(VarDecl& node) override {
+        ++nodes;
+        count(node.type);
+    }
+    void visit(Type&) override { ++nodes; }
+    void visit(Statement&) override { ++nodes; }
+    void visit(IfStatement& node) override {
+        ++nodes;
+        count(node.condition);
+        count(node.thenStmt);
+        count(node.elseStmt);
+    }
+    void visit(WhileStatement& node) override {
+        ++nodes;
+        count(node.condition);
+        count(node.body);
+    }
+    void visit(ReturnStatement& node) override {
+        ++nodes;
+        count(node.expression);
+    }
+    void visit(AssignStatement& node) override {
+        ++nodes;
+        count(node.lhs);
+        count(node.rhs);
+    }
+    void visit(BlockStatement& node) override {
+        ++nodes;
+        for (std::size_t i = 0; i < node.count; ++i) {
+            count(node.children[i]);
+        }
+    }
+    void visit(CallStatement& node) override {
+        ++nodes;
+        count(node.call);
+    }
+    void visit(Expression&) override { ++nodes; }
+    void visit(BinaryExpression& node) override {
+        ++nodes;
+        count(node.left);
+        count(node.right);
+    }
+    void visit(UnaryExpression& node) override {
+        ++nodes;
+        count(node.expr);
+    }
+    void visit(CallExpression& node) override {
+        ++nodes;
+        count(node.callee);
+        for (Expression* arg : node.args) {
+            count(arg);
+        }
+    }
+    void visit(IndexExpression& node) override {
+        ++nodes;
+        count(node.base);
+        count(node.index);
+    }
+    void visit(MemberExpression& node) override {
+        ++nodes;
+        count(node.object);
+    }
+    void visit(Identifier&) override { ++nodes; }
+    void visit(IntegerLiteral&) override { ++nodes; }
+    void visit(FloatLiteral&) override { ++nodes; }
+};
+
+class WalkCounter : public ASTWalker<WalkCounter> {
+public:
+    using ASTWalker<WalkCounter>::enter;
+    std::size_t nodes = 0;
+
+    template <typename Node>
+    bool enter(Node&) {
+        ++nodes;
+        return true;
+    }
+};
+
+// A program through the front end and lowering, as main.cpp compiles it
+struct Compilation {
+    ASTContext context;
+    std::unique_ptr<ExprTable> exprs;
+    std::unique_ptr<TypeTable> types;
+    SymbolTables tables;
+    std::vector<Diagnostic> diagnostics;
+    ASTNode* root = nullptr;
+    IRProgram ir;
+};
+
+bool compile(const std::vector<token::Token>& tokens, Compilation& c, unsigned threads = 0) {
+    c.root = buildAST(tokens, c.context);
+    if (!c.root) {
+        return false;
+    }
+    c.types.reset(new TypeTable(c.context));
+    checkSemantics(c.root, c.context, c.tables, *c.types, c.diagnostics, threads);
+    foldConstants(c.root, c.context);
+    for (const Diagnostic& diagnostic : c.diagnostics) {
+        if (diagnostic.severity == Severity::Error) {
+            std::cerr << "semantic error: " << diagnostic.message << std::endl;
+            return false;
+        }
+    }
+    c.ir = lowerProgram(c.root, c.context, c.tables, *c.types, c.diagnostics);
+    return !c.ir.functions.empty();
+}
+
+void row(const char* pass, double seconds, std::size_t units, const char* unit) {
+    std::printf("  %-28s %9.1f ms  %10zu %-14s %7.1f ns each\n", pass, seconds * 1e3, units, unit,
+                units ? seconds * 1e9 / static_cast<double>(units) : 0.0);
+}
+
+int front(int functions) {
+    std::string source = frontProgram(functions);
+    std::vector<token::Token> tokens = scan(source);
+    std::printf("%d functions, %zu bytes, %zu tokens\n", functions, source.size(), tokens.size());
+
+    // Each pass is timed on a fresh compilation brought up to just before it
+    std::unique_ptr<Compilation> c;
+    auto fresh = [&] { c.reset(new Compilation); };
+    auto built = [&] {
+        fresh();
+        c->root = buildAST(tokens, c->context);
+    };
+    auto checked = [&] {
+        built();
+        c->types.reset(new TypeTable(c->context));
+        checkSemantics(c->root, c->context, c->tables, *c->types, c->diagnostics);
+    };
+    auto folded = [&] {
+        checked();
+        foldConstants(c->root, c->context);
+    };
+
+    double seconds = best(fresh, [&] { c->root = buildAST(tokens, c->context); });
+    std::size_t nodes = c->context.nodeCount();
+    row("build AST", seconds, nodes, "nodes");
+    seconds = best(fresh, [&] {
+        c->exprs.reset(new ExprTable(c->context));
+        c->root = buildAST(tokens, c->context, c->exprs.get());
+    });
+    row("build AST, hash-consed", seconds, c->context.nodeCount(), "nodes");
+    FlatAST flat;
+    seconds = best(built, [&] { flat = flattenAST(c->root); });
+    row("flatten", seconds, flat.size(), "nodes");
+    VirtualCounter virtualCounter;
+    seconds = best(built, [&] {
+        virtualCounter.nodes = 0;
+        virtualCounter.count(c->root);
+    });
+    row("count nodes, ASTVisitor", seconds, virtualCounter.nodes, "nodes");
+    WalkCounter walkCounter;
+    seconds = best(built, [&] {
+        walkCounter.nodes = 0;
+        walkCounter.walk(c->root);
+    });
+    row("count nodes, ASTWalker", seconds, walkCounter.nodes, "nodes");
+    seconds = best(built, [&] { printAST(c->root, c->context, "benchmark.ast"); });
+    row("print AST", seconds, nodes, "nodes");
+    std::remove("benchmark.ast");
+    for (unsigned threads : {1u, 0u}) {
+        seconds = best(built, [&] {
+            c->types.reset(new TypeTable(c->context));
+            checkSemantics(c->root, c->context, c->tables, *c->types, c->diagnostics, threads);
+        });
+        row(threads == 1 ? "check, one thread" : "check, one thread per core", seconds, nodes, "nodes");
+    }
+    if (!c->diagnostics.empty()) {
+        std::cerr << "semantic error: " << c->diagnostics.front().message << std::endl;
+        return 1;
+    }
+    FoldStats folding;
+    seconds = best(checked, [&] { folding = foldConstants(c->root, c->context); });
+    row("fold constants", seconds, nodes, "nodes");
+    seconds = best(folded, [&] { c->ir = lowerProgram(c->root, c->context, c->tables, *c->types, c->diagnostics); });
+    std::size_t instructions = c->ir.instructionCount();
+    row("lower to IR", seconds, instructions, "instructions");
+
+    IRProgram ir;
+    auto copy = [&] { ir = c->ir; };
+    seconds = best(copy, [&] { inlineFunctions(ir); });
+    row("inline", seconds, instructions, "instructions");
+    seconds = best(copy, [&] { optimizeLoops(ir); });
+    row("loops", seconds, instructions, "instructions");
+    seconds = best(copy, [&] { optimizeProgram(ir); });
+    row("SSA", seconds, instructions, "instructions");
+    MoonProgram code;
+    MoonStats moon;
+    std::string error;
+    for (bool allocate : {false, true}) {
+        seconds = best([] {}, [&] { generateMoon(c->ir, allocate, code, moon, error); });
+        row(allocate ? "Moon, allocated" : "Moon, every value in memory", seconds, instructions, "instructions");
+    }
+    seconds = best([&] { generateMoon(c->ir, true, code, moon, error); }, [&] { optimizeMoon(code); });
+    row("Moon peephole", seconds, code.code.size(), "lines");
+    Bytecode bytecode;
+    seconds = best([] {}, [&] { compileBytecode(c->ir, bytecode, error); });
+    row("bytecode", seconds, instructions, "instructions");
+    return 0;
+}
+
+struct Level {
+    const char* name;
+    bool inlining;
+    bool loops;
+    bool optimize;
+};
+
+const Level levels[] = {
+    {"", false, false, false},
+    {"-inline", true, false, false},
+    {"-loops", false, true, false},
+    {"-O", false, false, true},
+    {"-inline -loops", true, true, false},
+    {"-inline -O", true, false, true},
+    {"-loops -O", false, true, true},
+    {"-inline -loops -O", true, true, true},
+};
+
+int run(const char* name, const std::string& source) {
+    Compilation c;
+    if (!compile(scan(source), c)) {
+        return 1;
+    }
+    std::printf("%s\n", name);
+
+    std::string output, error;
+    InterpreterStats interpreted;
+    double seconds = best([&] {
+        output.clear();
+        interpreted = InterpreterStats();
+    }, [&] {
+        std::istringstream in;
+        interpret(c.root, c.context, c.tables, *c.types, in, output, interpreted, error);
+    });
+    std::printf("  %-24s %9.2f ms  %12zu operations %8zu calls\n", "interpreter", seconds * 1e3,
+                interpreted.operations, interpreted.calls);
+
+    for (const Level& level : levels) {
+        IRProgram ir = c.ir;
+        if (level.inlining) {
+            inlineFunctions(ir);
+        }
+        if (level.loops) {
+            optimizeLoops(ir);
+        }
+        if (level.optimize) {
+            optimizeProgram(ir);
+        }
+        Bytecode bytecode;
+        if (!compileBytecode(ir, bytecode, error)) {
+            std::cerr << "cannot compile bytecode: " << error << std::endl;
+            return 1;
+        }
+        BytecodeStats executed;
+        seconds = best([&] {
+            output.clear();
+            executed = BytecodeStats();
+        }, [&] {
+            std::istringstream in;
+            runBytecode(bytecode, in, output, executed, error);
+        });
+        // Calls made next to the static size, so what -inline trades is shown
+        std::printf("  %-24s %9.2f ms  %12zu instructions %8zu calls, %zu static\n",
+                    ("VM " + std::string(level.name)).c_str(), seconds * 1e3, executed.executed, executed.calls,
+                    bytecode.instructions);
+
+        MoonProgram code;
+        MoonStats moon;
+        if (!generateMoon(ir, true, code, moon, error)) {
+            continue;  // floats
+        }
+        optimizeMoon(code);
+        countMoon(code, moon);
+        std::string printed;
+        MoonRunStats simulated;
+        if (!MoonSimulator(code).run("", printed, simulated, error)) {
+            std::cerr << "Moon code failed: " << error << std::endl;
+            return 1;
+        }
+        std::printf("  %-24s %12zu cycles %12zu instructions, %zu static, %zu spilled\n",
+                    ("Moon " + std::string(level.name)).c_str(), simulated.cycles, simulated.executed,
+                    moon.instructions, moon.spilled);
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int functions = 0, size = 0;
+    for (int a = 1; a + 1 < argc; a += 2) {
+        if (std::strcmp(argv[a], "-front") == 0) {
+            functions = std::stoi(argv[a + 1]);
+        } else if (std::strcmp(argv[a], "-run") == 0) {
+            size = std::stoi(argv[a + 1]);
+        } else if (std::strcmp(argv[a], "-repeat") == 0) {
+            repeats = static_cast<unsigned>(std::max(1, std::stoi(argv[a + 1])));
+        } else {
+            std::cerr << "usage: benchmark [-front FUNCTIONS] [-run N] [-repeat TIMES]" << std::endl;
+            return 2;
+        }
+    }
+    if (functions == 0 && size == 0) {
+        functions = 10000;
+        size = 1000;
+    }
+    if (functions > 0 && front(functions) != 0) {
+        return 1;
+    }
+    if (size > 0 && (run(("bubble sort of " + std::to_string(size) + " ints").c_str(), sortProgram(size)) != 0 ||
+                     run((std::to_string(size) + " polynomial evaluations").c_str(), polynomialProgram(size)) != 0)) {
+        return 1;
+    }
+    return 0;
+}
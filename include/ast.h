@@ -1,12 +1,18 @@
 #ifndef AST_H
 #define AST_H
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
+#include "operators.h"
 
+class ASTContext;
 class ASTNode;
 class Program;
 class ClassDecl;
+class ImplDecl;
 class FuncDecl;
 class VarDecl;
 class Type;
@@ -15,20 +21,78 @@ class IfStatement;
 class WhileStatement;
 class ReturnStatement;
 class AssignStatement;
+class BlockStatement;
+class CallStatement;
 class Expression;
 class BinaryExpression;
 class UnaryExpression;
 class CallExpression;
+class IndexExpression;
+class MemberExpression;
 class Identifier;
 class IntegerLiteral;
 class FloatLiteral;
 
+// Concrete class of a node, so passes can dispatch with a switch instead of
+// going through ASTVisitor
+enum class NodeKind : std::uint8_t {
+    Program, ClassDecl, ImplDecl, FuncDecl, VarDecl, Type,
+    Statement, IfStatement, WhileStatement, ReturnStatement, AssignStatement, BlockStatement, CallStatement,
+    Expression, BinaryExpression, UnaryExpression, CallExpression, IndexExpression, MemberExpression,
+    Identifier, IntegerLiteral, FloatLiteral,
+    Empty  // stands for a missing optional child in flat storage
+};
+
+// Half-open range [begin, end) of token indices covered by a parsed region.
+// Nested ranges are stored relative to the start of the node that owns them,
+// so an edit only shifts the ranges of the declarations that follow it.
+struct TokenRange {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+// Source bytes [offset, offset + length) a node was parsed from. Both are
+// 32 bits so the span adds 8 bytes to a node; LineTable turns an offset
+// into a line and column when a diagnostic needs one.
+struct SourceSpan {
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+};
+
+// Access specifier of a class member
+enum class Visibility : std::uint8_t { Public, Private };
+
+// An interned spelling: a 32-bit id into the symbol table of the ASTContext
+// that created it. Equal spellings share an id, so comparing and hashing is
+// O(1); use ASTContext::spelling() to get the text back.
+struct Symbol {
+    std::uint32_t id = 0;  // 0 is always the empty string
+
+    bool operator==(Symbol other) const { return id == other.id; }
+    bool operator!=(Symbol other) const { return id != other.id; }
+};
+
+// Index of a type in a TypeTable (see type_table.h); 0 means not computed
+using TypeId = std::uint32_t;
+
+namespace std {
+template <>
+struct hash<Symbol> {
+    size_t operator()(Symbol symbol) const noexcept { return symbol.id; }
+};
+}
+
 // Add the printAST function declaration
-void printAST(ASTNode* root, const std::string& outputFile);
+void printAST(ASTNode* root, const ASTContext& context, const std::string& outputFile);
+
+// Write the tree as a Graphviz DOT graph, streaming nodes and edges as they
+// are visited
+void printDOT(ASTNode* root, const ASTContext& context, const std::string& outputFile);
 class ASTVisitor {
 public:
     virtual void visit(Program& node) = 0;
     virtual void visit(ClassDecl& node) = 0;
+    virtual void visit(ImplDecl& node) = 0;
     virtual void visit(FuncDecl& node) = 0;
     virtual void visit(VarDecl& node) = 0;
     virtual void visit(Type& node) = 0;
@@ -37,10 +101,14 @@ public:
     virtual void visit(WhileStatement& node) = 0;
     virtual void visit(ReturnStatement& node) = 0;
     virtual void visit(AssignStatement& node) = 0;
+    virtual void visit(BlockStatement& node) = 0;
+    virtual void visit(CallStatement& node) = 0;
     virtual void visit(Expression& node) = 0;
     virtual void visit(BinaryExpression& node) = 0;
     virtual void visit(UnaryExpression& node) = 0;
     virtual void visit(CallExpression& node) = 0;
+    virtual void visit(IndexExpression& node) = 0;
+    virtual void visit(MemberExpression& node) = 0;
     virtual void visit(Identifier& node) = 0;
     virtual void visit(IntegerLiteral& node) = 0;
     virtual void visit(FloatLiteral& node) = 0;
@@ -48,6 +116,11 @@ public:
 
 class ASTNode {
 public:
+    const NodeKind kind;
+    bool interned = false;  // an expression hash-consing may share, see expr_table.h
+    SourceSpan span;  // empty for nodes the builder synthesizes
+
+    explicit ASTNode(NodeKind k) : kind(k) {}
     virtual ~ASTNode() = default;
     virtual void accept(ASTVisitor& visitor) = 0;
 };
@@ -55,51 +128,71 @@ public:
 class Program : public ASTNode {
 public:
     std::vector<ASTNode*> declarations;
+    std::vector<TokenRange> ranges;  // absolute range of each declaration
 
-    Program(std::vector<ASTNode*> decls) : declarations(std::move(decls)) {}
+    Program(std::vector<ASTNode*> decls) : ASTNode(NodeKind::Program), declarations(std::move(decls)) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class ClassDecl : public ASTNode {
 public:
-    std::string name;
+    Symbol name;
+    std::vector<Type*> parents;  // classes named after isa
     std::vector<ASTNode*> members;
+    std::vector<TokenRange> memberRanges;  // relative to the class start
+    std::vector<Visibility> memberVisibility;  // one per member, public if not given
+
+    ClassDecl(Symbol n, std::vector<ASTNode*> membs) : ASTNode(NodeKind::ClassDecl), name(n), members(std::move(membs)) {}
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+};
 
-    ClassDecl(std::string n, std::vector<ASTNode*> membs) : name(std::move(n)), members(std::move(membs)) {}
+// The bodies of the member functions of a class, given apart from the
+// class declaration
+class ImplDecl : public ASTNode {
+public:
+    Symbol name;
+    std::vector<FuncDecl*> functions;
+    std::vector<TokenRange> functionRanges;  // relative to the implementation start
+
+    ImplDecl(Symbol n, std::vector<FuncDecl*> funcs) : ASTNode(NodeKind::ImplDecl), name(n), functions(std::move(funcs)) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class FuncDecl : public ASTNode {
 public:
-    std::string name;
+    Symbol name;
     std::vector<VarDecl*> params;
     Type* returnType;
     Statement* body;
+    TokenRange bodyRange;  // relative to the function start, empty if no body
 
-    FuncDecl(std::string n, std::vector<VarDecl*> p, Type* type, Statement* b) : 
-        name(std::move(n)), params(std::move(p)), returnType(type), body(b) {}
+    FuncDecl(Symbol n, std::vector<VarDecl*> p, Type* type, Statement* b) : 
+        ASTNode(NodeKind::FuncDecl), name(n), params(std::move(p)), returnType(type), body(b) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }  
 };
 
 class VarDecl : public ASTNode {
 public:
-    std::string name;
+    Symbol name;
     Type* type;
 
-    VarDecl(std::string n, Type* t) : name(std::move(n)), type(t) {}
+    VarDecl(Symbol n, Type* t) : ASTNode(NodeKind::VarDecl), name(n), type(t) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class Type : public ASTNode {
 public:  
-    std::string name;
+    Symbol name;
+    std::uint32_t* dims = nullptr;  // array sizes from ARRAYSIZES, 0 for []
+    std::uint32_t dimCount = 0;
 
-    Type(std::string n) : name(std::move(n)) {}
+    Type(Symbol n) : ASTNode(NodeKind::Type), name(n) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class Statement : public ASTNode {
 public:
+    explicit Statement(NodeKind k = NodeKind::Statement) : ASTNode(k) {}
     virtual void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
@@ -109,7 +202,7 @@ public:
     Statement* thenStmt;
     Statement* elseStmt;
 
-    IfStatement(Expression* cond, Statement* thenS, Statement* elseS) : condition(cond), thenStmt(thenS), elseStmt(elseS) {}
+    IfStatement(Expression* cond, Statement* thenS, Statement* elseS) : Statement(NodeKind::IfStatement), condition(cond), thenStmt(thenS), elseStmt(elseS) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }  
 };
 
@@ -118,7 +211,7 @@ public:
     Expression* condition;
     Statement* body;
 
-    WhileStatement(Expression* cond, Statement* b) : condition(cond), body(b) {}
+    WhileStatement(Expression* cond, Statement* b) : Statement(NodeKind::WhileStatement), condition(cond), body(b) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
@@ -126,57 +219,106 @@ class ReturnStatement : public Statement {
 public:
     Expression* expression;
 
-    ReturnStatement(Expression* expr) : expression(expr) {} 
+    ReturnStatement(Expression* expr) : Statement(NodeKind::ReturnStatement), expression(expr) {} 
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class AssignStatement : public Statement {
 public:  
-    Identifier* lhs;
+    Expression* lhs;  // a variable: identifier, index or member expression
     Expression* rhs;
 
-    AssignStatement(Identifier* left, Expression* right) : lhs(left), rhs(right) {}
+    AssignStatement(Expression* left, Expression* right) : Statement(NodeKind::AssignStatement), lhs(left), rhs(right) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }  
 };
 
+// The statements and local variable declarations between a pair of braces,
+// in source order. The children are an array sized exactly to the block and
+// allocated from the same arena as the nodes, not a growable vector.
+class BlockStatement : public Statement {
+public:
+    ASTNode** children;
+    std::uint32_t count;
+
+    BlockStatement(ASTNode** c, std::uint32_t n) : Statement(NodeKind::BlockStatement), children(c), count(n) {}
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+    ASTNode** begin() const { return children; }
+    ASTNode** end() const { return children + count; }
+};
+
+// A call made for its effect. read(), write() and put() are calls to the
+// reserved names of those statements.
+class CallStatement : public Statement {
+public:
+    CallExpression* call;
+
+    CallStatement(CallExpression* c) : Statement(NodeKind::CallStatement), call(c) {}
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+};
+
 class Expression : public ASTNode {
 public:
+    TypeId type = 0;  // set once by the type checker, so later queries are a load
+
+    explicit Expression(NodeKind k = NodeKind::Expression) : ASTNode(k) {}
     virtual void accept(ASTVisitor& visitor) override { visitor.visit(*this); }  
 };
 
 class BinaryExpression : public Expression {
 public:
-    std::string op;  
+    BinOp op;  
     Expression* left;
     Expression* right;
 
-    BinaryExpression(std::string o, Expression* l, Expression* r) : op(std::move(o)), left(l), right(r) {}
+    BinaryExpression(BinOp o, Expression* l, Expression* r) : Expression(NodeKind::BinaryExpression), op(o), left(l), right(r) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class UnaryExpression : public Expression {
 public:
-    std::string op;
+    UnOp op;
     Expression* expr;
 
-    UnaryExpression(std::string o, Expression* e) : op(std::move(o)), expr(e) {}  
+    UnaryExpression(UnOp o, Expression* e) : Expression(NodeKind::UnaryExpression), op(o), expr(e) {}  
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class CallExpression : public Expression {
 public:
-    Identifier* callee; 
+    Expression* callee;  // an Identifier, or a MemberExpression for a method
     std::vector<Expression*> args;
+    FuncDecl* target = nullptr;  // overload chosen by the type checker
 
-    CallExpression(Identifier* c, std::vector<Expression*> a) : callee(c), args(std::move(a)) {}
+    CallExpression(Expression* c, std::vector<Expression*> a) : Expression(NodeKind::CallExpression), callee(c), args(std::move(a)) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }  
 };
 
+// base[index]; a[i][j] nests with a[i] as the base
+class IndexExpression : public Expression {
+public:
+    Expression* base;
+    Expression* index;
+
+    IndexExpression(Expression* b, Expression* i) : Expression(NodeKind::IndexExpression), base(b), index(i) {}
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+};
+
+// object.member
+class MemberExpression : public Expression {
+public:
+    Symbol member;
+    Expression* object;
+
+    MemberExpression(Expression* o, Symbol m) : Expression(NodeKind::MemberExpression), member(m), object(o) {}
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+};
+
 class Identifier : public Expression {
 public:
-    std::string name;
+    Symbol name;
 
-    Identifier(std::string n) : name(std::move(n)) {}
+    Identifier(Symbol n) : Expression(NodeKind::Identifier), name(n) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
@@ -184,7 +326,7 @@ class IntegerLiteral : public Expression {
 public:  
     int value;
 
-    IntegerLiteral(int v) : value(v) {}
+    IntegerLiteral(int v) : Expression(NodeKind::IntegerLiteral), value(v) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }  
 };
 
@@ -192,7 +334,7 @@ class FloatLiteral : public Expression {
 public:
     float value;  
 
-    FloatLiteral(float v) : value(v) {}
+    FloatLiteral(float v) : Expression(NodeKind::FloatLiteral), value(v) {}
     void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
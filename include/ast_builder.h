@@ -2,14 +2,45 @@
 #define AST_BUILDER_H
 
 #include "ast.h"
+#include "ast_context.h"
+#include "expr_table.h"
 #include "tokenizer.h"
 #include <vector>
 #include <string>
 
-// Build an AST from a sequence of tokens
+// Build an AST from a sequence of tokens. The tree lives in a builder-owned
+// context that is reset, freeing the previous tree, on every call.
 ASTNode* buildAST(const std::vector<token::Token>& tokens);
 
+// Build an AST whose nodes are owned by the given context
+ASTNode* buildAST(const std::vector<token::Token>& tokens, ASTContext& context);
+
+// Same, but with identical expression subtrees built once and shared
+// through exprs (see expr_table.h), which must belong to context
+ASTNode* buildAST(const std::vector<token::Token>& tokens, ASTContext& context, ExprTable* exprs);
+
+// Update the current AST after an edit that replaced tokens [editBegin, editEnd)
+// of the previous token sequence with newLength tokens. Only the smallest
+// declaration, program block local or statement, class member, function of
+// an implementation or function body enclosing the edit is reparsed and
+// spliced into the existing Program; edits crossing their bounds rebuild the
+// whole tree. The source spans of the nodes after the reparsed region are
+// moved to where the edit left their text, and those of the nodes around it
+// resized, so they match a full rebuild.
+ASTNode* reparseAST(const std::vector<token::Token>& tokens, size_t editBegin, size_t editEnd, size_t newLength);
+
 // Get the root of the AST (implementation of function declared in parser.h)
 ASTNode* getASTRoot();
 
+// Get the context owning the tree returned by getASTRoot()
+ASTContext& getASTContext();
+
+// Hash-cons expressions in the trees built by buildAST(tokens) and
+// reparseAST(); off by default
+void setHashConsing(bool enabled);
+
+// Get the table sharing the expressions of the current AST, empty unless
+// hash-consing is on
+const ExprTable& getExprTable();
+
 #endif // AST_BUILDER_H
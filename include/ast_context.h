@@ -0,0 +1,94 @@
+#ifndef AST_CONTEXT_H
+#define AST_CONTEXT_H
+
+#include "ast.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Arena that owns every node of an AST. Nodes are bump-allocated from large
+// chunks and all of them are destroyed in one shot by reset() or the
+// destructor, so a tree never has to be freed node by node.
+//
+// The context also interns every identifier, type name and operator of the
+// compilation, storing each distinct spelling once.
+class ASTContext {
+public:
+    ASTContext();
+    ~ASTContext();
+
+    ASTContext(const ASTContext&) = delete;
+    ASTContext& operator=(const ASTContext&) = delete;
+
+    // Construct an object in the arena. Nodes get their destructor run on
+    // reset(); anything else must not need one.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if constexpr (std::is_base_of<ASTNode, T>::value) {
+            nodes.push_back(object);
+        } else {
+            static_assert(std::is_trivially_destructible<T>::value,
+                          "arena objects other than AST nodes must be trivially destructible");
+        }
+        return object;
+    }
+
+    // Copy count trivially copyable items into an exactly sized arena array
+    template <typename T>
+    T* makeArray(const T* items, std::size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "arena arrays hold trivially copyable items");
+        if (count == 0) {
+            return nullptr;
+        }
+        T* array = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        std::copy(items, items + count, array);
+        return array;
+    }
+
+    // Uninitialised storage aligned to align (a power of two)
+    void* allocate(std::size_t size, std::size_t align);
+
+    // Destroy every node and release all chunks but the first, which is kept
+    // so the next compilation reuses it. Interned symbols are dropped too.
+    void reset();
+
+    // Return the id of a spelling, adding it on first use
+    Symbol intern(std::string_view text);
+
+    // The id of a spelling already interned, or the empty symbol; unlike
+    // intern() this never writes, so threads may share the context
+    Symbol find(std::string_view text) const;
+
+    std::string_view spelling(Symbol symbol) const { return spellings[symbol.id]; }
+    std::size_t symbolCount() const { return spellings.size(); }
+
+    std::size_t nodeCount() const { return nodes.size(); }
+    std::size_t bytesUsed() const { return used; }
+    std::size_t bytesReserved() const { return reserved; }
+
+private:
+    static const std::size_t chunkSize = 64 * 1024;
+
+    char* newChunk(std::size_t size);
+
+    std::vector<char*> chunks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    std::size_t used = 0;
+    std::size_t reserved = 0;
+    std::vector<ASTNode*> nodes;
+
+    // Spellings live in the arena; the map's keys view the same bytes
+    std::vector<std::string_view> spellings;
+    std::unordered_map<std::string_view, std::uint32_t> symbolIds;
+};
+
+#endif // AST_CONTEXT_H
@@ -0,0 +1,104 @@
+#ifndef AST_FILE_H
+#define AST_FILE_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include "flat_ast.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Binary AST file, so tools can reuse a parsed tree without running the
+// front end again. The file is the flat AST's arrays followed by the string
+// table of its symbols, laid out so a loader can map it and read nodes in
+// place:
+//
+//   header       magic "AST\x1a", version, byte-order tag, node count,
+//                symbol count, string table size (six 32-bit words)
+//   uint32[n]    first child of each node
+//   uint32[n]    next sibling of each node
+//   uint32[n]    payload of each node
+//   uint32[s+1]  offset of each symbol's spelling in the string table
+//   uint8[n]     kind of each node, padded to 4 bytes
+//   char[]       string table
+//
+// Integers are in the writer's byte order; a file from a machine with the
+// other order is rejected rather than converted.
+namespace astfile {
+constexpr char magic[4] = {'A', 'S', 'T', '\x1a'};
+constexpr std::uint32_t version = 3;
+constexpr std::uint32_t byteOrder = 0x01020304u;
+} // namespace astfile
+
+// Write flat, whose symbols belong to context, to path with a single write
+bool writeASTFile(const FlatAST& flat, const ASTContext& context, const std::string& path);
+
+// Read-only view of an AST file mapped into memory. open() checks the
+// header, the sizes, every child index and the shape of every node once, so
+// passes can then walk the arrays in place with the same accessors FlatAST
+// offers, as printAST() below does. Symbol ids are local to the file;
+// spelling() resolves them against its string table.
+class MappedAST {
+public:
+    static constexpr std::uint32_t none = FlatAST::none;
+
+    MappedAST() = default;
+    ~MappedAST();
+    MappedAST(const MappedAST&) = delete;
+    MappedAST& operator=(const MappedAST&) = delete;
+
+    // Map path, reporting problems on stderr; false leaves the view closed
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    std::uint32_t root() const { return nodeCount == 0 ? none : 0; }
+    std::uint32_t size() const { return nodeCount; }
+    std::uint32_t symbolCount() const { return symbols; }
+
+    NodeKind kind(std::uint32_t node) const { return static_cast<NodeKind>(kinds[node]); }
+    std::uint32_t firstChild(std::uint32_t node) const { return firstChildren[node]; }
+    std::uint32_t nextSibling(std::uint32_t node) const { return nextSiblings[node]; }
+    std::uint32_t payload(std::uint32_t node) const { return payloads[node]; }
+
+    Symbol symbol(std::uint32_t node) const { return Symbol{payloads[node]}; }
+    std::string_view spelling(Symbol symbol) const {
+        return std::string_view(strings + stringOffsets[symbol.id],
+                                stringOffsets[symbol.id + 1] - stringOffsets[symbol.id]);
+    }
+    int intValue(std::uint32_t node) const;
+    float floatValue(std::uint32_t node) const;
+
+    template <typename F>
+    void forEachChild(std::uint32_t node, F f) const {
+        for (std::uint32_t child = firstChildren[node]; child != none; child = nextSiblings[child]) {
+            f(child);
+        }
+    }
+
+    // Copy the tree into a FlatAST whose symbols are interned in context,
+    // e.g. to inflate it for passes that need pointer nodes
+    FlatAST toFlat(ASTContext& context) const;
+
+private:
+    void* base = nullptr;
+    std::size_t length = 0;
+
+    std::uint32_t nodeCount = 0;
+    std::uint32_t symbols = 0;
+    const std::uint8_t* kinds = nullptr;
+    const std::uint32_t* firstChildren = nullptr;
+    const std::uint32_t* nextSiblings = nullptr;
+    const std::uint32_t* payloads = nullptr;
+    const std::uint32_t* stringOffsets = nullptr;
+    const char* strings = nullptr;
+
+    bool validate(std::uint32_t stringBytes) const;
+};
+
+// Write the same listing as printAST() of the inflated tree, reading the
+// mapped arrays in place
+void printAST(const MappedAST& mapped, const std::string& outputFile);
+
+#endif // AST_FILE_H
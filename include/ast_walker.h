@@ -0,0 +1,237 @@
+#ifndef AST_WALKER_H
+#define AST_WALKER_H
+
+#include "ast.h"
+#include <cstddef>
+#include <vector>
+
+// What an enter() hook asks the walker to do next
+enum class WalkAction {
+    Continue,      // walk the children
+    SkipChildren,  // go straight to leave()
+    Stop           // abandon the traversal
+};
+
+// Statically dispatched traversal. A pass derives from ASTWalker<Pass> and
+// declares enter()/leave() overloads for the node classes it cares about:
+//
+//   class CountCalls : public ASTWalker<CountCalls> {
+//   public:
+//       using ASTWalker<CountCalls>::enter;
+//       int calls = 0;
+//       bool enter(CallExpression&) { ++calls; return true; }
+//   };
+//
+// walk() switches on NodeKind and calls the hooks through the derived type,
+// so each visit is a direct call the compiler can inline rather than the
+// two virtual calls of accept()/visit(). enter() runs before the children
+// (pre-order) and returns a WalkAction, or a bool where false means skip the
+// children; leave() runs after them (post-order). Children are walked in the
+// order printAST emits them. A null child is not entered; missing() is
+// called in its place.
+//
+// The traversal never recurses: pending nodes live on an explicit stack that
+// is kept between walks, so trees of any depth (such as a million-term
+// a+a+...+a chain) are walked without touching the native stack. The price
+// is one switch for every node of the tree, whose indirect jump predicts
+// worse than the virtual calls a recursive visitor makes from a separate
+// site for each child; a pass that does almost nothing per node, such as
+// counting them, walks about 1.7 times slower than through ASTVisitor
+// (benchmark -front).
+template <typename Derived>
+class ASTWalker {
+public:
+    // Returns false if a hook stopped the traversal early
+    bool walk(ASTNode* root) {
+        top = 0;
+        open.clear();
+        push(root);
+        while (true) {
+            // Leave the nodes whose children have all been walked
+            while (!open.empty() && top == open.back().mark) {
+                ASTNode* node = open.back().node;
+                open.pop_back();
+                leaveNode(node);
+            }
+            if (top == 0) {
+                return true;
+            }
+            ASTNode* node = pending[--top];
+            if (!node) {
+                derived().missing();
+                continue;
+            }
+            bool entered = true;
+            switch (node->kind) {
+            case NodeKind::Program: entered = step(static_cast<Program&>(*node)); break;
+            case NodeKind::ClassDecl: entered = step(static_cast<ClassDecl&>(*node)); break;
+            case NodeKind::ImplDecl: entered = step(static_cast<ImplDecl&>(*node)); break;
+            case NodeKind::FuncDecl: entered = step(static_cast<FuncDecl&>(*node)); break;
+            case NodeKind::VarDecl: entered = step(static_cast<VarDecl&>(*node)); break;
+            case NodeKind::Type: entered = step(static_cast<Type&>(*node)); break;
+            case NodeKind::Statement: entered = step(static_cast<Statement&>(*node)); break;
+            case NodeKind::IfStatement: entered = step(static_cast<IfStatement&>(*node)); break;
+            case NodeKind::WhileStatement: entered = step(static_cast<WhileStatement&>(*node)); break;
+            case NodeKind::ReturnStatement: entered = step(static_cast<ReturnStatement&>(*node)); break;
+            case NodeKind::AssignStatement: entered = step(static_cast<AssignStatement&>(*node)); break;
+            case NodeKind::BlockStatement: entered = step(static_cast<BlockStatement&>(*node)); break;
+            case NodeKind::CallStatement: entered = step(static_cast<CallStatement&>(*node)); break;
+            case NodeKind::Expression: entered = step(static_cast<Expression&>(*node)); break;
+            case NodeKind::BinaryExpression: entered = step(static_cast<BinaryExpression&>(*node)); break;
+            case NodeKind::UnaryExpression: entered = step(static_cast<UnaryExpression&>(*node)); break;
+            case NodeKind::CallExpression: entered = step(static_cast<CallExpression&>(*node)); break;
+            case NodeKind::IndexExpression: entered = step(static_cast<IndexExpression&>(*node)); break;
+            case NodeKind::MemberExpression: entered = step(static_cast<MemberExpression&>(*node)); break;
+            case NodeKind::Identifier: entered = step(static_cast<Identifier&>(*node)); break;
+            case NodeKind::IntegerLiteral: entered = step(static_cast<IntegerLiteral&>(*node)); break;
+            case NodeKind::FloatLiteral: entered = step(static_cast<FloatLiteral&>(*node)); break;
+            case NodeKind::Empty: break;
+            }
+            if (!entered) {
+                top = 0;
+                open.clear();
+                return false;
+            }
+        }
+    }
+
+    // Default hooks: descend into every node, nothing to do afterwards
+    template <typename Node>
+    bool enter(Node&) { return true; }
+
+    template <typename Node>
+    void leave(Node&) {}
+
+    void missing() {}
+
+    // From a hook, the node depth levels up from the one entered or left:
+    // 0 is its parent. Null above the root of the walk.
+    ASTNode* ancestor(std::size_t depth) const {
+        return depth < open.size() ? open[open.size() - 1 - depth].node : nullptr;
+    }
+
+private:
+    struct Open {
+        ASTNode* node;
+        std::size_t mark;  // size of pending before the node's children were pushed
+    };
+    std::vector<ASTNode*> pending;  // nodes still to enter, the next one last, up to top
+    std::size_t top = 0;
+    std::vector<Open> open;         // nodes entered and not yet left, the root first
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    static WalkAction action(bool descend) { return descend ? WalkAction::Continue : WalkAction::SkipChildren; }
+    static WalkAction action(WalkAction next) { return next; }
+
+    // Enter a node, then queue its children, or leave it right away if it
+    // has none to walk. One switch in walk() reaches this with the node's
+    // class, so a leaf is entered and left with no further dispatch; false
+    // means stop.
+    template <typename Node>
+    bool step(Node& node) {
+        WalkAction next = action(derived().enter(node));
+        if (next == WalkAction::Stop) {
+            return false;
+        }
+        std::size_t mark = top;
+        if (next == WalkAction::Continue) {
+            pushChildren(node);
+        }
+        if (top != mark) {
+            open.push_back({&node, mark});
+        } else {
+            derived().leave(node);
+        }
+        return true;
+    }
+
+    void leaveNode(ASTNode* node) {
+        switch (node->kind) {
+        case NodeKind::Program: derived().leave(static_cast<Program&>(*node)); break;
+        case NodeKind::ClassDecl: derived().leave(static_cast<ClassDecl&>(*node)); break;
+        case NodeKind::ImplDecl: derived().leave(static_cast<ImplDecl&>(*node)); break;
+        case NodeKind::FuncDecl: derived().leave(static_cast<FuncDecl&>(*node)); break;
+        case NodeKind::VarDecl: derived().leave(static_cast<VarDecl&>(*node)); break;
+        case NodeKind::Type: derived().leave(static_cast<Type&>(*node)); break;
+        case NodeKind::Statement: derived().leave(static_cast<Statement&>(*node)); break;
+        case NodeKind::IfStatement: derived().leave(static_cast<IfStatement&>(*node)); break;
+        case NodeKind::WhileStatement: derived().leave(static_cast<WhileStatement&>(*node)); break;
+        case NodeKind::ReturnStatement: derived().leave(static_cast<ReturnStatement&>(*node)); break;
+        case NodeKind::AssignStatement: derived().leave(static_cast<AssignStatement&>(*node)); break;
+        case NodeKind::BlockStatement: derived().leave(static_cast<BlockStatement&>(*node)); break;
+        case NodeKind::CallStatement: derived().leave(static_cast<CallStatement&>(*node)); break;
+        case NodeKind::Expression: derived().leave(static_cast<Expression&>(*node)); break;
+        case NodeKind::BinaryExpression: derived().leave(static_cast<BinaryExpression&>(*node)); break;
+        case NodeKind::UnaryExpression: derived().leave(static_cast<UnaryExpression&>(*node)); break;
+        case NodeKind::CallExpression: derived().leave(static_cast<CallExpression&>(*node)); break;
+        case NodeKind::IndexExpression: derived().leave(static_cast<IndexExpression&>(*node)); break;
+        case NodeKind::MemberExpression: derived().leave(static_cast<MemberExpression&>(*node)); break;
+        case NodeKind::Identifier: derived().leave(static_cast<Identifier&>(*node)); break;
+        case NodeKind::IntegerLiteral: derived().leave(static_cast<IntegerLiteral&>(*node)); break;
+        case NodeKind::FloatLiteral: derived().leave(static_cast<FloatLiteral&>(*node)); break;
+        case NodeKind::Empty: break;
+        }
+    }
+
+    // Queue the child slots of a node, including ones that hold null, last
+    // first so the first is entered next
+    void pushChildren(ASTNode&) {}
+
+    void pushChildren(Program& node) { push(node.declarations); }
+    void pushChildren(ClassDecl& node) {
+        push(node.members);
+        push(node.parents);
+    }
+    void pushChildren(ImplDecl& node) { push(node.functions); }
+    void pushChildren(FuncDecl& node) {
+        push(node.body, node.returnType);
+        push(node.params);
+    }
+    void pushChildren(VarDecl& node) { push(node.type); }
+    void pushChildren(IfStatement& node) { push(node.elseStmt, node.thenStmt, node.condition); }
+    void pushChildren(WhileStatement& node) { push(node.body, node.condition); }
+    void pushChildren(ReturnStatement& node) { push(node.expression); }
+    void pushChildren(AssignStatement& node) { push(node.rhs, node.lhs); }
+    void pushChildren(BlockStatement& node) { push(node.children, node.count); }
+    void pushChildren(CallStatement& node) { push(node.call); }
+    void pushChildren(BinaryExpression& node) { push(node.right, node.left); }
+    void pushChildren(UnaryExpression& node) { push(node.expr); }
+    void pushChildren(CallExpression& node) {
+        push(node.args);
+        push(node.callee);
+    }
+    void pushChildren(IndexExpression& node) { push(node.index, node.base); }
+    void pushChildren(MemberExpression& node) { push(node.object); }
+
+    // Space for n more pending nodes, growing the stack only when it is full
+    ASTNode** room(std::size_t n) {
+        if (pending.size() - top < n) {
+            pending.resize(2 * pending.size() + n);
+        }
+        return pending.data() + top;
+    }
+
+    template <typename... Children>
+    void push(Children*... children) {
+        ASTNode** slot = room(sizeof...(children));
+        ((*slot++ = children), ...);
+        top += sizeof...(children);
+    }
+
+    template <typename Child>
+    void push(Child* const* children, std::size_t count) {
+        ASTNode** slot = room(count);
+        for (std::size_t i = count; i > 0; --i) {
+            *slot++ = children[i - 1];
+        }
+        top += count;
+    }
+
+    template <typename Child>
+    void push(const std::vector<Child*>& children) {
+        push(children.data(), children.size());
+    }
+};
+
+#endif // AST_WALKER_H
@@ -0,0 +1,48 @@
+#ifndef BIT_SET_H
+#define BIT_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size set of small integers, one bit each, for the per-block and
+// per-register facts of the IR passes
+class BitSet {
+public:
+    BitSet() = default;
+    explicit BitSet(std::size_t size) : words((size + 63) / 64, 0), bits(size) {}
+
+    // Resize to size bits, all clear
+    void assign(std::size_t size) {
+        words.assign((size + 63) / 64, 0);
+        bits = size;
+    }
+
+    bool test(std::size_t i) const { return words[i >> 6] >> (i & 63) & 1; }
+    void set(std::size_t i) { words[i >> 6] |= std::uint64_t{1} << (i & 63); }
+    void reset(std::size_t i) { words[i >> 6] &= ~(std::uint64_t{1} << (i & 63)); }
+
+    // Set bit i and report whether it was clear before
+    bool insert(std::size_t i) {
+        std::uint64_t mask = std::uint64_t{1} << (i & 63);
+        bool added = !(words[i >> 6] & mask);
+        words[i >> 6] |= mask;
+        return added;
+    }
+
+    std::size_t size() const { return bits; }
+
+    std::size_t count() const {
+        std::size_t total = 0;
+        for (std::uint64_t word : words) {
+            total += static_cast<std::size_t>(__builtin_popcountll(word));
+        }
+        return total;
+    }
+
+private:
+    std::vector<std::uint64_t> words;
+    std::size_t bits = 0;
+};
+
+#endif // BIT_SET_H
@@ -0,0 +1,54 @@
+#ifndef BYTECODE_VM_H
+#define BYTECODE_VM_H
+
+#include "ir.h"
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Register bytecode for the virtual machine. Instructions are an opcode
+// word followed by their operand words in one array; jump targets are
+// word offsets into it.
+struct Bytecode {
+    struct Function {
+        std::uint32_t start = 0;          // offset of the first instruction
+        std::uint32_t params = 0;         // registers 0 .. params-1 hold the arguments
+        std::uint32_t locals = 0;         // IR registers; those after the params are zeroed on entry
+        std::uint32_t constantFirst = 0;  // constants copied in after the locals
+        std::uint32_t constantCount = 0;
+        std::uint32_t registers = 0;      // window size, outgoing arguments included
+        std::uint32_t frameSize = 0;      // bytes of arrays, objects and call results
+    };
+
+    std::vector<std::uint32_t> code;
+    std::vector<Function> functions;
+    std::vector<std::uint32_t> constants;
+    std::uint32_t entry = Instr::none;
+    std::size_t instructions = 0;
+};
+
+struct BytecodeStats {
+    std::size_t executed = 0;  // instructions dispatched
+    std::size_t calls = 0;     // function calls made
+};
+
+// Compile a program out of SSA form to bytecode, one instruction per IR
+// instruction with a few exceptions: a constant that dominates all its
+// uses becomes a register preset on entry, an int comparison that
+// only feeds the branch after it is fused into a compare-and-jump, a
+// result only copied by the next instruction is written to the copy's
+// target, Args write straight into the callee's registers, and jumps to
+// the next block or to a block that only jumps are left out or threaded.
+bool compileBytecode(const IRProgram& program, Bytecode& out, std::string& error);
+
+// Run compiled bytecode from its entry function, with the I/O and runtime
+// errors of interpret(). Each call gets a window of the register file
+// right after its caller's registers, which is where the caller has put
+// its arguments, and a zeroed frame on a byte stack for its aggregates.
+// Dispatch jumps through a table of label addresses on GCC and Clang and
+// falls back to a switch elsewhere, or when BYTECODE_SWITCH is defined.
+bool runBytecode(const Bytecode& program, std::istream& in, std::string& out, BytecodeStats& stats, std::string& error);
+
+#endif // BYTECODE_VM_H
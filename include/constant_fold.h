@@ -0,0 +1,35 @@
+#ifndef CONSTANT_FOLD_H
+#define CONSTANT_FOLD_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include <cstddef>
+
+struct FoldStats {
+    std::size_t folded = 0;      // operators evaluated at compile time
+    std::size_t simplified = 0;  // identities such as x*1 or not not x applied
+    std::size_t removed = 0;     // nodes no longer reachable from their statement
+};
+
+// Fold the constant subexpressions of the tree rooted at root and rewrite
+// algebraic identities, replacing each rewritten expression in its parent:
+//
+//   2 * (3 + 4)  ->  14          x + 0, 0 + x, x - 0  ->  x
+//   1.5 * 2.0    ->  3.0         x * 1, 1 * x, x / 1  ->  x
+//   3 < 4        ->  1           - - x, + x           ->  x
+//   not 0        ->  1           not not (a < b)      ->  a < b
+//
+// Operands must be of one type, as the type checker requires, so int and
+// float are never mixed. Integer arithmetic wraps at 32 bits; a division
+// by zero, or of INT_MIN by -1, is left for run time. not not x becomes x
+// only when x is already 0 or 1 (a comparison, and, or, not). An identity
+// never drops an operand, so calls are kept even where their value is not
+// needed.
+//
+// New literals are allocated in context and take the span, and the type if
+// one was computed, of the expression they replace. The old nodes stay in
+// the arena but are unreachable. Nodes are rewritten in place, so a
+// hash-consing table built over the tree no longer describes it.
+FoldStats foldConstants(ASTNode* root, ASTContext& context);
+
+#endif // CONSTANT_FOLD_H
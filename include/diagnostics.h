@@ -0,0 +1,24 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "line_table.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Severity : std::uint8_t { Warning, Error };
+
+// A semantic error or warning, located by the source offset of the node it
+// is about rather than by line, so passes never need the source text
+struct Diagnostic {
+    std::uint32_t offset = 0;
+    Severity severity = Severity::Error;
+    std::string message;
+};
+
+// Sort diagnostics by offset and write them to path, one per line as
+// "[error] line:column: message". Reports at the same offset keep the order
+// they were made in.
+bool writeDiagnostics(std::vector<Diagnostic>& diagnostics, const LineTable& lines, const std::string& path);
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,73 @@
+#ifndef EXPR_TABLE_H
+#define EXPR_TABLE_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hash-consing table for expression nodes. Each factory returns the
+// existing node when an identical one was already built in the current
+// function body and constructs a new one otherwise, so repeated
+// subexpressions such as n - i - 1 or arr[j + 1] are stored once and the
+// expressions of a body form a DAG.
+//
+// The table is keyed per body: startBody() forgets the expressions of the
+// previous one, so no node is shared between bodies and each body can be
+// checked on its own thread. Within a body every name resolves in the same
+// flat scope of parameters, locals, members and globals, so an identifier
+// is keyed on its name, which stands for its resolved declaration there,
+// and what later passes store on a shared node, such as the checked type,
+// is the same for all its occurrences. Calls are never shared: they may
+// have side effects and their callee takes the type of the overload each
+// one resolves to, so every call and callee stays a distinct node, though
+// the arguments can be shared.
+//
+// Children are canonical by the time their parent is built, so structural
+// equality reduces to comparing the operator or value and the child
+// pointers, and a node is hashed from those in constant time.
+//
+// The table holds pointers into the context and must be cleared whenever
+// the context is reset.
+class ExprTable {
+public:
+    explicit ExprTable(ASTContext& context) : context(context) {}
+
+    Identifier* identifier(Symbol name);
+    IntegerLiteral* integer(int value);
+    FloatLiteral* floating(float value);
+    BinaryExpression* binary(BinOp op, Expression* left, Expression* right);
+    UnaryExpression* unary(UnOp op, Expression* operand);
+    IndexExpression* index(Expression* base, Expression* index);
+    MemberExpression* member(Expression* object, Symbol member);
+
+    // Start sharing afresh for the next function body
+    void startBody();
+    void clear();
+
+    // Distinct expressions built through the table
+    std::size_t size() const { return count; }
+
+    // Requests answered with an existing node, i.e. nodes not allocated
+    std::size_t duplicates() const { return reused; }
+
+private:
+    struct Slot {
+        std::uint64_t hash;
+        Expression* expr;  // null if the slot is empty
+    };
+
+    ASTContext& context;
+    std::vector<Slot> slots;  // open addressing, linear probing, power-of-two size
+    std::size_t occupied = 0;  // slots in use for the current body
+    std::size_t count = 0;
+    std::size_t reused = 0;
+
+    template <typename T, typename Same, typename Make>
+    T* intern(NodeKind kind, std::uint64_t hash, Same same, Make make);
+
+    void grow();
+};
+
+#endif // EXPR_TABLE_H
@@ -0,0 +1,67 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include <cstdint>
+#include <vector>
+
+// Compact alternative layout for an AST. A node is a 32-bit index into
+// parallel per-node arrays: its kind, its first child, its next sibling and
+// one payload word. There are no vtables and no per-node heap blocks, so a
+// pass over the whole tree is a walk over a few dense arrays.
+//
+// The payload holds the Symbol id of named nodes (ClassDecl, ImplDecl,
+// FuncDecl, VarDecl, Type, Identifier, MemberExpression), the operator of
+// Binary/UnaryExpression and the bits of Integer/FloatLiteral values.
+// Children appear in the same order as the pointer AST visits them, except
+// that the array sizes of a Type are IntegerLiteral children of it; a missing
+// optional child (no else branch, no function body) is kept as an Empty node
+// so positions stay meaningful. Token ranges, spans and member visibility
+// are not kept.
+class FlatAST {
+public:
+    static constexpr std::uint32_t none = 0xFFFFFFFFu;
+
+    std::vector<NodeKind> kinds;
+    std::vector<std::uint32_t> firstChild;
+    std::vector<std::uint32_t> nextSibling;
+    std::vector<std::uint32_t> payload;
+
+    std::uint32_t root() const { return kinds.empty() ? none : 0; }
+    std::uint32_t size() const { return static_cast<std::uint32_t>(kinds.size()); }
+    std::size_t bytes() const {
+        return kinds.size() * (sizeof(NodeKind) + 3 * sizeof(std::uint32_t));
+    }
+
+    // Append a node with no children yet and return its index
+    std::uint32_t addNode(NodeKind kind, std::uint32_t value = 0);
+
+    Symbol symbol(std::uint32_t node) const { return Symbol{payload[node]}; }
+    int intValue(std::uint32_t node) const;
+    float floatValue(std::uint32_t node) const;
+
+    template <typename F>
+    void forEachChild(std::uint32_t node, F f) const {
+        for (std::uint32_t child = firstChild[node]; child != none; child = nextSibling[child]) {
+            f(child);
+        }
+    }
+};
+
+// Lay out the tree rooted at root in pre-order. Symbols keep referring to
+// the ASTContext that owns the pointer tree.
+//
+// ASTBuilder does not emit this layout itself: reparseAST() splices into
+// the pointer tree, and constant folding and the type checker rewrite and
+// annotate its nodes in place, so the front end needs that tree anyway.
+// Its nodes come from the context's arena, one bump per node, and building
+// it is dominated by token matching; a flat form is only made when one is
+// written out or measured.
+FlatAST flattenAST(ASTNode* root);
+
+// Rebuild a pointer tree in context, so ASTVisitor passes such as printAST
+// can run on a flat AST unchanged
+ASTNode* inflateAST(const FlatAST& flat, ASTContext& context);
+
+#endif // FLAT_AST_H
@@ -0,0 +1,36 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include "symbol_table.h"
+#include "type_table.h"
+#include <cstddef>
+#include <istream>
+#include <string>
+
+struct InterpreterStats {
+    std::size_t nodes = 0;       // resolved statement and expression nodes
+    std::size_t operations = 0;  // nodes executed
+    std::size_t calls = 0;       // function calls made
+};
+
+// Run a program that passed checkSemantics without errors: the program
+// block if there is one, or else main. read() takes numbers from in, and
+// write() and put() append to out.
+//
+// Each function body is first resolved into a tree of compact nodes that
+// mirrors its AST. Variables become word slots of a frame, attributes and
+// array elements become offsets from an address, and calls carry the
+// index of the overload the type checker chose, so execution walks the
+// tree without any name lookup. Memory is one array of 32-bit words;
+// frames are pushed on it and zeroed, arrays and objects live inline in
+// them and are passed and returned by address, as in the IR. Integer
+// division by zero, running out of memory for frames and calls nested too
+// deep stop the program with error set. Like the VM, the interpreter
+// allows 10000 frames, the entry function's included; it runs on a thread
+// of its own with a stack large enough for them.
+bool interpret(ASTNode* root, const ASTContext& context, const SymbolTables& tables, const TypeTable& types,
+               std::istream& in, std::string& out, InterpreterStats& stats, std::string& error);
+
+#endif // INTERPRETER_H
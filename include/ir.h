@@ -0,0 +1,103 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Three-address intermediate representation. A function is a flat array of
+// fixed-size instructions over an unbounded set of virtual registers, cut
+// into basic blocks by a block table; passes scan the arrays linearly and
+// never chase pointers.
+//
+// Every value is a 32-bit word, an int, a float or a byte address. Scalar
+// variables live in registers; arrays and objects live in the frame of
+// their function and are handled through their addresses, so an aggregate
+// parameter or result is passed by reference.
+enum class Opcode : std::uint8_t {
+    Const,                            // dst = a, the bits of an int or float
+    Copy,                             // dst = a
+    Phi,                              // dst = the operand of the block entered from; b operands at a in IRFunction::phiOperands
+    Add, Sub, Mul, Div, And, Or,      // dst = a op b on ints; and, or give 0 or 1
+    Eq, NotEq, Lt, Gt, LtEq, GtEq,    // dst = a op b on ints, 0 or 1
+    FAdd, FSub, FMul, FDiv,           // dst = a op b on floats
+    FEq, FNotEq, FLt, FGt, FLtEq, FGtEq,  // dst = a op b on floats, 0 or 1
+    Neg, FNeg, Not,                   // dst = op a
+    Frame,                            // dst = address of the frame plus c
+    Load,                             // dst = word at a + c
+    Store,                            // word at a + c = b
+    Move,                             // copy c bytes from address b to address a
+    Arg,                              // pass a to the next Call
+    Call,                             // dst = function a applied to the last b Args; dst none if void
+    Read,                             // dst = a value read from the input
+    Write,                            // print a and a newline
+    Put,                              // print a
+    Jump,                             // continue at block a
+    Branch,                           // continue at block b if a is nonzero, else at block c
+    Ret                               // return a, or nothing if a is none
+};
+
+enum class IRType : std::uint8_t { Int, Float };
+
+struct Instr {
+    static constexpr std::uint32_t none = 0xFFFFFFFFu;
+
+    Opcode op;
+    std::uint32_t dst = none;
+    std::uint32_t a = none;
+    std::uint32_t b = none;
+    std::uint32_t c = none;
+
+    bool isTerminator() const { return op == Opcode::Jump || op == Opcode::Branch || op == Opcode::Ret; }
+};
+
+// Instructions [begin, end) of the code array. Blocks are stored in code
+// order, the entry block first, and each ends with its only terminator.
+struct IRBlock {
+    std::uint32_t begin;
+    std::uint32_t end;
+};
+
+struct IRFunction {
+    std::string name;            // CLASS::name for a member function
+    std::vector<Instr> code;
+    std::vector<IRBlock> blocks;
+    std::vector<IRType> regs;    // type of each virtual register
+    std::vector<std::uint32_t> phiOperands;  // register, predecessor block pairs of the phis in SSA form
+    std::uint32_t params = 0;    // registers 0 .. params-1 hold the arguments
+    std::uint32_t frameSize = 0; // bytes of arrays, objects and call results
+    bool returnsValue = false;   // Ret carries a value; a class result is written through param 0 instead
+};
+
+// The functions of a program. A member function takes the address of its
+// object as its first argument, preceded by the address to write the result
+// to when it returns an object; a free function returning an object takes
+// only the latter.
+struct IRProgram {
+    std::vector<IRFunction> functions;
+    std::uint32_t entry = Instr::none;  // the program block, or main
+
+    std::size_t instructionCount() const;
+    std::size_t blockCount() const;
+};
+
+std::string_view opcodeName(Opcode op);
+
+// Whether op writes its dst register
+bool definesRegister(Opcode op);
+
+// Which of a and b an instruction reads as registers: bit 0 for a, bit 1
+// for b. The operands of a Phi are not included.
+unsigned registerOperands(const Instr& instr);
+
+// Registers of a function other than its parameters that may be read
+// before they are written, conservatively. A call starts them at zero, so
+// code that stands in for one has to as well.
+std::vector<std::uint32_t> exposedRegisters(const IRFunction& function);
+
+// Write the program as text, one instruction per line under block labels
+bool printIR(const IRProgram& program, const std::string& path);
+
+#endif // IR_H
@@ -0,0 +1,26 @@
+#ifndef IR_BUILDER_H
+#define IR_BUILDER_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include "diagnostics.h"
+#include "ir.h"
+#include "symbol_table.h"
+#include "type_table.h"
+#include <vector>
+
+// Lower a program that passed checkSemantics without errors to IR: one
+// function for each defined free or member function, and one named program
+// for the statements of the program block. Calls go to the overload the
+// type checker recorded, and every expression already carries its type.
+//
+// An object of a derived class starts with the attributes of its base
+// classes, in the order they are inherited, followed by its own; ints and
+// floats take 4 bytes each. The statements are lowered recursively, the
+// expressions with an ASTWalker, so deep expressions do not grow the
+// native stack. Constructs with no lowering, such as an array parameter
+// with an unsized inner dimension, are reported to diagnostics.
+IRProgram lowerProgram(ASTNode* root, const ASTContext& context, const SymbolTables& tables, const TypeTable& types,
+                       std::vector<Diagnostic>& diagnostics);
+
+#endif // IR_BUILDER_H
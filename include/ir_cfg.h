@@ -0,0 +1,74 @@
+#ifndef IR_CFG_H
+#define IR_CFG_H
+
+#include "ir.h"
+#include <cstdint>
+#include <vector>
+
+// A run of indices inside one of the flat arrays below
+struct IndexRange {
+    const std::uint32_t* first;
+    const std::uint32_t* last;
+
+    const std::uint32_t* begin() const { return first; }
+    const std::uint32_t* end() const { return last; }
+    std::uint32_t size() const { return static_cast<std::uint32_t>(last - first); }
+    std::uint32_t operator[](std::uint32_t i) const { return first[i]; }
+};
+
+// Successor and predecessor lists of the blocks of a function, each stored
+// as one array of block indices with an offset per block (compressed
+// sparse rows). Successors come in terminator order, so the edges leaving a
+// block have consecutive ids: edge e runs to succ[e].
+class CFG {
+public:
+    explicit CFG(const IRFunction& function);
+
+    std::uint32_t blockCount() const { return static_cast<std::uint32_t>(succBegin.size() - 1); }
+    IndexRange successors(std::uint32_t block) const { return {succ.data() + succBegin[block], succ.data() + succBegin[block + 1]}; }
+    IndexRange predecessors(std::uint32_t block) const { return {pred.data() + predBegin[block], pred.data() + predBegin[block + 1]}; }
+
+    // The id of the first edge from block to its successor target, or none
+    std::uint32_t edge(std::uint32_t block, std::uint32_t target) const;
+    std::uint32_t edgeCount() const { return static_cast<std::uint32_t>(succ.size()); }
+    std::uint32_t edgeTarget(std::uint32_t edge) const { return succ[edge]; }
+
+private:
+    std::vector<std::uint32_t> succBegin, succ;
+    std::vector<std::uint32_t> predBegin, pred;
+};
+
+// Dominator tree and dominance frontiers of the blocks reachable from the
+// entry, by the iterative algorithm of Cooper, Harvey and Kennedy: idoms
+// are refined in reverse postorder, intersecting predecessors by walking up
+// the tree with postorder numbers, until nothing changes. That takes two
+// or three passes on the reducible graphs lowering produces.
+class Dominators {
+public:
+    static constexpr std::uint32_t none = Instr::none;
+
+    Dominators(const CFG& cfg);
+
+    // Reachable blocks in reverse postorder, the entry first
+    const std::vector<std::uint32_t>& reversePostorder() const { return rpo; }
+
+    bool reachable(std::uint32_t block) const { return idoms[block] != none; }
+
+    // Immediate dominator; the entry is its own
+    std::uint32_t idom(std::uint32_t block) const { return idoms[block]; }
+
+    IndexRange children(std::uint32_t block) const { return {child.data() + childBegin[block], child.data() + childBegin[block + 1]}; }
+    IndexRange frontier(std::uint32_t block) const { return {front.data() + frontBegin[block], front.data() + frontBegin[block + 1]}; }
+
+    // Whether a dominates b, from preorder intervals of the tree
+    bool dominates(std::uint32_t a, std::uint32_t b) const { return enter[a] <= enter[b] && exit[b] <= exit[a]; }
+
+private:
+    std::vector<std::uint32_t> rpo;
+    std::vector<std::uint32_t> idoms;
+    std::vector<std::uint32_t> childBegin, child;
+    std::vector<std::uint32_t> frontBegin, front;
+    std::vector<std::uint32_t> enter, exit;
+};
+
+#endif // IR_CFG_H
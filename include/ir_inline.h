@@ -0,0 +1,27 @@
+#ifndef IR_INLINE_H
+#define IR_INLINE_H
+
+#include "ir.h"
+#include <cstddef>
+
+struct InlineStats {
+    std::size_t calls = 0;               // call sites replaced by the body of their callee
+    std::size_t instructionsBefore = 0;  // instructions of the program on entry
+    std::size_t instructionsAfter = 0;
+};
+
+// Replace calls to small leaf functions by a copy of the callee's body,
+// on IR out of SSA form. Callers are visited in postorder of the call
+// graph, so a callee has had its own calls inlined first and may have
+// become a leaf by then. A function on a cycle of the graph always keeps
+// a call and is never inlined, which makes recursion safe.
+//
+// The copy gets fresh registers and its own part of the caller's frame.
+// Arguments are copied into its parameters where the Args were, and its
+// returns copy the result and jump to the rest of the calling block. The
+// registers it might read before writing and its frame are zeroed first,
+// as a call would. A callee is taken when it has at most 40 instructions,
+// and while the program has grown by less than half its size.
+InlineStats inlineFunctions(IRProgram& program);
+
+#endif // IR_INLINE_H
@@ -0,0 +1,38 @@
+#ifndef IR_LOOPS_H
+#define IR_LOOPS_H
+
+#include "ir.h"
+#include <cstddef>
+
+struct LoopStats {
+    std::size_t loops = 0;       // natural loops found
+    std::size_t preheaders = 0;  // blocks added to enter a loop through
+    std::size_t hoisted = 0;     // instructions moved to a preheader
+    std::size_t reduced = 0;     // multiplications replaced by a running sum
+};
+
+// Loop optimizations on IR out of SSA form. A natural loop is a header
+// and the blocks reaching one of its back edges, the edges into a block
+// that dominates their source, without passing through the header. Loops
+// are visited innermost first, each through a preheader: the header's
+// only predecessor from outside when that block jumps nowhere else, or a
+// new block otherwise, so what an inner loop hoists is seen by the loop
+// around it.
+//
+// An instruction without side effects that cannot fault, written to a
+// register defined nowhere else and read only where it dominates, moves
+// to the preheader once its operands are not written inside the loop or
+// have moved themselves. A constant, copy or frame address moves only
+// when such an instruction reads it: kept in a register across the whole
+// loop it would cost more than it saves. Then, for each register i whose
+// only write in the loop is i = i + c or i = i - c with c invariant, a
+// product i * k or (i + d) * k with k and d invariant becomes a register
+// set to i * k in the preheader and stepped by c * k after each step of
+// i, read directly or through a single add. A constant left in the loop
+// counts as invariant, and c * k of two constants is folded. A loop is
+// only reduced when it then runs fewer instructions per iteration: a lone
+// i * k trades its multiply for the step, and the setup in the preheader
+// would make every entry to the loop cost more.
+LoopStats optimizeLoops(IRProgram& program);
+
+#endif // IR_LOOPS_H
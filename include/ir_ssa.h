@@ -0,0 +1,54 @@
+#ifndef IR_SSA_H
+#define IR_SSA_H
+
+#include "ir.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SSAStats {
+    std::size_t phis = 0;                // phis placed by buildSSA
+    std::size_t constants = 0;           // instructions replaced by a Const
+    std::size_t branchesFolded = 0;      // Branches on a constant turned into Jumps
+    std::size_t blocksRemoved = 0;       // blocks found unreachable
+    std::size_t instructionsRemoved = 0; // instructions deleted as dead or unreachable
+};
+
+// Rename the registers of a function so each is written once, inserting
+// phis at the iterated dominance frontiers of the blocks that write a
+// variable. Only variables live across a block boundary get phis; a
+// variable read on a path where it was never written reads a version set
+// to zero at the top of the entry block. Phis come first in their block.
+// Returns the register each register is a version of, itself for those
+// left alone.
+std::vector<std::uint32_t> buildSSA(IRFunction& function, SSAStats& stats);
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over a
+// function in SSA form. Registers and CFG edges go through two index
+// worklists, and a register's lattice value only ever lowers from unknown
+// to a constant to varying, so each instruction is visited a bounded
+// number of times. Registers proven constant are redefined by a Const,
+// Branches on a constant become Jumps and blocks never reached are
+// removed along with their phi operands.
+void propagateConstants(IRFunction& function, SSAStats& stats);
+
+// Delete instructions whose results are never used, marking backwards
+// from the instructions with effects: memory writes, calls and their
+// arguments, I/O and terminators. Works on SSA form, where each register
+// has a single definition.
+void eliminateDeadCode(IRFunction& function, SSAStats& stats);
+
+// Leave SSA form by renaming every version back to the register it came
+// from, as given by buildSSA, and dropping the phis. That is sound while no
+// two versions of one register are live at once, which propagateConstants
+// and eliminateDeadCode preserve. A phi operand from another register
+// becomes a copy at the end of the predecessor, on a new block placed
+// after the others when the edge is critical; copies of one edge that read
+// each other's targets go through fresh registers.
+void destroySSA(IRFunction& function, const std::vector<std::uint32_t>& origin);
+
+// buildSSA, propagateConstants, eliminateDeadCode and destroySSA on every
+// function of the program
+SSAStats optimizeProgram(IRProgram& program);
+
+#endif // IR_SSA_H
@@ -0,0 +1,34 @@
+#ifndef LINE_TABLE_H
+#define LINE_TABLE_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// 1-based line and column of a source offset; columns count bytes
+struct LineColumn {
+    std::uint32_t line = 0;
+    std::uint32_t column = 0;
+};
+
+// Maps the byte offsets stored in tokens and AST nodes back to lines and
+// columns. One table serves every node of a source file. The start of each
+// line is found on the first lookup, so a compilation that reports nothing
+// never scans the text, and each lookup after that is a binary search.
+class LineTable {
+public:
+    // source must outlive the table
+    explicit LineTable(std::string_view source) : source(source) {}
+
+    LineColumn resolve(std::uint32_t offset) const;
+
+    std::uint32_t lineCount() const;
+
+private:
+    std::string_view source;
+    mutable std::vector<std::uint32_t> lineStarts;  // empty until first used
+
+    void scan() const;
+};
+
+#endif // LINE_TABLE_H
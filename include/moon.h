@@ -0,0 +1,59 @@
+#ifndef MOON_H
+#define MOON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Instructions of the Moon virtual machine, in the fixed-size form code
+// generation produces and the passes over it read. r0 always holds zero;
+// memory is byte-addressed in 4-byte words, and K is a signed 16-bit
+// immediate or a label.
+enum class MoonOp : std::uint8_t {
+    Add, Sub, Mul, Div, Mod, And, Or,             // Ri = Rj op Rk
+    Ceq, Cne, Clt, Cle, Cgt, Cge,                 // Ri = Rj op Rk, 0 or 1
+    Addi, Subi, Muli, Divi, Modi, Andi, Ori,      // Ri = Rj op K
+    Ceqi, Cnei, Clti, Clei, Cgti, Cgei,           // Ri = Rj op K, 0 or 1
+    Not,                                          // Ri = not Rj
+    Sl, Sr,                                       // Ri = Ri shifted by K
+    Lw,                                           // Ri = word at K(Rj)
+    Sw,                                           // word at K(Rj) = Ri
+    Getc, Putc,                                   // read or print the character in Ri
+    Bz, Bnz,                                      // go to K if Ri is zero, nonzero
+    J,                                            // go to K
+    Jr,                                           // go to Ri
+    Jl,                                           // Ri = return address, go to K
+    Nop, Hlt,
+    Entry,                                        // directive: execution starts here
+    Align,                                        // directive: next address is word-aligned
+    Res,                                          // directive: reserve K bytes
+    Label                                         // defines label
+};
+
+struct MoonInstr {
+    static constexpr std::uint32_t none = 0xFFFFFFFFu;
+
+    MoonOp op;
+    std::uint8_t ri = 0;
+    std::uint8_t rj = 0;
+    std::uint8_t rk = 0;
+    std::int32_t k = 0;
+    std::uint32_t label = none;  // K is this label instead, or the one a Label defines
+
+    // An operation the machine executes, as opposed to a label or directive
+    bool executes() const { return op < MoonOp::Entry; }
+};
+
+struct MoonProgram {
+    std::vector<MoonInstr> code;
+    std::vector<std::string> labels;  // names, indexed by MoonInstr::label
+};
+
+std::string_view moonOpName(MoonOp op);
+
+// Write the program as Moon assembly text, labels in the first column
+bool printMoon(const MoonProgram& program, const std::string& path);
+
+#endif // MOON_H
@@ -0,0 +1,44 @@
+#ifndef MOON_CODEGEN_H
+#define MOON_CODEGEN_H
+
+#include "ir.h"
+#include "moon.h"
+#include <cstddef>
+#include <string>
+
+struct MoonStats {
+    std::size_t instructions = 0;  // executable instructions emitted
+    std::size_t loads = 0;         // lw
+    std::size_t stores = 0;        // sw
+    std::size_t allocated = 0;     // virtual registers kept in a machine register
+    std::size_t spilled = 0;       // virtual registers kept in their frame slot
+};
+
+// Count the instructions, loads and stores of a program
+void countMoon(const MoonProgram& program, MoonStats& stats);
+
+// Translate IR to Moon assembly. Each function gets a frame addressed by
+// r14, holding the return address at 0, the arguments from 4, then a slot
+// for each virtual register that needs one and the arrays and objects of
+// the IR frame; a call moves r14 past the caller's frame. The prologue
+// zeroes the IR frame and the registers exposedRegisters() finds, which
+// the interpreter and the VM start at zero too. Results come back in
+// r13. Integer I/O goes through putint and getint routines that are
+// appended when used and touch only r11 to r13 and r15.
+//
+// With allocate, virtual registers get r1 to r10 by linear scan (Poletto
+// and Sarkar) over live intervals in code order: each interval is spilled
+// to its slot only when more than ten are live, the one ending furthest
+// away first, and registers live across a call are saved around it.
+// Without, every value goes through its slot, the baseline the allocator
+// is measured against. Either way constants small enough for an immediate
+// are folded into the instructions that use them, zero is read from r0,
+// and r11 and r12 carry operands loaded from slots. Frame, slot and
+// element offsets too large for the 16-bit K are built in r15 and added
+// to the base register.
+//
+// Moon has no floating point; a program with float values is reported
+// through error and nothing is generated.
+bool generateMoon(const IRProgram& program, bool allocate, MoonProgram& out, MoonStats& stats, std::string& error);
+
+#endif // MOON_CODEGEN_H
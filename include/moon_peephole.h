@@ -0,0 +1,28 @@
+#ifndef MOON_PEEPHOLE_H
+#define MOON_PEEPHOLE_H
+
+#include "moon.h"
+#include <cstddef>
+
+struct PeepholeStats {
+    std::size_t rewrites = 0;  // windows replaced
+    std::size_t removed = 0;   // executable instructions removed, net
+    std::size_t cycles = 0;    // estimated cycles saved, counting each instruction once
+};
+
+// Estimated cycles to execute op once: one, plus ten for the memory
+// access of lw and sw
+int moonCycles(MoonOp op);
+
+// Rewrite short runs of instructions into fewer or cheaper ones: loads of
+// a word just stored or stores of a word just loaded, stores overwritten
+// by the next, jumps to the next instruction, a branch over a jump,
+// instructions after an unconditional jump, branches on r0 and operations
+// that leave their register as it was. Instructions are moved one at a
+// time into a kept prefix of the buffer, and the patterns that can end
+// with the newest one are tried on the tail of that prefix until none
+// matches, so a rewrite exposes earlier instructions to further ones.
+// Which patterns apply to which op is a table built at compile time.
+PeepholeStats optimizeMoon(MoonProgram& program);
+
+#endif // MOON_PEEPHOLE_H
@@ -0,0 +1,45 @@
+#ifndef OBJECT_LAYOUT_H
+#define OBJECT_LAYOUT_H
+
+#include "symbol_table.h"
+#include "type_table.h"
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Sizes of types and offsets of attributes and base classes in objects,
+// in bytes. An object of a derived class starts with the attributes of its
+// base classes, in the order they are inherited, followed by its own; ints
+// and floats take 4 bytes each. Class layouts are computed on first use.
+class Layout {
+public:
+    Layout(const SymbolTable& global, const TypeTable& types) : global(global), types(types) {}
+
+    bool isScalar(TypeId type) const { return type == TypeTable::intType || type == TypeTable::floatType; }
+
+    std::uint32_t size(TypeId type);
+
+    const SymbolTable* classTable(TypeId type) const { return global.find(types.className(type))->table; }
+
+    // Where the part of a cls object that is a base object starts
+    std::uint32_t baseOffset(const SymbolTable* cls, const SymbolTable* base);
+
+    // Offset of an attribute in an object of the class that declares it
+    std::uint32_t attributeOffset(const SymbolTable* owner, const SymbolEntry& attribute);
+
+private:
+    struct ClassLayout {
+        std::uint32_t size = 0;
+        std::vector<std::pair<const SymbolTable*, std::uint32_t>> bases;  // direct and indirect
+    };
+
+    const SymbolTable& global;
+    const TypeTable& types;
+    std::unordered_map<const SymbolTable*, ClassLayout> classes;
+    std::unordered_map<const SymbolEntry*, std::uint32_t> attributes;
+
+    const ClassLayout& of(const SymbolTable* cls);
+};
+
+#endif // OBJECT_LAYOUT_H
@@ -0,0 +1,79 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Operators of the language, stored in expression nodes instead of their
+// spelling so passes can switch on them.
+enum class BinOp : std::uint8_t {
+    Add, Sub, Or,               // addop
+    Mul, Div, And,              // multop
+    Eq, NotEq, Lt, Gt, LtEq, GtEq  // relop
+};
+
+enum class UnOp : std::uint8_t {
+    Plus, Minus, Not
+};
+
+enum class OpClass : std::uint8_t {
+    Arithmetic, Relational, Logical
+};
+
+struct OperatorInfo {
+    std::string_view spelling;
+    int precedence;  // higher binds tighter
+    OpClass opClass;
+};
+
+// Indexed by the enum values above
+constexpr OperatorInfo binOpTable[] = {
+    {"+", 2, OpClass::Arithmetic},
+    {"-", 2, OpClass::Arithmetic},
+    {"or", 2, OpClass::Logical},
+    {"*", 3, OpClass::Arithmetic},
+    {"/", 3, OpClass::Arithmetic},
+    {"and", 3, OpClass::Logical},
+    {"==", 1, OpClass::Relational},
+    {"<>", 1, OpClass::Relational},
+    {"<", 1, OpClass::Relational},
+    {">", 1, OpClass::Relational},
+    {"<=", 1, OpClass::Relational},
+    {">=", 1, OpClass::Relational},
+};
+
+constexpr OperatorInfo unOpTable[] = {
+    {"+", 4, OpClass::Arithmetic},
+    {"-", 4, OpClass::Arithmetic},
+    {"not", 4, OpClass::Logical},
+};
+
+constexpr const OperatorInfo& info(BinOp op) { return binOpTable[static_cast<std::size_t>(op)]; }
+constexpr const OperatorInfo& info(UnOp op) { return unOpTable[static_cast<std::size_t>(op)]; }
+
+constexpr std::string_view spelling(BinOp op) { return info(op).spelling; }
+constexpr std::string_view spelling(UnOp op) { return info(op).spelling; }
+
+// Look up the operator spelled by a token value; returns false if there is none
+constexpr bool toBinOp(std::string_view text, BinOp& op) {
+    for (std::size_t i = 0; i < sizeof(binOpTable) / sizeof(binOpTable[0]); ++i) {
+        if (binOpTable[i].spelling == text) {
+            op = static_cast<BinOp>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+constexpr bool toUnOp(std::string_view text, UnOp& op) {
+    for (std::size_t i = 0; i < sizeof(unOpTable) / sizeof(unOpTable[0]); ++i) {
+        if (unOpTable[i].spelling == text) {
+            op = static_cast<UnOp>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // OPERATORS_H
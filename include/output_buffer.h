@@ -0,0 +1,49 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Growable byte buffer for generated listings. Text and numbers are
+// appended without going through iostreams, and the bytes reach the kernel
+// in as few write calls as possible: one for a listing written whole with
+// writeTo(), or one per flushTo() for a stream emitted in pieces.
+class OutputBuffer {
+public:
+    OutputBuffer& operator<<(std::string_view text) {
+        data.append(text.data(), text.size());
+        return *this;
+    }
+
+    OutputBuffer& operator<<(char c) {
+        data.push_back(c);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(int value);
+    OutputBuffer& operator<<(unsigned value);
+
+    // Same digits as std::ostream's default formatting (%g, precision 6)
+    OutputBuffer& operator<<(float value);
+
+    // Two spaces per level, copied out of a cache grown on demand
+    void indent(int level);
+
+    std::size_t size() const { return data.size(); }
+
+    // Create or truncate path and write the buffer in a single call
+    bool writeTo(const std::string& path) const;
+
+    // Write the buffer to an open file descriptor and empty it
+    bool flushTo(int fd);
+
+private:
+    std::string data;
+    std::string spaces;
+};
+
+// Open path for writing, reporting failures on stderr; returns -1 on error
+int openOutputFile(const std::string& path);
+
+#endif // OUTPUT_BUFFER_H
@@ -0,0 +1,34 @@
+#ifndef SEMANTIC_CHECK_H
+#define SEMANTIC_CHECK_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include "diagnostics.h"
+#include "symbol_table.h"
+#include "type_table.h"
+#include <vector>
+
+// Semantic analysis of a whole program in two phases. The symbol tables are
+// built first, on the calling thread; from then on they and the tree are
+// only read. Every function body, and the program block, is then checked
+// on its own against them: each name must be declared, and every
+// expression is given a type, stored in Expression::type so later passes
+// read it in O(1) instead of recomputing it. Operands, assignments, return
+// values, conditions, indices and arguments must have the types the
+// language requires; a call resolves to the overload whose parameters
+// accept its arguments; private members are visible to their own class
+// only. An expression already in error gets TypeTable::error, which is
+// never reported again.
+//
+// The declared types are interned in types before the bodies are checked,
+// and the table is only read afterwards. A hash-consed tree shares
+// expressions only within a body, so checking it needs no more care.
+//
+// The bodies are shared out among threads workers (0 for one per core),
+// each taking the next unchecked body when it finishes one. Diagnostics
+// are kept per body and merged in source order, so the output does not
+// depend on the number of threads or on scheduling.
+void checkSemantics(ASTNode* root, const ASTContext& context, SymbolTables& tables, TypeTable& types,
+                    std::vector<Diagnostic>& diagnostics, unsigned threads = 0);
+
+#endif // SEMANTIC_CHECK_H
@@ -0,0 +1,119 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include "diagnostics.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+enum class SymbolKind : std::uint8_t { Class, Function, Parameter, Local, Attribute, Variable };
+
+class SymbolTable;
+
+struct SymbolEntry {
+    static constexpr std::uint32_t none = 0xFFFFFFFFu;
+
+    Symbol name;
+    SymbolKind kind = SymbolKind::Variable;
+    Visibility visibility = Visibility::Public;
+    bool defined = false;             // a function whose body has been seen
+    ASTNode* decl = nullptr;          // ClassDecl, VarDecl, or the FuncDecl with the body once defined
+    SymbolTable* table = nullptr;     // scope opened by a class or function
+    std::uint32_t overloaded = none;  // earlier entry of the same table with the same name
+    TypeId type = 0;                  // declared type, or return type of a function; set by checkSemantics
+};
+
+// One scope: its entries in declaration order, indexed by an open-addressing
+// hash map from Symbol id to the latest entry with that name. Ids are
+// interned, so a probe compares integers and never touches the spelling.
+class SymbolTable {
+public:
+    Symbol name;                      // class or function, empty for the global scope
+    SymbolTable* parent;              // enclosing scope, null for the global scope
+    std::vector<SymbolTable*> bases;  // tables of the inherited classes
+
+    SymbolTable(Symbol name, SymbolTable* parent) : name(name), parent(parent) {}
+
+    // Append an entry and index it under its name. An earlier entry with the
+    // same name (an overload) stays reachable through overloaded.
+    SymbolEntry& insert(const SymbolEntry& entry);
+
+    // The latest entry with this name in this scope only, or null
+    SymbolEntry* find(Symbol name);
+    const SymbolEntry* find(Symbol name) const;
+
+    // Search this scope, then its base classes, then the enclosing scopes.
+    // If where is given it receives the table the entry was found in.
+    const SymbolEntry* lookup(Symbol name, const SymbolTable** where = nullptr) const;
+
+    // Search a class and the classes it inherits from, but not the global scope
+    const SymbolEntry* findMember(Symbol name, const SymbolTable** where = nullptr) const;
+
+    // The entry an overload chain continues with, or null at its end
+    SymbolEntry* previous(const SymbolEntry& entry) {
+        return entry.overloaded == SymbolEntry::none ? nullptr : &entries[entry.overloaded];
+    }
+    const SymbolEntry* previous(const SymbolEntry& entry) const {
+        return entry.overloaded == SymbolEntry::none ? nullptr : &entries[entry.overloaded];
+    }
+
+    const std::vector<SymbolEntry>& all() const { return entries; }
+    SymbolEntry& at(std::size_t index) { return entries[index]; }
+    std::size_t size() const { return entries.size(); }
+
+private:
+    std::vector<SymbolEntry> entries;
+    std::vector<std::uint32_t> slots;  // entry index + 1, 0 if empty; power-of-two size
+
+    std::uint32_t indexOf(Symbol name) const;
+    const SymbolEntry* findInBases(Symbol name, const SymbolTable** where) const;
+    void grow();
+};
+
+// Owns every scope of a compilation. push() creates a table nested in the
+// current one and makes it current, pop() goes back to the parent and
+// reopen() makes an existing table current again, all in O(1). Tables stay
+// alive after being popped so later passes can look names up in them.
+class SymbolTables {
+public:
+    SymbolTables() { clear(); }
+
+    SymbolTables(const SymbolTables&) = delete;
+    SymbolTables& operator=(const SymbolTables&) = delete;
+
+    SymbolTable& global() { return tables.front(); }
+    const SymbolTable& global() const { return tables.front(); }
+    SymbolTable& current() { return *scope; }
+
+    SymbolTable& push(Symbol name);
+    void pop() { scope = scope->parent; }
+    void reopen(SymbolTable& table) { scope = &table; }
+
+    // Tables and entries over all scopes
+    std::size_t tableCount() const { return tables.size(); }
+    std::size_t symbolCount() const;
+
+    // Drop every table but an empty global one
+    void clear();
+
+private:
+    std::deque<SymbolTable> tables;  // stable addresses; the global table first
+    SymbolTable* scope = nullptr;
+};
+
+// Record the classes, attributes, functions, parameters, locals and
+// program variables of the program rooted at root. Member function bodies
+// given in an implementation are attached to the declaration in their
+// class. Multiply declared names, implementations of unknown classes or
+// members, undefined member functions, unknown or circular base classes
+// are reported as errors; overloads and shadowed members as warnings.
+void buildSymbolTables(ASTNode* root, const ASTContext& context, SymbolTables& tables, std::vector<Diagnostic>& diagnostics);
+
+// Write the tables in the nested layout of the .outsymboltables files
+bool writeSymbolTables(const SymbolTables& tables, const ASTContext& context, const std::string& path);
+
+#endif // SYMBOL_TABLE_H
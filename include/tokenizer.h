@@ -4,19 +4,23 @@
 #include <string>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <regex>
 #include <fstream>
 #include <iostream>
 using std::string;
 using std::vector;
 using std::size_t;
+using std::uint32_t;
 
 namespace token {
 
-// A simple Token structure.
+// A simple Token structure. offset is the position of the token's first
+// character in the source, counted in bytes.
 struct Token {
     string type;
     string value;
+    uint32_t offset = 0;
 };
 
 // Lexeme holds a token and the number of characters consumed.
@@ -69,6 +73,7 @@ private:
     string outputErrorsFileName;
     string outputTokensFileName;
     State state;
+    size_t position = 0;  // bytes consumed so far
 };
 
 } // namespace token
@@ -0,0 +1,72 @@
+#ifndef TYPE_TABLE_H
+#define TYPE_TABLE_H
+
+#include "ast.h"
+#include "ast_context.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TypeKind : std::uint8_t { None, Error, Void, Int, Float, Class, Array };
+
+// Interns every type of a compilation under a 32-bit TypeId, so two types
+// are equal exactly when their ids are. The built-in types have fixed ids; a
+// class type is keyed by the class name, and an array type by its element
+// type and size, one dimension at a time: int[5][3] is an array of 5
+// arrays of 3 ints, and indexing it once gives int[3]. A size of 0 stands
+// for an unsized dimension, [].
+//
+// Lookups go through an open-addressing map from (kind, operand, size) to
+// id. Nothing is added after the declarations are read, so the table can
+// then be shared by threads without locking.
+class TypeTable {
+public:
+    static constexpr TypeId none = 0;  // an expression not checked yet
+    static constexpr TypeId error = 1;  // absorbs further errors about the same expression
+    static constexpr TypeId voidType = 2;
+    static constexpr TypeId intType = 3;
+    static constexpr TypeId floatType = 4;
+
+    explicit TypeTable(const ASTContext& context);
+
+    TypeId classType(Symbol name);
+    TypeId arrayOf(TypeId element, std::uint32_t size);
+
+    // The type a Type node spells, with its ARRAYSIZES
+    TypeId fromNode(const Type& node);
+
+    TypeKind kind(TypeId type) const { return types[type].kind; }
+    bool isArray(TypeId type) const { return types[type].kind == TypeKind::Array; }
+    bool isNumeric(TypeId type) const { return type == intType || type == floatType; }
+    Symbol className(TypeId type) const { return Symbol{types[type].operand}; }
+    TypeId element(TypeId type) const { return types[type].operand; }
+    std::uint32_t arraySize(TypeId type) const { return types[type].size; }
+
+    // Whether a value of type value can be passed where target is expected:
+    // equal types, or arrays of the same rank whose element types match
+    // where the target leaves sizes unspecified
+    bool accepts(TypeId target, TypeId value) const;
+
+    // As the type is written in source, such as QUADRATIC or int[7][]
+    std::string spelling(TypeId type) const;
+
+    std::size_t size() const { return types.size(); }
+
+private:
+    struct Info {
+        TypeKind kind;
+        std::uint32_t operand;  // class name or element type
+        std::uint32_t size;     // array size, 0 if unsized
+    };
+
+    const ASTContext& context;
+    std::vector<Info> types;           // indexed by TypeId
+    std::vector<std::uint32_t> slots;  // TypeId, 0 if empty; power-of-two size
+    Symbol intName, floatName, voidName;
+
+    TypeId intern(TypeKind kind, std::uint32_t operand, std::uint32_t size);
+    void grow();
+};
+
+#endif // TYPE_TABLE_H
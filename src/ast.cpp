@@ -1,157 +1,191 @@
 #include "../include/ast.h"
-#include <iostream>
-#include <fstream>
+#include "../include/ast_context.h"
+#include "../include/ast_walker.h"
+#include "../include/output_buffer.h"
 
-class ASTPrintVisitor : public ASTVisitor {
+class ASTPrinter : public ASTWalker<ASTPrinter> {
 public:
-    std::ofstream out;
-    int indentLevel = 0;
+    using ASTWalker<ASTPrinter>::enter;
+    using ASTWalker<ASTPrinter>::leave;
 
-    ASTPrintVisitor(const std::string& outputFile) {
-        out.open(outputFile);
-    }
+    OutputBuffer out;  // the whole listing, written in one call at the end
+    const ASTContext& context;  // resolves interned names
+    int indentLevel = 0;
 
-    ~ASTPrintVisitor() {
-        out.close();
-    }
+    ASTPrinter(const ASTContext& context) : context(context) {}
 
     void indent() {
-        for (int i = 0; i < indentLevel; ++i) {
-            out << "  ";
-        }
+        out.indent(indentLevel);
     }
 
-    void visit(Program& node) override {
+    // Nodes with children print a line and indent what follows; leave()
+    // undoes the indentation once the children are done
+
+    bool enter(Program&) {
         out << "Program\n";
         ++indentLevel;
-        for (auto decl : node.declarations) {
-            decl->accept(*this);
-        }
-        --indentLevel;
+        return true;
     }
 
-    void visit(ClassDecl& node) override {
+    bool enter(ClassDecl& node) {
         indent();
-        out << "ClassDecl: " << node.name << "\n";
+        out << "ClassDecl: " << context.spelling(node.name) << "\n";
         ++indentLevel;
-        for (auto member : node.members) {
-            member->accept(*this);
-        }
-        --indentLevel;
+        return true;
     }
 
-    void visit(FuncDecl& node) override {
+    bool enter(ImplDecl& node) {
         indent();
-        out << "FuncDecl: " << node.name << "\n";
+        out << "ImplDecl: " << context.spelling(node.name) << "\n";
         ++indentLevel;
-        for (auto param : node.params) {
-            param->accept(*this);
-        }
-        node.returnType->accept(*this);
-        node.body->accept(*this);
-        --indentLevel;
+        return true;
     }
 
-    void visit(VarDecl& node) override {
+    bool enter(FuncDecl& node) {
         indent();
-        out << "VarDecl: " << node.name << "\n";
+        out << "FuncDecl: " << context.spelling(node.name) << "\n";
         ++indentLevel;
-        node.type->accept(*this);
-        --indentLevel;
+        return true;
     }
 
-    void visit(Type& node) override {
+    bool enter(VarDecl& node) {
         indent();
-        out << "Type: " << node.name << "\n";
+        out << "VarDecl: " << context.spelling(node.name) << "\n";
+        ++indentLevel;
+        return true;
     }
 
-    void visit(Statement& node) override {}
-
-    void visit(IfStatement& node) override {
+    bool enter(IfStatement&) {
         indent();
         out << "IfStatement\n";
         ++indentLevel;
-        node.condition->accept(*this);
-        node.thenStmt->accept(*this);
-        if (node.elseStmt) {
-            node.elseStmt->accept(*this);
-        }
-        --indentLevel;
+        return true;
     }
 
-    void visit(WhileStatement& node) override {
+    bool enter(WhileStatement&) {
         indent();
         out << "WhileStatement\n";
         ++indentLevel;
-        node.condition->accept(*this);
-        node.body->accept(*this);
-        --indentLevel;
+        return true;
     }
 
-    void visit(ReturnStatement& node) override {
+    bool enter(ReturnStatement&) {
         indent();
         out << "ReturnStatement\n";
         ++indentLevel;
-        node.expression->accept(*this);
-        --indentLevel;
+        return true;
     }
 
-    void visit(AssignStatement& node) override {
+    bool enter(AssignStatement&) {
         indent();
         out << "AssignStatement\n";
         ++indentLevel;
-        node.lhs->accept(*this);
-        node.rhs->accept(*this);
-        --indentLevel;  
+        return true;
+    }
+
+    bool enter(BlockStatement&) {
+        indent();
+        out << "BlockStatement\n";
+        ++indentLevel;
+        return true;
     }
 
-    void visit(Expression& node) override {}
+    bool enter(CallStatement&) {
+        indent();
+        out << "CallStatement\n";
+        ++indentLevel;
+        return true;
+    }
 
-    void visit(BinaryExpression& node) override {
+    bool enter(BinaryExpression& node) {
         indent();
-        out << "BinaryExpression: " << node.op << "\n";
+        out << "BinaryExpression: " << spelling(node.op) << "\n";
         ++indentLevel;
-        node.left->accept(*this);
-        node.right->accept(*this);
-        --indentLevel;
+        return true;
     }
 
-    void visit(UnaryExpression& node) override {
-        indent();   
-        out << "UnaryExpression: " << node.op << "\n";
+    bool enter(UnaryExpression& node) {
+        indent();
+        out << "UnaryExpression: " << spelling(node.op) << "\n";
         ++indentLevel;
-        node.expr->accept(*this);
-        --indentLevel;
+        return true;
     }
 
-    void visit(CallExpression& node) override {
+    bool enter(CallExpression&) {
         indent();
-        out << "CallExpression\n";  
+        out << "CallExpression\n";
         ++indentLevel;
-        node.callee->accept(*this);
-        for (auto arg : node.args) {
-            arg->accept(*this);
+        return true;
+    }
+
+    bool enter(IndexExpression&) {
+        indent();
+        out << "IndexExpression\n";
+        ++indentLevel;
+        return true;
+    }
+
+    bool enter(MemberExpression& node) {
+        indent();
+        out << "MemberExpression: " << context.spelling(node.member) << "\n";
+        ++indentLevel;
+        return true;
+    }
+
+    void leave(Program&) { --indentLevel; }
+    void leave(ClassDecl&) { --indentLevel; }
+    void leave(ImplDecl&) { --indentLevel; }
+    void leave(FuncDecl&) { --indentLevel; }
+    void leave(VarDecl&) { --indentLevel; }
+    void leave(IfStatement&) { --indentLevel; }
+    void leave(WhileStatement&) { --indentLevel; }
+    void leave(ReturnStatement&) { --indentLevel; }
+    void leave(AssignStatement&) { --indentLevel; }
+    void leave(BlockStatement&) { --indentLevel; }
+    void leave(CallStatement&) { --indentLevel; }
+    void leave(BinaryExpression&) { --indentLevel; }
+    void leave(UnaryExpression&) { --indentLevel; }
+    void leave(CallExpression&) { --indentLevel; }
+    void leave(IndexExpression&) { --indentLevel; }
+    void leave(MemberExpression&) { --indentLevel; }
+
+    // Leaves
+
+    bool enter(Type& node) {
+        indent();
+        out << "Type: " << context.spelling(node.name);
+        for (std::uint32_t i = 0; i < node.dimCount; ++i) {
+            out << '[';
+            if (node.dims[i] != 0) {
+                out << node.dims[i];
+            }
+            out << ']';
         }
-        --indentLevel;
+        out << "\n";
+        return false;
     }
 
-    void visit(Identifier& node) override {
+    bool enter(Identifier& node) {
         indent();
-        out << "Identifier: " << node.name << "\n";  
+        out << "Identifier: " << context.spelling(node.name) << "\n";
+        return false;
     }
 
-    void visit(IntegerLiteral& node) override {
+    bool enter(IntegerLiteral& node) {
         indent();
         out << "IntegerLiteral: " << node.value << "\n";
+        return false;
     }
 
-    void visit(FloatLiteral& node) override {
-        indent(); 
+    bool enter(FloatLiteral& node) {
+        indent();
         out << "FloatLiteral: " << node.value << "\n";
+        return false;
     }
 };
 
-void printAST(ASTNode* root, const std::string& outputFile) {
-    ASTPrintVisitor visitor(outputFile);
-    root->accept(visitor);
+void printAST(ASTNode* root, const ASTContext& context, const std::string& outputFile) {
+    ASTPrinter printer(context);
+    printer.walk(root);
+    printer.out.writeTo(outputFile);
 }
@@ -1,4 +1,7 @@
 #include "../include/ast_builder.h"
+#include "../include/ast_walker.h"
+#include "../include/expr_table.h"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -55,6 +58,15 @@ public:
         return currentPos;
     }
     
+    const token::Token& at(size_t pos) const {
+        return tokens[pos];
+    }
+    
+    // Jump to an absolute token index, used when reparsing a single region
+    void seek(size_t pos) {
+        currentPos = std::min(pos, tokens.size());
+    }
+    
     bool atEnd() const {
         return currentPos >= tokens.size();
     }
@@ -80,19 +92,36 @@ private:
 // AST builder class that constructs an AST from a token stream
 class ASTBuilder {
 public:
-    ASTBuilder(const std::vector<token::Token>& tokens)
-        : tokens(tokens) {}
+    // With a table, identical expression subtrees are built only once
+    ASTBuilder(const std::vector<token::Token>& tokens, ASTContext& context, ExprTable* exprs = nullptr)
+        : tokens(tokens), context(context), exprs(exprs) {}
     
     ASTNode* buildAST() {
         return parseProgram();
     }
     
+    // Reparse only the part of an existing program touched by an edit that
+    // replaced tokens [editBegin, editEnd) with newLength tokens. Returns false,
+    // leaving the program untouched, if the edit is not confined to a single
+    // declaration or function body.
+    bool reparse(Program* program, size_t editBegin, size_t editEnd, size_t newLength);
+    
 private:
     TokenStream tokens;
+    ASTContext& context;  // owns every node the builder creates
+    ExprTable* exprs;     // hash-consing table, or null to build a plain tree
+    std::vector<ASTNode*> blockItems;  // children of the blocks being parsed, innermost last
+    std::vector<std::uint32_t> arraySizes;  // scratch for parseArraySizes
+    SourceSpan replacedSpan;           // span before the edit of the node a reparse replaced
+    ASTNode* replacement = nullptr;    // and the node put in its place
     
     // Parsing functions for each nonterminal in the grammar
     Program* parseProgram();
+    ASTNode* parseItem();
+    ASTNode* parseTypedDecl();
     ClassDecl* parseClassDecl();
+    ASTNode* parseClassMember(Visibility& visibility);
+    ImplDecl* parseImplDecl();
     FuncDecl* parseFuncDecl();
     VarDecl* parseVarDecl();
     Type* parseType();
@@ -102,85 +131,249 @@ private:
     ReturnStatement* parseReturnStatement();
     AssignStatement* parseAssignStatement();
     Expression* parseExpression();
+    Expression* parseArithExpression();
     Expression* parseTerm();
     Expression* parseFactor();
-    BinaryExpression* parseBinaryExpression(Expression* left, const std::string& op);
+    BinaryExpression* parseBinaryExpression(Expression* left, BinOp op);
     UnaryExpression* parseUnaryExpression();
-    CallExpression* parseCallExpression(Identifier* callee);
+    CallExpression* parseCallExpression(Expression* callee);
+    Expression* parsePostfix(Expression* expr, size_t startPos);
+    CallStatement* parseIOStatement();
     Identifier* parseIdentifier();
     IntegerLiteral* parseIntegerLiteral();
     FloatLiteral* parseFloatLiteral();
     
     // Helper functions
-    Statement* parseBlock();
+    BlockStatement* parseBlock();
+    BlockStatement* parseBody();
+    Statement* parseStatBlock();
     std::vector<VarDecl*> parseParams();
     std::vector<Expression*> parseExpressionList();
     bool isType();
+    void parseArraySizes(Type* type);
+    bool consumeBinOp(int precedence, BinOp& op);
+    
+    // Record the source span of tokens [begin, end), or [begin, current)
+    template <typename T>
+    T* located(T* node, size_t begin, size_t end);
+    template <typename T>
+    T* located(T* node, size_t begin) { return located(node, begin, tokens.position()); }
+    
+    // Expression node factories
+    Identifier* makeIdentifier(Symbol name);
+    Identifier* makeBase(Symbol name);
+    IntegerLiteral* makeInteger(int value);
+    FloatLiteral* makeFloat(float value);
+    BinaryExpression* makeBinary(BinOp op, Expression* left, Expression* right);
+    UnaryExpression* makeUnary(UnOp op, Expression* operand);
+    IndexExpression* makeIndex(Expression* base, Expression* index);
+    MemberExpression* makeMember(Expression* object, Symbol member);
+    
+    // Incremental reparsing helpers
+    bool reparseNested(ASTNode* node, size_t start, size_t editBegin, size_t editEnd, std::ptrdiff_t delta);
+    template <typename T>
+    void splice(T*& slot, T* node);
+};
+
+// Moves the spans of the nodes after a reparsed region by the change in its
+// length in bytes and stretches those of the nodes around it. The region
+// ended at byte end before the edit; its new nodes are skipped, and so is
+// everything before it.
+class SpanShifter : public ASTWalker<SpanShifter> {
+public:
+    SpanShifter(const ASTNode* region, std::uint32_t end, std::int64_t delta)
+        : region(region), end(end), delta(delta) {}
+
+    template <typename Node>
+    bool enter(Node& node) {
+        if (&node == region) {
+            return false;
+        }
+        SourceSpan& span = node.span;
+        if (span.length == 0) {
+            // Synthesized, or a constant shared by hash-consing
+            return true;
+        }
+        if (span.offset >= end) {
+            span.offset = static_cast<std::uint32_t>(span.offset + delta);
+        } else if (span.offset + span.length >= end) {
+            span.length = static_cast<std::uint32_t>(span.length + delta);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const ASTNode* region;
+    std::uint32_t end;
+    std::int64_t delta;
 };
 
+// True if the edit [editBegin, editEnd) lies inside the range, which is
+// relative to start. An insertion at the very end belongs to what follows.
+static bool encloses(const TokenRange& range, size_t start, size_t editBegin, size_t editEnd) {
+    return start + range.begin <= editBegin && editEnd <= start + range.end && editBegin < start + range.end;
+}
+
+// Find the range enclosing the edit in a list of ranges sorted by position
+static size_t findEnclosing(const std::vector<TokenRange>& ranges, size_t start, size_t editBegin, size_t editEnd) {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), editBegin,
+        [start](size_t pos, const TokenRange& range) { return pos < start + range.begin; });
+    if (it == ranges.begin()) {
+        return ranges.size();
+    }
+    size_t index = (it - ranges.begin()) - 1;
+    return encloses(ranges[index], start, editBegin, editEnd) ? index : ranges.size();
+}
+
+static void shiftRanges(std::vector<TokenRange>& ranges, size_t from, std::ptrdiff_t delta) {
+    for (size_t i = from; i < ranges.size(); ++i) {
+        ranges[i].begin += delta;
+        ranges[i].end += delta;
+    }
+}
+
+bool ASTBuilder::reparse(Program* program, size_t editBegin, size_t editEnd, size_t newLength) {
+    std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(newLength) - static_cast<std::ptrdiff_t>(editEnd - editBegin);
+    
+    // The region reparsed shares no expressions with the rest of the tree
+    if (exprs) {
+        exprs->startBody();
+    }
+    
+    size_t index = findEnclosing(program->ranges, 0, editBegin, editEnd);
+    if (index == program->ranges.size()) {
+        return false;
+    }
+    
+    TokenRange& range = program->ranges[index];
+    if (!reparseNested(program->declarations[index], range.begin, editBegin, editEnd, delta)) {
+        tokens.seek(range.begin);
+        ASTNode* decl = parseItem();
+        if (!decl || tokens.position() != range.end + delta) {
+            return false;
+        }
+        splice(program->declarations[index], decl);
+    }
+    
+    range.end += delta;
+    shiftRanges(program->ranges, index + 1, delta);
+    
+    // The text after the region moved with its end
+    if (replacement && replacedSpan.length != 0 && replacement->span.length != 0) {
+        std::uint32_t end = replacedSpan.offset + replacedSpan.length;
+        std::int64_t moved = static_cast<std::int64_t>(replacement->span.offset) + replacement->span.length - end;
+        if (moved != 0) {
+            SpanShifter(replacement, end, moved).walk(program);
+        }
+    }
+    return true;
+}
+
+// Put node in place of the one in slot, remembering where that one was
+template <typename T>
+void ASTBuilder::splice(T*& slot, T* node) {
+    replacedSpan = slot ? slot->span : SourceSpan{};
+    replacement = node;
+    slot = node;
+}
+
+// Try to confine the reparse to a function body, a class member or a
+// function of an implementation in node, which starts at the absolute
+// token index start.
+bool ASTBuilder::reparseNested(ASTNode* node, size_t start, size_t editBegin, size_t editEnd, std::ptrdiff_t delta) {
+    if (node->kind == NodeKind::FuncDecl) {
+        FuncDecl* func = static_cast<FuncDecl*>(node);
+        TokenRange& body = func->bodyRange;
+        // The braces themselves must be untouched
+        if (body.end == 0 || editBegin <= start + body.begin || editEnd >= start + body.end) {
+            return false;
+        }
+        
+        tokens.seek(start + body.begin);
+        Statement* stmt = parseBody();
+        if (tokens.position() != start + body.end + delta) {
+            return false;
+        }
+        splice(func->body, stmt);
+        body.end += delta;
+        return true;
+    }
+    
+    if (node->kind == NodeKind::ClassDecl) {
+        ClassDecl* cls = static_cast<ClassDecl*>(node);
+        size_t index = findEnclosing(cls->memberRanges, start, editBegin, editEnd);
+        if (index == cls->memberRanges.size()) {
+            return false;
+        }
+        
+        TokenRange& range = cls->memberRanges[index];
+        if (!reparseNested(cls->members[index], start + range.begin, editBegin, editEnd, delta)) {
+            tokens.seek(start + range.begin);
+            Visibility visibility;
+            ASTNode* member = parseClassMember(visibility);
+            if (!member || tokens.position() != start + range.end + delta) {
+                return false;
+            }
+            splice(cls->members[index], member);
+            cls->memberVisibility[index] = visibility;
+        }
+        range.end += delta;
+        shiftRanges(cls->memberRanges, index + 1, delta);
+        return true;
+    }
+    
+    if (node->kind == NodeKind::ImplDecl) {
+        ImplDecl* impl = static_cast<ImplDecl*>(node);
+        size_t index = findEnclosing(impl->functionRanges, start, editBegin, editEnd);
+        if (index == impl->functionRanges.size()) {
+            return false;
+        }
+        
+        TokenRange& range = impl->functionRanges[index];
+        if (!reparseNested(impl->functions[index], start + range.begin, editBegin, editEnd, delta)) {
+            tokens.seek(start + range.begin);
+            if (!tokens.match("function") && !tokens.match("constructor")) {
+                return false;
+            }
+            FuncDecl* func = parseFuncDecl();
+            if (tokens.position() != start + range.end + delta) {
+                return false;
+            }
+            splice(impl->functions[index], func);
+        }
+        range.end += delta;
+        shiftRanges(impl->functionRanges, index + 1, delta);
+        return true;
+    }
+    
+    return false;
+}
+
 Program* ASTBuilder::parseProgram() {
+    size_t programPos = tokens.position();
     std::vector<ASTNode*> declarations;
+    std::vector<TokenRange> ranges;
     
     while (!tokens.atEnd()) {
-        if (tokens.match("class")) {
-            declarations.push_back(parseClassDecl());
-        } 
-        else if (tokens.match("function")) {
-            declarations.push_back(parseFuncDecl());
-        }
-        else if (tokens.match("constructor")) {
-            declarations.push_back(parseFuncDecl());
-        }
-        else if (isType()) {
-            // Check if this is a function declaration (type followed by id and '(')
-            size_t startPos = tokens.position();
-            Type* type = parseType();
-            
-            if (tokens.match("id")) {
-                std::string name = tokens.current().value;
-                tokens.next();
-                
-                if (tokens.match("(")) {
-                    // This is a function declaration
-                    tokens.next(); // consume '('
-                    std::vector<VarDecl*> params = parseParams();
-                    tokens.expect(")");
-                    
-                    // Function body
-                    Statement* body = nullptr;
-                    if (tokens.match("{")) {
-                        body = parseBlock();
-                    } else {
-                        tokens.expect(";");
-                    }
-                    
-                    declarations.push_back(new FuncDecl(name, params, type, body));
-                } else {
-                    // This is a variable declaration
-                    // Handle array dimensions if any
-                    while (tokens.consume("[")) {
-                        if (tokens.match("intlit") || tokens.match("integer")) {
-                            tokens.next();
-                        }
-                        tokens.expect("]");
-                    }
-                    
-                    tokens.expect(";");
-                    declarations.push_back(new VarDecl(name, type));
-                }
-            } else {
-                std::cerr << "Error: Expected identifier after type at position " << tokens.position() << std::endl;
-                // Skip to semicolon
-                while (!tokens.atEnd() && !tokens.match(";")) {
-                    tokens.next();
-                }
-                if (!tokens.atEnd()) tokens.next(); // Skip semicolon
+        size_t start = tokens.position();
+        
+        if (tokens.match("class") || tokens.match("implementation") || tokens.match("function") ||
+            tokens.match("constructor") || isType()) {
+            ASTNode* decl = parseItem();
+            if (decl) {
+                declarations.push_back(decl);
+                ranges.push_back({start, tokens.position()});
             }
         } 
         else if (tokens.match("program")) {
             // Parse program block
             tokens.expect("program");
             tokens.expect("{");
+            if (exprs) {
+                exprs->startBody();
+            }
             
             // Parse statements and variable declarations
             while (!tokens.match("}")) {
@@ -189,14 +382,17 @@ Program* ASTBuilder::parseProgram() {
                     break;
                 }
                 
-                if (isType()) {
+                start = tokens.position();
+                if (isType() || tokens.match("local")) {
                     // Variable declaration
                     declarations.push_back(parseVarDecl());
+                    ranges.push_back({start, tokens.position()});
                 } else {
                     // Statement
                     Statement* stmt = parseStatement();
                     if (stmt) {
                         declarations.push_back(stmt);
+                        ranges.push_back({start, tokens.position()});
                     } else {
                         // Skip unexpected token
                         std::cerr << "Skipping unexpected token in program block: " << tokens.current().type 
@@ -216,15 +412,105 @@ Program* ASTBuilder::parseProgram() {
         }
     }
     
-    return new Program(declarations);
+    Program* program = located(context.make<Program>(declarations), programPos);
+    program->ranges = std::move(ranges);
+    return program;
+}
+
+// Parse one entry of Program::declarations. Program block locals and
+// statements are accepted too so that any recorded range can be reparsed
+// on its own.
+ASTNode* ASTBuilder::parseItem() {
+    if (tokens.match("class")) {
+        return parseClassDecl();
+    } else if (tokens.match("implementation")) {
+        return parseImplDecl();
+    } else if (tokens.match("function") || tokens.match("constructor")) {
+        return parseFuncDecl();
+    } else if (isType()) {
+        return parseTypedDecl();
+    } else if (tokens.match("local")) {
+        return parseVarDecl();
+    } else {
+        return parseStatement();
+    }
 }
 
+// A declaration starting with its type, reached only when isType() holds
+ASTNode* ASTBuilder::parseTypedDecl() {
+    // Check if this is a function declaration (type followed by id and '(')
+    size_t startPos = tokens.position();
+    Type* type = parseType();
+    
+    if (tokens.match("id")) {
+        std::string name = tokens.current().value;
+        tokens.next();
+        
+        if (tokens.match("(")) {
+            // This is a function declaration
+            tokens.next(); // consume '('
+            std::vector<VarDecl*> params = parseParams();
+            tokens.expect(")");
+            
+            // Function body
+            Statement* body = nullptr;
+            TokenRange bodyRange;
+            if (tokens.match("{")) {
+                bodyRange.begin = tokens.position() - startPos;
+                body = parseBody();
+                bodyRange.end = tokens.position() - startPos;
+            } else {
+                tokens.expect(";");
+            }
+            
+            FuncDecl* func = located(context.make<FuncDecl>(context.intern(name), params, type, body), startPos);
+            func->bodyRange = bodyRange;
+            return func;
+        } else {
+            // This is a variable declaration
+            parseArraySizes(type);
+            
+            tokens.expect(";");
+            return located(context.make<VarDecl>(context.intern(name), type), startPos);
+        }
+    } else {
+        std::cerr << "Error: Expected identifier after type at position " << tokens.position() << std::endl;
+        // Skip to semicolon
+        while (!tokens.atEnd() && !tokens.match(";")) {
+            tokens.next();
+        }
+        if (!tokens.atEnd()) tokens.next(); // Skip semicolon
+        return nullptr;
+    }
+}
+
+// The float keyword, not a float literal, which has the same token type
 bool ASTBuilder::isType() {
-    return tokens.match("int") || tokens.match("float") || 
-           (tokens.match("id") && (tokens.peek().type == "id" || tokens.peek().type == ":"));
+    return tokens.match("int") || (tokens.match("float") && tokens.current().type == "reserved") ||
+           (tokens.match("id") && tokens.peek().type == "id");
+}
+
+// ARRAYSIZES: zero or more [intLit] or [] after a declared name or type
+void ASTBuilder::parseArraySizes(Type* type) {
+    arraySizes.clear();
+    while (tokens.consume("[")) {
+        std::uint32_t size = 0;
+        if (tokens.match("intlit") || tokens.match("integer")) {
+            size = static_cast<std::uint32_t>(std::stoul(tokens.current().value));
+            tokens.next();
+        }
+        tokens.expect("]");
+        arraySizes.push_back(size);
+    }
+    
+    if (type && !arraySizes.empty()) {
+        type->dims = context.makeArray(arraySizes.data(), arraySizes.size());
+        type->dimCount = static_cast<std::uint32_t>(arraySizes.size());
+    }
 }
 
 ClassDecl* ASTBuilder::parseClassDecl() {
+    size_t startPos = tokens.position();
     tokens.expect("class");
     
     // Parse class name
@@ -234,9 +520,12 @@ ClassDecl* ASTBuilder::parseClassDecl() {
         tokens.next();
     }
     
-    // Skip "isa" inheritance
+    // Inherited classes, kept as the types they name
+    std::vector<Type*> parents;
     if (tokens.consume("isa")) {
         while (tokens.match("id")) {
+            size_t parentPos = tokens.position();
+            parents.push_back(located(context.make<Type>(context.intern(tokens.current().value)), parentPos, parentPos + 1));
             tokens.next();
             if (!tokens.consume(",")) {
                 break;
@@ -248,26 +537,93 @@ ClassDecl* ASTBuilder::parseClassDecl() {
     
     // Parse class members
     std::vector<ASTNode*> members;
+    std::vector<TokenRange> memberRanges;
+    std::vector<Visibility> memberVisibility;
+    while (!tokens.match("}")) {
+        if (tokens.atEnd()) {
+            std::cerr << "Error: Unexpected end of input while parsing class" << std::endl;
+            break;
+        }
+        
+        size_t memberPos = tokens.position();
+        Visibility visibility;
+        ASTNode* member = parseClassMember(visibility);
+        if (member) {
+            members.push_back(member);
+            memberRanges.push_back({memberPos - startPos, tokens.position() - startPos});
+            memberVisibility.push_back(visibility);
+        }
+    }
+    
+    tokens.expect("}");
+    tokens.consume(";");
+    
+    ClassDecl* cls = located(context.make<ClassDecl>(context.intern(name), members), startPos);
+    cls->parents = std::move(parents);
+    cls->memberRanges = std::move(memberRanges);
+    cls->memberVisibility = std::move(memberVisibility);
+    return cls;
+}
+
+ASTNode* ASTBuilder::parseClassMember(Visibility& visibility) {
+    visibility = Visibility::Public;
+    if (tokens.consume("private")) {
+        visibility = Visibility::Private;
+    } else {
+        tokens.consume("public");
+    }
+    
+    if (tokens.match("function") || tokens.match("constructor")) {
+        return parseFuncDecl();
+    } else if (isType() || tokens.match("attribute")) {
+        return parseVarDecl();
+    } else {
+        // Skip unknown token
+        std::cerr << "Skipping unexpected token in class: " << tokens.current().type 
+                  << " (" << tokens.current().value << ")" << std::endl;
+        tokens.next();
+        return nullptr;
+    }
+}
+
+// IMPLDEF: implementation id { FUNCDEF* }
+ImplDecl* ASTBuilder::parseImplDecl() {
+    size_t startPos = tokens.position();
+    tokens.expect("implementation");
+    
+    std::string name;
+    if (tokens.match("id")) {
+        name = tokens.current().value;
+        tokens.next();
+    }
+    
+    tokens.expect("{");
+    
+    std::vector<FuncDecl*> functions;
+    std::vector<TokenRange> functionRanges;
     while (!tokens.match("}")) {
-        if (tokens.match("public") || tokens.match("private")) {
-            tokens.next(); // Skip visibility modifier
+        if (tokens.atEnd()) {
+            std::cerr << "Error: Unexpected end of input while parsing implementation" << std::endl;
+            break;
         }
         
         if (tokens.match("function") || tokens.match("constructor")) {
-            members.push_back(parseFuncDecl());
-        } else if (isType() || tokens.match("attribute")) {
-            members.push_back(parseVarDecl());
+            size_t functionPos = tokens.position();
+            functions.push_back(parseFuncDecl());
+            functionRanges.push_back({functionPos - startPos, tokens.position() - startPos});
         } else {
-            // Skip unknown token
-            std::cerr << "Skipping unexpected token in class: " << tokens.current().type 
+            std::cerr << "Skipping unexpected token in implementation: " << tokens.current().type
                       << " (" << tokens.current().value << ")" << std::endl;
             tokens.next();
         }
     }
     
     tokens.expect("}");
+    tokens.consume(";");
     
-    return new ClassDecl(name, members);
+    ImplDecl* impl = located(context.make<ImplDecl>(context.intern(name), functions), startPos);
+    impl->functionRanges = std::move(functionRanges);
+    return impl;
 }
 
 FuncDecl* ASTBuilder::parseFuncDecl() {
@@ -275,6 +631,8 @@ FuncDecl* ASTBuilder::parseFuncDecl() {
     std::vector<VarDecl*> params;
     Type* returnType = nullptr;
     Statement* body = nullptr;
+    TokenRange bodyRange;
+    size_t startPos = tokens.position();
     
     // Function head
     if (tokens.consume("function")) {
@@ -292,12 +650,14 @@ FuncDecl* ASTBuilder::parseFuncDecl() {
             returnType = parseType();
         } else {
             // Default to void if not specified
-            returnType = new Type("void");
+            returnType = context.make<Type>(context.intern("void"));
         }
         
         // Function body
         if (tokens.match("{")) {
-            body = parseBlock();
+            bodyRange.begin = tokens.position() - startPos;
+            body = parseBody();
+            bodyRange.end = tokens.position() - startPos;
         } else {
             tokens.expect(";");
         }
@@ -309,17 +669,21 @@ FuncDecl* ASTBuilder::parseFuncDecl() {
         tokens.expect(")");
         
         // Constructor doesn't have a return type
-        returnType = new Type("void");
+        returnType = context.make<Type>(context.intern("void"));
         
         // Function body
         if (tokens.match("{")) {
-            body = parseBlock();
+            bodyRange.begin = tokens.position() - startPos;
+            body = parseBody();
+            bodyRange.end = tokens.position() - startPos;
         } else {
             tokens.expect(";");
         }
     }
     
-    return new FuncDecl(name, params, returnType, body);
+    FuncDecl* func = located(context.make<FuncDecl>(context.intern(name), params, returnType, body), startPos);
+    func->bodyRange = bodyRange;
+    return func;
 }
 
 std::vector<VarDecl*> ASTBuilder::parseParams() {
@@ -327,6 +691,12 @@ std::vector<VarDecl*> ASTBuilder::parseParams() {
     
     if (!tokens.match(")")) {  // Check if parameter list is not empty
         do {
+            // A trailing separator may come right before the parenthesis
+            if (tokens.match(")")) {
+                break;
+            }
+            
+            size_t paramPos = tokens.position();
             if (isType()) {
                 // Parameter with type-first syntax
                 Type* type = parseType();
@@ -339,15 +709,9 @@ std::vector<VarDecl*> ASTBuilder::parseParams() {
                     paramName = "unnamed";
                 }
                 
-                // Handle array dimensions if any
-                while (tokens.consume("[")) {
-                    if (tokens.match("intlit") || tokens.match("integer")) {
-                        tokens.next();
-                    }
-                    tokens.expect("]");
-                }
+                parseArraySizes(type);
                 
-                params.push_back(new VarDecl(paramName, type));
+                params.push_back(located(context.make<VarDecl>(context.intern(paramName), type), paramPos));
             } 
             else if (tokens.match("id")) {
                 // Parameter with name-first syntax (id : type)
@@ -357,32 +721,20 @@ std::vector<VarDecl*> ASTBuilder::parseParams() {
                 tokens.expect(":");
                 Type* type = parseType();
                 
-                // Handle array dimensions if any
-                while (tokens.consume("[")) {
-                    if (tokens.match("intlit") || tokens.match("integer")) {
-                        tokens.next();
-                    }
-                    tokens.expect("]");
-                }
+                parseArraySizes(type);
                 
-                params.push_back(new VarDecl(paramName, type));
-            }
-            
-            // Handle parameter separator
-            if (tokens.consume(";")) {
-                // Semicolon separates parameter groups - continue parsing
-                continue;
+                params.push_back(located(context.make<VarDecl>(context.intern(paramName), type), paramPos));
             }
-            
-        } while (tokens.consume(","));  // Continue if we see a comma
+        } while (tokens.consume(",") || tokens.consume(";"));  // Commas, or semicolons between groups
     }
     
     return params;
 }
 
 VarDecl* ASTBuilder::parseVarDecl() {
-    if (tokens.consume("attribute")) {
-        // Skip attribute keyword
+    size_t startPos = tokens.position();
+    if (tokens.consume("attribute") || tokens.consume("local")) {
+        // The keyword only says where the variable lives
     }
     
     std::string name;
@@ -407,20 +759,15 @@ VarDecl* ASTBuilder::parseVarDecl() {
         }
     }
     
-    // Skip array sizes
-    while (tokens.consume("[")) {
-        if (tokens.match("intlit") || tokens.match("integer")) {
-            tokens.next();
-        }
-        tokens.expect("]");
-    }
+    parseArraySizes(type);
     
     tokens.expect(";");
     
-    return new VarDecl(name, type);
+    return located(context.make<VarDecl>(context.intern(name), type), startPos);
 }
 
 Type* ASTBuilder::parseType() {
+    size_t startPos = tokens.position();
     std::string typeName;
     
     if (tokens.match("int")) {
@@ -441,7 +788,7 @@ Type* ASTBuilder::parseType() {
         std::cerr << "Warning: Unknown type encountered, defaulting to 'unknown'" << std::endl;
     }
     
-    return new Type(typeName);
+    return located(context.make<Type>(context.intern(typeName)), startPos);
 }
 
 Statement* ASTBuilder::parseStatement() {
@@ -451,37 +798,28 @@ Statement* ASTBuilder::parseStatement() {
         return parseWhileStatement();
     } else if (tokens.match("return")) {
         return parseReturnStatement();
+    } else if (tokens.match("read") || tokens.match("write") || tokens.match("put")) {
+        return parseIOStatement();
     } else if (tokens.match("id") || tokens.match("self")) {
-        std::string idName = tokens.current().value;
+        // FUNCALLORASSIGN: a variable or call chain, then := for an assignment
+        size_t startPos = tokens.position();
+        Identifier* base = located(makeBase(context.intern(tokens.current().value)), startPos, startPos + 1);
         tokens.next();
+        Expression* target = parsePostfix(base, startPos);
         
-        // Check if this is an assignment statement
-        if (tokens.match("=")) {
-            tokens.next();
+        if (tokens.consume(":=") || tokens.consume("=")) {
             Expression* rhs = parseExpression();
             tokens.expect(";");
-            return new AssignStatement(new Identifier(idName), rhs);
-        } 
-        // Check if this is a function call
-        else if (tokens.match("(")) {
-            // Backtrack to re-parse this as an expression
-            tokens.consume("("); // Skip the open parenthesis
-            
-            std::vector<Expression*> args;
-            if (!tokens.match(")")) {
-                args = parseExpressionList();
-            }
-            
-            tokens.expect(")");
+            return located(context.make<AssignStatement>(target, rhs), startPos);
+        }
+        if (target->kind == NodeKind::CallExpression) {
             tokens.expect(";");
-            
-            // Create a call expression statement
-            CallExpression* call = new CallExpression(new Identifier(idName), args);
-            // This is a hack - we should have a proper ExpressionStatement class
-            return new AssignStatement(new Identifier("_unused"), call);
+            return located(context.make<CallStatement>(static_cast<CallExpression*>(target)), startPos);
         }
         
         // If not an assignment or call, skip to semicolon
+        std::cerr << "Error: Expected := or a call but found " << tokens.current().type
+                  << " (" << tokens.current().value << ") at position " << tokens.position() << std::endl;
         while (!tokens.atEnd() && !tokens.match(";")) {
             tokens.next();
         }
@@ -489,10 +827,11 @@ Statement* ASTBuilder::parseStatement() {
         return nullptr;
     } else if (tokens.match("{")) {
         return parseBlock();
-    } else if (isType()) {
-        // Handle variable declarations 
-        parseVarDecl(); // Process the variable declaration
-        return nullptr; // But return nullptr since VarDecl is not a Statement
+    } else if (isType() || tokens.match("local")) {
+        // A VarDecl is not a Statement; keep it as a block of its own
+        size_t startPos = tokens.position();
+        ASTNode* decl = parseVarDecl();
+        return located(context.make<BlockStatement>(context.makeArray(&decl, 1), 1), startPos);
     } else if (!tokens.atEnd()) {
         // Skip unknown token
         std::cerr << "Skipping unexpected token in statement: " << tokens.current().type 
@@ -504,37 +843,59 @@ Statement* ASTBuilder::parseStatement() {
     }
 }
 
-Statement* ASTBuilder::parseBlock() {
+// The block of a function, the unit expressions are shared within
+BlockStatement* ASTBuilder::parseBody() {
+    if (exprs) {
+        exprs->startBody();
+    }
+    return parseBlock();
+}
+
+BlockStatement* ASTBuilder::parseBlock() {
+    size_t startPos = tokens.position();
     tokens.expect("{");
     
+    // Children are gathered on a stack shared by all nesting levels; those
+    // below base belong to the enclosing blocks
+    size_t base = blockItems.size();
+    
     // Parse statements until we hit the closing brace
-    Statement* lastStmt = nullptr;
     while (!tokens.match("}")) {
         if (tokens.atEnd()) {
             std::cerr << "Error: Unexpected end of input while parsing block" << std::endl;
             break;
         }
         
-        if (isType()) {
+        if (isType() || tokens.match("local")) {
             // Variable declaration
-            parseVarDecl();
+            blockItems.push_back(parseVarDecl());
         } else {
             // Regular statement
             Statement* stmt = parseStatement();
             if (stmt) {
-                lastStmt = stmt;
+                blockItems.push_back(stmt);
             }
         }
     }
     
     tokens.expect("}");
     
-    // For simplicity, we just return the last statement
-    // A more complete implementation would collect all statements in a block
-    return lastStmt;
+    std::uint32_t count = static_cast<std::uint32_t>(blockItems.size() - base);
+    ASTNode** children = context.makeArray(blockItems.data() + base, count);
+    blockItems.resize(base);
+    return located(context.make<BlockStatement>(children, count), startPos);
+}
+
+// STATBLOCK may be empty, as in "else ;", which leaves the branch missing
+Statement* ASTBuilder::parseStatBlock() {
+    if (tokens.match(";") || tokens.match("else")) {
+        return nullptr;
+    }
+    return parseStatement();
 }
 
 IfStatement* ASTBuilder::parseIfStatement() {
+    size_t startPos = tokens.position();
     tokens.expect("if");
     tokens.expect("(");
     
@@ -543,19 +904,20 @@ IfStatement* ASTBuilder::parseIfStatement() {
     tokens.expect(")");
     tokens.expect("then");
     
-    Statement* thenStmt = parseStatement();
+    Statement* thenStmt = parseStatBlock();
     
     Statement* elseStmt = nullptr;
     if (tokens.consume("else")) {
-        elseStmt = parseStatement();
+        elseStmt = parseStatBlock();
     }
     
     tokens.expect(";");
     
-    return new IfStatement(condition, thenStmt, elseStmt);
+    return located(context.make<IfStatement>(condition, thenStmt, elseStmt), startPos);
 }
 
 WhileStatement* ASTBuilder::parseWhileStatement() {
+    size_t startPos = tokens.position();
     tokens.expect("while");
     tokens.expect("(");
     
@@ -563,14 +925,15 @@ WhileStatement* ASTBuilder::parseWhileStatement() {
     
     tokens.expect(")");
     
-    Statement* body = parseStatement();
+    Statement* body = parseStatBlock();
     
     tokens.expect(";");
     
-    return new WhileStatement(condition, body);
+    return located(context.make<WhileStatement>(condition, body), startPos);
 }
 
 ReturnStatement* ASTBuilder::parseReturnStatement() {
+    size_t startPos = tokens.position();
     tokens.expect("return");
     tokens.expect("(");
     
@@ -579,10 +942,11 @@ ReturnStatement* ASTBuilder::parseReturnStatement() {
     tokens.expect(")");
     tokens.expect(";");
     
-    return new ReturnStatement(expr);
+    return located(context.make<ReturnStatement>(expr), startPos);
 }
 
 AssignStatement* ASTBuilder::parseAssignStatement() {
+    size_t startPos = tokens.position();
     Identifier* lhs = parseIdentifier();
     
     tokens.expect("=");
@@ -591,102 +955,112 @@ AssignStatement* ASTBuilder::parseAssignStatement() {
     
     tokens.expect(";");
     
-    return new AssignStatement(lhs, rhs);
+    return located(context.make<AssignStatement>(lhs, rhs), startPos);
+}
+
+// If the current token is a binary operator of the given precedence, store it
+// in op and consume it
+bool ASTBuilder::consumeBinOp(int precedence, BinOp& op) {
+    const token::Token& token = tokens.current();
+    if ((token.type == "operator" || token.type == "reserved") &&
+        toBinOp(token.value, op) && info(op).precedence == precedence) {
+        tokens.next();
+        return true;
+    }
+    return false;
 }
 
 Expression* ASTBuilder::parseExpression() {
+    size_t startPos = tokens.position();
+    // EXPR -> ARITHEXPR EXPR2, where EXPR2 is an optional relational operator
+    Expression* left = parseArithExpression();
+    
+    BinOp op;
+    if (consumeBinOp(info(BinOp::Eq).precedence, op)) {
+        Expression* right = parseArithExpression();
+        left = located(makeBinary(op, left, right), startPos);
+    }
+    
+    return left;
+}
+
+Expression* ASTBuilder::parseArithExpression() {
+    size_t startPos = tokens.position();
     // Parse the first term
     Expression* left = parseTerm();
     
-    // Look for binary operators
-    while (tokens.match("+") || tokens.match("-") || tokens.match("or")) {
-        std::string op = tokens.current().value;
-        tokens.next();
-        
+    // Look for additive operators
+    BinOp op;
+    while (consumeBinOp(info(BinOp::Add).precedence, op)) {
         Expression* right = parseTerm();
-        left = new BinaryExpression(op, left, right);
+        left = located(makeBinary(op, left, right), startPos);
     }
     
     return left;
 }
 
 Expression* ASTBuilder::parseTerm() {
+    size_t startPos = tokens.position();
     // Parse the first factor
     Expression* left = parseFactor();
     
     // Look for multiplicative operators
-    while (tokens.match("*") || tokens.match("/") || tokens.match("and")) {
-        std::string op = tokens.current().value;
-        tokens.next();
-        
+    BinOp op;
+    while (consumeBinOp(info(BinOp::Mul).precedence, op)) {
         Expression* right = parseFactor();
-        left = new BinaryExpression(op, left, right);
+        left = located(makeBinary(op, left, right), startPos);
     }
     
     return left;
 }
 
 Expression* ASTBuilder::parseFactor() {
+    size_t startPos = tokens.position();
+    
     // Handle unary operators
-    if (tokens.match("+") || tokens.match("-") || tokens.match("not")) {
-        std::string op = tokens.current().value;
+    UnOp unary;
+    if ((tokens.match("operator") || tokens.match("reserved")) && toUnOp(tokens.current().value, unary)) {
         tokens.next();
         Expression* operand = parseFactor();
-        return new UnaryExpression(op, operand);
+        return located(makeUnary(unary, operand), startPos);
     }
     
     // Parse primary expression
-    if (tokens.match("id")) {
-        std::string id = tokens.current().value;
+    if (tokens.match("id") || tokens.match("self")) {
+        Identifier* base = located(makeBase(context.intern(tokens.current().value)), startPos, startPos + 1);
         tokens.next();
-        
-        // Check for function call
-        if (tokens.match("(")) {
-            tokens.next();
-            std::vector<Expression*> args;
-            if (!tokens.match(")")) {
-                args = parseExpressionList();
-            }
-            tokens.expect(")");
-            return new CallExpression(new Identifier(id), args);
-        } else {
-            return new Identifier(id);
-        }
+        return parsePostfix(base, startPos);
     } else if (tokens.match("intlit") || tokens.match("integer")) {
         int value = std::stoi(tokens.current().value);
         tokens.next();
-        return new IntegerLiteral(value);
-    } else if (tokens.match("floatlit") || tokens.match("float")) {
+        return located(makeInteger(value), startPos);
+    } else if (tokens.match("floatlit") || (tokens.match("float") && tokens.current().type != "reserved")) {
         float value = std::stof(tokens.current().value);
         tokens.next();
-        return new FloatLiteral(value);
+        return located(makeFloat(value), startPos);
     } else if (tokens.match("(")) {
         tokens.next();
         Expression* expr = parseExpression();
         tokens.expect(")");
         return expr;
-    } else if (tokens.match("self")) {
-        tokens.next();
-        return new Identifier("self");
     } else {
         // If we can't parse an expression, skip this token and return a placeholder
         std::cerr << "Warning: Unable to parse expression at token " 
                   << tokens.current().type << " (" << tokens.current().value 
                   << "), using placeholder" << std::endl;
         tokens.next();
-        return new Identifier("error");
+        return located(makeIdentifier(context.intern("error")), startPos);
     }
 }
 
-BinaryExpression* ASTBuilder::parseBinaryExpression(Expression* left, const std::string& op) {
+BinaryExpression* ASTBuilder::parseBinaryExpression(Expression* left, BinOp op) {
     Expression* right = parseFactor();
-    return new BinaryExpression(op, left, right);
+    return makeBinary(op, left, right);
 }
 
 UnaryExpression* ASTBuilder::parseUnaryExpression() {
-    std::string op;
-    if (tokens.match("+") || tokens.match("-") || tokens.match("not")) {
-        op = tokens.current().value;
+    UnOp op;
+    if ((tokens.match("operator") || tokens.match("reserved")) && toUnOp(tokens.current().value, op)) {
         tokens.next();
     } else {
         return nullptr;
@@ -694,10 +1068,10 @@ UnaryExpression* ASTBuilder::parseUnaryExpression() {
     
     Expression* expr = parseFactor();
     
-    return new UnaryExpression(op, expr);
+    return makeUnary(op, expr);
 }
 
-CallExpression* ASTBuilder::parseCallExpression(Identifier* callee) {
+CallExpression* ASTBuilder::parseCallExpression(Expression* callee) {
     tokens.expect("(");
     
     std::vector<Expression*> args;
@@ -707,7 +1081,47 @@ CallExpression* ASTBuilder::parseCallExpression(Identifier* callee) {
     
     tokens.expect(")");
     
-    return new CallExpression(callee, args);
+    return context.make<CallExpression>(callee, args);
+}
+
+// Apply the [index], .member and (args) suffixes that follow a variable or
+// call, each node spanning from startPos to its last suffix
+Expression* ASTBuilder::parsePostfix(Expression* expr, size_t startPos) {
+    while (true) {
+        if (tokens.consume("[")) {
+            Expression* index = parseArithExpression();
+            tokens.expect("]");
+            expr = located(makeIndex(expr, index), startPos);
+        } else if (tokens.match("(")) {
+            expr = located(parseCallExpression(expr), startPos);
+        } else if (tokens.consume(".")) {
+            std::string member = "error";
+            if (tokens.match("id")) {
+                member = tokens.current().value;
+                tokens.next();
+            } else {
+                std::cerr << "Error: Expected member name but found " << tokens.current().type
+                          << " (" << tokens.current().value << ") at position " << tokens.position() << std::endl;
+            }
+            // A called member stays a node of its own, see makeBase()
+            Symbol name = context.intern(member);
+            expr = located(tokens.match("(") ? context.make<MemberExpression>(expr, name) : makeMember(expr, name), startPos);
+        } else {
+            return expr;
+        }
+    }
+}
+
+// read(variable), write(expr) and put(expr), kept as calls to the keyword
+CallStatement* ASTBuilder::parseIOStatement() {
+    size_t startPos = tokens.position();
+    Identifier* callee = located(context.make<Identifier>(context.intern(tokens.current().value)), startPos, startPos + 1);
+    tokens.next();
+    
+    CallExpression* call = located(parseCallExpression(callee), startPos);
+    tokens.expect(";");
+    
+    return located(context.make<CallStatement>(call), startPos);
 }
 
 std::vector<Expression*> ASTBuilder::parseExpressionList() {
@@ -738,7 +1152,7 @@ Identifier* ASTBuilder::parseIdentifier() {
         name = "error";
     }
     
-    return new Identifier(name);
+    return makeIdentifier(context.intern(name));
 }
 
 IntegerLiteral* ASTBuilder::parseIntegerLiteral() {
@@ -751,7 +1165,7 @@ IntegerLiteral* ASTBuilder::parseIntegerLiteral() {
                   << tokens.current().type << " (" << tokens.current().value << ")" << std::endl;
     }
     
-    return new IntegerLiteral(value);
+    return makeInteger(value);
 }
 
 FloatLiteral* ASTBuilder::parseFloatLiteral() {
@@ -764,25 +1178,125 @@ FloatLiteral* ASTBuilder::parseFloatLiteral() {
                   << tokens.current().type << " (" << tokens.current().value << ")" << std::endl;
     }
     
-    return new FloatLiteral(value);
+    return makeFloat(value);
+}
+
+// Nodes shared by hash-consing have no span, as they stand for several
+// places in the source; a node located twice keeps its first, innermost span
+template <typename T>
+T* ASTBuilder::located(T* node, size_t begin, size_t end) {
+    if (node && !node->interned && node->span.length == 0 && begin < end) {
+        const token::Token& first = tokens.at(begin);
+        const token::Token& last = tokens.at(end - 1);
+        node->span.offset = first.offset;
+        node->span.length = last.offset + static_cast<std::uint32_t>(last.value.size()) - first.offset;
+    }
+    return node;
+}
+
+Identifier* ASTBuilder::makeIdentifier(Symbol name) {
+    return exprs ? exprs->identifier(name) : context.make<Identifier>(name);
+}
+
+// The name a variable or call starts with, at the current token. A called
+// name is never shared: the checker gives it the type of the overload its
+// call resolves to, which differs between calls.
+Identifier* ASTBuilder::makeBase(Symbol name) {
+    return tokens.peek().value == "(" ? context.make<Identifier>(name) : makeIdentifier(name);
 }
 
-// Static variable to hold the AST root
+IntegerLiteral* ASTBuilder::makeInteger(int value) {
+    return exprs ? exprs->integer(value) : context.make<IntegerLiteral>(value);
+}
+
+FloatLiteral* ASTBuilder::makeFloat(float value) {
+    return exprs ? exprs->floating(value) : context.make<FloatLiteral>(value);
+}
+
+BinaryExpression* ASTBuilder::makeBinary(BinOp op, Expression* left, Expression* right) {
+    return exprs ? exprs->binary(op, left, right) : context.make<BinaryExpression>(op, left, right);
+}
+
+UnaryExpression* ASTBuilder::makeUnary(UnOp op, Expression* operand) {
+    return exprs ? exprs->unary(op, operand) : context.make<UnaryExpression>(op, operand);
+}
+
+IndexExpression* ASTBuilder::makeIndex(Expression* base, Expression* index) {
+    return exprs ? exprs->index(base, index) : context.make<IndexExpression>(base, index);
+}
+
+MemberExpression* ASTBuilder::makeMember(Expression* object, Symbol member) {
+    return exprs ? exprs->member(object, member) : context.make<MemberExpression>(object, member);
+}
+
+// Static variables holding the AST root and the arena that owns it
 static ASTNode* astRoot = nullptr;
+static ASTContext astContext;
 
-// Build an AST from a sequence of tokens
-ASTNode* buildAST(const std::vector<token::Token>& tokens) {
+// Hash-consing state for the static context
+static bool hashConsing = false;
+static ExprTable astExprs(astContext);
+
+// Build an AST from a sequence of tokens into the given context
+ASTNode* buildAST(const std::vector<token::Token>& tokens, ASTContext& context) {
+    return buildAST(tokens, context, nullptr);
+}
+
+// Build an AST into the given context, hash-consing expressions through
+// exprs unless it is null
+ASTNode* buildAST(const std::vector<token::Token>& tokens, ASTContext& context, ExprTable* exprs) {
     try {
-        ASTBuilder builder(tokens);
-        astRoot = builder.buildAST();
-        return astRoot;
+        ASTBuilder builder(tokens, context, exprs);
+        return builder.buildAST();
     } catch (const std::exception& e) {
         std::cerr << "Exception during AST building: " << e.what() << std::endl;
-        return new Program(std::vector<ASTNode*>());  // Return an empty program on error
+        return context.make<Program>(std::vector<ASTNode*>());  // Return an empty program on error
     }
 }
 
+// Build an AST from a sequence of tokens, releasing the previous tree
+ASTNode* buildAST(const std::vector<token::Token>& tokens) {
+    astRoot = nullptr;
+    astExprs.clear();
+    astContext.reset();
+    astRoot = buildAST(tokens, astContext, hashConsing ? &astExprs : nullptr);
+    return astRoot;
+}
+
+// Reparse after an edit, splicing the rebuilt declaration into the current AST
+ASTNode* reparseAST(const std::vector<token::Token>& tokens, size_t editBegin, size_t editEnd, size_t newLength) {
+    if (astRoot && astRoot->kind == NodeKind::Program) {
+        Program* program = static_cast<Program*>(astRoot);
+        try {
+            // Replaced subtrees stay in the arena until the next full build
+            ASTBuilder builder(tokens, astContext, hashConsing ? &astExprs : nullptr);
+            if (builder.reparse(program, editBegin, editEnd, newLength)) {
+                return astRoot;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Exception during incremental reparse: " << e.what() << std::endl;
+        }
+    }
+    
+    // The edit spans several declarations; rebuild everything
+    return buildAST(tokens);
+}
+
 // Get the root of the AST (implementation of function declared in ast_builder.h)
 ASTNode* getASTRoot() {
     return astRoot;
 }
+
+// Get the arena holding the current AST
+ASTContext& getASTContext() {
+    return astContext;
+}
+
+void setHashConsing(bool enabled) {
+    hashConsing = enabled;
+}
+
+// Get the hash-consing table of the current AST
+const ExprTable& getExprTable() {
+    return astExprs;
+}
@@ -0,0 +1,93 @@
+#include "../include/ast_context.h"
+#include <cstring>
+
+ASTContext::ASTContext() {
+    intern("");
+}
+
+ASTContext::~ASTContext() {
+    reset();
+    for (char* chunk : chunks) {
+        ::operator delete(chunk);
+    }
+}
+
+char* ASTContext::newChunk(std::size_t size) {
+    char* chunk = static_cast<char*>(::operator new(size));
+    chunks.push_back(chunk);
+    reserved += size;
+    return chunk;
+}
+
+void* ASTContext::allocate(std::size_t size, std::size_t align) {
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(cursor);
+    std::uintptr_t aligned = (address + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+
+    if (!cursor || aligned + size > reinterpret_cast<std::uintptr_t>(limit)) {
+        // Oversized requests get a chunk of their own so the current one
+        // keeps serving small nodes
+        if (size + align > chunkSize) {
+            char* chunk = newChunk(size + align);
+            address = reinterpret_cast<std::uintptr_t>(chunk);
+            used += size;
+            return reinterpret_cast<void*>((address + align - 1) & ~static_cast<std::uintptr_t>(align - 1));
+        }
+
+        cursor = newChunk(chunkSize);
+        limit = cursor + chunkSize;
+        address = reinterpret_cast<std::uintptr_t>(cursor);
+        aligned = (address + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+    }
+
+    cursor = reinterpret_cast<char*>(aligned + size);
+    used += size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+void ASTContext::reset() {
+    for (ASTNode* node : nodes) {
+        node->~ASTNode();
+    }
+    nodes.clear();
+
+    // Keep the first chunk around for the next tree
+    for (std::size_t i = 1; i < chunks.size(); ++i) {
+        ::operator delete(chunks[i]);
+    }
+    if (chunks.size() > 1) {
+        chunks.resize(1);
+    }
+
+    cursor = chunks.empty() ? nullptr : chunks[0];
+    limit = chunks.empty() ? nullptr : chunks[0] + chunkSize;
+    used = 0;
+    reserved = chunks.empty() ? 0 : chunkSize;
+
+    spellings.clear();
+    symbolIds.clear();
+    intern("");
+}
+
+Symbol ASTContext::find(std::string_view text) const {
+    auto it = symbolIds.find(text);
+    return it == symbolIds.end() ? Symbol{} : Symbol{it->second};
+}
+
+Symbol ASTContext::intern(std::string_view text) {
+    auto it = symbolIds.find(text);
+    if (it != symbolIds.end()) {
+        return Symbol{it->second};
+    }
+
+    std::string_view stored;
+    if (!text.empty()) {
+        char* storage = static_cast<char*>(allocate(text.size(), 1));
+        std::memcpy(storage, text.data(), text.size());
+        stored = std::string_view(storage, text.size());
+    }
+
+    std::uint32_t id = static_cast<std::uint32_t>(spellings.size());
+    spellings.push_back(stored);
+    symbolIds.emplace(stored, id);
+    return Symbol{id};
+}
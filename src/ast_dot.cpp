@@ -0,0 +1,155 @@
+#include "../include/ast.h"
+#include "../include/ast_context.h"
+#include "../include/ast_walker.h"
+#include "../include/output_buffer.h"
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Emits Graphviz DOT while walking the tree. Each node gets the next value
+// of a counter as its id and is written as soon as it is entered, preceded
+// by the edge from its parent, so nothing but the ids of the open ancestors
+// is kept in memory. The buffer is flushed whenever it grows past a fixed
+// size.
+class DotEmitter : public ASTWalker<DotEmitter> {
+public:
+    using ASTWalker<DotEmitter>::enter;
+    using ASTWalker<DotEmitter>::leave;
+
+    DotEmitter(const ASTContext& context, int fd) : context(context), fd(fd) {}
+
+    void begin() {
+        out << "digraph AST {\n"
+            << "node [shape=record];\n"
+            << " node [fontname=Sans];charset=\"UTF-8\" splines=true splines=spline rankdir =LR\n";
+    }
+
+    bool end() {
+        out << "}\n";
+        return out.flushTo(fd);
+    }
+
+    bool enter(Program&) { return open("Program"); }
+    bool enter(ClassDecl& node) { return open("ClassDecl", context.spelling(node.name)); }
+    bool enter(ImplDecl& node) { return open("ImplDecl", context.spelling(node.name)); }
+    bool enter(FuncDecl& node) { return open("FuncDecl", context.spelling(node.name)); }
+    bool enter(VarDecl& node) { return open("VarDecl", context.spelling(node.name)); }
+    bool enter(Type& node) {
+        if (node.dimCount == 0) {
+            return open("Type", context.spelling(node.name));
+        }
+        std::string name(context.spelling(node.name));
+        for (std::uint32_t i = 0; i < node.dimCount; ++i) {
+            name += '[';
+            if (node.dims[i] != 0) {
+                name += std::to_string(node.dims[i]);
+            }
+            name += ']';
+        }
+        return open("Type", name);
+    }
+
+    bool enter(IfStatement&) { return open("IfStatement"); }
+    bool enter(WhileStatement&) { return open("WhileStatement"); }
+    bool enter(ReturnStatement&) { return open("ReturnStatement"); }
+    bool enter(AssignStatement&) { return open("AssignStatement"); }
+    bool enter(BlockStatement&) { return open("BlockStatement"); }
+    bool enter(CallStatement&) { return open("CallStatement"); }
+    bool enter(BinaryExpression& node) { return open("BinaryExpression", spelling(node.op)); }
+    bool enter(UnaryExpression& node) { return open("UnaryExpression", spelling(node.op)); }
+    bool enter(CallExpression&) { return open("CallExpression"); }
+    bool enter(IndexExpression&) { return open("IndexExpression"); }
+    bool enter(MemberExpression& node) { return open("MemberExpression", context.spelling(node.member)); }
+    bool enter(Identifier& node) { return open("Identifier", context.spelling(node.name)); }
+
+    bool enter(IntegerLiteral& node) {
+        edge();
+        out << nextId << "[label=\"IntegerLiteral | " << node.value << "\"];\n";
+        ids.push_back(nextId++);
+        return true;
+    }
+
+    bool enter(FloatLiteral& node) {
+        edge();
+        out << nextId << "[label=\"FloatLiteral | " << node.value << "\"];\n";
+        ids.push_back(nextId++);
+        return true;
+    }
+
+    // Statement and Expression placeholders
+    template <typename Node>
+    bool enter(Node&) { return open("Empty"); }
+
+    template <typename Node>
+    void leave(Node&) {
+        ids.pop_back();
+        if (out.size() >= flushThreshold) {
+            out.flushTo(fd);
+        }
+    }
+
+    // A missing optional child is drawn as a point, like an empty list in
+    // the reference output
+    void missing() {
+        if (ids.empty()) {
+            return;
+        }
+        out << "none" << nextId << "[shape=point];\n" << ids.back() << "->none" << nextId << ";\n";
+        ++nextId;
+    }
+
+private:
+    static constexpr std::size_t flushThreshold = 64 * 1024;
+
+    const ASTContext& context;
+    int fd;
+    OutputBuffer out;
+    std::uint32_t nextId = 0;
+    std::vector<std::uint32_t> ids;  // open ancestors, innermost last
+
+    void edge() {
+        if (!ids.empty()) {
+            out << ids.back() << "->" << nextId << ";\n";
+        }
+    }
+
+    bool open(std::string_view kind, std::string_view value = std::string_view()) {
+        edge();
+        out << nextId << "[label=\"" << kind;
+        if (!value.empty()) {
+            out << " | ";
+            escape(value);
+        }
+        out << "\"];\n";
+        ids.push_back(nextId++);
+        return true;
+    }
+
+    // Characters with a meaning inside a record label or a quoted string
+    void escape(std::string_view text) {
+        for (char c : text) {
+            switch (c) {
+            case '{': case '}': case '|': case '<': case '>': case '"': case '\\':
+                out << '\\';
+                break;
+            default:
+                break;
+            }
+            out << c;
+        }
+    }
+};
+
+void printDOT(ASTNode* root, const ASTContext& context, const std::string& outputFile) {
+    int fd = openOutputFile(outputFile);
+    if (fd < 0) {
+        return;
+    }
+
+    DotEmitter emitter(context, fd);
+    emitter.begin();
+    emitter.walk(root);
+    emitter.end();
+    ::close(fd);
+}
@@ -0,0 +1,449 @@
+#include "../include/ast_file.h"
+#include "../include/output_buffer.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t nodeCount;
+    std::uint32_t symbolCount;
+    std::uint32_t stringBytes;
+};
+
+std::size_t paddedTo4(std::size_t size) {
+    return (size + 3) & ~std::size_t(3);
+}
+
+// Kinds whose payload is a symbol id
+bool isNamed(NodeKind kind) {
+    switch (kind) {
+    case NodeKind::ClassDecl:
+    case NodeKind::ImplDecl:
+    case NodeKind::FuncDecl:
+    case NodeKind::VarDecl:
+    case NodeKind::Type:
+    case NodeKind::Identifier:
+    case NodeKind::MemberExpression:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isStatement(NodeKind kind) {
+    return kind >= NodeKind::Statement && kind <= NodeKind::CallStatement;
+}
+
+bool isExpression(NodeKind kind) {
+    return kind >= NodeKind::Expression && kind <= NodeKind::FloatLiteral;
+}
+
+// A statement, or Empty for a branch or body that is missing
+bool isOptionalStatement(NodeKind kind) {
+    return isStatement(kind) || kind == NodeKind::Empty;
+}
+
+// Whether children, the kinds of a node's children in order, are what the
+// flattener emits for a node of kind, so Inflater can build it as is
+bool childrenFit(NodeKind kind, const std::vector<NodeKind>& children) {
+    std::size_t n = children.size();
+    auto all = [&](std::size_t from, std::size_t to, bool (*fits)(NodeKind)) {
+        for (std::size_t i = from; i < to; ++i) {
+            if (!fits(children[i])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    switch (kind) {
+    case NodeKind::Program:
+        return all(0, n, [](NodeKind k) {
+            return k == NodeKind::ClassDecl || k == NodeKind::ImplDecl || k == NodeKind::FuncDecl ||
+                   k == NodeKind::VarDecl || isStatement(k);
+        });
+    case NodeKind::ClassDecl: {
+        // parents..., members...
+        std::size_t parents = 0;
+        while (parents < n && children[parents] == NodeKind::Type) {
+            ++parents;
+        }
+        return all(parents, n, [](NodeKind k) { return k == NodeKind::VarDecl || k == NodeKind::FuncDecl; });
+    }
+    case NodeKind::ImplDecl:
+        return all(0, n, [](NodeKind k) { return k == NodeKind::FuncDecl; });
+    case NodeKind::FuncDecl:
+        // params..., return type, body
+        return n >= 2 && all(0, n - 2, [](NodeKind k) { return k == NodeKind::VarDecl; }) &&
+               children[n - 2] == NodeKind::Type && isOptionalStatement(children[n - 1]);
+    case NodeKind::VarDecl:
+        return n == 1 && children[0] == NodeKind::Type;
+    case NodeKind::Type:
+        return all(0, n, [](NodeKind k) { return k == NodeKind::IntegerLiteral; });
+    case NodeKind::IfStatement:
+        return n == 3 && isExpression(children[0]) && isOptionalStatement(children[1]) &&
+               isOptionalStatement(children[2]);
+    case NodeKind::WhileStatement:
+        return n == 2 && isExpression(children[0]) && isOptionalStatement(children[1]);
+    case NodeKind::ReturnStatement:
+    case NodeKind::UnaryExpression:
+    case NodeKind::MemberExpression:
+        return n == 1 && isExpression(children[0]);
+    case NodeKind::AssignStatement:
+    case NodeKind::BinaryExpression:
+    case NodeKind::IndexExpression:
+        return n == 2 && all(0, n, isExpression);
+    case NodeKind::BlockStatement:
+        return all(0, n, [](NodeKind k) { return k == NodeKind::VarDecl || isStatement(k); });
+    case NodeKind::CallStatement:
+        return n == 1 && children[0] == NodeKind::CallExpression;
+    case NodeKind::CallExpression:
+        // callee, args...
+        return n >= 1 && all(0, n, isExpression);
+    case NodeKind::Statement:
+    case NodeKind::Expression:
+    case NodeKind::Identifier:
+    case NodeKind::IntegerLiteral:
+    case NodeKind::FloatLiteral:
+    case NodeKind::Empty:
+        return n == 0;
+    }
+    return false;
+}
+
+template <typename T>
+void appendArray(OutputBuffer& out, const T* data, std::size_t count) {
+    out << std::string_view(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+} // namespace
+
+bool writeASTFile(const FlatAST& flat, const ASTContext& context, const std::string& path) {
+    std::uint32_t symbolCount = static_cast<std::uint32_t>(context.symbolCount());
+
+    std::vector<std::uint32_t> stringOffsets;
+    stringOffsets.reserve(symbolCount + 1);
+    std::uint32_t stringBytes = 0;
+    for (std::uint32_t id = 0; id < symbolCount; ++id) {
+        stringOffsets.push_back(stringBytes);
+        stringBytes += static_cast<std::uint32_t>(context.spelling(Symbol{id}).size());
+    }
+    stringOffsets.push_back(stringBytes);
+
+    FileHeader header;
+    std::memcpy(header.magic, astfile::magic, sizeof(header.magic));
+    header.version = astfile::version;
+    header.byteOrder = astfile::byteOrder;
+    header.nodeCount = flat.size();
+    header.symbolCount = symbolCount;
+    header.stringBytes = stringBytes;
+
+    OutputBuffer out;
+    appendArray(out, &header, 1);
+    appendArray(out, flat.firstChild.data(), flat.size());
+    appendArray(out, flat.nextSibling.data(), flat.size());
+    appendArray(out, flat.payload.data(), flat.size());
+    appendArray(out, stringOffsets.data(), stringOffsets.size());
+    appendArray(out, flat.kinds.data(), flat.size());
+    for (std::size_t pad = flat.size(); pad < paddedTo4(flat.size()); ++pad) {
+        out << '\0';
+    }
+    for (std::uint32_t id = 0; id < symbolCount; ++id) {
+        out << context.spelling(Symbol{id});
+    }
+    return out.writeTo(path);
+}
+
+MappedAST::~MappedAST() {
+    close();
+}
+
+void MappedAST::close() {
+    if (base != nullptr) {
+        ::munmap(base, length);
+    }
+    base = nullptr;
+    length = 0;
+    nodeCount = 0;
+    symbols = 0;
+}
+
+bool MappedAST::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Could not open AST file " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        std::cerr << "Error: " << path << " is too short to be an AST file" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<std::size_t>(info.st_size);
+    void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: Could not map AST file " << path << ": " << std::strerror(errno) << std::endl;
+        length = 0;
+        return false;
+    }
+    base = mapped;
+
+    const FileHeader* header = static_cast<const FileHeader*>(base);
+    if (std::memcmp(header->magic, astfile::magic, sizeof(header->magic)) != 0) {
+        std::cerr << "Error: " << path << " is not an AST file" << std::endl;
+        close();
+        return false;
+    }
+    if (header->version != astfile::version || header->byteOrder != astfile::byteOrder) {
+        std::cerr << "Error: " << path << " has an unsupported AST file version or byte order" << std::endl;
+        close();
+        return false;
+    }
+
+    std::size_t n = header->nodeCount;
+    std::size_t s = header->symbolCount;
+    std::size_t expected = sizeof(FileHeader) + 4 * (3 * n + s + 1) + paddedTo4(n) + header->stringBytes;
+    if (s == 0 || expected != length) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        close();
+        return false;
+    }
+
+    const std::uint32_t* words = reinterpret_cast<const std::uint32_t*>(header + 1);
+    nodeCount = header->nodeCount;
+    symbols = header->symbolCount;
+    firstChildren = words;
+    nextSiblings = words + n;
+    payloads = words + 2 * n;
+    stringOffsets = words + 3 * n;
+    kinds = reinterpret_cast<const std::uint8_t*>(stringOffsets + s + 1);
+    strings = reinterpret_cast<const char*>(kinds + paddedTo4(n));
+
+    if (!validate(header->stringBytes)) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Children must come after their parent and siblings after each other, as
+// in the pre-order the writer produces, and every node but the root must be
+// reached exactly once; that rules out cycles and shared nodes. Each node
+// must then have the number and kinds of children its kind is built from,
+// named nodes must refer to a symbol in the table and operators to an entry
+// of the operator tables, so any file open() accepts can be inflated or
+// walked without further checks.
+bool MappedAST::validate(std::uint32_t stringBytes) const {
+    for (std::uint32_t id = 0; id < symbols; ++id) {
+        if (stringOffsets[id] > stringOffsets[id + 1]) {
+            return false;
+        }
+    }
+    if (stringOffsets[0] != 0 || stringOffsets[symbols] != stringBytes) {
+        return false;
+    }
+
+    std::vector<std::uint8_t> reached(nodeCount, 0);
+    for (std::uint32_t node = 0; node < nodeCount; ++node) {
+        for (std::uint32_t next : {firstChildren[node], nextSiblings[node]}) {
+            if (next == none) {
+                continue;
+            }
+            if (next <= node || next >= nodeCount || reached[next]) {
+                return false;
+            }
+            reached[next] = 1;
+        }
+        if (kinds[node] > static_cast<std::uint8_t>(NodeKind::Empty)) {
+            return false;
+        }
+    }
+    for (std::uint32_t node = 1; node < nodeCount; ++node) {
+        if (!reached[node]) {
+            return false;
+        }
+    }
+    if (nodeCount > 0 && nextSiblings[0] != none) {
+        return false;
+    }
+
+    std::vector<NodeKind> children;
+    for (std::uint32_t node = 0; node < nodeCount; ++node) {
+        NodeKind nodeKind = kind(node);
+        children.clear();
+        forEachChild(node, [&](std::uint32_t child) { children.push_back(kind(child)); });
+        if (!childrenFit(nodeKind, children)) {
+            return false;
+        }
+        if (isNamed(nodeKind) && payloads[node] >= symbols) {
+            return false;
+        }
+        if ((nodeKind == NodeKind::BinaryExpression && payloads[node] >= std::size(binOpTable)) ||
+            (nodeKind == NodeKind::UnaryExpression && payloads[node] >= std::size(unOpTable))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int MappedAST::intValue(std::uint32_t node) const {
+    return static_cast<int>(payloads[node]);
+}
+
+float MappedAST::floatValue(std::uint32_t node) const {
+    float value;
+    std::memcpy(&value, &payloads[node], sizeof(value));
+    return value;
+}
+
+FlatAST MappedAST::toFlat(ASTContext& context) const {
+    std::vector<Symbol> local(symbols);
+    for (std::uint32_t id = 0; id < symbols; ++id) {
+        local[id] = context.intern(spelling(Symbol{id}));
+    }
+
+    FlatAST flat;
+    flat.kinds.assign(reinterpret_cast<const NodeKind*>(kinds), reinterpret_cast<const NodeKind*>(kinds) + nodeCount);
+    flat.firstChild.assign(firstChildren, firstChildren + nodeCount);
+    flat.nextSibling.assign(nextSiblings, nextSiblings + nodeCount);
+    flat.payload.assign(payloads, payloads + nodeCount);
+    for (std::uint32_t node = 0; node < nodeCount; ++node) {
+        if (isNamed(kind(node))) {
+            flat.payload[node] = local[payloads[node]].id;
+        }
+    }
+    return flat;
+}
+
+// Pre-order over the arrays with an explicit stack of pending nodes. A
+// node's depth is its indentation, since every printed node with children
+// indents them one level; a Type prints its array sizes itself instead.
+void printAST(const MappedAST& mapped, const std::string& outputFile) {
+    struct Pending {
+        std::uint32_t node;
+        int depth;
+    };
+    std::vector<Pending> stack;
+    if (mapped.root() != MappedAST::none) {
+        stack.push_back({mapped.root(), 0});
+    }
+
+    OutputBuffer out;
+    while (!stack.empty()) {
+        Pending top = stack.back();
+        stack.pop_back();
+        std::uint32_t node = top.node;
+        if (mapped.nextSibling(node) != MappedAST::none) {
+            stack.push_back({mapped.nextSibling(node), top.depth});
+        }
+
+        NodeKind kind = mapped.kind(node);
+        switch (kind) {
+        case NodeKind::Program:
+            out << "Program\n";
+            break;
+        case NodeKind::ClassDecl:
+        case NodeKind::ImplDecl:
+        case NodeKind::FuncDecl:
+        case NodeKind::VarDecl: {
+            static const char* const labels[] = {"ClassDecl: ", "ImplDecl: ", "FuncDecl: ", "VarDecl: "};
+            out.indent(top.depth);
+            out << labels[static_cast<int>(kind) - static_cast<int>(NodeKind::ClassDecl)]
+                << mapped.spelling(mapped.symbol(node)) << "\n";
+            break;
+        }
+        case NodeKind::Type:
+            out.indent(top.depth);
+            out << "Type: " << mapped.spelling(mapped.symbol(node));
+            mapped.forEachChild(node, [&](std::uint32_t dim) {
+                out << '[';
+                if (mapped.payload(dim) != 0) {
+                    out << static_cast<unsigned>(mapped.payload(dim));
+                }
+                out << ']';
+            });
+            out << "\n";
+            continue;
+        case NodeKind::IfStatement:
+            out.indent(top.depth);
+            out << "IfStatement\n";
+            break;
+        case NodeKind::WhileStatement:
+            out.indent(top.depth);
+            out << "WhileStatement\n";
+            break;
+        case NodeKind::ReturnStatement:
+            out.indent(top.depth);
+            out << "ReturnStatement\n";
+            break;
+        case NodeKind::AssignStatement:
+            out.indent(top.depth);
+            out << "AssignStatement\n";
+            break;
+        case NodeKind::BlockStatement:
+            out.indent(top.depth);
+            out << "BlockStatement\n";
+            break;
+        case NodeKind::CallStatement:
+            out.indent(top.depth);
+            out << "CallStatement\n";
+            break;
+        case NodeKind::BinaryExpression:
+            out.indent(top.depth);
+            out << "BinaryExpression: " << spelling(static_cast<BinOp>(mapped.payload(node))) << "\n";
+            break;
+        case NodeKind::UnaryExpression:
+            out.indent(top.depth);
+            out << "UnaryExpression: " << spelling(static_cast<UnOp>(mapped.payload(node))) << "\n";
+            break;
+        case NodeKind::CallExpression:
+            out.indent(top.depth);
+            out << "CallExpression\n";
+            break;
+        case NodeKind::IndexExpression:
+            out.indent(top.depth);
+            out << "IndexExpression\n";
+            break;
+        case NodeKind::MemberExpression:
+            out.indent(top.depth);
+            out << "MemberExpression: " << mapped.spelling(mapped.symbol(node)) << "\n";
+            break;
+        case NodeKind::Identifier:
+            out.indent(top.depth);
+            out << "Identifier: " << mapped.spelling(mapped.symbol(node)) << "\n";
+            break;
+        case NodeKind::IntegerLiteral:
+            out.indent(top.depth);
+            out << "IntegerLiteral: " << mapped.intValue(node) << "\n";
+            break;
+        case NodeKind::FloatLiteral:
+            out.indent(top.depth);
+            out << "FloatLiteral: " << mapped.floatValue(node) << "\n";
+            break;
+        case NodeKind::Statement:
+        case NodeKind::Expression:
+        case NodeKind::Empty:
+            break;
+        }
+
+        if (mapped.firstChild(node) != MappedAST::none) {
+            stack.push_back({mapped.firstChild(node), top.depth + 1});
+        }
+    }
+    out.writeTo(outputFile);
+}
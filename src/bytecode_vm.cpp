@@ -0,0 +1,711 @@
+#include "../include/bytecode_vm.h"
+#include "../include/ir_cfg.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+constexpr std::uint32_t none = Instr::none;
+constexpr std::size_t maxDepth = 10000;
+constexpr std::size_t memoryBytes = std::size_t(1) << 26;  // as much as interpret() allows
+
+// Operands follow the opcode in the order given: d is the register
+// written, a and b registers read, n an immediate and t a jump target.
+#define BYTECODE_OPS(X)                                                        \
+    X(Const)    /* d n: d = n */                                               \
+    X(Copy)     /* d a */                                                      \
+    X(Add) X(Sub) X(Mul) X(Div) X(And) X(Or)                /* d a b */       \
+    X(Eq) X(NotEq) X(Lt) X(Gt) X(LtEq) X(GtEq)             /* d a b */       \
+    X(FAdd) X(FSub) X(FMul) X(FDiv)                         /* d a b */       \
+    X(FEq) X(FNotEq) X(FLt) X(FGt) X(FLtEq) X(FGtEq)       /* d a b */       \
+    X(Neg) X(FNeg) X(Not)                                   /* d a */         \
+    X(Frame)    /* d n: d = frame address plus n */                            \
+    X(Load)     /* d a n: d = word at a + n */                                 \
+    X(Store)    /* a n b: word at a + n = b */                                 \
+    X(Move)     /* a b n: copy n bytes from address b to address a */          \
+    X(Call)     /* n d m: call function n on a window from register m */      \
+    X(Ret)      /* a */                                                        \
+    X(RetVoid)                                                                 \
+    X(ReadInt) X(ReadFloat)                                 /* d */           \
+    X(WriteInt) X(WriteFloat) X(PutInt) X(PutFloat)         /* a */           \
+    X(Jump)                                                 /* t */           \
+    X(JumpIf) X(JumpIfNot)                                  /* a t */         \
+    X(JumpEq) X(JumpNotEq) X(JumpLt) X(JumpGt) X(JumpLtEq) X(JumpGtEq)  /* a b t: on ints */
+
+enum class Bc : std::uint32_t {
+#define BYTECODE_ENUM(name) name,
+    BYTECODE_OPS(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+};
+
+// Bytecode operator for an IR operator with a result and one or two
+// register operands
+Bc arithmetic(Opcode op) {
+    switch (op) {
+    case Opcode::Copy: return Bc::Copy;
+    case Opcode::Add: return Bc::Add;
+    case Opcode::Sub: return Bc::Sub;
+    case Opcode::Mul: return Bc::Mul;
+    case Opcode::Div: return Bc::Div;
+    case Opcode::And: return Bc::And;
+    case Opcode::Or: return Bc::Or;
+    case Opcode::Eq: return Bc::Eq;
+    case Opcode::NotEq: return Bc::NotEq;
+    case Opcode::Lt: return Bc::Lt;
+    case Opcode::Gt: return Bc::Gt;
+    case Opcode::LtEq: return Bc::LtEq;
+    case Opcode::GtEq: return Bc::GtEq;
+    case Opcode::FAdd: return Bc::FAdd;
+    case Opcode::FSub: return Bc::FSub;
+    case Opcode::FMul: return Bc::FMul;
+    case Opcode::FDiv: return Bc::FDiv;
+    case Opcode::FEq: return Bc::FEq;
+    case Opcode::FNotEq: return Bc::FNotEq;
+    case Opcode::FLt: return Bc::FLt;
+    case Opcode::FGt: return Bc::FGt;
+    case Opcode::FLtEq: return Bc::FLtEq;
+    case Opcode::FGtEq: return Bc::FGtEq;
+    case Opcode::Neg: return Bc::Neg;
+    case Opcode::FNeg: return Bc::FNeg;
+    default: return Bc::Not;
+    }
+}
+
+// The compare-and-jump for an int comparison, or for its negation
+bool compareJump(Opcode op, bool negated, Bc& jump) {
+    switch (op) {
+    case Opcode::Eq: jump = negated ? Bc::JumpNotEq : Bc::JumpEq; return true;
+    case Opcode::NotEq: jump = negated ? Bc::JumpEq : Bc::JumpNotEq; return true;
+    case Opcode::Lt: jump = negated ? Bc::JumpGtEq : Bc::JumpLt; return true;
+    case Opcode::Gt: jump = negated ? Bc::JumpLtEq : Bc::JumpGt; return true;
+    case Opcode::LtEq: jump = negated ? Bc::JumpGt : Bc::JumpLtEq; return true;
+    case Opcode::GtEq: jump = negated ? Bc::JumpLt : Bc::JumpGtEq; return true;
+    default: return false;
+    }
+}
+
+class FunctionCompiler {
+public:
+    FunctionCompiler(const IRFunction& function, Bytecode& out, Bytecode::Function& compiled)
+        : function(function), out(out), compiled(compiled) {}
+
+    void compile() {
+        count();
+        findConstants();
+
+        compiled.start = static_cast<std::uint32_t>(out.code.size());
+        compiled.params = function.params;
+        compiled.locals = static_cast<std::uint32_t>(function.regs.size());
+        compiled.frameSize = (function.frameSize + 3) & ~3u;
+        window = compiled.locals + compiled.constantCount;
+
+        std::vector<std::uint32_t> blockStart(function.blocks.size());
+        std::uint32_t maxArgs = 0, args = 0;
+        for (std::uint32_t b = 0; b < function.blocks.size(); ++b) {
+            blockStart[b] = static_cast<std::uint32_t>(out.code.size());
+            next = b + 1;
+            const IRBlock& block = function.blocks[b];
+            blockEnd = block.end;
+            for (std::uint32_t i = block.begin; i < block.end; ++i) {
+                const Instr& instr = function.code[i];
+                switch (instr.op) {
+                case Opcode::Const:
+                    if (slot[instr.dst] == instr.dst) {
+                        emit(Bc::Const, target(i), instr.a);
+                    }
+                    break;
+                case Opcode::Frame:
+                    emit(Bc::Frame, target(i), instr.c);
+                    break;
+                case Opcode::Load:
+                    emit(Bc::Load, target(i), slot[instr.a], instr.c);
+                    break;
+                case Opcode::Store:
+                    emit(Bc::Store, slot[instr.a], instr.c, slot[instr.b]);
+                    break;
+                case Opcode::Move:
+                    emit(Bc::Move, slot[instr.a], slot[instr.b], instr.c);
+                    break;
+                case Opcode::Arg:
+                    emit(Bc::Copy, window + args++, slot[instr.a]);
+                    maxArgs = std::max(maxArgs, args);
+                    break;
+                case Opcode::Call:
+                    emit(Bc::Call, instr.a, instr.dst == none ? none : target(i), window);
+                    args = 0;
+                    break;
+                case Opcode::Read:
+                    emit(function.regs[instr.dst] == IRType::Float ? Bc::ReadFloat : Bc::ReadInt, target(i));
+                    break;
+                case Opcode::Write:
+                case Opcode::Put: {
+                    bool floating = function.regs[instr.a] == IRType::Float;
+                    Bc op = instr.op == Opcode::Write ? (floating ? Bc::WriteFloat : Bc::WriteInt)
+                                                      : (floating ? Bc::PutFloat : Bc::PutInt);
+                    emit(op, slot[instr.a]);
+                    break;
+                }
+                case Opcode::Jump:
+                    jump(instr.a);
+                    break;
+                case Opcode::Branch:
+                    branch(Bc::JumpIf, Bc::JumpIfNot, slot[instr.a], none, instr.b, instr.c);
+                    break;
+                case Opcode::Ret:
+                    if (instr.a == none) {
+                        emit(Bc::RetVoid);
+                    } else {
+                        emit(Bc::Ret, slot[instr.a]);
+                    }
+                    break;
+                default: {
+                    // An int comparison only tested by the branch after it
+                    // jumps on its operands directly
+                    Bc taken, notTaken;
+                    const Instr* following = i + 1 < block.end ? &function.code[i + 1] : nullptr;
+                    if (following && following->op == Opcode::Branch && following->a == instr.dst && single(instr.dst) &&
+                        compareJump(instr.op, false, taken) && compareJump(instr.op, true, notTaken)) {
+                        branch(taken, notTaken, slot[instr.a], slot[instr.b], following->b, following->c);
+                        ++i;
+                        break;
+                    }
+                    std::uint32_t d = target(i);
+                    if (registerOperands(instr) & 2) {
+                        emit(arithmetic(instr.op), d, slot[instr.a], slot[instr.b]);
+                    } else {
+                        emit(arithmetic(instr.op), d, slot[instr.a]);
+                    }
+                    break;
+                }
+                }
+                if (skipCopy) {
+                    skipCopy = false;
+                    ++i;
+                }
+            }
+        }
+        compiled.registers = window + maxArgs;
+
+        for (const auto& [offset, block] : fixups) {
+            out.code[offset] = blockStart[block];
+        }
+    }
+
+private:
+    const IRFunction& function;
+    Bytecode& out;
+    Bytecode::Function& compiled;
+    std::vector<std::uint32_t> uses, defs;
+    std::vector<std::uint32_t> slot;  // register each IR register is kept in
+    std::uint32_t window = 0;         // first register of a callee's window
+    std::uint32_t next = 0;           // the block emitted after the current one
+    std::uint32_t blockEnd = 0;       // end of the current block
+    bool skipCopy = false;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> fixups;  // code offset, block
+
+    void count() {
+        uses.assign(function.regs.size(), 0);
+        defs.assign(function.regs.size(), 0);
+        for (const Instr& instr : function.code) {
+            if (definesRegister(instr.op) && instr.dst != none) {
+                ++defs[instr.dst];
+            }
+            unsigned operands = registerOperands(instr);
+            if ((operands & 1) && instr.a != none) {
+                ++uses[instr.a];
+            }
+            if ((operands & 2) && instr.b != none) {
+                ++uses[instr.b];
+            }
+        }
+    }
+
+    bool single(std::uint32_t reg) const {
+        return defs[reg] == 1 && uses[reg] == 1;
+    }
+
+    // A register written only by a Const and read only where the Const
+    // dominates, after it in its block or in blocks it dominates, holds
+    // that constant wherever it is read, so it can share a register preset
+    // to the value on entry and the Const goes away
+    void findConstants() {
+        CFG cfg(function);
+        Dominators dom(cfg);
+        std::size_t n = function.regs.size();
+        std::vector<std::uint32_t> at(n, none);
+        std::vector<std::uint32_t> blockOf(function.code.size());
+        for (std::uint32_t b = 0; b < function.blocks.size(); ++b) {
+            for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+                blockOf[i] = b;
+                const Instr& instr = function.code[i];
+                if (instr.op == Opcode::Const && defs[instr.dst] == 1) {
+                    at[instr.dst] = i;
+                }
+            }
+        }
+        auto check = [&](std::uint32_t reg, std::uint32_t i) {
+            if (at[reg] == none) {
+                return;
+            }
+            std::uint32_t def = blockOf[at[reg]], use = blockOf[i];
+            if (def == use ? at[reg] > i : !dom.reachable(def) || !dom.reachable(use) || !dom.dominates(def, use)) {
+                at[reg] = none;
+            }
+        };
+        for (std::uint32_t i = 0; i < function.code.size(); ++i) {
+            const Instr& instr = function.code[i];
+            unsigned operands = registerOperands(instr);
+            if ((operands & 1) && instr.a != none) {
+                check(instr.a, i);
+            }
+            if ((operands & 2) && instr.b != none) {
+                check(instr.b, i);
+            }
+        }
+
+        compiled.constantFirst = static_cast<std::uint32_t>(out.constants.size());
+        std::unordered_map<std::uint32_t, std::uint32_t> registers;
+        slot.resize(n);
+        for (std::uint32_t reg = 0; reg < n; ++reg) {
+            slot[reg] = reg;
+            if (at[reg] != none) {
+                std::uint32_t value = function.code[at[reg]].a;
+                auto [it, added] = registers.emplace(value, static_cast<std::uint32_t>(n + registers.size()));
+                if (added) {
+                    out.constants.push_back(value);
+                }
+                slot[reg] = it->second;
+            }
+        }
+        compiled.constantCount = static_cast<std::uint32_t>(registers.size());
+    }
+
+    // The register instruction i writes: the target of the Copy after it
+    // when that Copy is the only reader
+    std::uint32_t target(std::uint32_t i) {
+        const Instr& instr = function.code[i];
+        if (i + 1 < blockEnd) {
+            const Instr& following = function.code[i + 1];
+            if (following.op == Opcode::Copy && following.a == instr.dst && single(instr.dst)) {
+                skipCopy = true;
+                return slot[following.dst];
+            }
+        }
+        return slot[instr.dst];
+    }
+
+    // Follow blocks holding nothing but a jump
+    std::uint32_t thread(std::uint32_t block) const {
+        for (std::size_t steps = 0; steps < function.blocks.size(); ++steps) {
+            const IRBlock& b = function.blocks[block];
+            if (b.end - b.begin != 1 || function.code[b.begin].op != Opcode::Jump) {
+                break;
+            }
+            block = function.code[b.begin].a;
+        }
+        return block;
+    }
+
+    void emit(Bc op, std::initializer_list<std::uint32_t> operands) {
+        out.code.push_back(static_cast<std::uint32_t>(op));
+        out.code.insert(out.code.end(), operands);
+        ++out.instructions;
+    }
+
+    template <typename... Operands>
+    void emit(Bc op, Operands... operands) {
+        emit(op, {static_cast<std::uint32_t>(operands)...});
+    }
+
+    void jumpOperand(std::uint32_t block) {
+        fixups.push_back({static_cast<std::uint32_t>(out.code.size()), block});
+        out.code.push_back(0);
+    }
+
+    void jump(std::uint32_t block) {
+        block = thread(block);
+        if (block != next) {
+            emit(Bc::Jump);
+            jumpOperand(block);
+        }
+    }
+
+    // Jump to ifTrue when the test holds and to ifFalse otherwise, falling
+    // through to whichever comes next; b is none for a one-register test
+    void branch(Bc test, Bc negated, std::uint32_t a, std::uint32_t b, std::uint32_t ifTrue, std::uint32_t ifFalse) {
+        ifTrue = thread(ifTrue);
+        ifFalse = thread(ifFalse);
+        bool flip = ifTrue == next;
+        if (b == none) {
+            emit(flip ? negated : test, a);
+        } else {
+            emit(flip ? negated : test, a, b);
+        }
+        jumpOperand(flip ? ifFalse : ifTrue);
+        if (!flip) {
+            jump(ifFalse);
+        }
+    }
+};
+
+struct Return {
+    std::uint32_t pc;
+    std::uint32_t base;
+    std::uint32_t fp;
+    std::uint32_t dst;
+};
+
+inline float toFloat(std::uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+inline std::uint32_t fromFloat(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    return bits;
+}
+
+inline std::int32_t toInt(std::uint32_t bits) {
+    return static_cast<std::int32_t>(bits);
+}
+
+} // namespace
+
+bool compileBytecode(const IRProgram& program, Bytecode& out, std::string& error) {
+    for (const IRFunction& function : program.functions) {
+        for (const Instr& instr : function.code) {
+            if (instr.op == Opcode::Phi) {
+                error = "function " + function.name + " is still in SSA form";
+                return false;
+            }
+        }
+    }
+    if (program.entry == none) {
+        error = "the program has neither a program block nor a main function";
+        return false;
+    }
+
+    out = Bytecode();
+    out.functions.resize(program.functions.size());
+    for (std::size_t f = 0; f < program.functions.size(); ++f) {
+        FunctionCompiler(program.functions[f], out, out.functions[f]).compile();
+    }
+    out.entry = program.entry;
+    return true;
+}
+
+bool runBytecode(const Bytecode& program, std::istream& in, std::string& out, BytecodeStats& stats, std::string& error) {
+    stats = BytecodeStats();
+    if (program.entry == none) {
+        error = "nothing to run";
+        return false;
+    }
+
+    // Registers and frames both grow by doubling; saved state holds
+    // offsets into them, never pointers
+    std::vector<std::uint32_t> registers(std::size_t(1) << 12);
+    std::vector<unsigned char> memory(std::size_t(1) << 16);
+    std::vector<Return> returns;
+    const std::uint32_t* code = program.code.data();
+    std::uint32_t* r = nullptr;
+    unsigned char* m = memory.data();
+    std::size_t size = memory.size();
+    std::uint32_t pc = 0, base = 0, fp = 0, sp = 0;
+    std::size_t executed = 0, calls = 1;  // the entry counts, as in interpret()
+    const char* fault = nullptr;
+
+    // Give function index the window from newBase, where its arguments
+    // already are, and a zeroed frame
+    auto enter = [&](std::uint32_t index, std::uint32_t newBase) {
+        const Bytecode::Function& function = program.functions[index];
+        if (registers.size() - newBase < function.registers) {
+            registers.resize(std::max(registers.size() * 2, std::size_t(newBase) + function.registers));
+        }
+        if (size - sp < function.frameSize) {
+            if (memoryBytes - sp < function.frameSize) {
+                fault = "out of memory for frames";
+                return false;
+            }
+            memory.resize(std::min(memoryBytes, std::max(size * 2, std::size_t(sp) + function.frameSize)));
+            m = memory.data();
+            size = memory.size();
+        }
+        base = newBase;
+        r = registers.data() + base;
+        std::fill(r + function.params, r + function.locals, 0);
+        std::copy_n(program.constants.begin() + function.constantFirst, function.constantCount, r + function.locals);
+        fp = sp;
+        sp += function.frameSize;
+        std::memset(m + fp, 0, function.frameSize);
+        pc = function.start;
+        return true;
+    };
+
+    // Back to the caller with the value returned; false when the entry
+    // function is done
+    auto leave = [&](std::uint32_t value) {
+        sp = fp;
+        if (returns.empty()) {
+            return false;
+        }
+        const Return& back = returns.back();
+        pc = back.pc;
+        base = back.base;
+        fp = back.fp;
+        r = registers.data() + base;
+        if (back.dst != none) {
+            r[back.dst] = value;
+        }
+        returns.pop_back();
+        return true;
+    };
+
+    auto input = [&](bool floating) -> std::uint32_t {
+        if (floating) {
+            float value = 0;
+            in >> value;
+            return fromFloat(in ? value : 0.0f);
+        }
+        int value = 0;
+        in >> value;
+        return in ? static_cast<std::uint32_t>(value) : 0;
+    };
+
+    auto print = [&](std::uint32_t value, bool floating, bool newline) {
+        char text[32];
+        if (floating) {
+            std::snprintf(text, sizeof text, "%g", toFloat(value));
+        } else {
+            std::snprintf(text, sizeof text, "%d", toInt(value));
+        }
+        out += text;
+        if (newline) {
+            out += '\n';
+        }
+    };
+
+    // An address and length inside memory
+    auto inside = [&](std::uint32_t address, std::uint32_t bytes) {
+        return std::size_t(address) + bytes <= size;
+    };
+
+    if (!enter(program.entry, 0)) {
+        error = fault;
+        return false;
+    }
+
+#if defined(__GNUC__) && !defined(BYTECODE_SWITCH)
+    static void* const handlers[] = {
+#define BYTECODE_LABEL(name) &&do##name,
+        BYTECODE_OPS(BYTECODE_LABEL)
+#undef BYTECODE_LABEL
+    };
+#define BYTECODE_CASE(name) do##name:
+#define BYTECODE_NEXT                 \
+    do {                              \
+        ++executed;                   \
+        goto *handlers[code[pc]];     \
+    } while (false)
+    BYTECODE_NEXT;
+#else
+#define BYTECODE_CASE(name) case Bc::name:
+#define BYTECODE_NEXT continue
+    for (;;) {
+        ++executed;
+        switch (static_cast<Bc>(code[pc])) {
+#endif
+
+#define BYTECODE_BINARY(name, result)                                      \
+    BYTECODE_CASE(name) {                                                  \
+        std::uint32_t x = r[code[pc + 2]], y = r[code[pc + 3]];             \
+        r[code[pc + 1]] = (result);                                        \
+        pc += 4;                                                           \
+    }                                                                      \
+    BYTECODE_NEXT;
+#define BYTECODE_COMPARE_JUMP(name, test)                                  \
+    BYTECODE_CASE(name) {                                                  \
+        std::int32_t x = toInt(r[code[pc + 1]]), y = toInt(r[code[pc + 2]]); \
+        pc = (test) ? code[pc + 3] : pc + 4;                               \
+    }                                                                      \
+    BYTECODE_NEXT;
+
+    BYTECODE_CASE(Const)
+        r[code[pc + 1]] = code[pc + 2];
+        pc += 3;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(Copy)
+        r[code[pc + 1]] = r[code[pc + 2]];
+        pc += 3;
+        BYTECODE_NEXT;
+
+    BYTECODE_BINARY(Add, x + y)
+    BYTECODE_BINARY(Sub, x - y)
+    BYTECODE_BINARY(Mul, x * y)
+    BYTECODE_CASE(Div) {
+        std::uint32_t x = r[code[pc + 2]], y = r[code[pc + 3]];
+        if (y == 0) {
+            fault = "division by zero";
+            goto failed;
+        }
+        r[code[pc + 1]] = toInt(y) == -1 ? 0u - x : static_cast<std::uint32_t>(toInt(x) / toInt(y));
+        pc += 4;
+    }
+        BYTECODE_NEXT;
+    BYTECODE_BINARY(And, x != 0 && y != 0)
+    BYTECODE_BINARY(Or, x != 0 || y != 0)
+    BYTECODE_BINARY(Eq, toInt(x) == toInt(y))
+    BYTECODE_BINARY(NotEq, toInt(x) != toInt(y))
+    BYTECODE_BINARY(Lt, toInt(x) < toInt(y))
+    BYTECODE_BINARY(Gt, toInt(x) > toInt(y))
+    BYTECODE_BINARY(LtEq, toInt(x) <= toInt(y))
+    BYTECODE_BINARY(GtEq, toInt(x) >= toInt(y))
+    BYTECODE_BINARY(FAdd, fromFloat(toFloat(x) + toFloat(y)))
+    BYTECODE_BINARY(FSub, fromFloat(toFloat(x) - toFloat(y)))
+    BYTECODE_BINARY(FMul, fromFloat(toFloat(x) * toFloat(y)))
+    BYTECODE_BINARY(FDiv, fromFloat(toFloat(x) / toFloat(y)))
+    BYTECODE_BINARY(FEq, toFloat(x) == toFloat(y))
+    BYTECODE_BINARY(FNotEq, toFloat(x) != toFloat(y))
+    BYTECODE_BINARY(FLt, toFloat(x) < toFloat(y))
+    BYTECODE_BINARY(FGt, toFloat(x) > toFloat(y))
+    BYTECODE_BINARY(FLtEq, toFloat(x) <= toFloat(y))
+    BYTECODE_BINARY(FGtEq, toFloat(x) >= toFloat(y))
+
+    BYTECODE_CASE(Neg)
+        r[code[pc + 1]] = 0u - r[code[pc + 2]];
+        pc += 3;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(FNeg)
+        r[code[pc + 1]] = fromFloat(-toFloat(r[code[pc + 2]]));
+        pc += 3;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(Not)
+        r[code[pc + 1]] = r[code[pc + 2]] == 0;
+        pc += 3;
+        BYTECODE_NEXT;
+
+    BYTECODE_CASE(Frame)
+        r[code[pc + 1]] = fp + code[pc + 2];
+        pc += 3;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(Load) {
+        std::uint32_t address = r[code[pc + 2]] + code[pc + 3];
+        if (!inside(address, 4)) {
+            fault = "memory access out of range";
+            goto failed;
+        }
+        std::memcpy(&r[code[pc + 1]], m + address, 4);
+        pc += 4;
+    }
+        BYTECODE_NEXT;
+    BYTECODE_CASE(Store) {
+        std::uint32_t address = r[code[pc + 1]] + code[pc + 2];
+        if (!inside(address, 4)) {
+            fault = "memory access out of range";
+            goto failed;
+        }
+        std::memcpy(m + address, &r[code[pc + 3]], 4);
+        pc += 4;
+    }
+        BYTECODE_NEXT;
+    BYTECODE_CASE(Move) {
+        std::uint32_t to = r[code[pc + 1]], from = r[code[pc + 2]], bytes = code[pc + 3];
+        if (!inside(to, bytes) || !inside(from, bytes)) {
+            fault = "memory access out of range";
+            goto failed;
+        }
+        std::memmove(m + to, m + from, bytes);
+        pc += 4;
+    }
+        BYTECODE_NEXT;
+
+    BYTECODE_CASE(Call) {
+        // returns holds every frame but the entry's, which interpret()
+        // counts towards the limit too
+        if (returns.size() + 1 >= maxDepth) {
+            fault = "calls nested too deep";
+            goto failed;
+        }
+        std::uint32_t index = code[pc + 1];
+        returns.push_back({pc + 4, base, fp, code[pc + 2]});
+        ++calls;
+        if (!enter(index, base + code[pc + 3])) {
+            goto failed;
+        }
+    }
+        BYTECODE_NEXT;
+    BYTECODE_CASE(Ret)
+        if (!leave(r[code[pc + 1]])) {
+            goto finished;
+        }
+        BYTECODE_NEXT;
+    BYTECODE_CASE(RetVoid)
+        if (!leave(0)) {
+            goto finished;
+        }
+        BYTECODE_NEXT;
+
+    BYTECODE_CASE(ReadInt)
+        r[code[pc + 1]] = input(false);
+        pc += 2;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(ReadFloat)
+        r[code[pc + 1]] = input(true);
+        pc += 2;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(WriteInt)
+        print(r[code[pc + 1]], false, true);
+        pc += 2;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(WriteFloat)
+        print(r[code[pc + 1]], true, true);
+        pc += 2;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(PutInt)
+        print(r[code[pc + 1]], false, false);
+        pc += 2;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(PutFloat)
+        print(r[code[pc + 1]], true, false);
+        pc += 2;
+        BYTECODE_NEXT;
+
+    BYTECODE_CASE(Jump)
+        pc = code[pc + 1];
+        BYTECODE_NEXT;
+    BYTECODE_CASE(JumpIf)
+        pc = r[code[pc + 1]] ? code[pc + 2] : pc + 3;
+        BYTECODE_NEXT;
+    BYTECODE_CASE(JumpIfNot)
+        pc = r[code[pc + 1]] ? pc + 3 : code[pc + 2];
+        BYTECODE_NEXT;
+    BYTECODE_COMPARE_JUMP(JumpEq, x == y)
+    BYTECODE_COMPARE_JUMP(JumpNotEq, x != y)
+    BYTECODE_COMPARE_JUMP(JumpLt, x < y)
+    BYTECODE_COMPARE_JUMP(JumpGt, x > y)
+    BYTECODE_COMPARE_JUMP(JumpLtEq, x <= y)
+    BYTECODE_COMPARE_JUMP(JumpGtEq, x >= y)
+
+#if !defined(__GNUC__) || defined(BYTECODE_SWITCH)
+        }
+    }
+#endif
+#undef BYTECODE_COMPARE_JUMP
+#undef BYTECODE_BINARY
+#undef BYTECODE_NEXT
+#undef BYTECODE_CASE
+
+failed:
+    stats.executed = executed;
+    stats.calls = calls;
+    error = fault;
+    return false;
+
+finished:
+    stats.executed = executed;
+    stats.calls = calls;
+    return true;
+}
@@ -0,0 +1,305 @@
+#include "../include/constant_fold.h"
+#include "../include/ast_walker.h"
+#include "../include/type_table.h"
+#include <climits>
+#include <cstdint>
+
+namespace {
+
+bool isLiteral(const Expression* expr) {
+    return expr->kind == NodeKind::IntegerLiteral || expr->kind == NodeKind::FloatLiteral;
+}
+
+// Whether a literal is the integer or float constant value
+bool isConstant(const Expression* expr, int value) {
+    if (expr->kind == NodeKind::IntegerLiteral) {
+        return static_cast<const IntegerLiteral*>(expr)->value == value;
+    }
+    return expr->kind == NodeKind::FloatLiteral && static_cast<const FloatLiteral*>(expr)->value == static_cast<float>(value);
+}
+
+// Whether expr has the type of the literal it is combined with, so removing
+// the literal does not change the type of the expression; an unchecked tree
+// is taken to be well typed
+bool sameType(const Expression* expr, const Expression* literal) {
+    if (expr->type == TypeTable::none) {
+        return true;
+    }
+    return expr->type == (literal->kind == NodeKind::IntegerLiteral ? TypeTable::intType : TypeTable::floatType);
+}
+
+// Whether expr evaluates to 0 or 1
+bool isBoolean(const Expression* expr) {
+    if (expr->kind == NodeKind::BinaryExpression) {
+        return info(static_cast<const BinaryExpression*>(expr)->op).opClass != OpClass::Arithmetic;
+    }
+    return expr->kind == NodeKind::UnaryExpression && static_cast<const UnaryExpression*>(expr)->op == UnOp::Not;
+}
+
+int wrap(std::int64_t value) {
+    return static_cast<int>(static_cast<std::uint32_t>(value));
+}
+
+// Rewrites bottom-up: leave() runs after the children of a node have been
+// rewritten, and replaces each of its expression slots with the simplest
+// equivalent of what is there.
+class Folder : public ASTWalker<Folder> {
+public:
+    using ASTWalker<Folder>::leave;
+
+    Folder(ASTContext& context, FoldStats& stats) : context(context), stats(stats) {}
+
+    void leave(BinaryExpression& node) {
+        node.left = simplify(node.left);
+        node.right = simplify(node.right);
+    }
+    void leave(UnaryExpression& node) { node.expr = simplify(node.expr); }
+    void leave(IndexExpression& node) {
+        node.base = simplify(node.base);
+        node.index = simplify(node.index);
+    }
+    void leave(MemberExpression& node) { node.object = simplify(node.object); }
+    void leave(CallExpression& node) {
+        for (Expression*& arg : node.args) {
+            arg = simplify(arg);
+        }
+    }
+
+    void leave(AssignStatement& node) {
+        node.lhs = simplify(node.lhs);
+        node.rhs = simplify(node.rhs);
+    }
+    void leave(ReturnStatement& node) { node.expression = simplify(node.expression); }
+    void leave(IfStatement& node) { node.condition = simplify(node.condition); }
+    void leave(WhileStatement& node) { node.condition = simplify(node.condition); }
+
+private:
+    ASTContext& context;
+    FoldStats& stats;
+
+    Expression* integer(const Expression& replaced, int value) {
+        IntegerLiteral* literal = context.make<IntegerLiteral>(value);
+        literal->span = replaced.span;
+        literal->type = replaced.type == TypeTable::none ? TypeTable::none : TypeTable::intType;
+        return literal;
+    }
+
+    Expression* floating(const Expression& replaced, float value) {
+        FloatLiteral* literal = context.make<FloatLiteral>(value);
+        literal->span = replaced.span;
+        literal->type = replaced.type == TypeTable::none ? TypeTable::none : TypeTable::floatType;
+        return literal;
+    }
+
+    Expression* binary(const Expression& replaced, BinOp op, Expression* left, Expression* right) {
+        BinaryExpression* node = context.make<BinaryExpression>(op, left, right);
+        node->span = replaced.span;
+        node->type = replaced.type;
+        return node;
+    }
+
+    // expr with its children already simplified
+    Expression* simplify(Expression* expr) {
+        if (!expr) {
+            return expr;
+        }
+        if (expr->kind == NodeKind::BinaryExpression) {
+            return simplifyBinary(static_cast<BinaryExpression*>(expr));
+        }
+        if (expr->kind == NodeKind::UnaryExpression) {
+            return simplifyUnary(static_cast<UnaryExpression*>(expr));
+        }
+        return expr;
+    }
+
+    Expression* simplifyBinary(BinaryExpression* node) {
+        Expression* left = node->left;
+        Expression* right = node->right;
+
+        if (left->kind == NodeKind::IntegerLiteral && right->kind == NodeKind::IntegerLiteral) {
+            int value;
+            if (evaluate(node->op, static_cast<IntegerLiteral*>(left)->value, static_cast<IntegerLiteral*>(right)->value, value)) {
+                ++stats.folded;
+                stats.removed += 2;
+                return integer(*node, value);
+            }
+            return node;
+        }
+        if (left->kind == NodeKind::FloatLiteral && right->kind == NodeKind::FloatLiteral) {
+            float a = static_cast<FloatLiteral*>(left)->value;
+            float b = static_cast<FloatLiteral*>(right)->value;
+            switch (info(node->op).opClass) {
+            case OpClass::Arithmetic: {
+                float value;
+                if (!evaluate(node->op, a, b, value)) {
+                    return node;
+                }
+                ++stats.folded;
+                stats.removed += 2;
+                return floating(*node, value);
+            }
+            case OpClass::Relational:
+                ++stats.folded;
+                stats.removed += 2;
+                return integer(*node, compare(node->op, a, b));
+            case OpClass::Logical:
+                return node;
+            }
+        }
+
+        if (Expression* reassociated = reassociate(node)) {
+            return reassociated;
+        }
+
+        // x + 0, x - 0, x * 1, x / 1 and the commuted 0 + x, 1 * x
+        Expression* kept = nullptr;
+        switch (node->op) {
+        case BinOp::Add:
+            kept = isConstant(right, 0) && sameType(left, right) ? left
+                 : isConstant(left, 0) && sameType(right, left) ? right : nullptr;
+            break;
+        case BinOp::Sub:
+            kept = isConstant(right, 0) && sameType(left, right) ? left : nullptr;
+            break;
+        case BinOp::Mul:
+            kept = isConstant(right, 1) && sameType(left, right) ? left
+                 : isConstant(left, 1) && sameType(right, left) ? right : nullptr;
+            break;
+        case BinOp::Div:
+            kept = isConstant(right, 1) && sameType(left, right) ? left : nullptr;
+            break;
+        default:
+            break;
+        }
+        if (kept) {
+            ++stats.simplified;
+            stats.removed += 2;
+            return kept;
+        }
+        return node;
+    }
+
+    // Move integer constants of a chain of + and - to its right end, where
+    // they meet and fold: (a + c1) + c2 becomes a + (c1 + c2), and
+    // (a + c1) + b becomes (a + b) + c1. Wrapping arithmetic is
+    // associative, and a and b are still evaluated in order. Float chains
+    // are left alone, since rounding makes their order matter.
+    Expression* reassociate(BinaryExpression* node) {
+        if ((node->op != BinOp::Add && node->op != BinOp::Sub) || node->left->kind != NodeKind::BinaryExpression ||
+            (node->type != TypeTable::none && node->type != TypeTable::intType)) {
+            return nullptr;
+        }
+        BinaryExpression* left = static_cast<BinaryExpression*>(node->left);
+        if ((left->op != BinOp::Add && left->op != BinOp::Sub) || left->right->kind != NodeKind::IntegerLiteral) {
+            return nullptr;
+        }
+        int inner = static_cast<IntegerLiteral*>(left->right)->value;
+
+        if (node->right->kind == NodeKind::IntegerLiteral) {
+            int outer = static_cast<IntegerLiteral*>(node->right)->value;
+            std::int64_t sum = static_cast<std::int64_t>(left->op == BinOp::Add ? inner : -static_cast<std::int64_t>(inner)) +
+                               (node->op == BinOp::Add ? outer : -static_cast<std::int64_t>(outer));
+            ++stats.folded;
+            stats.removed += 2;
+            if (wrap(sum) == 0) {
+                stats.removed += 2;
+                return left->left;
+            }
+            int value = wrap(sum);
+            if (value < 0 && value != INT_MIN) {
+                return binary(*node, BinOp::Sub, left->left, integer(*node->right, -value));
+            }
+            return binary(*node, BinOp::Add, left->left, integer(*node->right, value));
+        }
+        if (isLiteral(node->right)) {
+            return nullptr;
+        }
+        Expression* rest = binary(*left, node->op, left->left, node->right);
+        return binary(*node, left->op, rest, left->right);
+    }
+
+    Expression* simplifyUnary(UnaryExpression* node) {
+        Expression* operand = node->expr;
+        if (node->op == UnOp::Plus && (isLiteral(operand) || operand->type == node->type)) {
+            ++stats.simplified;
+            stats.removed += 1;
+            return operand;
+        }
+
+        if (operand->kind == NodeKind::IntegerLiteral) {
+            int value = static_cast<IntegerLiteral*>(operand)->value;
+            ++stats.folded;
+            stats.removed += 1;
+            return integer(*node, node->op == UnOp::Minus ? wrap(-static_cast<std::int64_t>(value)) : !value);
+        }
+        if (operand->kind == NodeKind::FloatLiteral && node->op == UnOp::Minus) {
+            ++stats.folded;
+            stats.removed += 1;
+            return floating(*node, -static_cast<FloatLiteral*>(operand)->value);
+        }
+
+        // - - x and not not x, the latter only when x is already 0 or 1
+        if (operand->kind == NodeKind::UnaryExpression) {
+            UnaryExpression* inner = static_cast<UnaryExpression*>(operand);
+            if (inner->op == node->op && (node->op == UnOp::Minus || (node->op == UnOp::Not && isBoolean(inner->expr)))) {
+                ++stats.simplified;
+                stats.removed += 2;
+                return inner->expr;
+            }
+        }
+        return node;
+    }
+
+    static bool evaluate(BinOp op, int a, int b, int& value) {
+        switch (op) {
+        case BinOp::Add: value = wrap(static_cast<std::int64_t>(a) + b); return true;
+        case BinOp::Sub: value = wrap(static_cast<std::int64_t>(a) - b); return true;
+        case BinOp::Mul: value = wrap(static_cast<std::int64_t>(a) * b); return true;
+        case BinOp::Div:
+            if (b == 0 || (a == INT_MIN && b == -1)) {
+                return false;
+            }
+            value = a / b;
+            return true;
+        case BinOp::And: value = a && b; return true;
+        case BinOp::Or: value = a || b; return true;
+        default: value = compare(op, a, b); return true;
+        }
+    }
+
+    static bool evaluate(BinOp op, float a, float b, float& value) {
+        switch (op) {
+        case BinOp::Add: value = a + b; return true;
+        case BinOp::Sub: value = a - b; return true;
+        case BinOp::Mul: value = a * b; return true;
+        case BinOp::Div:
+            if (b == 0.0f) {
+                return false;
+            }
+            value = a / b;
+            return true;
+        default: return false;
+        }
+    }
+
+    template <typename T>
+    static int compare(BinOp op, T a, T b) {
+        switch (op) {
+        case BinOp::Eq: return a == b;
+        case BinOp::NotEq: return a != b;
+        case BinOp::Lt: return a < b;
+        case BinOp::Gt: return a > b;
+        case BinOp::LtEq: return a <= b;
+        case BinOp::GtEq: return a >= b;
+        default: return 0;
+        }
+    }
+};
+
+} // namespace
+
+FoldStats foldConstants(ASTNode* root, ASTContext& context) {
+    FoldStats stats;
+    Folder(context, stats).walk(root);
+    return stats;
+}
@@ -0,0 +1,16 @@
+#include "../include/diagnostics.h"
+#include "../include/output_buffer.h"
+#include <algorithm>
+
+bool writeDiagnostics(std::vector<Diagnostic>& diagnostics, const LineTable& lines, const std::string& path) {
+    std::stable_sort(diagnostics.begin(), diagnostics.end(),
+        [](const Diagnostic& a, const Diagnostic& b) { return a.offset < b.offset; });
+
+    OutputBuffer out;
+    for (const Diagnostic& diagnostic : diagnostics) {
+        LineColumn position = lines.resolve(diagnostic.offset);
+        out << (diagnostic.severity == Severity::Error ? "[error] " : "[warning] ")
+            << position.line << ':' << position.column << ": " << diagnostic.message << '\n';
+    }
+    return out.writeTo(path);
+}
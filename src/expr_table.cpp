@@ -0,0 +1,142 @@
+#include "../include/expr_table.h"
+#include <algorithm>
+#include <cstring>
+
+// Final mixing step of splitmix64, enough to spread pointer and small
+// integer keys over the table
+static std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static std::uint64_t combine(std::uint64_t seed, std::uint64_t value) {
+    return mix(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+static std::uint64_t key(NodeKind kind, std::uint64_t value) {
+    return combine(static_cast<std::uint64_t>(kind), value);
+}
+
+static std::uint64_t key(const void* node) {
+    return reinterpret_cast<std::uintptr_t>(node);
+}
+
+template <typename T, typename Same, typename Make>
+T* ExprTable::intern(NodeKind kind, std::uint64_t hash, Same same, Make make) {
+    // Keep the load factor at or below one half
+    if (2 * (occupied + 1) > slots.size()) {
+        grow();
+    }
+
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (slot.expr == nullptr) {
+            T* node = make();
+            node->interned = true;
+            slot = {hash, node};
+            ++occupied;
+            ++count;
+            return node;
+        }
+        if (slot.hash == hash && slot.expr->kind == kind && same(static_cast<T*>(slot.expr))) {
+            ++reused;
+            return static_cast<T*>(slot.expr);
+        }
+    }
+}
+
+void ExprTable::grow() {
+    std::vector<Slot> old(slots.empty() ? 64 : 2 * slots.size(), Slot{0, nullptr});
+    old.swap(slots);
+
+    std::size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.expr == nullptr) {
+            continue;
+        }
+        std::size_t i = slot.hash & mask;
+        while (slots[i].expr != nullptr) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
+
+// Keep the slots for the next body rather than growing them again
+void ExprTable::startBody() {
+    std::fill(slots.begin(), slots.end(), Slot{0, nullptr});
+    occupied = 0;
+}
+
+void ExprTable::clear() {
+    slots.clear();
+    occupied = 0;
+    count = 0;
+    reused = 0;
+}
+
+Identifier* ExprTable::identifier(Symbol name) {
+    return intern<Identifier>(NodeKind::Identifier, key(NodeKind::Identifier, name.id),
+        [&](Identifier* node) { return node->name == name; },
+        [&] { return context.make<Identifier>(name); });
+}
+
+IntegerLiteral* ExprTable::integer(int value) {
+    return intern<IntegerLiteral>(NodeKind::IntegerLiteral, key(NodeKind::IntegerLiteral, static_cast<std::uint32_t>(value)),
+        [&](IntegerLiteral* node) { return node->value == value; },
+        [&] { return context.make<IntegerLiteral>(value); });
+}
+
+// Float literals are compared by their bits, so 0.0 and -0.0 stay apart
+FloatLiteral* ExprTable::floating(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return intern<FloatLiteral>(NodeKind::FloatLiteral, key(NodeKind::FloatLiteral, bits),
+        [&](FloatLiteral* node) { return std::memcmp(&node->value, &value, sizeof(value)) == 0; },
+        [&] { return context.make<FloatLiteral>(value); });
+}
+
+BinaryExpression* ExprTable::binary(BinOp op, Expression* left, Expression* right) {
+    if (!left->interned || !right->interned) {
+        return context.make<BinaryExpression>(op, left, right);
+    }
+    std::uint64_t hash = combine(combine(key(NodeKind::BinaryExpression, static_cast<std::uint64_t>(op)), key(left)), key(right));
+    return intern<BinaryExpression>(NodeKind::BinaryExpression, hash,
+        [&](BinaryExpression* node) { return node->op == op && node->left == left && node->right == right; },
+        [&] { return context.make<BinaryExpression>(op, left, right); });
+}
+
+UnaryExpression* ExprTable::unary(UnOp op, Expression* operand) {
+    if (!operand->interned) {
+        return context.make<UnaryExpression>(op, operand);
+    }
+    std::uint64_t hash = combine(key(NodeKind::UnaryExpression, static_cast<std::uint64_t>(op)), key(operand));
+    return intern<UnaryExpression>(NodeKind::UnaryExpression, hash,
+        [&](UnaryExpression* node) { return node->op == op && node->expr == operand; },
+        [&] { return context.make<UnaryExpression>(op, operand); });
+}
+
+IndexExpression* ExprTable::index(Expression* base, Expression* index) {
+    if (!base->interned || !index->interned) {
+        return context.make<IndexExpression>(base, index);
+    }
+    std::uint64_t hash = combine(combine(key(NodeKind::IndexExpression, 0), key(base)), key(index));
+    return intern<IndexExpression>(NodeKind::IndexExpression, hash,
+        [&](IndexExpression* node) { return node->base == base && node->index == index; },
+        [&] { return context.make<IndexExpression>(base, index); });
+}
+
+MemberExpression* ExprTable::member(Expression* object, Symbol member) {
+    if (!object->interned) {
+        return context.make<MemberExpression>(object, member);
+    }
+    std::uint64_t hash = combine(key(NodeKind::MemberExpression, member.id), key(object));
+    return intern<MemberExpression>(NodeKind::MemberExpression, hash,
+        [&](MemberExpression* node) { return node->member == member && node->object == object; },
+        [&] { return context.make<MemberExpression>(object, member); });
+}
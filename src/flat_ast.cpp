@@ -0,0 +1,237 @@
+#include "../include/flat_ast.h"
+#include "../include/ast_walker.h"
+#include <cstring>
+
+std::uint32_t FlatAST::addNode(NodeKind kind, std::uint32_t value) {
+    std::uint32_t index = size();
+    kinds.push_back(kind);
+    firstChild.push_back(none);
+    nextSibling.push_back(none);
+    payload.push_back(value);
+    return index;
+}
+
+int FlatAST::intValue(std::uint32_t node) const {
+    return static_cast<int>(payload[node]);
+}
+
+float FlatAST::floatValue(std::uint32_t node) const {
+    float value;
+    std::memcpy(&value, &payload[node], sizeof(value));
+    return value;
+}
+
+static std::uint32_t floatBits(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Appends nodes in pre-order, linking each one after the previous child of
+// the node currently open
+class Flattener : public ASTWalker<Flattener> {
+public:
+    using ASTWalker<Flattener>::enter;
+    using ASTWalker<Flattener>::leave;
+
+    FlatAST flat;
+
+    bool enter(ClassDecl& node) { return open(node.kind, node.name.id); }
+    bool enter(ImplDecl& node) { return open(node.kind, node.name.id); }
+    bool enter(FuncDecl& node) { return open(node.kind, node.name.id); }
+    bool enter(VarDecl& node) { return open(node.kind, node.name.id); }
+    bool enter(MemberExpression& node) { return open(node.kind, node.member.id); }
+
+    // Array sizes become IntegerLiteral children of the type
+    bool enter(Type& node) {
+        open(node.kind, node.name.id);
+        for (std::uint32_t i = 0; i < node.dimCount; ++i) {
+            open(NodeKind::IntegerLiteral, node.dims[i]);
+            frames.pop_back();
+        }
+        return true;
+    }
+
+    bool enter(BinaryExpression& node) { return open(node.kind, static_cast<std::uint32_t>(node.op)); }
+    bool enter(UnaryExpression& node) { return open(node.kind, static_cast<std::uint32_t>(node.op)); }
+    bool enter(Identifier& node) { return open(node.kind, node.name.id); }
+    bool enter(IntegerLiteral& node) { return open(node.kind, static_cast<std::uint32_t>(node.value)); }
+    bool enter(FloatLiteral& node) { return open(node.kind, floatBits(node.value)); }
+
+    // Nodes without a payload
+    template <typename Node>
+    bool enter(Node& node) { return open(node.kind, 0); }
+
+    template <typename Node>
+    void leave(Node&) { frames.pop_back(); }
+
+    void missing() {
+        open(NodeKind::Empty, 0);
+        frames.pop_back();
+    }
+
+private:
+    struct Frame {
+        std::uint32_t node;
+        std::uint32_t lastChild;
+    };
+    std::vector<Frame> frames;
+
+    bool open(NodeKind kind, std::uint32_t value) {
+        std::uint32_t index = flat.addNode(kind, value);
+        if (!frames.empty()) {
+            Frame& parent = frames.back();
+            if (parent.lastChild == FlatAST::none) {
+                flat.firstChild[parent.node] = index;
+            } else {
+                flat.nextSibling[parent.lastChild] = index;
+            }
+            parent.lastChild = index;
+        }
+        frames.push_back({index, FlatAST::none});
+        return true;
+    }
+};
+
+FlatAST flattenAST(ASTNode* root) {
+    Flattener flattener;
+    flattener.walk(root);
+    return std::move(flattener.flat);
+}
+
+// Rebuilds pointer nodes from a flat AST. Children always have larger
+// indices than their parent in pre-order, so building from the last node to
+// the first finds every child already built, with no recursion.
+class Inflater {
+public:
+    Inflater(const FlatAST& flat, ASTContext& context) : flat(flat), context(context), built(flat.size(), nullptr) {}
+
+    ASTNode* inflate() {
+        for (std::uint32_t node = flat.size(); node-- > 0;) {
+            children.clear();
+            flat.forEachChild(node, [&](std::uint32_t child) { children.push_back(child); });
+            built[node] = make(node);
+        }
+        return built.empty() ? nullptr : built[0];
+    }
+
+private:
+    const FlatAST& flat;
+    ASTContext& context;
+    std::vector<ASTNode*> built;
+    std::vector<std::uint32_t> children;  // of the node being built
+
+    ASTNode* make(std::uint32_t node) {
+        switch (flat.kinds[node]) {
+        case NodeKind::Program: {
+            std::vector<ASTNode*> decls;
+            for (auto child : children) {
+                decls.push_back(built[child]);
+            }
+            return context.make<Program>(decls);
+        }
+        case NodeKind::ClassDecl: {
+            // parents..., members...; members are never bare types
+            std::vector<Type*> parents;
+            std::vector<ASTNode*> members;
+            for (auto child : children) {
+                if (flat.kinds[child] == NodeKind::Type && members.empty()) {
+                    parents.push_back(static_cast<Type*>(built[child]));
+                } else {
+                    members.push_back(built[child]);
+                }
+            }
+            ClassDecl* cls = context.make<ClassDecl>(flat.symbol(node), members);
+            cls->parents = std::move(parents);
+            cls->memberVisibility.assign(cls->members.size(), Visibility::Public);
+            return cls;
+        }
+        case NodeKind::ImplDecl: {
+            std::vector<FuncDecl*> functions;
+            for (auto child : children) {
+                functions.push_back(static_cast<FuncDecl*>(built[child]));
+            }
+            return context.make<ImplDecl>(flat.symbol(node), functions);
+        }
+        case NodeKind::FuncDecl: {
+            // params..., return type, body
+            std::vector<VarDecl*> params;
+            for (std::size_t i = 0; i + 2 < children.size(); ++i) {
+                params.push_back(static_cast<VarDecl*>(built[children[i]]));
+            }
+            Type* returnType = static_cast<Type*>(built[children[children.size() - 2]]);
+            Statement* body = statement(children.back());
+            return context.make<FuncDecl>(flat.symbol(node), params, returnType, body);
+        }
+        case NodeKind::VarDecl:
+            return context.make<VarDecl>(flat.symbol(node), static_cast<Type*>(built[children[0]]));
+        case NodeKind::Type: {
+            Type* type = context.make<Type>(flat.symbol(node));
+            if (!children.empty()) {
+                std::vector<std::uint32_t> dims;
+                for (auto child : children) {
+                    dims.push_back(flat.payload[child]);
+                }
+                type->dims = context.makeArray(dims.data(), dims.size());
+                type->dimCount = static_cast<std::uint32_t>(dims.size());
+            }
+            return type;
+        }
+        case NodeKind::Statement:
+            return context.make<Statement>();
+        case NodeKind::IfStatement:
+            return context.make<IfStatement>(expression(children[0]), statement(children[1]), statement(children[2]));
+        case NodeKind::WhileStatement:
+            return context.make<WhileStatement>(expression(children[0]), statement(children[1]));
+        case NodeKind::ReturnStatement:
+            return context.make<ReturnStatement>(expression(children[0]));
+        case NodeKind::AssignStatement:
+            return context.make<AssignStatement>(expression(children[0]), expression(children[1]));
+        case NodeKind::BlockStatement: {
+            std::vector<ASTNode*> items;
+            for (auto child : children) {
+                items.push_back(built[child]);
+            }
+            return context.make<BlockStatement>(context.makeArray(items.data(), items.size()),
+                                                static_cast<std::uint32_t>(items.size()));
+        }
+        case NodeKind::CallStatement:
+            return context.make<CallStatement>(static_cast<CallExpression*>(built[children[0]]));
+        case NodeKind::Expression:
+            return context.make<Expression>();
+        case NodeKind::BinaryExpression:
+            return context.make<BinaryExpression>(static_cast<BinOp>(flat.payload[node]),
+                                                  expression(children[0]), expression(children[1]));
+        case NodeKind::UnaryExpression:
+            return context.make<UnaryExpression>(static_cast<UnOp>(flat.payload[node]), expression(children[0]));
+        case NodeKind::CallExpression: {
+            std::vector<Expression*> args;
+            for (std::size_t i = 1; i < children.size(); ++i) {
+                args.push_back(expression(children[i]));
+            }
+            return context.make<CallExpression>(expression(children[0]), args);
+        }
+        case NodeKind::IndexExpression:
+            return context.make<IndexExpression>(expression(children[0]), expression(children[1]));
+        case NodeKind::MemberExpression:
+            return context.make<MemberExpression>(expression(children[0]), flat.symbol(node));
+        case NodeKind::Identifier:
+            return context.make<Identifier>(flat.symbol(node));
+        case NodeKind::IntegerLiteral:
+            return context.make<IntegerLiteral>(flat.intValue(node));
+        case NodeKind::FloatLiteral:
+            return context.make<FloatLiteral>(flat.floatValue(node));
+        case NodeKind::Empty:
+            return nullptr;
+        }
+        return nullptr;
+    }
+
+    Expression* expression(std::uint32_t node) { return static_cast<Expression*>(built[node]); }
+    Statement* statement(std::uint32_t node) { return static_cast<Statement*>(built[node]); }
+};
+
+ASTNode* inflateAST(const FlatAST& flat, ASTContext& context) {
+    Inflater inflater(flat, context);
+    return inflater.inflate();
+}
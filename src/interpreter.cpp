@@ -0,0 +1,809 @@
+#include "../include/interpreter.h"
+#include "../include/ast_walker.h"
+#include "../include/object_layout.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr std::uint32_t none = 0xFFFFFFFFu;
+
+// Expressions evaluate to a word: an int, the bits of a float, or the
+// address of an array or object. Statements evaluate to nothing.
+enum class Op : std::uint8_t {
+    Const,                                                  // value
+    Slot,                                                   // the word in slot value of the frame
+    Frame,                                                  // the address of slot value
+    Load,                                                   // the word at address a plus value
+    Offset,                                                 // address a plus value
+    Index,                                                  // address a plus b times value
+    Add, Sub, Mul, Div, And, Or, Eq, NotEq, Lt, Gt, LtEq, GtEq,  // a op b on ints
+    FAdd, FSub, FMul, FDiv, FEq, FNotEq, FLt, FGt, FLtEq, FGtEq,  // a op b on floats
+    Neg, FNeg, Not,                                         // op a
+    Call,                                                   // function value on the b words listed from a; an object result goes to slot c
+    Block,                                                  // the b statements listed from a
+    SetSlot,                                                // slot value = a
+    Store,                                                  // word at address a plus value = b
+    Copy,                                                   // value words from address b to address a
+    If,                                                     // if a then b else c, if not none
+    While,                                                  // while a do b
+    Return,                                                 // return a, if not none
+    ReturnCopy,                                             // copy value words from address a to the result, return
+    Evaluate,                                               // a for its effects
+    ReadSlot,                                               // slot value = a number read
+    ReadStore,                                              // word at address a plus value = a number read
+    Write, Put                                              // print a, and a newline for Write
+};
+
+// Addresses and offsets count words
+struct Node {
+    Op op;
+    bool floating = false;  // Read*, Write and Put of a float
+    std::uint32_t a = none;
+    std::uint32_t b = none;
+    std::uint32_t c = none;
+    std::uint32_t value = 0;
+};
+
+struct Function {
+    std::uint32_t body = none;
+    std::uint32_t frameWords = 0;
+};
+
+struct Callee {
+    std::uint32_t index;
+    const SymbolEntry* entry;
+    const SymbolTable* cls;  // class of a member function, or null
+};
+
+// Where a variable lives in its frame
+struct Storage {
+    enum Kind : std::uint8_t { Slot, Frame, Address } kind;  // a scalar, an array or object, a parameter's address
+    std::uint32_t slot;
+};
+
+// The resolved program: functions, their nodes and the lists of children
+// of blocks and calls
+struct Code {
+    std::vector<Function> functions;
+    std::vector<Node> nodes;
+    std::vector<std::uint32_t> lists;
+    std::uint32_t entry = none;
+};
+
+// Builds the nodes of one function at a time. Statements are resolved
+// recursively and expressions with an ASTWalker, the children's nodes
+// pushed on values before their parent's; constant offsets are folded
+// into the node that uses them as they are built.
+class Resolver : public ASTWalker<Resolver> {
+public:
+    using ASTWalker<Resolver>::enter;
+    using ASTWalker<Resolver>::leave;
+
+    Resolver(const ASTContext& context, Layout& layout, Code& code,
+             const std::unordered_map<const FuncDecl*, Callee>& callees, std::string& error)
+        : context(context), layout(layout), code(code), callees(callees), error(error),
+          self(context.find("self")), read(context.find("read")), write(context.find("write")), put(context.find("put")) {}
+
+    void resolveFunction(const Callee& callee) {
+        const FuncDecl& func = static_cast<const FuncDecl&>(*callee.entry->decl);
+        begin(code.functions[callee.index], callee.entry->table, callee.cls, callee.entry->type);
+        if (!layout.isScalar(returnType) && returnType != TypeTable::voidType) {
+            ++function->frameWords;  // slot 0 holds the result address
+        }
+        if (cls) {
+            selfSlot = function->frameWords++;
+        }
+        for (const VarDecl* param : func.params) {
+            const SymbolEntry* entry = scope->find(param->name);
+            place(*entry) = {layout.isScalar(entry->type) ? Storage::Slot : Storage::Address, function->frameWords++};
+        }
+        declareLocals(*scope, SymbolKind::Local);
+        function->body = statement(func.body);
+    }
+
+    void resolveProgram(const Program& root, const SymbolTable& global, Function& target) {
+        begin(target, &global, nullptr, TypeTable::voidType);
+        declareLocals(global, SymbolKind::Variable);
+        std::vector<std::uint32_t> statements;
+        for (ASTNode* decl : root.declarations) {
+            if (decl->kind != NodeKind::ClassDecl && decl->kind != NodeKind::ImplDecl &&
+                decl->kind != NodeKind::FuncDecl && decl->kind != NodeKind::VarDecl) {
+                statements.push_back(statement(decl));
+            }
+        }
+        function->body = list(Op::Block, statements);
+    }
+
+    bool enter(IntegerLiteral& node) {
+        values.push_back(add({Op::Const, false, none, none, none, static_cast<std::uint32_t>(node.value)}));
+        return false;
+    }
+
+    bool enter(FloatLiteral& node) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &node.value, sizeof bits);
+        values.push_back(add({Op::Const, false, none, none, none, bits}));
+        return false;
+    }
+
+    bool enter(CallExpression& node) {
+        calls.push_back(node.callee);
+        return true;
+    }
+
+    bool enter(Identifier& node) {
+        if (!calls.empty() && &node == calls.back()) {
+            return false;
+        }
+        if (node.name == self) {
+            values.push_back(slot(selfSlot));
+            return false;
+        }
+
+        const SymbolTable* where = nullptr;
+        const SymbolEntry* entry = scope->lookup(node.name, &where);
+        if (entry->kind == SymbolKind::Attribute) {
+            std::uint32_t offset = layout.baseOffset(cls, where) + layout.attributeOffset(where, *entry);
+            values.push_back(access(offsetBy(slot(selfSlot), offset / 4), node.type));
+            return false;
+        }
+        if (where != scope) {
+            fail("program variable " + std::string(context.spelling(node.name)) + " used outside the program block");
+            values.push_back(add({Op::Const}));
+            return false;
+        }
+
+        const Storage& variable = place(*entry);
+        switch (variable.kind) {
+        case Storage::Slot:
+        case Storage::Address:
+            values.push_back(slot(variable.slot));
+            break;
+        case Storage::Frame:
+            values.push_back(add({Op::Frame, false, none, none, none, variable.slot}));
+            break;
+        }
+        return false;
+    }
+
+    void leave(BinaryExpression& node) {
+        std::uint32_t right = pop();
+        std::uint32_t left = pop();
+        bool floating = node.left->type == TypeTable::floatType && info(node.op).opClass != OpClass::Logical;
+        values.push_back(add({binaryOp(node.op, floating), false, left, right}));
+    }
+
+    void leave(UnaryExpression& node) {
+        if (node.op == UnOp::Plus) {
+            return;
+        }
+        std::uint32_t operand = pop();
+        Op op = node.op == UnOp::Not ? Op::Not : node.type == TypeTable::floatType ? Op::FNeg : Op::Neg;
+        values.push_back(add({op, false, operand}));
+    }
+
+    void leave(IndexExpression& node) {
+        std::uint32_t index = pop();
+        std::uint32_t base = pop();
+        std::uint32_t words = layout.size(node.type) / 4;
+        if (words == 0) {
+            fail("cannot index an array whose elements have an unsized dimension");
+        }
+        // A constant index, the last node built, becomes an offset
+        if (code.nodes[index].op == Op::Const && index == code.nodes.size() - 1) {
+            std::uint32_t offset = code.nodes[index].value * words;
+            code.nodes.pop_back();
+            values.push_back(access(offsetBy(base, offset), node.type));
+            return;
+        }
+        values.push_back(access(add({Op::Index, false, base, index, none, words}), node.type));
+    }
+
+    void leave(MemberExpression& node) {
+        if (!calls.empty() && &node == calls.back()) {
+            // The object stays on values as the self of the call
+            return;
+        }
+        std::uint32_t object = pop();
+        const SymbolTable* objectClass = layout.classTable(node.object->type);
+        const SymbolTable* where = nullptr;
+        const SymbolEntry* entry = objectClass->findMember(node.member, &where);
+        std::uint32_t offset = layout.baseOffset(objectClass, where) + layout.attributeOffset(where, *entry);
+        values.push_back(access(offsetBy(object, offset / 4), node.type));
+    }
+
+    void leave(CallExpression& node) {
+        calls.pop_back();
+        if (isBuiltin(node, write) || isBuiltin(node, put)) {
+            std::uint32_t value = pop();
+            values.push_back(add({isBuiltin(node, write) ? Op::Write : Op::Put, node.args[0]->type == TypeTable::floatType, value}));
+            return;
+        }
+        if (isBuiltin(node, read)) {
+            std::uint32_t target = pop();
+            Node& place = code.nodes[target];
+            bool floating = node.args[0]->type == TypeTable::floatType;
+            if (place.op == Op::Slot) {
+                place = {Op::ReadSlot, floating, none, none, none, place.value};
+            } else {
+                place = {Op::ReadStore, floating, place.a, none, none, place.value};
+            }
+            values.push_back(target);
+            return;
+        }
+
+        const Callee& target = callees.at(node.target);
+        std::size_t count = node.args.size();
+        std::vector<std::uint32_t> words;
+        TypeId type = target.entry->type;
+        std::uint32_t resultSlot = none;
+        if (!layout.isScalar(type) && type != TypeTable::voidType) {
+            resultSlot = function->frameWords;
+            function->frameWords += layout.size(type) / 4;
+            words.push_back(add({Op::Frame, false, none, none, none, resultSlot}));
+        }
+        std::vector<std::uint32_t> arguments(values.end() - count, values.end());
+        values.resize(values.size() - count);
+        if (target.cls) {
+            // The object of a method call is under the arguments
+            if (node.callee->kind == NodeKind::MemberExpression) {
+                const SymbolTable* objectClass = layout.classTable(static_cast<MemberExpression&>(*node.callee).object->type);
+                words.push_back(offsetBy(pop(), layout.baseOffset(objectClass, target.cls) / 4));
+            } else {
+                words.push_back(offsetBy(slot(selfSlot), layout.baseOffset(cls, target.cls) / 4));
+            }
+        }
+        words.insert(words.end(), arguments.begin(), arguments.end());
+        std::uint32_t call = list(Op::Call, words);
+        code.nodes[call].value = target.index;
+        code.nodes[call].c = resultSlot;
+        values.push_back(call);
+    }
+
+private:
+    const ASTContext& context;
+    Layout& layout;
+    Code& code;
+    const std::unordered_map<const FuncDecl*, Callee>& callees;
+    std::string& error;
+    const Symbol self, read, write, put;
+
+    Function* function = nullptr;
+    const SymbolTable* scope = nullptr;
+    const SymbolTable* cls = nullptr;
+    TypeId returnType = TypeTable::voidType;
+    std::uint32_t selfSlot = none;
+    std::vector<Storage> storage;  // indexed like the entries of scope
+    std::vector<std::uint32_t> values;
+    std::vector<const Expression*> calls;  // callee of each call being walked
+
+    void fail(std::string message) {
+        if (error.empty()) {
+            error = std::move(message);
+        }
+    }
+
+    bool isBuiltin(const CallExpression& node, Symbol name) const {
+        return node.callee->kind == NodeKind::Identifier && static_cast<const Identifier&>(*node.callee).name == name;
+    }
+
+    void begin(Function& target, const SymbolTable* table, const SymbolTable* owner, TypeId type) {
+        function = &target;
+        scope = table;
+        cls = owner;
+        returnType = type;
+        selfSlot = none;
+        storage.assign(table->size(), {Storage::Slot, none});
+        values.clear();
+        calls.clear();
+    }
+
+    void declareLocals(const SymbolTable& table, SymbolKind kind) {
+        for (const SymbolEntry& entry : table.all()) {
+            if (entry.kind != kind) {
+                continue;
+            }
+            if (layout.isScalar(entry.type)) {
+                place(entry) = {Storage::Slot, function->frameWords++};
+            } else {
+                place(entry) = {Storage::Frame, function->frameWords};
+                function->frameWords += layout.size(entry.type) / 4;
+            }
+        }
+    }
+
+    Storage& place(const SymbolEntry& entry) { return storage[&entry - scope->all().data()]; }
+
+    std::uint32_t add(const Node& node) {
+        code.nodes.push_back(node);
+        return static_cast<std::uint32_t>(code.nodes.size() - 1);
+    }
+
+    // A node over the children given, listed contiguously
+    std::uint32_t list(Op op, const std::vector<std::uint32_t>& children) {
+        std::uint32_t first = static_cast<std::uint32_t>(code.lists.size());
+        code.lists.insert(code.lists.end(), children.begin(), children.end());
+        return add({op, false, first, static_cast<std::uint32_t>(children.size())});
+    }
+
+    std::uint32_t slot(std::uint32_t index) {
+        return add({Op::Slot, false, none, none, none, index});
+    }
+
+    std::uint32_t pop() {
+        std::uint32_t node = values.back();
+        values.pop_back();
+        return node;
+    }
+
+    // An address plus a constant, folded into the address when it already
+    // is a frame address or an offset
+    std::uint32_t offsetBy(std::uint32_t address, std::uint32_t words) {
+        Node& node = code.nodes[address];
+        if (node.op == Op::Frame || node.op == Op::Offset) {
+            node.value += words;
+            return address;
+        }
+        if (words == 0) {
+            return address;
+        }
+        return add({Op::Offset, false, address, none, none, words});
+    }
+
+    // The value at an address: the word for a scalar, the address itself
+    // for an array or object
+    std::uint32_t access(std::uint32_t address, TypeId type) {
+        if (!layout.isScalar(type)) {
+            return address;
+        }
+        Node& node = code.nodes[address];
+        if (node.op == Op::Frame) {
+            node.op = Op::Slot;
+        } else if (node.op == Op::Offset) {
+            node.op = Op::Load;
+        } else {
+            return add({Op::Load, false, address, none, none, 0});
+        }
+        return address;
+    }
+
+    std::uint32_t expression(Expression* expr) {
+        walk(expr);
+        return pop();
+    }
+
+    std::uint32_t statement(ASTNode* node) {
+        if (!node) {
+            return list(Op::Block, {});
+        }
+        switch (node->kind) {
+        case NodeKind::BlockStatement: {
+            std::vector<std::uint32_t> statements;
+            for (ASTNode* child : static_cast<BlockStatement&>(*node)) {
+                if (child->kind != NodeKind::VarDecl) {
+                    statements.push_back(statement(child));
+                }
+            }
+            return list(Op::Block, statements);
+        }
+        case NodeKind::AssignStatement: {
+            AssignStatement& assign = static_cast<AssignStatement&>(*node);
+            std::uint32_t target = expression(assign.lhs);
+            std::uint32_t value = expression(assign.rhs);
+            if (!layout.isScalar(assign.lhs->type)) {
+                return add({Op::Copy, false, target, value, none, layout.size(assign.lhs->type) / 4});
+            }
+            Node& place = code.nodes[target];
+            if (place.op == Op::Slot) {
+                place = {Op::SetSlot, false, value, none, none, place.value};
+            } else {
+                place = {Op::Store, false, place.a, value, none, place.value};
+            }
+            return target;
+        }
+        case NodeKind::CallStatement: {
+            // read, write and put already are statements
+            std::uint32_t call = expression(static_cast<CallStatement&>(*node).call);
+            return code.nodes[call].op == Op::Call ? add({Op::Evaluate, false, call}) : call;
+        }
+        case NodeKind::ReturnStatement: {
+            Expression* expr = static_cast<ReturnStatement&>(*node).expression;
+            if (!expr) {
+                return add({Op::Return});
+            }
+            if (!layout.isScalar(returnType)) {
+                return add({Op::ReturnCopy, false, expression(expr), none, none, layout.size(returnType) / 4});
+            }
+            return add({Op::Return, false, expression(expr)});
+        }
+        case NodeKind::IfStatement: {
+            IfStatement& branch = static_cast<IfStatement&>(*node);
+            std::uint32_t condition = expression(branch.condition);
+            std::uint32_t then = statement(branch.thenStmt);
+            std::uint32_t otherwise = branch.elseStmt ? statement(branch.elseStmt) : none;
+            return add({Op::If, false, condition, then, otherwise});
+        }
+        case NodeKind::WhileStatement: {
+            WhileStatement& loop = static_cast<WhileStatement&>(*node);
+            std::uint32_t condition = expression(loop.condition);
+            return add({Op::While, false, condition, statement(loop.body)});
+        }
+        default:
+            return list(Op::Block, {});
+        }
+    }
+
+    static Op binaryOp(BinOp op, bool floating) {
+        switch (op) {
+        case BinOp::Add: return floating ? Op::FAdd : Op::Add;
+        case BinOp::Sub: return floating ? Op::FSub : Op::Sub;
+        case BinOp::Mul: return floating ? Op::FMul : Op::Mul;
+        case BinOp::Div: return floating ? Op::FDiv : Op::Div;
+        case BinOp::And: return Op::And;
+        case BinOp::Or: return Op::Or;
+        case BinOp::Eq: return floating ? Op::FEq : Op::Eq;
+        case BinOp::NotEq: return floating ? Op::FNotEq : Op::NotEq;
+        case BinOp::Lt: return floating ? Op::FLt : Op::Lt;
+        case BinOp::Gt: return floating ? Op::FGt : Op::Gt;
+        case BinOp::LtEq: return floating ? Op::FLtEq : Op::LtEq;
+        case BinOp::GtEq: return floating ? Op::FGtEq : Op::GtEq;
+        }
+        return Op::Add;
+    }
+};
+
+// Thrown out of the machine to stop the program
+struct Stop {
+    const char* reason;
+};
+
+// Calls, statements and expressions are run by native recursion, so how
+// much stack a call takes depends on how deeply its body nests and on how
+// the interpreter was compiled. The machine therefore runs on a thread of
+// its own whose stack holds maxDepth calls of any ordinary body even in an
+// unoptimized build, and a call or expression that finds less than
+// stackReserve bytes left stops the program rather than overflowing it.
+class Machine {
+public:
+    Machine(const Code& code, std::istream& in, std::string& out, InterpreterStats& stats)
+        : code(code), in(in), out(out), stats(stats), memory(initialWords) {}
+
+    // Null if the program ran to its end, or why it stopped
+    const char* run() {
+        pthread_attr_t attributes;
+        pthread_t thread;
+        bool started = pthread_attr_init(&attributes) == 0 &&
+                       pthread_attr_setstacksize(&attributes, stackBytes) == 0 &&
+                       pthread_create(&thread, &attributes, &Machine::start, this) == 0;
+        pthread_attr_destroy(&attributes);
+        if (!started) {
+            return "cannot start the interpreter thread";
+        }
+        pthread_join(thread, nullptr);
+        return stopped;
+    }
+
+private:
+    static constexpr std::size_t initialWords = std::size_t(1) << 16;
+    static constexpr std::size_t memoryWords = std::size_t(1) << 24;
+    static constexpr unsigned maxDepth = 10000;
+    static constexpr std::size_t stackBytes = std::size_t(256) << 20;
+    static constexpr std::size_t stackReserve = std::size_t(256) << 10;
+
+    const Code& code;
+    std::istream& in;
+    std::string& out;
+    InterpreterStats& stats;
+    std::vector<std::uint32_t> memory;
+    std::uint32_t fp = 0;
+    std::uint32_t sp = 0;
+    unsigned depth = 0;
+    std::uint32_t result = 0;  // value of the last return
+    std::uintptr_t stackLimit = 0;  // lowest address the stack may grow to
+    const char* stopped = nullptr;
+
+    static void* start(void* self) {
+        Machine& machine = *static_cast<Machine*>(self);
+        char top;
+        machine.stackLimit = reinterpret_cast<std::uintptr_t>(&top) - (stackBytes - stackReserve);
+        try {
+            machine.call(machine.code.entry, none, 0);
+        } catch (const Stop& stop) {
+            machine.stopped = stop.reason;
+        }
+        return nullptr;
+    }
+
+    // Whether the stack has grown into its reserve
+    bool stackLow() const {
+        char here;
+        return reinterpret_cast<std::uintptr_t>(&here) < stackLimit;
+    }
+
+    static float toFloat(std::uint32_t bits) {
+        float value;
+        std::memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+
+    static std::uint32_t fromFloat(float value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        return bits;
+    }
+
+    std::uint32_t& word(std::uint32_t address) {
+        if (address >= memory.size()) {
+            throw Stop{"memory access out of range"};
+        }
+        return memory[address];
+    }
+
+    // Run function index on the words listed from first, evaluated in the
+    // caller's frame
+    std::uint32_t call(std::uint32_t index, std::uint32_t first, std::uint32_t count) {
+        const Function& function = code.functions[index];
+        if (++depth > maxDepth || stackLow()) {
+            throw Stop{"calls nested too deep"};
+        }
+        if (memory.size() - sp < function.frameWords) {
+            // Grown by doubling; nodes hold addresses, never pointers
+            if (memoryWords - sp < function.frameWords) {
+                throw Stop{"out of memory for frames"};
+            }
+            memory.resize(std::min(memoryWords, std::max(memory.size() * 2, std::size_t(sp) + function.frameWords)));
+        }
+        std::uint32_t frame = sp;
+        sp += function.frameWords;
+        std::fill(memory.begin() + frame, memory.begin() + sp, 0);
+        for (std::uint32_t k = 0; k < count; ++k) {
+            memory[frame + k] = eval(code.lists[first + k]);
+        }
+
+        std::uint32_t caller = fp;
+        fp = frame;
+        // A body that ends without a return gives 0, as Ret 0 does in the
+        // IR, not whatever the last call it made returned
+        if (!exec(function.body)) {
+            result = 0;
+        }
+        fp = caller;
+        sp = frame;
+        --depth;
+        ++stats.calls;
+        return result;
+    }
+
+    std::uint32_t eval(std::uint32_t index) {
+        const Node& node = code.nodes[index];
+        ++stats.operations;
+        if (stackLow()) {
+            throw Stop{"expressions nested too deep"};
+        }
+        switch (node.op) {
+        case Op::Const: return node.value;
+        case Op::Slot: return memory[fp + node.value];
+        case Op::Frame: return fp + node.value;
+        case Op::Load: return word(eval(node.a) + node.value);
+        case Op::Offset: return eval(node.a) + node.value;
+        case Op::Index: {
+            std::uint32_t base = eval(node.a);
+            return base + eval(node.b) * node.value;
+        }
+        case Op::Call: {
+            std::uint32_t value = call(node.value, node.a, node.b);
+            return node.c == none ? value : fp + node.c;
+        }
+        case Op::Neg: return 0u - eval(node.a);
+        case Op::FNeg: return fromFloat(-toFloat(eval(node.a)));
+        case Op::Not: return eval(node.a) == 0;
+        default:
+            break;
+        }
+
+        std::uint32_t left = eval(node.a);
+        std::uint32_t right = eval(node.b);
+        std::int32_t x = static_cast<std::int32_t>(left), y = static_cast<std::int32_t>(right);
+        float f = toFloat(left), g = toFloat(right);
+        switch (node.op) {
+        case Op::Add: return left + right;
+        case Op::Sub: return left - right;
+        case Op::Mul: return left * right;
+        case Op::Div:
+            if (y == 0) {
+                throw Stop{"division by zero"};
+            }
+            return y == -1 ? 0u - left : static_cast<std::uint32_t>(x / y);
+        case Op::And: return left != 0 && right != 0;
+        case Op::Or: return left != 0 || right != 0;
+        case Op::Eq: return x == y;
+        case Op::NotEq: return x != y;
+        case Op::Lt: return x < y;
+        case Op::Gt: return x > y;
+        case Op::LtEq: return x <= y;
+        case Op::GtEq: return x >= y;
+        case Op::FAdd: return fromFloat(f + g);
+        case Op::FSub: return fromFloat(f - g);
+        case Op::FMul: return fromFloat(f * g);
+        case Op::FDiv: return fromFloat(f / g);
+        case Op::FEq: return f == g;
+        case Op::FNotEq: return f != g;
+        case Op::FLt: return f < g;
+        case Op::FGt: return f > g;
+        case Op::FLtEq: return f <= g;
+        case Op::FGtEq: return f >= g;
+        default:
+            return 0;
+        }
+    }
+
+    std::uint32_t input(bool floating) {
+        if (floating) {
+            float value = 0;
+            in >> value;
+            return fromFloat(in ? value : 0.0f);
+        }
+        int value = 0;
+        in >> value;
+        return in ? static_cast<std::uint32_t>(value) : 0;
+    }
+
+    void print(std::uint32_t value, bool floating) {
+        char text[32];
+        if (floating) {
+            std::snprintf(text, sizeof text, "%g", toFloat(value));
+        } else {
+            std::snprintf(text, sizeof text, "%d", static_cast<int>(value));
+        }
+        out += text;
+    }
+
+    // Whether a return ran
+    bool exec(std::uint32_t index) {
+        const Node& node = code.nodes[index];
+        ++stats.operations;
+        switch (node.op) {
+        case Op::Block:
+            for (std::uint32_t k = 0; k < node.b; ++k) {
+                if (exec(code.lists[node.a + k])) {
+                    return true;
+                }
+            }
+            return false;
+        case Op::SetSlot:
+            memory[fp + node.value] = eval(node.a);
+            return false;
+        case Op::Store: {
+            std::uint32_t address = eval(node.a) + node.value;
+            word(address) = eval(node.b);
+            return false;
+        }
+        case Op::Copy: {
+            std::uint32_t to = eval(node.a);
+            std::uint32_t from = eval(node.b);
+            if (to + node.value > memory.size() || from + node.value > memory.size()) {
+                throw Stop{"memory access out of range"};
+            }
+            std::copy_n(memory.begin() + from, node.value, memory.begin() + to);
+            return false;
+        }
+        case Op::If:
+            if (eval(node.a)) {
+                return exec(node.b);
+            }
+            return node.c != none && exec(node.c);
+        case Op::While:
+            while (eval(node.a)) {
+                if (exec(node.b)) {
+                    return true;
+                }
+            }
+            return false;
+        case Op::Return:
+            result = node.a != none ? eval(node.a) : 0;
+            return true;
+        case Op::ReturnCopy: {
+            std::uint32_t from = eval(node.a);
+            std::uint32_t to = memory[fp];
+            if (to + node.value > memory.size() || from + node.value > memory.size()) {
+                throw Stop{"memory access out of range"};
+            }
+            std::copy_n(memory.begin() + from, node.value, memory.begin() + to);
+            return true;
+        }
+        case Op::Evaluate:
+            eval(node.a);
+            return false;
+        case Op::ReadSlot:
+            memory[fp + node.value] = input(node.floating);
+            return false;
+        case Op::ReadStore: {
+            std::uint32_t address = eval(node.a) + node.value;
+            word(address) = input(node.floating);
+            return false;
+        }
+        case Op::Write:
+        case Op::Put:
+            print(eval(node.a), node.floating);
+            if (node.op == Op::Write) {
+                out += '\n';
+            }
+            return false;
+        default:
+            return false;
+        }
+    }
+};
+
+} // namespace
+
+bool interpret(ASTNode* root, const ASTContext& context, const SymbolTables& tables, const TypeTable& types,
+               std::istream& in, std::string& out, InterpreterStats& stats, std::string& error) {
+    stats = InterpreterStats();
+    if (!root || root->kind != NodeKind::Program) {
+        error = "nothing to run";
+        return false;
+    }
+    const SymbolTable& global = tables.global();
+    Layout layout(global, types);
+    Code code;
+
+    // Every function gets its index before any body is resolved, so calls
+    // can refer to functions further down
+    std::unordered_map<const FuncDecl*, Callee> callees;
+    std::vector<Callee> order;
+    auto addFunctions = [&](const SymbolTable& table, const SymbolTable* cls) {
+        for (const SymbolEntry& entry : table.all()) {
+            if (entry.kind == SymbolKind::Function && entry.defined) {
+                Callee callee{static_cast<std::uint32_t>(code.functions.size()), &entry, cls};
+                callees[static_cast<const FuncDecl*>(entry.decl)] = callee;
+                order.push_back(callee);
+                code.functions.push_back({});
+            }
+        }
+    };
+    addFunctions(global, nullptr);
+    for (const SymbolEntry& entry : global.all()) {
+        if (entry.kind == SymbolKind::Class) {
+            addFunctions(*entry.table, entry.table);
+        }
+    }
+
+    Resolver resolver(context, layout, code, callees, error);
+    for (const Callee& callee : order) {
+        resolver.resolveFunction(callee);
+    }
+    const Program& prog = static_cast<const Program&>(*root);
+    bool hasBlock = std::any_of(prog.declarations.begin(), prog.declarations.end(), [](const ASTNode* decl) {
+        return decl->kind != NodeKind::ClassDecl && decl->kind != NodeKind::ImplDecl && decl->kind != NodeKind::FuncDecl;
+    });
+    if (hasBlock) {
+        code.entry = static_cast<std::uint32_t>(code.functions.size());
+        code.functions.push_back({});
+        resolver.resolveProgram(prog, global, code.functions.back());
+    } else if (const SymbolEntry* main = global.find(context.find("main"))) {
+        if (main->kind == SymbolKind::Function && main->defined) {
+            code.entry = callees[static_cast<const FuncDecl*>(main->decl)].index;
+        }
+    }
+    stats.nodes = code.nodes.size();
+    if (!error.empty()) {
+        return false;
+    }
+    if (code.entry == none) {
+        error = "the program has neither a program block nor a main function";
+        return false;
+    }
+
+    if (const char* reason = Machine(code, in, out, stats).run()) {
+        error = reason;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,266 @@
+#include "../include/ir.h"
+#include "../include/output_buffer.h"
+#include <cstring>
+
+namespace {
+
+// Indexed by Opcode
+constexpr std::string_view opcodeNames[] = {
+    "const", "copy", "phi",
+    "add", "sub", "mul", "div", "and", "or",
+    "eq", "noteq", "lt", "gt", "lteq", "gteq",
+    "fadd", "fsub", "fmul", "fdiv",
+    "feq", "fnoteq", "flt", "fgt", "flteq", "fgteq",
+    "neg", "fneg", "not",
+    "frame", "load", "store", "move", "arg", "call", "read", "write", "put",
+    "jump", "branch", "ret",
+};
+
+void reg(OutputBuffer& out, std::uint32_t r) {
+    out << 'v' << r;
+}
+
+void address(OutputBuffer& out, std::uint32_t r, std::uint32_t offset) {
+    reg(out, r);
+    if (offset != 0) {
+        out << '+' << offset;
+    }
+}
+
+void instruction(OutputBuffer& out, const IRProgram& program, const IRFunction& function, const Instr& instr) {
+    out << "    ";
+    if (instr.dst != Instr::none) {
+        reg(out, instr.dst);
+        out << " = ";
+    }
+    out << opcodeName(instr.op);
+
+    switch (instr.op) {
+    case Opcode::Const:
+        if (function.regs[instr.dst] == IRType::Float) {
+            float value;
+            std::memcpy(&value, &instr.a, sizeof value);
+            out << ' ' << value;
+        } else {
+            out << ' ' << static_cast<int>(instr.a);
+        }
+        break;
+    case Opcode::Phi:
+        for (std::uint32_t i = 0; i < instr.b; ++i) {
+            out << (i ? ", [" : " [");
+            reg(out, function.phiOperands[instr.a + 2 * i]);
+            out << ", b" << function.phiOperands[instr.a + 2 * i + 1] << ']';
+        }
+        break;
+    case Opcode::Frame:
+        out << ' ' << instr.c;
+        break;
+    case Opcode::Load:
+        out << ' ';
+        address(out, instr.a, instr.c);
+        break;
+    case Opcode::Store:
+        out << ' ';
+        address(out, instr.a, instr.c);
+        out << ", ";
+        reg(out, instr.b);
+        break;
+    case Opcode::Move:
+        out << ' ';
+        reg(out, instr.a);
+        out << ", ";
+        reg(out, instr.b);
+        out << ", " << instr.c;
+        break;
+    case Opcode::Call:
+        out << ' ' << program.functions[instr.a].name << ", " << instr.b;
+        break;
+    case Opcode::Jump:
+        out << " b" << instr.a;
+        break;
+    case Opcode::Branch:
+        out << ' ';
+        reg(out, instr.a);
+        out << ", b" << instr.b << ", b" << instr.c;
+        break;
+    default:
+        // Register operands
+        if (instr.a != Instr::none) {
+            out << ' ';
+            reg(out, instr.a);
+        }
+        if (instr.b != Instr::none) {
+            out << ", ";
+            reg(out, instr.b);
+        }
+        break;
+    }
+    out << '\n';
+}
+
+} // namespace
+
+std::string_view opcodeName(Opcode op) {
+    return opcodeNames[static_cast<std::size_t>(op)];
+}
+
+bool definesRegister(Opcode op) {
+    switch (op) {
+    case Opcode::Store:
+    case Opcode::Move:
+    case Opcode::Arg:
+    case Opcode::Write:
+    case Opcode::Put:
+    case Opcode::Jump:
+    case Opcode::Branch:
+    case Opcode::Ret:
+        return false;
+    default:
+        // A void Call has no dst even though the opcode can define one
+        return true;
+    }
+}
+
+unsigned registerOperands(const Instr& instr) {
+    switch (instr.op) {
+    case Opcode::Const:
+    case Opcode::Phi:
+    case Opcode::Frame:
+    case Opcode::Call:
+    case Opcode::Read:
+    case Opcode::Jump:
+        return 0;
+    case Opcode::Copy:
+    case Opcode::Neg:
+    case Opcode::FNeg:
+    case Opcode::Not:
+    case Opcode::Load:
+    case Opcode::Arg:
+    case Opcode::Write:
+    case Opcode::Put:
+    case Opcode::Branch:
+        return 1;
+    case Opcode::Ret:
+        return instr.a != Instr::none ? 1 : 0;
+    default:
+        // Binary operators, Store and Move
+        return 3;
+    }
+}
+
+// A register is safe when the entry block writes it before reading it,
+// since every path starts there, or when it is written once and only read
+// by later instructions of its block; an instruction reads its operands
+// before it writes, so t := t + x exposes t.
+std::vector<std::uint32_t> exposedRegisters(const IRFunction& function) {
+    std::size_t regs = function.regs.size();
+    std::vector<std::uint32_t> defs(regs, 0), defAt(regs, Instr::none);
+    std::vector<std::uint32_t> blockOf(function.code.size());
+    for (std::uint32_t b = 0; b < function.blocks.size(); ++b) {
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            blockOf[i] = b;
+            const Instr& instr = function.code[i];
+            if (definesRegister(instr.op) && instr.dst != Instr::none) {
+                ++defs[instr.dst];
+                defAt[instr.dst] = i;
+            }
+        }
+    }
+
+    std::vector<bool> safe(regs, false), read(regs, false), seenInEntry(regs, false);
+    for (std::uint32_t r = 0; r < regs; ++r) {
+        safe[r] = r < function.params || defs[r] == 1;
+    }
+    auto use = [&](std::uint32_t r, std::uint32_t i) {
+        read[r] = true;
+        if (r >= function.params && defs[r] == 1 && (blockOf[defAt[r]] != blockOf[i] || defAt[r] >= i)) {
+            safe[r] = false;
+        }
+    };
+    for (std::uint32_t i = 0; i < function.code.size(); ++i) {
+        const Instr& instr = function.code[i];
+        unsigned operands = registerOperands(instr);
+        if ((operands & 1) && instr.a != Instr::none) {
+            use(instr.a, i);
+        }
+        if ((operands & 2) && instr.b != Instr::none) {
+            use(instr.b, i);
+        }
+    }
+
+    // Registers the entry block writes before any read
+    if (!function.blocks.empty()) {
+        for (std::uint32_t i = function.blocks[0].begin; i < function.blocks[0].end; ++i) {
+            const Instr& instr = function.code[i];
+            unsigned operands = registerOperands(instr);
+            if ((operands & 1) && instr.a != Instr::none) {
+                seenInEntry[instr.a] = true;
+            }
+            if ((operands & 2) && instr.b != Instr::none) {
+                seenInEntry[instr.b] = true;
+            }
+            if (definesRegister(instr.op) && instr.dst != Instr::none && !seenInEntry[instr.dst]) {
+                seenInEntry[instr.dst] = true;
+                safe[instr.dst] = true;
+            }
+        }
+    }
+
+    std::vector<std::uint32_t> exposed;
+    for (std::uint32_t r = function.params; r < regs; ++r) {
+        if (read[r] && !safe[r]) {
+            exposed.push_back(r);
+        }
+    }
+    return exposed;
+}
+
+std::size_t IRProgram::instructionCount() const {
+    std::size_t count = 0;
+    for (const IRFunction& function : functions) {
+        count += function.code.size();
+    }
+    return count;
+}
+
+std::size_t IRProgram::blockCount() const {
+    std::size_t count = 0;
+    for (const IRFunction& function : functions) {
+        count += function.blocks.size();
+    }
+    return count;
+}
+
+bool printIR(const IRProgram& program, const std::string& path) {
+    OutputBuffer out;
+    for (std::size_t f = 0; f < program.functions.size(); ++f) {
+        const IRFunction& function = program.functions[f];
+        if (f > 0) {
+            out << '\n';
+        }
+        out << "function " << function.name << '(';
+        for (std::uint32_t p = 0; p < function.params; ++p) {
+            out << (p ? ", " : "");
+            reg(out, p);
+        }
+        out << ')';
+        if (function.returnsValue) {
+            out << " returns";
+        }
+        if (function.frameSize != 0) {
+            out << ", frame " << function.frameSize;
+        }
+        if (f == program.entry) {
+            out << ", entry";
+        }
+        out << '\n';
+
+        for (std::size_t b = 0; b < function.blocks.size(); ++b) {
+            out << 'b' << static_cast<unsigned>(b) << ":\n";
+            for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+                instruction(out, program, function, function.code[i]);
+            }
+        }
+    }
+    return out.writeTo(path);
+}
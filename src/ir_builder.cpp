@@ -0,0 +1,650 @@
+#include "../include/ir_builder.h"
+#include "../include/ast_walker.h"
+#include "../include/object_layout.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// What the lowering of each defined function needs to know about the others
+struct Callee {
+    std::uint32_t index;
+    const SymbolEntry* entry;
+    const SymbolTable* cls;  // class of a member function, or null
+};
+
+// Where a variable lives
+struct Storage {
+    enum Kind : std::uint8_t { Register, Frame, Address } kind;
+    std::uint32_t value;  // the register, or the frame offset
+};
+
+// An expression's result: a register, plus a constant offset when it is an
+// address. An aggregate's value is its address.
+struct Value {
+    std::uint32_t reg = Instr::none;
+    std::uint32_t offset = 0;
+};
+
+// The target of an assignment or read
+struct Location {
+    bool memory = false;  // a word at reg + offset, or else register reg itself
+    std::uint32_t reg = Instr::none;
+    std::uint32_t offset = 0;
+};
+
+class FunctionLowerer : public ASTWalker<FunctionLowerer> {
+public:
+    using ASTWalker<FunctionLowerer>::enter;
+    using ASTWalker<FunctionLowerer>::leave;
+
+    FunctionLowerer(const ASTContext& context, Layout& layout, IRProgram& program,
+                    const std::unordered_map<const FuncDecl*, Callee>& callees, std::vector<Diagnostic>& diagnostics)
+        : layout(layout), program(program), callees(callees), diagnostics(diagnostics),
+          self(context.find("self")), read(context.find("read")), write(context.find("write")), put(context.find("put")) {}
+
+    // A defined free or member function
+    void lowerFunction(const Callee& callee) {
+        const FuncDecl& func = static_cast<const FuncDecl&>(*callee.entry->decl);
+        begin(program.functions[callee.index], callee.entry->table, callee.cls, callee.entry->type);
+
+        if (resultReg != Instr::none) {
+            newReg(IRType::Int);
+        }
+        if (cls) {
+            selfReg = newReg(IRType::Int);
+        }
+        for (const VarDecl* param : func.params) {
+            const SymbolEntry* entry = scope->find(param->name);
+            if (layout.isScalar(entry->type)) {
+                place(*entry) = {Storage::Register, newReg(irType(entry->type))};
+            } else {
+                place(*entry) = {Storage::Address, newReg(IRType::Int)};
+            }
+        }
+        function->params = static_cast<std::uint32_t>(function->regs.size());
+        declareLocals(*scope, SymbolKind::Local);
+        firstTemp = static_cast<std::uint32_t>(function->regs.size());
+
+        statement(func.body);
+        finish();
+    }
+
+    // The statements of the program block, with the program variables as
+    // its locals
+    void lowerProgram(const Program& root, const SymbolTable& global, IRFunction& target) {
+        begin(target, &global, nullptr, TypeTable::voidType);
+        declareLocals(global, SymbolKind::Variable);
+        firstTemp = static_cast<std::uint32_t>(function->regs.size());
+        for (ASTNode* decl : root.declarations) {
+            if (decl->kind != NodeKind::ClassDecl && decl->kind != NodeKind::ImplDecl &&
+                decl->kind != NodeKind::FuncDecl && decl->kind != NodeKind::VarDecl) {
+                statement(static_cast<Statement*>(decl));
+            }
+        }
+        finish();
+    }
+
+    // Expressions push their Value; the one named by wantAddress leaves its
+    // Location instead
+
+    bool enter(IntegerLiteral& node) {
+        values.push_back({constant(IRType::Int, static_cast<std::uint32_t>(node.value))});
+        return false;
+    }
+
+    bool enter(FloatLiteral& node) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &node.value, sizeof bits);
+        values.push_back({constant(IRType::Float, bits)});
+        return false;
+    }
+
+    bool enter(CallExpression& node) {
+        calls.push_back(node.callee);
+        if (isBuiltin(node, read) && !node.args.empty()) {
+            wantAddress = node.args[0];
+        }
+        return true;
+    }
+
+    bool enter(Identifier& node) {
+        if (!calls.empty() && &node == calls.back()) {
+            return false;
+        }
+        if (node.name == self) {
+            values.push_back({selfReg});
+            return false;
+        }
+
+        const SymbolTable* where = nullptr;
+        const SymbolEntry* entry = scope->lookup(node.name, &where);
+        if (entry->kind == SymbolKind::Attribute) {
+            access({selfReg, layout.baseOffset(cls, where) + layout.attributeOffset(where, *entry)}, node);
+            return false;
+        }
+
+        if (where != scope) {
+            report(node, "program variable used outside the program block");
+            values.push_back({constant(irType(node.type), 0)});
+            return false;
+        }
+        const Storage& variable = place(*entry);
+        switch (variable.kind) {
+        case Storage::Register:
+            if (&node == wantAddress) {
+                location = {false, variable.value, 0};
+            } else {
+                values.push_back({variable.value});
+            }
+            break;
+        case Storage::Frame:
+            access({frame(variable.value)}, node);
+            break;
+        case Storage::Address:
+            access({variable.value}, node);
+            break;
+        }
+        return false;
+    }
+
+    void leave(BinaryExpression& node) {
+        Value right = pop();
+        Value left = pop();
+        bool floating = node.left->type == TypeTable::floatType;
+        Opcode op = binaryOpcode(node.op, floating);
+        IRType type = floating && info(node.op).opClass == OpClass::Arithmetic ? IRType::Float : IRType::Int;
+        std::uint32_t dst = newReg(type);
+        emit({op, dst, left.reg, right.reg});
+        values.push_back({dst});
+    }
+
+    void leave(UnaryExpression& node) {
+        if (node.op == UnOp::Plus) {
+            return;
+        }
+        Value operand = pop();
+        Opcode op = node.op == UnOp::Not ? Opcode::Not : node.type == TypeTable::floatType ? Opcode::FNeg : Opcode::Neg;
+        std::uint32_t dst = newReg(irType(node.type));
+        emit({op, dst, operand.reg});
+        values.push_back({dst});
+    }
+
+    void leave(IndexExpression& node) {
+        Value index = pop();
+        Value base = pop();
+        std::uint32_t size = layout.size(node.type);
+        if (size == 0) {
+            report(node, "cannot index an array whose elements have an unsized dimension");
+        }
+        // A constant index, just emitted, becomes part of the offset
+        const Instr* last = lastInstr();
+        if (last && last->op == Opcode::Const && last->dst == index.reg) {
+            std::uint32_t offset = last->a * size;
+            function->code.pop_back();
+            access({base.reg, base.offset + offset}, node);
+            return;
+        }
+        std::uint32_t scaled = newReg(IRType::Int);
+        emit({Opcode::Mul, scaled, index.reg, constant(IRType::Int, size)});
+        std::uint32_t element = newReg(IRType::Int);
+        emit({Opcode::Add, element, base.reg, scaled});
+        access({element, base.offset}, node);
+    }
+
+    void leave(MemberExpression& node) {
+        if (!calls.empty() && &node == calls.back()) {
+            // The object stays on the stack as the self of the call
+            return;
+        }
+        Value object = pop();
+        const SymbolTable* objectClass = layout.classTable(node.object->type);
+        const SymbolTable* where = nullptr;
+        const SymbolEntry* entry = objectClass->findMember(node.member, &where);
+        std::uint32_t offset = layout.baseOffset(objectClass, where) + layout.attributeOffset(where, *entry);
+        access({object.reg, object.offset + offset}, node);
+    }
+
+    void leave(CallExpression& node) {
+        calls.pop_back();
+        if (isBuiltin(node, write) || isBuiltin(node, put)) {
+            Value value = pop();
+            emit({isBuiltin(node, write) ? Opcode::Write : Opcode::Put, Instr::none, value.reg});
+            values.push_back({});
+            return;
+        }
+        if (isBuiltin(node, read)) {
+            std::uint32_t value = newReg(irType(node.args[0]->type));
+            emit({Opcode::Read, value});
+            store(location, {value}, node.args[0]->type);
+            wantAddress = nullptr;
+            values.push_back({});
+            return;
+        }
+
+        const Callee& target = callees.at(node.target);
+        std::size_t count = node.args.size();
+        arguments.assign(values.end() - count, values.end());
+        values.resize(values.size() - count);
+
+        // The object of a method call is under the arguments
+        Value object;
+        if (target.cls) {
+            if (node.callee->kind == NodeKind::MemberExpression) {
+                object = pop();
+                const SymbolTable* objectClass = layout.classTable(static_cast<MemberExpression&>(*node.callee).object->type);
+                object.offset += layout.baseOffset(objectClass, target.cls);
+            } else {
+                object = {selfReg, layout.baseOffset(cls, target.cls)};
+            }
+        }
+
+        const IRFunction& called = program.functions[target.index];
+        std::uint32_t argCount = 0;
+        Value result;
+        if (target.entry->type != TypeTable::voidType && !called.returnsValue) {
+            std::uint32_t offset = function->frameSize;
+            function->frameSize += layout.size(target.entry->type);
+            result = {frame(offset)};
+            emit({Opcode::Arg, Instr::none, result.reg});
+            ++argCount;
+        }
+        if (target.cls) {
+            emit({Opcode::Arg, Instr::none, materialize(object)});
+            ++argCount;
+        }
+        for (const Value& argument : arguments) {
+            emit({Opcode::Arg, Instr::none, materialize(argument)});
+            ++argCount;
+        }
+
+        if (called.returnsValue) {
+            result = {newReg(irType(target.entry->type))};
+        }
+        emit({Opcode::Call, called.returnsValue ? result.reg : Instr::none, target.index, argCount});
+        values.push_back(result);
+    }
+
+private:
+    Layout& layout;
+    IRProgram& program;
+    const std::unordered_map<const FuncDecl*, Callee>& callees;
+    std::vector<Diagnostic>& diagnostics;
+    const Symbol self, read, write, put;
+
+    // The function being lowered
+    IRFunction* function = nullptr;
+    const SymbolTable* scope = nullptr;
+    const SymbolTable* cls = nullptr;
+    TypeId returnType = TypeTable::voidType;
+    std::uint32_t resultReg = Instr::none;  // where an object result is written
+    std::uint32_t selfReg = Instr::none;
+    std::uint32_t firstTemp = 0;  // registers below hold parameters and variables
+    std::vector<Storage> storage;  // indexed like the entries of scope
+    std::uint32_t current = 0;  // block being filled
+    bool open = false;          // whether current still lacks its terminator
+
+    std::vector<Value> values;
+    std::vector<Value> arguments;  // scratch for a call
+    const Expression* wantAddress = nullptr;
+    Location location;
+    std::vector<const Expression*> calls;  // callee of each call being walked
+
+    void report(const ASTNode& node, std::string message) {
+        diagnostics.push_back({node.span.offset, Severity::Error, std::move(message)});
+    }
+
+    IRType irType(TypeId type) const { return type == TypeTable::floatType ? IRType::Float : IRType::Int; }
+
+    bool isBuiltin(const CallExpression& node, Symbol name) const {
+        return node.callee->kind == NodeKind::Identifier && static_cast<const Identifier&>(*node.callee).name == name;
+    }
+
+    void begin(IRFunction& target, const SymbolTable* table, const SymbolTable* owner, TypeId type) {
+        function = &target;
+        scope = table;
+        cls = owner;
+        returnType = type;
+        resultReg = type != TypeTable::voidType && !target.returnsValue ? 0 : Instr::none;
+        selfReg = Instr::none;
+        storage.assign(table->size(), {Storage::Register, Instr::none});
+        values.clear();
+        wantAddress = nullptr;
+        calls.clear();
+        start(newBlock());
+    }
+
+    void declareLocals(const SymbolTable& table, SymbolKind kind) {
+        for (const SymbolEntry& entry : table.all()) {
+            if (entry.kind != kind) {
+                continue;
+            }
+            if (layout.isScalar(entry.type)) {
+                place(entry) = {Storage::Register, newReg(irType(entry.type))};
+            } else {
+                place(entry) = {Storage::Frame, function->frameSize};
+                function->frameSize += layout.size(entry.type);
+            }
+        }
+    }
+
+    // Where a variable of the function's own scope lives
+    Storage& place(const SymbolEntry& entry) { return storage[&entry - scope->all().data()]; }
+
+    std::uint32_t newReg(IRType type) {
+        function->regs.push_back(type);
+        return static_cast<std::uint32_t>(function->regs.size() - 1);
+    }
+
+    std::uint32_t newBlock() {
+        function->blocks.push_back({Instr::none, Instr::none});
+        return static_cast<std::uint32_t>(function->blocks.size() - 1);
+    }
+
+    void start(std::uint32_t block) {
+        function->blocks[block].begin = static_cast<std::uint32_t>(function->code.size());
+        current = block;
+        open = true;
+    }
+
+    // Code after a terminator, such as statements after a return, goes to a
+    // new block that finish() drops as unreachable
+    void emit(const Instr& instr) {
+        if (!open) {
+            start(newBlock());
+        }
+        function->code.push_back(instr);
+        if (instr.isTerminator()) {
+            function->blocks[current].end = static_cast<std::uint32_t>(function->code.size());
+            open = false;
+        }
+    }
+
+    std::uint32_t constant(IRType type, std::uint32_t bits) {
+        std::uint32_t dst = newReg(type);
+        emit({Opcode::Const, dst, bits});
+        return dst;
+    }
+
+    std::uint32_t frame(std::uint32_t offset) {
+        std::uint32_t dst = newReg(IRType::Int);
+        emit({Opcode::Frame, dst, Instr::none, Instr::none, offset});
+        return dst;
+    }
+
+    // The last instruction of the open block, if it has any
+    Instr* lastInstr() {
+        if (!open || function->code.size() == function->blocks[current].begin) {
+            return nullptr;
+        }
+        return &function->code.back();
+    }
+
+    Value pop() {
+        Value value = values.back();
+        values.pop_back();
+        return value;
+    }
+
+    // An address as a single register
+    std::uint32_t materialize(const Value& value) {
+        if (value.offset == 0) {
+            return value.reg;
+        }
+        std::uint32_t dst = newReg(IRType::Int);
+        emit({Opcode::Add, dst, value.reg, constant(IRType::Int, value.offset)});
+        return dst;
+    }
+
+    // Use the object at address: load a scalar, keep the address of an
+    // aggregate, or record the location of an assignment target
+    void access(const Value& address, const Expression& node) {
+        if (&node == wantAddress) {
+            location = {true, address.reg, address.offset};
+        } else if (layout.isScalar(node.type)) {
+            std::uint32_t dst = newReg(irType(node.type));
+            emit({Opcode::Load, dst, address.reg, Instr::none, address.offset});
+            values.push_back({dst});
+        } else {
+            values.push_back(address);
+        }
+    }
+
+    void store(const Location& target, const Value& value, TypeId type) {
+        if (!layout.isScalar(type)) {
+            std::uint32_t to = materialize({target.reg, target.offset});
+            emit({Opcode::Move, Instr::none, to, materialize(value), layout.size(type)});
+        } else if (target.memory) {
+            emit({Opcode::Store, Instr::none, target.reg, value.reg, target.offset});
+        } else if (Instr* last = lastInstr(); last && last->dst == value.reg && value.reg >= firstTemp) {
+            // The temporary just computed can be the variable itself
+            last->dst = target.reg;
+        } else {
+            emit({Opcode::Copy, target.reg, value.reg});
+        }
+    }
+
+    Value expression(Expression* expr) {
+        walk(expr);
+        return pop();
+    }
+
+    void statement(ASTNode* node) {
+        if (!node) {
+            return;
+        }
+        switch (node->kind) {
+        case NodeKind::BlockStatement:
+            for (ASTNode* child : static_cast<BlockStatement&>(*node)) {
+                if (child->kind != NodeKind::VarDecl) {
+                    statement(child);
+                }
+            }
+            break;
+        case NodeKind::AssignStatement: {
+            AssignStatement& assign = static_cast<AssignStatement&>(*node);
+            wantAddress = assign.lhs;
+            walk(assign.lhs);
+            Location target = location;
+            wantAddress = nullptr;
+            store(target, expression(assign.rhs), assign.lhs->type);
+            break;
+        }
+        case NodeKind::CallStatement:
+            expression(static_cast<CallStatement&>(*node).call);
+            break;
+        case NodeKind::ReturnStatement: {
+            Expression* expr = static_cast<ReturnStatement&>(*node).expression;
+            if (!expr) {
+                emit({Opcode::Ret});
+            } else if (resultReg != Instr::none) {
+                emit({Opcode::Move, Instr::none, resultReg, materialize(expression(expr)), layout.size(returnType)});
+                emit({Opcode::Ret});
+            } else {
+                emit({Opcode::Ret, Instr::none, expression(expr).reg});
+            }
+            break;
+        }
+        case NodeKind::IfStatement: {
+            IfStatement& branch = static_cast<IfStatement&>(*node);
+            std::uint32_t condition = expression(branch.condition).reg;
+            std::uint32_t then = newBlock();
+            std::uint32_t otherwise = branch.elseStmt ? newBlock() : Instr::none;
+            std::uint32_t join = newBlock();
+            emit({Opcode::Branch, Instr::none, condition, then, branch.elseStmt ? otherwise : join});
+            start(then);
+            statement(branch.thenStmt);
+            emit({Opcode::Jump, Instr::none, join});
+            if (branch.elseStmt) {
+                start(otherwise);
+                statement(branch.elseStmt);
+                emit({Opcode::Jump, Instr::none, join});
+            }
+            start(join);
+            break;
+        }
+        case NodeKind::WhileStatement: {
+            WhileStatement& loop = static_cast<WhileStatement&>(*node);
+            std::uint32_t header = newBlock();
+            emit({Opcode::Jump, Instr::none, header});
+            start(header);
+            std::uint32_t condition = expression(loop.condition).reg;
+            std::uint32_t body = newBlock();
+            std::uint32_t exit = newBlock();
+            emit({Opcode::Branch, Instr::none, condition, body, exit});
+            start(body);
+            statement(loop.body);
+            emit({Opcode::Jump, Instr::none, header});
+            start(exit);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Terminate the last block, then drop the unreachable blocks and lay the
+    // others out in code order, renumbering the branch targets
+    void finish() {
+        if (open) {
+            if (function->returnsValue) {
+                emit({Opcode::Ret, Instr::none, constant(irType(returnType), 0)});
+            } else {
+                emit({Opcode::Ret});
+            }
+        }
+
+        std::vector<IRBlock>& blocks = function->blocks;
+        std::vector<std::uint32_t> renumbered(blocks.size(), Instr::none);
+        std::vector<std::uint32_t> pending{0};
+        renumbered[0] = 0;
+        while (!pending.empty()) {
+            std::uint32_t block = pending.back();
+            pending.pop_back();
+            const Instr& last = function->code[blocks[block].end - 1];
+            for (std::uint32_t next : {last.op == Opcode::Jump ? last.a : Instr::none,
+                                       last.op == Opcode::Branch ? last.b : Instr::none,
+                                       last.op == Opcode::Branch ? last.c : Instr::none}) {
+                if (next != Instr::none && renumbered[next] == Instr::none) {
+                    renumbered[next] = 0;
+                    pending.push_back(next);
+                }
+            }
+        }
+
+        std::vector<std::uint32_t> order;
+        for (std::uint32_t block = 0; block < blocks.size(); ++block) {
+            if (renumbered[block] != Instr::none) {
+                order.push_back(block);
+            }
+        }
+        std::sort(order.begin(), order.end(),
+            [&](std::uint32_t a, std::uint32_t b) { return blocks[a].begin < blocks[b].begin; });
+        for (std::uint32_t i = 0; i < order.size(); ++i) {
+            renumbered[order[i]] = i;
+        }
+
+        std::vector<Instr> code;
+        std::vector<IRBlock> laidOut;
+        code.reserve(function->code.size());
+        laidOut.reserve(order.size());
+        for (std::uint32_t block : order) {
+            std::uint32_t begin = static_cast<std::uint32_t>(code.size());
+            code.insert(code.end(), function->code.begin() + blocks[block].begin, function->code.begin() + blocks[block].end);
+            Instr& last = code.back();
+            if (last.op == Opcode::Jump) {
+                last.a = renumbered[last.a];
+            } else if (last.op == Opcode::Branch) {
+                last.b = renumbered[last.b];
+                last.c = renumbered[last.c];
+            }
+            laidOut.push_back({begin, static_cast<std::uint32_t>(code.size())});
+        }
+        function->code = std::move(code);
+        function->blocks = std::move(laidOut);
+    }
+
+    static Opcode binaryOpcode(BinOp op, bool floating) {
+        switch (op) {
+        case BinOp::Add: return floating ? Opcode::FAdd : Opcode::Add;
+        case BinOp::Sub: return floating ? Opcode::FSub : Opcode::Sub;
+        case BinOp::Mul: return floating ? Opcode::FMul : Opcode::Mul;
+        case BinOp::Div: return floating ? Opcode::FDiv : Opcode::Div;
+        case BinOp::And: return Opcode::And;
+        case BinOp::Or: return Opcode::Or;
+        case BinOp::Eq: return floating ? Opcode::FEq : Opcode::Eq;
+        case BinOp::NotEq: return floating ? Opcode::FNotEq : Opcode::NotEq;
+        case BinOp::Lt: return floating ? Opcode::FLt : Opcode::Lt;
+        case BinOp::Gt: return floating ? Opcode::FGt : Opcode::Gt;
+        case BinOp::LtEq: return floating ? Opcode::FLtEq : Opcode::LtEq;
+        case BinOp::GtEq: return floating ? Opcode::FGtEq : Opcode::GtEq;
+        }
+        return Opcode::Add;
+    }
+};
+
+} // namespace
+
+IRProgram lowerProgram(ASTNode* root, const ASTContext& context, const SymbolTables& tables, const TypeTable& types,
+                       std::vector<Diagnostic>& diagnostics) {
+    IRProgram program;
+    if (!root || root->kind != NodeKind::Program) {
+        return program;
+    }
+    const SymbolTable& global = tables.global();
+    Layout layout(global, types);
+
+    // Every function gets its index and signature before any body is
+    // lowered, so calls can refer to functions further down
+    std::unordered_map<const FuncDecl*, Callee> callees;
+    std::vector<Callee> order;
+    auto addFunctions = [&](const SymbolTable& table, const SymbolTable* cls) {
+        for (const SymbolEntry& entry : table.all()) {
+            if (entry.kind != SymbolKind::Function || !entry.defined) {
+                continue;
+            }
+            const FuncDecl& func = static_cast<const FuncDecl&>(*entry.decl);
+            Callee callee{static_cast<std::uint32_t>(program.functions.size()), &entry, cls};
+            callees[&func] = callee;
+            order.push_back(callee);
+
+            IRFunction function;
+            function.name = std::string(context.spelling(func.name));
+            if (cls) {
+                function.name = std::string(context.spelling(cls->name)) + "::" + function.name;
+            }
+            function.returnsValue = layout.isScalar(entry.type);
+            program.functions.push_back(std::move(function));
+        }
+    };
+    addFunctions(global, nullptr);
+    for (const SymbolEntry& entry : global.all()) {
+        if (entry.kind == SymbolKind::Class) {
+            addFunctions(*entry.table, entry.table);
+        }
+    }
+
+    FunctionLowerer lowerer(context, layout, program, callees, diagnostics);
+    for (const Callee& callee : order) {
+        lowerer.lowerFunction(callee);
+    }
+
+    // The program block, if there is one, is where execution starts
+    const Program& prog = static_cast<const Program&>(*root);
+    bool hasBlock = std::any_of(prog.declarations.begin(), prog.declarations.end(), [](const ASTNode* decl) {
+        return decl->kind != NodeKind::ClassDecl && decl->kind != NodeKind::ImplDecl && decl->kind != NodeKind::FuncDecl;
+    });
+    if (hasBlock) {
+        program.entry = static_cast<std::uint32_t>(program.functions.size());
+        program.functions.push_back({});
+        program.functions.back().name = "program";
+        lowerer.lowerProgram(prog, global, program.functions.back());
+    } else if (const SymbolEntry* main = global.find(context.find("main"))) {
+        if (main->kind == SymbolKind::Function && main->defined) {
+            program.entry = callees[static_cast<const FuncDecl*>(main->decl)].index;
+        }
+    }
+    return program;
+}
@@ -0,0 +1,171 @@
+#include "../include/ir_cfg.h"
+#include <utility>
+
+namespace {
+
+// Group (row, item) pairs by row: items of row r end up in
+// items[begin[r] .. begin[r + 1]), in the order the pairs were given
+void buildRows(std::uint32_t rows, const std::vector<std::pair<std::uint32_t, std::uint32_t>>& pairs,
+               std::vector<std::uint32_t>& begin, std::vector<std::uint32_t>& items) {
+    begin.assign(rows + 1, 0);
+    for (const auto& pair : pairs) {
+        ++begin[pair.first + 1];
+    }
+    for (std::uint32_t r = 0; r < rows; ++r) {
+        begin[r + 1] += begin[r];
+    }
+    items.resize(pairs.size());
+    std::vector<std::uint32_t> next(begin.begin(), begin.end() - 1);
+    for (const auto& pair : pairs) {
+        items[next[pair.first]++] = pair.second;
+    }
+}
+
+} // namespace
+
+CFG::CFG(const IRFunction& function) {
+    std::uint32_t blocks = static_cast<std::uint32_t>(function.blocks.size());
+    succBegin.reserve(blocks + 1);
+    succBegin.push_back(0);
+    for (const IRBlock& block : function.blocks) {
+        const Instr& last = function.code[block.end - 1];
+        if (last.op == Opcode::Jump) {
+            succ.push_back(last.a);
+        } else if (last.op == Opcode::Branch) {
+            succ.push_back(last.b);
+            succ.push_back(last.c);
+        }
+        succBegin.push_back(static_cast<std::uint32_t>(succ.size()));
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> edges;
+    edges.reserve(succ.size());
+    for (std::uint32_t block = 0; block < blocks; ++block) {
+        for (std::uint32_t target : successors(block)) {
+            edges.push_back({target, block});
+        }
+    }
+    buildRows(blocks, edges, predBegin, pred);
+}
+
+std::uint32_t CFG::edge(std::uint32_t block, std::uint32_t target) const {
+    for (std::uint32_t e = succBegin[block]; e < succBegin[block + 1]; ++e) {
+        if (succ[e] == target) {
+            return e;
+        }
+    }
+    return Instr::none;
+}
+
+Dominators::Dominators(const CFG& cfg) {
+    std::uint32_t blocks = cfg.blockCount();
+    idoms.assign(blocks, none);
+    if (blocks == 0) {
+        childBegin.assign(1, 0);
+        frontBegin.assign(1, 0);
+        return;
+    }
+
+    // Postorder by an explicit-stack depth-first search from the entry
+    std::vector<std::uint32_t> postNumber(blocks, none);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack{{0, 0}};  // block, next successor
+    std::vector<bool> seen(blocks, false);
+    seen[0] = true;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        IndexRange succs = cfg.successors(block);
+        if (next < succs.size()) {
+            std::uint32_t target = succs[next++];
+            if (!seen[target]) {
+                seen[target] = true;
+                stack.push_back({target, 0});
+            }
+        } else {
+            postNumber[block] = static_cast<std::uint32_t>(rpo.size());
+            rpo.push_back(block);
+            stack.pop_back();
+        }
+    }
+    std::uint32_t reachableCount = static_cast<std::uint32_t>(rpo.size());
+    for (std::uint32_t i = 0; i < reachableCount / 2; ++i) {
+        std::swap(rpo[i], rpo[reachableCount - 1 - i]);
+    }
+
+    auto intersect = [&](std::uint32_t a, std::uint32_t b) {
+        while (a != b) {
+            while (postNumber[a] < postNumber[b]) {
+                a = idoms[a];
+            }
+            while (postNumber[b] < postNumber[a]) {
+                b = idoms[b];
+            }
+        }
+        return a;
+    };
+
+    idoms[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (std::uint32_t i = 1; i < reachableCount; ++i) {
+            std::uint32_t block = rpo[i];
+            std::uint32_t idom = none;
+            for (std::uint32_t p : cfg.predecessors(block)) {
+                if (idoms[p] != none) {
+                    idom = idom == none ? p : intersect(p, idom);
+                }
+            }
+            if (idoms[block] != idom) {
+                idoms[block] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+    pairs.reserve(reachableCount);
+    for (std::uint32_t i = 1; i < reachableCount; ++i) {
+        pairs.push_back({idoms[rpo[i]], rpo[i]});
+    }
+    buildRows(blocks, pairs, childBegin, child);
+
+    // A join point is in the frontier of every block on the way up from
+    // each of its predecessors to its idom
+    pairs.clear();
+    std::vector<std::uint32_t> lastAdded(blocks, none);
+    for (std::uint32_t block = 0; block < blocks; ++block) {
+        if (idoms[block] == none || cfg.predecessors(block).size() < 2) {
+            continue;
+        }
+        for (std::uint32_t p : cfg.predecessors(block)) {
+            for (std::uint32_t runner = p; idoms[runner] != none && runner != idoms[block]; runner = idoms[runner]) {
+                if (lastAdded[runner] != block) {
+                    lastAdded[runner] = block;
+                    pairs.push_back({runner, block});
+                }
+                if (runner == 0) {
+                    break;
+                }
+            }
+        }
+    }
+    buildRows(blocks, pairs, frontBegin, front);
+
+    // Preorder intervals of the tree for constant-time dominance queries
+    enter.assign(blocks, none);
+    exit.assign(blocks, 0);
+    std::uint32_t clock = 0;
+    stack.assign(1, {0, 0});
+    enter[0] = clock++;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        IndexRange kids = children(block);
+        if (next < kids.size()) {
+            std::uint32_t kid = kids[next++];
+            enter[kid] = clock++;
+            stack.push_back({kid, 0});
+        } else {
+            exit[block] = clock++;
+            stack.pop_back();
+        }
+    }
+}
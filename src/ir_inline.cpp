@@ -0,0 +1,220 @@
+#include "../include/ir_inline.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr std::uint32_t none = Instr::none;
+constexpr std::size_t maxCalleeSize = 40;
+
+bool hasCalls(const IRFunction& function) {
+    return std::any_of(function.code.begin(), function.code.end(),
+                       [](const Instr& instr) { return instr.op == Opcode::Call || instr.op == Opcode::Phi; });
+}
+
+// Functions in postorder of the call graph, callees before their callers
+// except along a cycle
+std::vector<std::uint32_t> postorder(const IRProgram& program) {
+    std::uint32_t count = static_cast<std::uint32_t>(program.functions.size());
+    std::vector<std::vector<std::uint32_t>> callees(count);
+    for (std::uint32_t f = 0; f < count; ++f) {
+        for (const Instr& instr : program.functions[f].code) {
+            if (instr.op == Opcode::Call) {
+                callees[f].push_back(instr.a);
+            }
+        }
+    }
+
+    std::vector<std::uint32_t> order;
+    std::vector<bool> seen(count, false);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack;  // function, next callee
+    for (std::uint32_t root = 0; root < count; ++root) {
+        if (seen[root]) {
+            continue;
+        }
+        seen[root] = true;
+        stack.push_back({root, 0});
+        while (!stack.empty()) {
+            auto& [f, next] = stack.back();
+            if (next < callees[f].size()) {
+                std::uint32_t callee = callees[f][next++];
+                if (!seen[callee]) {
+                    seen[callee] = true;
+                    stack.push_back({callee, 0});
+                }
+            } else {
+                order.push_back(f);
+                stack.pop_back();
+            }
+        }
+    }
+    return order;
+}
+
+class Inliner {
+public:
+    Inliner(IRProgram& program, InlineStats& stats, std::size_t budget)
+        : program(program), stats(stats), budget(budget), exposed(program.functions.size()),
+          computed(program.functions.size(), false) {}
+
+    void inlineInto(std::uint32_t index) {
+        IRFunction& caller = program.functions[index];
+        if (std::none_of(caller.code.begin(), caller.code.end(),
+                         [&](const Instr& instr) { return instr.op == Opcode::Call && inlinable(instr.a); })) {
+            return;
+        }
+        for (const Instr& instr : caller.code) {
+            if (instr.op == Opcode::Phi) {
+                return;
+            }
+        }
+
+        // Block contents in order; the originals keep their indices and
+        // the inlined blocks and the continuations of split blocks are
+        // numbered after them, so code order still follows block order
+        std::vector<std::vector<Instr>> contents;
+        for (const IRBlock& block : caller.blocks) {
+            contents.emplace_back(caller.code.begin() + block.begin, caller.code.begin() + block.end);
+        }
+        std::vector<Instr> code;
+        std::vector<IRBlock> blocks;
+        for (std::uint32_t id = 0; id < contents.size(); ++id) {
+            std::vector<Instr> segment = std::move(contents[id]);
+            std::uint32_t begin = static_cast<std::uint32_t>(code.size());
+            for (std::size_t k = 0; k < segment.size(); ++k) {
+                const Instr& instr = segment[k];
+                if (instr.op != Opcode::Call || !inlinable(instr.a) || cost(instr.a) > budget) {
+                    code.push_back(instr);
+                    continue;
+                }
+                budget -= cost(instr.a);
+                ++stats.calls;
+                expand(caller, instr, code, begin, contents);
+                contents.emplace_back(segment.begin() + k + 1, segment.end());
+                break;
+            }
+            blocks.push_back({begin, static_cast<std::uint32_t>(code.size())});
+        }
+        caller.code = std::move(code);
+        caller.blocks = std::move(blocks);
+    }
+
+private:
+    IRProgram& program;
+    InlineStats& stats;
+    std::size_t budget;
+    std::vector<std::vector<std::uint32_t>> exposed;
+    std::vector<bool> computed;
+
+    bool inlinable(std::uint32_t callee) const {
+        const IRFunction& function = program.functions[callee];
+        return !function.blocks.empty() && function.code.size() <= maxCalleeSize && !hasCalls(function);
+    }
+
+    const std::vector<std::uint32_t>& exposedOf(std::uint32_t callee) {
+        if (!computed[callee]) {
+            exposed[callee] = exposedRegisters(program.functions[callee]);
+            computed[callee] = true;
+        }
+        return exposed[callee];
+    }
+
+    // Instructions added in place of the call
+    std::size_t cost(std::uint32_t callee) {
+        const IRFunction& function = program.functions[callee];
+        std::size_t frame = function.frameSize ? 2 + (function.frameSize + 3) / 4 : 0;
+        return function.code.size() + exposedOf(callee).size() + frame;
+    }
+
+    // Replace call, the last instruction of the block begun at begin, by a
+    // jump into a copy of its callee's blocks appended to contents, which
+    // return to the block added after them
+    void expand(IRFunction& caller, const Instr& call, std::vector<Instr>& code, std::uint32_t begin,
+                std::vector<std::vector<Instr>>& contents) {
+        const IRFunction& callee = program.functions[call.a];
+        std::uint32_t base = static_cast<std::uint32_t>(caller.regs.size());
+        caller.regs.insert(caller.regs.end(), callee.regs.begin(), callee.regs.end());
+
+        // The Args of the call become copies into the parameters
+        std::uint32_t param = call.b;
+        for (std::size_t j = code.size(); j > begin && param > 0; --j) {
+            Instr& arg = code[j - 1];
+            if (arg.op == Opcode::Arg) {
+                arg = {Opcode::Copy, base + --param, arg.a};
+            }
+        }
+
+        for (std::uint32_t r : exposedOf(call.a)) {
+            code.push_back({Opcode::Const, base + r, 0});
+        }
+        std::uint32_t frame = (caller.frameSize + 3) & ~3u;
+        if (callee.frameSize) {
+            std::uint32_t address = static_cast<std::uint32_t>(caller.regs.size());
+            std::uint32_t zero = address + 1;
+            caller.regs.push_back(IRType::Int);
+            caller.regs.push_back(IRType::Int);
+            code.push_back({Opcode::Frame, address, none, none, frame});
+            code.push_back({Opcode::Const, zero, 0});
+            for (std::uint32_t offset = 0; offset < callee.frameSize; offset += 4) {
+                code.push_back({Opcode::Store, none, address, zero, offset});
+            }
+            caller.frameSize = frame + callee.frameSize;
+        }
+
+        std::uint32_t entry = static_cast<std::uint32_t>(contents.size());
+        std::uint32_t after = entry + static_cast<std::uint32_t>(callee.blocks.size());
+        code.push_back({Opcode::Jump, none, entry});
+        for (const IRBlock& block : callee.blocks) {
+            std::vector<Instr> copy;
+            for (std::uint32_t i = block.begin; i < block.end; ++i) {
+                Instr instr = callee.code[i];
+                if (instr.op == Opcode::Ret) {
+                    if (call.dst != none && instr.a != none) {
+                        copy.push_back({Opcode::Copy, call.dst, base + instr.a});
+                    }
+                    copy.push_back({Opcode::Jump, none, after});
+                    continue;
+                }
+                unsigned operands = registerOperands(instr);
+                if ((operands & 1) && instr.a != none) {
+                    instr.a += base;
+                }
+                if ((operands & 2) && instr.b != none) {
+                    instr.b += base;
+                }
+                if (definesRegister(instr.op) && instr.dst != none) {
+                    instr.dst += base;
+                }
+                switch (instr.op) {
+                case Opcode::Frame:
+                    instr.c += frame;
+                    break;
+                case Opcode::Jump:
+                    instr.a += entry;
+                    break;
+                case Opcode::Branch:
+                    instr.b += entry;
+                    instr.c += entry;
+                    break;
+                default:
+                    break;
+                }
+                copy.push_back(instr);
+            }
+            contents.push_back(std::move(copy));
+        }
+    }
+};
+
+} // namespace
+
+InlineStats inlineFunctions(IRProgram& program) {
+    InlineStats stats;
+    stats.instructionsBefore = program.instructionCount();
+    Inliner inliner(program, stats, stats.instructionsBefore / 2);
+    for (std::uint32_t f : postorder(program)) {
+        inliner.inlineInto(f);
+    }
+    stats.instructionsAfter = program.instructionCount();
+    return stats;
+}
@@ -0,0 +1,529 @@
+#include "../include/ir_loops.h"
+#include "../include/ir_cfg.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+constexpr std::uint32_t none = Instr::none;
+
+// Operators that neither touch memory nor fault, safe to run on an
+// iteration that would not have
+bool hoistable(Opcode op) {
+    switch (op) {
+    case Opcode::Const:
+    case Opcode::Copy:
+    case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::And: case Opcode::Or:
+    case Opcode::Eq: case Opcode::NotEq: case Opcode::Lt: case Opcode::Gt: case Opcode::LtEq: case Opcode::GtEq:
+    case Opcode::FAdd: case Opcode::FSub: case Opcode::FMul: case Opcode::FDiv:
+    case Opcode::FEq: case Opcode::FNotEq: case Opcode::FLt: case Opcode::FGt: case Opcode::FLtEq: case Opcode::FGtEq:
+    case Opcode::Neg: case Opcode::FNeg: case Opcode::Not:
+    case Opcode::Frame:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Hoistable operators that cost no more to run on every iteration than a
+// register kept across the whole loop
+bool cheap(Opcode op) {
+    return op == Opcode::Const || op == Opcode::Copy || op == Opcode::Frame;
+}
+
+template <typename Instruction, typename F>
+void forEachOperand(Instruction& instr, F f) {
+    unsigned operands = registerOperands(instr);
+    if ((operands & 1) && instr.a != none) {
+        f(instr.a);
+    }
+    if ((operands & 2) && instr.b != none) {
+        f(instr.b);
+    }
+}
+
+bool defines(const Instr& instr) {
+    return instr.dst != none && definesRegister(instr.op);
+}
+
+// Instruction i of block b
+struct Site {
+    std::uint32_t block = none;
+    std::uint32_t index = none;
+};
+
+class LoopOptimizer {
+public:
+    LoopOptimizer(IRFunction& function, LoopStats& stats) : function(function), stats(stats) {}
+
+    void run() {
+        for (const Instr& instr : function.code) {
+            if (instr.op == Opcode::Phi) {
+                return;
+            }
+        }
+        for (const IRBlock& block : function.blocks) {
+            blocks.emplace_back(function.code.begin() + block.begin, function.code.begin() + block.end);
+        }
+
+        std::vector<bool> done;
+        for (;;) {
+            store();
+            done.resize(blocks.size(), false);
+            std::vector<bool> loop;
+            std::uint32_t header = innermost(done, loop);
+            if (header == none) {
+                break;
+            }
+            done[header] = true;
+            ++stats.loops;
+            std::uint32_t preheader = makePreheader(header, loop);
+            if (preheader == none) {
+                continue;
+            }
+            store();
+            hoist(loop, preheader);
+            reduce(loop, preheader);
+        }
+        store();
+    }
+
+private:
+    IRFunction& function;
+    LoopStats& stats;
+    std::vector<std::vector<Instr>> blocks;
+    std::vector<std::uint32_t> defs;          // writes of each register in the function
+    std::vector<std::uint32_t> defsInLoop;    // and inside the loop
+    std::vector<Site> defSite;                // the last write found
+    std::vector<Site> loopDefSite;            // the last write found inside the loop
+    std::vector<std::vector<Site>> useSites;  // reads of each register
+
+    // Write the blocks back as code and block table
+    void store() {
+        function.code.clear();
+        function.blocks.clear();
+        for (const std::vector<Instr>& block : blocks) {
+            std::uint32_t begin = static_cast<std::uint32_t>(function.code.size());
+            function.code.insert(function.code.end(), block.begin(), block.end());
+            function.blocks.push_back({begin, static_cast<std::uint32_t>(function.code.size())});
+        }
+    }
+
+    std::uint32_t newReg() {
+        function.regs.push_back(IRType::Int);
+        return static_cast<std::uint32_t>(function.regs.size() - 1);
+    }
+
+    // The header of the smallest natural loop not visited yet, its blocks
+    // marked in loop; none if there is no such loop. An inner loop has
+    // fewer blocks than any loop around it.
+    std::uint32_t innermost(const std::vector<bool>& done, std::vector<bool>& loop) {
+        CFG cfg(function);
+        Dominators dom(cfg);
+        std::uint32_t best = none;
+        std::size_t bestSize = 0;
+        for (std::uint32_t header = 0; header < cfg.blockCount(); ++header) {
+            if (done[header] || !dom.reachable(header)) {
+                continue;
+            }
+            std::vector<bool> body(cfg.blockCount(), false);
+            std::vector<std::uint32_t> work;
+            for (std::uint32_t pred : cfg.predecessors(header)) {
+                if (dom.reachable(pred) && dom.dominates(header, pred)) {
+                    work.push_back(pred);
+                }
+            }
+            if (work.empty()) {
+                continue;
+            }
+            body[header] = true;
+            std::size_t size = 1;
+            while (!work.empty()) {
+                std::uint32_t b = work.back();
+                work.pop_back();
+                if (body[b]) {
+                    continue;
+                }
+                body[b] = true;
+                ++size;
+                for (std::uint32_t pred : cfg.predecessors(b)) {
+                    if (dom.reachable(pred)) {
+                        work.push_back(pred);
+                    }
+                }
+            }
+            if (best == none || size < bestSize) {
+                best = header;
+                bestSize = size;
+                loop = std::move(body);
+            }
+        }
+        return best;
+    }
+
+    // The block to put code running once before the loop in: the only
+    // predecessor from outside if it leads nowhere else, or a new block
+    // the edges from outside are sent through
+    std::uint32_t makePreheader(std::uint32_t header, const std::vector<bool>& loop) {
+        CFG cfg(function);
+        std::vector<std::uint32_t> outside;
+        for (std::uint32_t pred : cfg.predecessors(header)) {
+            if (!loop[pred] && std::find(outside.begin(), outside.end(), pred) == outside.end()) {
+                outside.push_back(pred);
+            }
+        }
+        if (outside.empty()) {
+            return none;
+        }
+        if (outside.size() == 1 && cfg.successors(outside[0]).size() == 1) {
+            return outside[0];
+        }
+
+        std::uint32_t preheader = static_cast<std::uint32_t>(blocks.size());
+        for (std::uint32_t pred : outside) {
+            Instr& last = blocks[pred].back();
+            if (last.op == Opcode::Jump && last.a == header) {
+                last.a = preheader;
+            } else if (last.op == Opcode::Branch) {
+                last.b = last.b == header ? preheader : last.b;
+                last.c = last.c == header ? preheader : last.c;
+            }
+        }
+        blocks.push_back({{Opcode::Jump, none, header}});
+        ++stats.preheaders;
+        return preheader;
+    }
+
+    void countDefinitions(const std::vector<bool>& loop) {
+        std::size_t regs = function.regs.size();
+        defs.assign(regs, 0);
+        defsInLoop.assign(regs, 0);
+        defSite.assign(regs, {});
+        loopDefSite.assign(regs, {});
+        useSites.assign(regs, {});
+        for (std::uint32_t b = 0; b < blocks.size(); ++b) {
+            for (std::uint32_t i = 0; i < blocks[b].size(); ++i) {
+                const Instr& instr = blocks[b][i];
+                forEachOperand(instr, [&](std::uint32_t r) { useSites[r].push_back({b, i}); });
+                if (defines(instr)) {
+                    ++defs[instr.dst];
+                    defSite[instr.dst] = {b, i};
+                    if (b < loop.size() && loop[b]) {
+                        ++defsInLoop[instr.dst];
+                        loopDefSite[instr.dst] = {b, i};
+                    }
+                }
+            }
+        }
+    }
+
+    bool invariant(std::uint32_t reg) const {
+        return reg < defsInLoop.size() && defsInLoop[reg] == 0;
+    }
+
+    // Whether the only write of reg comes before each of its reads
+    bool dominatesUses(std::uint32_t reg, const Dominators& dom) const {
+        Site def = defSite[reg];
+        for (const Site& use : useSites[reg]) {
+            if (!dom.reachable(use.block)) {
+                return false;
+            }
+            if (use.block == def.block ? use.index <= def.index : !dom.dominates(def.block, use.block)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void hoist(const std::vector<bool>& loop, std::uint32_t preheader) {
+        countDefinitions(loop);
+        CFG cfg(function);
+        Dominators dom(cfg);
+        std::vector<bool> moved(function.regs.size(), false);
+        std::vector<std::vector<bool>> marked(blocks.size());
+        std::vector<Instr> hoisted;
+        std::vector<Site> from;
+
+        // Candidates are found in code order, so one is always moved after
+        // the instructions it reads that moved
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (std::uint32_t b = 0; b < loop.size(); ++b) {
+                if (!loop[b]) {
+                    continue;
+                }
+                marked[b].resize(blocks[b].size(), false);
+                for (std::uint32_t i = 0; i + 1 < blocks[b].size(); ++i) {
+                    const Instr& instr = blocks[b][i];
+                    if (marked[b][i] || !hoistable(instr.op) || instr.dst == none || defs[instr.dst] != 1) {
+                        continue;
+                    }
+                    bool operands = true;
+                    forEachOperand(instr, [&](std::uint32_t r) { operands = operands && (invariant(r) || moved[r]); });
+                    if (!operands || !dominatesUses(instr.dst, dom)) {
+                        continue;
+                    }
+                    marked[b][i] = true;
+                    moved[instr.dst] = true;
+                    hoisted.push_back(instr);
+                    from.push_back({b, i});
+                    changed = true;
+                }
+            }
+        }
+
+        // A cheap instruction read only inside the loop stays there, where
+        // Moon folds a constant into its readers; it moves only for
+        // another instruction that moved. Its readers come after it.
+        std::vector<bool> readByHoisted(function.regs.size(), false), stays(hoisted.size(), false);
+        for (std::size_t k = hoisted.size(); k-- > 0;) {
+            const Instr& instr = hoisted[k];
+            if (cheap(instr.op) && !readByHoisted[instr.dst]) {
+                stays[k] = true;
+                marked[from[k].block][from[k].index] = false;
+                continue;
+            }
+            forEachOperand(instr, [&](std::uint32_t r) { readByHoisted[r] = true; });
+        }
+        std::size_t count = 0;
+        for (std::size_t k = 0; k < hoisted.size(); ++k) {
+            if (!stays[k]) {
+                hoisted[count++] = hoisted[k];
+            }
+        }
+        hoisted.resize(count);
+        if (hoisted.empty()) {
+            return;
+        }
+
+        for (std::uint32_t b = 0; b < marked.size(); ++b) {
+            if (marked[b].empty()) {
+                continue;
+            }
+            std::uint32_t kept = 0;
+            for (std::uint32_t i = 0; i < blocks[b].size(); ++i) {
+                if (!marked[b][i]) {
+                    blocks[b][kept++] = blocks[b][i];
+                }
+            }
+            blocks[b].resize(kept);
+        }
+        std::vector<Instr>& target = blocks[preheader];
+        target.insert(target.end() - 1, hoisted.begin(), hoisted.end());
+        stats.hoisted += hoisted.size();
+    }
+
+    // Whether reg is written only by one Const, whose value is then in value
+    bool constant(std::uint32_t reg, std::uint32_t& value) const {
+        if (reg >= defs.size() || defs[reg] != 1) {
+            return false;
+        }
+        const Instr& instr = blocks[defSite[reg].block][defSite[reg].index];
+        value = instr.a;
+        return instr.op == Opcode::Const;
+    }
+
+    // Invariant, or a constant that stayed in the loop and is written
+    // before each read
+    bool fixed(std::uint32_t reg, const Dominators& dom) const {
+        std::uint32_t value;
+        return invariant(reg) || (constant(reg, value) && dominatesUses(reg, dom));
+    }
+
+    void reduce(const std::vector<bool>& loop, std::uint32_t preheader) {
+        countDefinitions(loop);
+        CFG cfg(function);
+        Dominators dom(cfg);
+        std::size_t regs = function.regs.size();
+
+        // Basic induction variables: the site of their only step
+        std::vector<Site> step(regs);
+        for (std::uint32_t r = 0; r < regs; ++r) {
+            if (defsInLoop[r] != 1) {
+                continue;
+            }
+            const Instr& instr = blocks[loopDefSite[r].block][loopDefSite[r].index];
+            bool add = instr.op == Opcode::Add && (instr.a == r ? instr.b != r && fixed(instr.b, dom) : instr.b == r && fixed(instr.a, dom));
+            bool sub = instr.op == Opcode::Sub && instr.a == r && instr.b != r && fixed(instr.b, dom);
+            if (add || sub) {
+                step[r] = loopDefSite[r];
+            }
+        }
+        auto stepIncrement = [&](std::uint32_t iv) {
+            const Instr& instr = blocks[step[iv].block][step[iv].index];
+            return instr.a == iv ? instr.b : instr.a;
+        };
+        // Whether iv steps strictly between two sites of block b
+        auto stepsBetween = [&](std::uint32_t iv, std::uint32_t b, std::uint32_t from, std::uint32_t to) {
+            return step[iv].block == b && step[iv].index > from && step[iv].index < to;
+        };
+
+        // Instructions the loop runs per iteration after the reduction
+        // less those it runs now; a reduction that does not save any is not
+        // worth the setup in the preheader
+        std::ptrdiff_t added = 0;
+        std::size_t reduced = 0;
+        std::size_t regsBefore = function.regs.size();
+
+        std::vector<Instr> setup;
+        std::vector<std::pair<Site, Instr>> rewritten;
+        std::vector<std::vector<bool>> removed(blocks.size());
+        std::vector<std::vector<std::vector<Instr>>> inserted(blocks.size());
+        std::map<std::pair<std::uint32_t, std::uint64_t>, std::uint32_t> products;
+        std::vector<std::pair<Site, std::pair<std::uint32_t, std::uint32_t>>> renames;  // site, from, to
+
+        // x * k computed in the preheader into dst; a constant the loop
+        // still writes is read there as its value, and two constants fold
+        auto multiply = [&](std::uint32_t dst, std::uint32_t x, std::uint32_t k) {
+            std::uint32_t a, b;
+            bool constantX = constant(x, a), constantK = constant(k, b);
+            if (constantX && constantK) {
+                setup.push_back({Opcode::Const, dst, a * b});
+                return;
+            }
+            for (auto [r, isConstant, value] : {std::make_tuple(&x, constantX, a), std::make_tuple(&k, constantK, b)}) {
+                if (isConstant && !invariant(*r)) {
+                    *r = newReg();
+                    setup.push_back({Opcode::Const, *r, value});
+                }
+            }
+            setup.push_back({Opcode::Mul, dst, x, k});
+        };
+
+        // The register holding iv * k throughout the loop, shared by the
+        // registers k that hold one constant
+        auto product = [&](std::uint32_t iv, std::uint32_t k) {
+            std::uint64_t factor = k;
+            std::uint32_t value;
+            if (constant(k, value)) {
+                factor = std::uint64_t{1} << 32 | value;
+            }
+            auto [it, fresh] = products.emplace(std::make_pair(iv, factor), none);
+            if (fresh) {
+                it->second = newReg();
+                std::uint32_t increment = newReg();
+                multiply(it->second, iv, k);
+                multiply(increment, stepIncrement(iv), k);
+                Site at = step[iv];
+                Opcode op = blocks[at.block][at.index].op;
+                inserted[at.block].resize(blocks[at.block].size());
+                inserted[at.block][at.index].push_back({op, it->second, it->second, increment});
+                ++added;
+            }
+            return it->second;
+        };
+
+        for (std::uint32_t b = 0; b < loop.size(); ++b) {
+            if (!loop[b]) {
+                continue;
+            }
+            removed[b].resize(blocks[b].size(), false);
+            for (std::uint32_t i = 0; i < blocks[b].size(); ++i) {
+                Instr& instr = blocks[b][i];
+                if (instr.op != Opcode::Mul || defs[instr.dst] != 1) {
+                    continue;
+                }
+                std::uint32_t t = instr.dst;
+                for (auto [x, k] : {std::make_pair(instr.a, instr.b), std::make_pair(instr.b, instr.a)}) {
+                    if (!fixed(k, dom) || x == k) {
+                        continue;
+                    }
+                    if (step[x].block != none) {
+                        // Read the running product directly where iv cannot
+                        // have stepped since the multiplication
+                        std::uint32_t s = product(x, k);
+                        bool direct = !useSites[t].empty();
+                        for (const Site& use : useSites[t]) {
+                            direct = direct && use.block == b && use.index > i && !stepsBetween(x, b, i, use.index);
+                        }
+                        if (direct) {
+                            for (const Site& use : useSites[t]) {
+                                renames.push_back({use, {t, s}});
+                            }
+                            removed[b][i] = true;
+                            --added;
+                        } else {
+                            rewritten.push_back({{b, i}, {Opcode::Copy, t, s}});
+                        }
+                        ++reduced;
+                        break;
+                    }
+                    // (iv + d) * k is iv * k + d * k
+                    if (defs[x] != 1 || defsInLoop[x] != 1 || defSite[x].block != b || defSite[x].index >= i) {
+                        continue;
+                    }
+                    const Instr& sum = blocks[b][defSite[x].index];
+                    std::uint32_t iv = none, d = none;
+                    if ((sum.op == Opcode::Add || sum.op == Opcode::Sub) && sum.a < regs && step[sum.a].block != none &&
+                        fixed(sum.b, dom)) {
+                        iv = sum.a;
+                        d = sum.b;
+                    } else if (sum.op == Opcode::Add && sum.b < regs && step[sum.b].block != none && fixed(sum.a, dom)) {
+                        iv = sum.b;
+                        d = sum.a;
+                    }
+                    if (iv == none || iv == d || stepsBetween(iv, b, defSite[x].index, i)) {
+                        continue;
+                    }
+                    std::uint32_t s = product(iv, k);
+                    std::uint32_t offset = newReg();
+                    multiply(offset, d, k);
+                    rewritten.push_back({{b, i}, {sum.op, t, s, offset}});
+                    if (useSites[x].size() == 1) {
+                        removed[b][defSite[x].index] = true;
+                        --added;
+                    }
+                    ++reduced;
+                    break;
+                }
+            }
+        }
+        if (setup.empty() || added >= 0) {
+            function.regs.resize(regsBefore);
+            return;
+        }
+        stats.reduced += reduced;
+
+        for (const auto& [site, instr] : rewritten) {
+            blocks[site.block][site.index] = instr;
+        }
+        for (const auto& [site, names] : renames) {
+            Instr& use = blocks[site.block][site.index];
+            forEachOperand(use, [&](std::uint32_t& r) {
+                if (r == names.first) {
+                    r = names.second;
+                }
+            });
+        }
+        for (std::uint32_t b = 0; b < blocks.size(); ++b) {
+            if (removed[b].empty() && inserted[b].empty()) {
+                continue;
+            }
+            removed[b].resize(blocks[b].size(), false);
+            inserted[b].resize(blocks[b].size());
+            std::vector<Instr> code;
+            for (std::uint32_t i = 0; i < blocks[b].size(); ++i) {
+                if (!removed[b][i]) {
+                    code.push_back(blocks[b][i]);
+                }
+                code.insert(code.end(), inserted[b][i].begin(), inserted[b][i].end());
+            }
+            blocks[b] = std::move(code);
+        }
+        std::vector<Instr>& target = blocks[preheader];
+        target.insert(target.end() - 1, setup.begin(), setup.end());
+    }
+};
+
+} // namespace
+
+LoopStats optimizeLoops(IRProgram& program) {
+    LoopStats stats;
+    for (IRFunction& function : program.functions) {
+        LoopOptimizer(function, stats).run();
+    }
+    return stats;
+}
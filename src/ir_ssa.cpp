@@ -0,0 +1,797 @@
+#include "../include/ir_ssa.h"
+#include "../include/bit_set.h"
+#include "../include/ir_cfg.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr std::uint32_t none = Instr::none;
+
+std::uint32_t newReg(IRFunction& function, IRType type) {
+    function.regs.push_back(type);
+    return static_cast<std::uint32_t>(function.regs.size() - 1);
+}
+
+// Call f on each register operand slot of an instruction, phi operands
+// excluded
+template <typename Instruction, typename F>
+void forEachOperand(Instruction& instr, F f) {
+    unsigned operands = registerOperands(instr);
+    if (operands & 1) {
+        f(instr.a);
+    }
+    if (operands & 2) {
+        f(instr.b);
+    }
+}
+
+bool defines(const Instr& instr) {
+    return instr.dst != none && definesRegister(instr.op);
+}
+
+// Same rows as ir_cfg.cpp: items of row r in items[begin[r] .. begin[r + 1])
+void groupByRow(std::uint32_t rows, const std::vector<std::pair<std::uint32_t, std::uint32_t>>& pairs,
+                std::vector<std::uint32_t>& begin, std::vector<std::uint32_t>& items) {
+    begin.assign(rows + 1, 0);
+    for (const auto& pair : pairs) {
+        ++begin[pair.first + 1];
+    }
+    for (std::uint32_t r = 0; r < rows; ++r) {
+        begin[r + 1] += begin[r];
+    }
+    items.resize(pairs.size());
+    std::vector<std::uint32_t> next(begin.begin(), begin.end() - 1);
+    for (const auto& pair : pairs) {
+        items[next[pair.first]++] = pair.second;
+    }
+}
+
+// Keep the instructions whose bit is set, sliding them down in place. Blocks
+// are in code order, so a block never moves past its old start.
+void compact(IRFunction& function, const BitSet& keep) {
+    std::uint32_t out = 0;
+    for (IRBlock& block : function.blocks) {
+        std::uint32_t begin = out;
+        for (std::uint32_t i = block.begin; i < block.end; ++i) {
+            if (keep.test(i)) {
+                function.code[out++] = function.code[i];
+            }
+        }
+        block = {begin, out};
+    }
+    function.code.resize(out);
+}
+
+// Drop the blocks whose bit is clear and renumber the others in order,
+// along with branch targets and phi predecessors. No remaining block may
+// still branch to, or have a phi operand from, a dropped one.
+void removeBlocks(IRFunction& function, const BitSet& live, SSAStats& stats) {
+    std::uint32_t blocks = static_cast<std::uint32_t>(function.blocks.size());
+    std::vector<std::uint32_t> number(blocks, none);
+    std::uint32_t count = 0;
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        if (live.test(b)) {
+            number[b] = count++;
+        }
+    }
+
+    std::uint32_t out = 0;
+    std::vector<IRBlock> kept;
+    kept.reserve(count);
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        if (!live.test(b)) {
+            stats.instructionsRemoved += function.blocks[b].end - function.blocks[b].begin;
+            ++stats.blocksRemoved;
+            continue;
+        }
+        std::uint32_t begin = out;
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            Instr& instr = function.code[out++] = function.code[i];
+            if (instr.op == Opcode::Jump) {
+                instr.a = number[instr.a];
+            } else if (instr.op == Opcode::Branch) {
+                instr.b = number[instr.b];
+                instr.c = number[instr.c];
+            } else if (instr.op == Opcode::Phi) {
+                for (std::uint32_t k = 0; k < instr.b; ++k) {
+                    std::uint32_t& pred = function.phiOperands[instr.a + 2 * k + 1];
+                    pred = number[pred];
+                }
+            }
+        }
+        kept.push_back({begin, out});
+    }
+    function.code.resize(out);
+    function.blocks = std::move(kept);
+}
+
+// Move the phis of each block back in front of its other instructions
+void phisFirst(IRFunction& function) {
+    for (const IRBlock& block : function.blocks) {
+        std::stable_partition(function.code.begin() + block.begin, function.code.begin() + block.end,
+                              [](const Instr& instr) { return instr.op == Opcode::Phi; });
+    }
+}
+
+// Lattice of propagateConstants, from unknown down to varying
+enum class Lattice : std::uint8_t { Top, Constant, Bottom };
+
+bool isFloatOp(Opcode op) {
+    return op >= Opcode::FAdd && op <= Opcode::FGtEq;
+}
+
+template <typename T>
+std::uint32_t compare(Opcode op, T a, T b) {
+    switch (op) {
+    case Opcode::Eq: case Opcode::FEq: return a == b;
+    case Opcode::NotEq: case Opcode::FNotEq: return a != b;
+    case Opcode::Lt: case Opcode::FLt: return a < b;
+    case Opcode::Gt: case Opcode::FGt: return a > b;
+    case Opcode::LtEq: case Opcode::FLtEq: return a <= b;
+    default: return a >= b;
+    }
+}
+
+// Evaluate a binary operator on the bits of its operands as constant
+// folding does; a division the target would trap on is left to run time
+bool evaluate(Opcode op, std::uint32_t a, std::uint32_t b, std::uint32_t& value) {
+    if (isFloatOp(op)) {
+        float x, y, result;
+        std::memcpy(&x, &a, sizeof x);
+        std::memcpy(&y, &b, sizeof y);
+        switch (op) {
+        case Opcode::FAdd: result = x + y; break;
+        case Opcode::FSub: result = x - y; break;
+        case Opcode::FMul: result = x * y; break;
+        case Opcode::FDiv:
+            if (y == 0.0f) {
+                return false;
+            }
+            result = x / y;
+            break;
+        default:
+            value = compare(op, x, y);
+            return true;
+        }
+        std::memcpy(&value, &result, sizeof value);
+        return true;
+    }
+
+    // Unsigned arithmetic wraps at 32 bits like the ints it stands for
+    int x = static_cast<int>(a), y = static_cast<int>(b);
+    switch (op) {
+    case Opcode::Add: value = a + b; return true;
+    case Opcode::Sub: value = a - b; return true;
+    case Opcode::Mul: value = a * b; return true;
+    case Opcode::Div:
+        if (y == 0 || (x == INT_MIN && y == -1)) {
+            return false;
+        }
+        value = static_cast<std::uint32_t>(x / y);
+        return true;
+    case Opcode::And: value = a && b; return true;
+    case Opcode::Or: value = a || b; return true;
+    default: value = compare(op, x, y); return true;
+    }
+}
+
+std::uint32_t evaluate(Opcode op, std::uint32_t a) {
+    switch (op) {
+    case Opcode::Neg: return 0u - a;
+    case Opcode::FNeg: return a ^ 0x80000000u;
+    default: return a == 0;
+    }
+}
+
+} // namespace
+
+std::vector<std::uint32_t> buildSSA(IRFunction& function, SSAStats& stats) {
+    CFG cfg(function);
+    Dominators dom(cfg);
+    std::uint32_t blocks = cfg.blockCount();
+    std::uint32_t regs = static_cast<std::uint32_t>(function.regs.size());
+
+    // Phis only take operands from reachable predecessors
+    if (dom.reversePostorder().size() != blocks) {
+        BitSet live(blocks);
+        for (std::uint32_t b : dom.reversePostorder()) {
+            live.set(b);
+        }
+        removeBlocks(function, live, stats);
+        return buildSSA(function, stats);
+    }
+
+    // Definitions of each register, one (register, block) site per block,
+    // and the blocks that read a register before writing it. A register
+    // read that way is live on entry to the block, so it is global.
+    std::vector<std::uint32_t> defs(regs, 0), lastDef(regs, none), lastExposed(regs, none);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> defSites, exposed;
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            const Instr& instr = function.code[i];
+            forEachOperand(instr, [&](std::uint32_t r) {
+                if (lastDef[r] != b && lastExposed[r] != b) {
+                    lastExposed[r] = b;
+                    exposed.push_back({r, b});
+                }
+            });
+            if (defines(instr)) {
+                std::uint32_t r = instr.dst;
+                ++defs[r];
+                if (lastDef[r] != b) {
+                    lastDef[r] = b;
+                    defSites.push_back({r, b});
+                }
+            }
+        }
+        // Stamps are per block, a register defined in b is not in the next
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            if (defines(function.code[i])) {
+                lastDef[function.code[i].dst] = none;
+            }
+        }
+    }
+
+    // A register needs new names if it is written more than once, or read
+    // where its only definition does not reach: in a block it does not
+    // strictly dominate, or before it is written at all. Parameters are
+    // defined above the entry block and dominate every use.
+    std::vector<std::uint32_t> defBlock(regs, none);
+    for (const auto& site : defSites) {
+        defBlock[site.first] = site.second;
+    }
+    BitSet rename(regs);
+    for (std::uint32_t r = 0; r < regs; ++r) {
+        std::uint32_t total = defs[r] + (r < function.params ? 1 : 0);
+        if (total > 1) {
+            rename.set(r);
+        }
+    }
+    for (const auto& [r, b] : exposed) {
+        if (r < function.params ? defs[r] == 0 : defs[r] == 1 && b != defBlock[r] && dom.dominates(defBlock[r], b)) {
+            continue;
+        }
+        rename.set(r);
+    }
+
+    // Phis at the iterated dominance frontier of each renamed register's
+    // definition blocks, found with stamped worklists instead of per
+    // register sets
+    std::vector<std::uint32_t> siteBegin, siteBlocks;
+    groupByRow(regs, defSites, siteBegin, siteBlocks);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> phis;  // block, register
+    std::vector<std::uint32_t> hasPhi(blocks, none), queued(blocks, none), work;
+    for (std::uint32_t r = 0; r < regs; ++r) {
+        if (!rename.test(r)) {
+            continue;
+        }
+        work.assign(siteBlocks.begin() + siteBegin[r], siteBlocks.begin() + siteBegin[r + 1]);
+        for (std::uint32_t b : work) {
+            queued[b] = r;
+        }
+        while (!work.empty()) {
+            std::uint32_t b = work.back();
+            work.pop_back();
+            for (std::uint32_t f : dom.frontier(b)) {
+                if (hasPhi[f] == r) {
+                    continue;
+                }
+                hasPhi[f] = r;
+                phis.push_back({f, r});
+                if (queued[f] != r) {
+                    queued[f] = r;
+                    work.push_back(f);
+                }
+            }
+        }
+    }
+    std::vector<std::uint32_t> phiBegin, phiRegs;
+    groupByRow(blocks, phis, phiBegin, phiRegs);
+    stats.phis += phis.size();
+
+    // Lay the phis out at the top of their blocks, each operand slot
+    // holding the original register until renaming fills it in
+    std::vector<Instr> code;
+    code.reserve(function.code.size() + phis.size());
+    function.phiOperands.clear();
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        std::uint32_t begin = static_cast<std::uint32_t>(code.size());
+        IndexRange preds = cfg.predecessors(b);
+        for (std::uint32_t k = phiBegin[b]; k < phiBegin[b + 1]; ++k) {
+            std::uint32_t r = phiRegs[k];
+            code.push_back({Opcode::Phi, r, static_cast<std::uint32_t>(function.phiOperands.size()), preds.size()});
+            for (std::uint32_t p : preds) {
+                function.phiOperands.push_back(r);
+                function.phiOperands.push_back(p);
+            }
+        }
+        code.insert(code.end(), function.code.begin() + function.blocks[b].begin, function.code.begin() + function.blocks[b].end);
+        function.blocks[b] = {begin, static_cast<std::uint32_t>(code.size())};
+    }
+    function.code = std::move(code);
+
+    // Rename down the dominator tree: current holds the live name of each
+    // original register, and the log undoes a block's names on the way up.
+    // A read where the register was never written gets a version of its
+    // own set to zero at the top of the entry block.
+    std::vector<std::uint32_t> origin(regs);
+    for (std::uint32_t r = 0; r < regs; ++r) {
+        origin[r] = r;
+    }
+    auto version = [&](std::uint32_t r) {
+        origin.push_back(r);
+        return newReg(function, function.regs[r]);
+    };
+    std::vector<std::uint32_t> current(regs, none), zero(regs, none);
+    std::vector<Instr> zeros;
+    for (std::uint32_t p = 0; p < function.params; ++p) {
+        current[p] = p;
+    }
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> log;
+    BitSet filled(function.phiOperands.size() / 2);
+    auto name = [&](std::uint32_t r) {
+        if (r >= regs || !rename.test(r)) {
+            return r;
+        }
+        if (current[r] != none) {
+            return current[r];
+        }
+        if (zero[r] == none) {
+            zero[r] = version(r);
+            zeros.push_back({Opcode::Const, zero[r], 0});
+        }
+        return zero[r];
+    };
+
+    struct Frame {
+        std::uint32_t block;
+        std::uint32_t mark;
+        std::uint32_t next;
+    };
+    std::vector<Frame> stack;
+    auto visit = [&](std::uint32_t b) {
+        stack.push_back({b, static_cast<std::uint32_t>(log.size()), 0});
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            Instr& instr = function.code[i];
+            forEachOperand(instr, [&](std::uint32_t& r) { r = name(r); });
+            if (defines(instr) && instr.dst < regs && rename.test(instr.dst)) {
+                std::uint32_t r = instr.dst;
+                log.push_back({r, current[r]});
+                current[r] = instr.dst = version(r);
+            }
+        }
+        for (std::uint32_t s : cfg.successors(b)) {
+            for (std::uint32_t i = function.blocks[s].begin; i < function.blocks[s].end && function.code[i].op == Opcode::Phi; ++i) {
+                const Instr& phi = function.code[i];
+                for (std::uint32_t k = 0; k < phi.b; ++k) {
+                    std::uint32_t slot = phi.a / 2 + k;
+                    if (function.phiOperands[2 * slot + 1] == b && filled.insert(slot)) {
+                        function.phiOperands[2 * slot] = name(function.phiOperands[2 * slot]);
+                        break;
+                    }
+                }
+            }
+        }
+    };
+    visit(0);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        IndexRange kids = dom.children(frame.block);
+        if (frame.next < kids.size()) {
+            visit(kids[frame.next++]);
+        } else {
+            for (std::size_t i = log.size(); i > frame.mark; --i) {
+                current[log[i - 1].first] = log[i - 1].second;
+            }
+            log.resize(frame.mark);
+            stack.pop_back();
+        }
+    }
+
+    if (!zeros.empty()) {
+        std::uint32_t shift = static_cast<std::uint32_t>(zeros.size());
+        function.code.insert(function.code.begin(), zeros.begin(), zeros.end());
+        for (IRBlock& block : function.blocks) {
+            block.begin += block.begin != 0 ? shift : 0;
+            block.end += shift;
+        }
+    }
+    return origin;
+}
+
+void propagateConstants(IRFunction& function, SSAStats& stats) {
+    CFG cfg(function);
+    std::uint32_t blocks = cfg.blockCount();
+    std::uint32_t regs = static_cast<std::uint32_t>(function.regs.size());
+    std::uint32_t size = static_cast<std::uint32_t>(function.code.size());
+
+    // The block of each instruction and the instructions that read each
+    // register, phis included
+    std::vector<std::uint32_t> blockOf(size);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+    pairs.reserve(size * 2);
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            const Instr& instr = function.code[i];
+            blockOf[i] = b;
+            forEachOperand(instr, [&](std::uint32_t r) { pairs.push_back({r, i}); });
+            if (instr.op == Opcode::Phi) {
+                for (std::uint32_t k = 0; k < instr.b; ++k) {
+                    pairs.push_back({function.phiOperands[instr.a + 2 * k], i});
+                }
+            }
+        }
+    }
+    std::vector<std::uint32_t> useBegin, uses;
+    groupByRow(regs, pairs, useBegin, uses);
+
+    std::vector<Lattice> state(regs, Lattice::Top);
+    std::vector<std::uint32_t> value(regs, 0);
+    BitSet visited(blocks), executable(cfg.edgeCount());
+    std::vector<std::uint32_t> flowWork, ssaWork;
+
+    // Lower a register, queueing its readers when it changes
+    auto lower = [&](std::uint32_t r, Lattice to, std::uint32_t bits) {
+        if (state[r] == Lattice::Bottom || (state[r] == to && (to != Lattice::Constant || value[r] == bits))) {
+            return;
+        }
+        if (state[r] == Lattice::Constant && to == Lattice::Constant) {
+            to = Lattice::Bottom;
+        }
+        state[r] = to;
+        value[r] = bits;
+        ssaWork.push_back(r);
+    };
+    // A Branch with equal targets has two edges to one block; only the
+    // first is ever marked
+    auto markEdge = [&](std::uint32_t block, std::uint32_t target) {
+        std::uint32_t e = cfg.edge(block, target);
+        if (executable.insert(e)) {
+            flowWork.push_back(e);
+        }
+    };
+    auto taken = [&](std::uint32_t block, std::uint32_t target) { return executable.test(cfg.edge(block, target)); };
+
+    auto visit = [&](std::uint32_t i) {
+        const Instr& instr = function.code[i];
+        std::uint32_t b = blockOf[i];
+        switch (instr.op) {
+        case Opcode::Const:
+            lower(instr.dst, Lattice::Constant, instr.a);
+            break;
+        case Opcode::Copy:
+            lower(instr.dst, state[instr.a], value[instr.a]);
+            break;
+        case Opcode::Phi: {
+            // Meet of the operands on executable edges only
+            Lattice meet = Lattice::Top;
+            std::uint32_t bits = 0;
+            for (std::uint32_t k = 0; k < instr.b && meet != Lattice::Bottom; ++k) {
+                std::uint32_t r = function.phiOperands[instr.a + 2 * k];
+                std::uint32_t pred = function.phiOperands[instr.a + 2 * k + 1];
+                if (!taken(pred, b)) {
+                    continue;
+                }
+                if (state[r] == Lattice::Bottom || (meet == Lattice::Constant && state[r] == Lattice::Constant && bits != value[r])) {
+                    meet = Lattice::Bottom;
+                } else if (state[r] == Lattice::Constant) {
+                    meet = Lattice::Constant;
+                    bits = value[r];
+                }
+            }
+            lower(instr.dst, meet, bits);
+            break;
+        }
+        case Opcode::Neg:
+        case Opcode::FNeg:
+        case Opcode::Not:
+            if (state[instr.a] != Lattice::Constant) {
+                lower(instr.dst, state[instr.a], 0);
+            } else {
+                lower(instr.dst, Lattice::Constant, evaluate(instr.op, value[instr.a]));
+            }
+            break;
+        case Opcode::Jump:
+            markEdge(b, instr.a);
+            break;
+        case Opcode::Branch:
+            if (state[instr.a] == Lattice::Bottom) {
+                markEdge(b, instr.b);
+                markEdge(b, instr.c);
+            } else if (state[instr.a] == Lattice::Constant) {
+                markEdge(b, value[instr.a] != 0 ? instr.b : instr.c);
+            }
+            break;
+        default:
+            if (instr.op >= Opcode::Add && instr.op <= Opcode::FGtEq) {
+                Lattice x = state[instr.a], y = state[instr.b];
+                std::uint32_t bits;
+                if (x == Lattice::Bottom || y == Lattice::Bottom) {
+                    lower(instr.dst, Lattice::Bottom, 0);
+                } else if (x == Lattice::Constant && y == Lattice::Constant) {
+                    if (evaluate(instr.op, value[instr.a], value[instr.b], bits)) {
+                        lower(instr.dst, Lattice::Constant, bits);
+                    } else {
+                        lower(instr.dst, Lattice::Bottom, 0);
+                    }
+                }
+            } else if (defines(instr)) {
+                // Frame, Load, Call and Read produce values only known at run time
+                lower(instr.dst, Lattice::Bottom, 0);
+            }
+            break;
+        }
+    };
+
+    // Parameters arrive varying; the entry block is reached from outside
+    for (std::uint32_t p = 0; p < function.params; ++p) {
+        state[p] = Lattice::Bottom;
+    }
+    auto enterBlock = [&](std::uint32_t b) {
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            visit(i);
+        }
+    };
+    if (blocks != 0) {
+        visited.set(0);
+        enterBlock(0);
+    }
+    while (!flowWork.empty() || !ssaWork.empty()) {
+        while (!flowWork.empty()) {
+            std::uint32_t e = flowWork.back();
+            flowWork.pop_back();
+            std::uint32_t target = cfg.edgeTarget(e);
+            if (visited.insert(target)) {
+                enterBlock(target);
+            } else {
+                // Only the phis see a new edge into a block already visited
+                for (std::uint32_t i = function.blocks[target].begin;
+                     i < function.blocks[target].end && function.code[i].op == Opcode::Phi; ++i) {
+                    visit(i);
+                }
+            }
+        }
+        while (!ssaWork.empty()) {
+            std::uint32_t r = ssaWork.back();
+            ssaWork.pop_back();
+            for (std::uint32_t k = useBegin[r]; k < useBegin[r + 1]; ++k) {
+                if (visited.test(blockOf[uses[k]])) {
+                    visit(uses[k]);
+                }
+            }
+        }
+    }
+
+    // Rewrite: constants become Consts, decided Branches become Jumps and
+    // phi operands from edges never taken are dropped
+    bool reorder = false;
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        if (!visited.test(b)) {
+            continue;
+        }
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+            Instr& instr = function.code[i];
+            if (defines(instr) && state[instr.dst] == Lattice::Constant && instr.op != Opcode::Const) {
+                reorder = reorder || instr.op == Opcode::Phi;
+                instr = {Opcode::Const, instr.dst, value[instr.dst]};
+                ++stats.constants;
+            } else if (instr.op == Opcode::Branch && state[instr.a] == Lattice::Constant) {
+                instr = {Opcode::Jump, none, value[instr.a] != 0 ? instr.b : instr.c};
+                ++stats.branchesFolded;
+            } else if (instr.op == Opcode::Phi) {
+                std::uint32_t kept = 0;
+                for (std::uint32_t k = 0; k < instr.b; ++k) {
+                    std::uint32_t pred = function.phiOperands[instr.a + 2 * k + 1];
+                    if (taken(pred, b)) {
+                        function.phiOperands[instr.a + 2 * kept] = function.phiOperands[instr.a + 2 * k];
+                        function.phiOperands[instr.a + 2 * kept + 1] = pred;
+                        ++kept;
+                    }
+                }
+                instr.b = kept;
+                if (kept == 1) {
+                    reorder = true;
+                    instr = {Opcode::Copy, instr.dst, function.phiOperands[instr.a]};
+                }
+            }
+        }
+    }
+    if (reorder) {
+        phisFirst(function);
+    }
+
+    if (visited.count() != blocks) {
+        removeBlocks(function, visited, stats);
+    }
+}
+
+void eliminateDeadCode(IRFunction& function, SSAStats& stats) {
+    std::uint32_t size = static_cast<std::uint32_t>(function.code.size());
+    std::vector<std::uint32_t> defOf(function.regs.size(), none);
+    BitSet live(size);
+    std::vector<std::uint32_t> work;
+    for (std::uint32_t i = 0; i < size; ++i) {
+        const Instr& instr = function.code[i];
+        if (defines(instr)) {
+            defOf[instr.dst] = i;
+        }
+        switch (instr.op) {
+        case Opcode::Store:
+        case Opcode::Move:
+        case Opcode::Arg:
+        case Opcode::Call:
+        case Opcode::Read:
+        case Opcode::Write:
+        case Opcode::Put:
+        case Opcode::Jump:
+        case Opcode::Branch:
+        case Opcode::Ret:
+            live.set(i);
+            work.push_back(i);
+            break;
+        default:
+            break;
+        }
+    }
+
+    auto need = [&](std::uint32_t r) {
+        std::uint32_t def = defOf[r];
+        if (def != none && live.insert(def)) {
+            work.push_back(def);
+        }
+    };
+    while (!work.empty()) {
+        const Instr& instr = function.code[work.back()];
+        work.pop_back();
+        forEachOperand(instr, need);
+        if (instr.op == Opcode::Phi) {
+            for (std::uint32_t k = 0; k < instr.b; ++k) {
+                need(function.phiOperands[instr.a + 2 * k]);
+            }
+        }
+    }
+
+    std::size_t kept = live.count();
+    if (kept != size) {
+        stats.instructionsRemoved += size - kept;
+        compact(function, live);
+    }
+}
+
+void destroySSA(IRFunction& function, const std::vector<std::uint32_t>& origin) {
+    CFG cfg(function);
+    std::uint32_t blocks = cfg.blockCount();
+    auto base = [&](std::uint32_t r) { return r < origin.size() ? origin[r] : r; };
+
+    // The copies each phi still needs, keyed by the block that will hold
+    // them: the predecessor, or a new block on a critical edge
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> copies;  // block, index into moves
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> moves;   // dst, src
+    std::vector<IRBlock> split;                                   // new blocks, as (from, to)
+    std::vector<std::uint32_t> splitOf;                           // per edge id, the block splitting it
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end && function.code[i].op == Opcode::Phi; ++i) {
+            const Instr& phi = function.code[i];
+            for (std::uint32_t k = 0; k < phi.b; ++k) {
+                std::uint32_t src = base(function.phiOperands[phi.a + 2 * k]);
+                std::uint32_t pred = function.phiOperands[phi.a + 2 * k + 1];
+                if (src == base(phi.dst)) {
+                    continue;
+                }
+                const Instr& last = function.code[function.blocks[pred].end - 1];
+                std::uint32_t holder = pred;
+                if (last.op == Opcode::Branch && last.b != last.c) {
+                    if (splitOf.empty()) {
+                        splitOf.assign(cfg.edgeCount(), none);
+                    }
+                    std::uint32_t e = cfg.edge(pred, b);
+                    if (splitOf[e] == none) {
+                        splitOf[e] = blocks + static_cast<std::uint32_t>(split.size());
+                        split.push_back({pred, b});
+                    }
+                    holder = splitOf[e];
+                }
+                copies.push_back({holder, static_cast<std::uint32_t>(moves.size())});
+                moves.push_back({base(phi.dst), src});
+            }
+        }
+    }
+    for (std::uint32_t n = 0; n < split.size(); ++n) {
+        Instr& last = function.code[function.blocks[split[n].begin].end - 1];
+        if (last.b == split[n].end) {
+            last.b = blocks + n;
+        } else {
+            last.c = blocks + n;
+        }
+    }
+
+    std::uint32_t total = blocks + static_cast<std::uint32_t>(split.size());
+    std::vector<std::uint32_t> copyBegin, copyMoves;
+    groupByRow(total, copies, copyBegin, copyMoves);
+
+    // Emit a block's copies as a parallel assignment: when a source is also
+    // a destination of the same group, read every source into a fresh
+    // register first
+    std::vector<std::uint32_t> written(function.regs.size(), none);
+    std::vector<Instr> code;
+    code.reserve(function.code.size() + moves.size() + split.size());
+    auto emitCopies = [&](std::uint32_t holder) {
+        bool overlap = false;
+        for (std::uint32_t k = copyBegin[holder]; k < copyBegin[holder + 1]; ++k) {
+            written[moves[copyMoves[k]].first] = holder;
+        }
+        for (std::uint32_t k = copyBegin[holder]; k < copyBegin[holder + 1]; ++k) {
+            overlap = overlap || written[moves[copyMoves[k]].second] == holder;
+        }
+        if (!overlap) {
+            for (std::uint32_t k = copyBegin[holder]; k < copyBegin[holder + 1]; ++k) {
+                code.push_back({Opcode::Copy, moves[copyMoves[k]].first, moves[copyMoves[k]].second});
+            }
+            return;
+        }
+        std::uint32_t first = static_cast<std::uint32_t>(function.regs.size());
+        for (std::uint32_t k = copyBegin[holder]; k < copyBegin[holder + 1]; ++k) {
+            std::uint32_t src = moves[copyMoves[k]].second;
+            code.push_back({Opcode::Copy, newReg(function, function.regs[src]), src});
+        }
+        for (std::uint32_t k = copyBegin[holder]; k < copyBegin[holder + 1]; ++k) {
+            code.push_back({Opcode::Copy, moves[copyMoves[k]].first, first + (k - copyBegin[holder])});
+        }
+    };
+
+    // Everything else reads and writes the registers the versions came
+    // from; a copy between two versions of one register disappears
+    for (std::uint32_t b = 0; b < blocks; ++b) {
+        std::uint32_t begin = static_cast<std::uint32_t>(code.size());
+        for (std::uint32_t i = function.blocks[b].begin; i + 1 < function.blocks[b].end; ++i) {
+            Instr instr = function.code[i];
+            if (instr.op == Opcode::Phi) {
+                continue;
+            }
+            forEachOperand(instr, [&](std::uint32_t& r) { r = base(r); });
+            if (defines(instr)) {
+                instr.dst = base(instr.dst);
+            }
+            if (instr.op != Opcode::Copy || instr.dst != instr.a) {
+                code.push_back(instr);
+            }
+        }
+        emitCopies(b);
+        Instr last = function.code[function.blocks[b].end - 1];
+        forEachOperand(last, [&](std::uint32_t& r) { r = base(r); });
+        code.push_back(last);
+        function.blocks[b] = {begin, static_cast<std::uint32_t>(code.size())};
+    }
+    for (std::uint32_t n = 0; n < split.size(); ++n) {
+        std::uint32_t begin = static_cast<std::uint32_t>(code.size());
+        emitCopies(blocks + n);
+        code.push_back({Opcode::Jump, none, split[n].end});
+        function.blocks.push_back({begin, static_cast<std::uint32_t>(code.size())});
+    }
+    function.code = std::move(code);
+    function.phiOperands.clear();
+
+    // Versions are no longer referenced; drop them unless registers were
+    // allocated after them
+    if (function.regs.size() == origin.size()) {
+        std::uint32_t versions = 0;
+        while (versions < origin.size() && origin[versions] == versions) {
+            ++versions;
+        }
+        function.regs.resize(versions);
+    }
+}
+
+SSAStats optimizeProgram(IRProgram& program) {
+    SSAStats stats;
+    for (IRFunction& function : program.functions) {
+        std::vector<std::uint32_t> origin = buildSSA(function, stats);
+        propagateConstants(function, stats);
+        eliminateDeadCode(function, stats);
+        destroySSA(function, origin);
+    }
+    return stats;
+}
@@ -0,0 +1,32 @@
+#include "../include/line_table.h"
+#include <algorithm>
+#include <cstring>
+
+void LineTable::scan() const {
+    lineStarts.push_back(0);
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    for (const char* c = begin; (c = static_cast<const char*>(std::memchr(c, '\n', end - c))) != nullptr;) {
+        ++c;
+        lineStarts.push_back(static_cast<std::uint32_t>(c - begin));
+    }
+}
+
+LineColumn LineTable::resolve(std::uint32_t offset) const {
+    if (lineStarts.empty()) {
+        scan();
+    }
+    // The last line starting at or before offset
+    auto line = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - 1;
+    LineColumn result;
+    result.line = static_cast<std::uint32_t>(line - lineStarts.begin()) + 1;
+    result.column = offset - *line + 1;
+    return result;
+}
+
+std::uint32_t LineTable::lineCount() const {
+    if (lineStarts.empty()) {
+        scan();
+    }
+    return static_cast<std::uint32_t>(lineStarts.size());
+}
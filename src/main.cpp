@@ -1,8 +1,25 @@
 #include "../include/ast.h"
+#include "../include/ast_file.h"
 #include "../include/ast_builder.h"
+#include "../include/constant_fold.h"
 #include "../include/filereader.h"
+#include "../include/flat_ast.h"
+#include "../include/ir_builder.h"
+#include "../include/interpreter.h"
+#include "../include/bytecode_vm.h"
+#include "../include/ir_ssa.h"
+#include "../include/ir_inline.h"
+#include "../include/ir_loops.h"
+#include "../include/line_table.h"
+#include "../include/moon_codegen.h"
+#include "../include/moon_peephole.h"
 #include "../include/parser.h"
+#include "../include/semantic_check.h"
+#include "../include/symbol_table.h"
 #include "../include/tokenizer.h"
+#include "../include/type_table.h"
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <iostream>
 #include <regex>
@@ -23,8 +40,30 @@ string parse_args(int argc, char **argv, const string &flag) {
         return filepath;
 }
 
+bool has_flag(int argc, char **argv, const string &flag) {
+        for (int i = 1; i < argc; ++i) {
+                if (string(argv[i]) == flag) {
+                        return true;
+                }
+        }
+        return false;
+}
+
 int main(int argc, char **argv) {
         try {
+                // Print a cached binary AST without running the front end.
+                string binaryInputFile = parse_args(argc, argv, "-load");
+                if (!binaryInputFile.empty()) {
+                        MappedAST mapped;
+                        if (!mapped.open(binaryInputFile)) {
+                                return 1;
+                        }
+                        string astOutputFile = binaryInputFile + ".ast";
+                        printAST(mapped, astOutputFile);
+                        cout << "AST has been written to " << astOutputFile << endl;
+                        return 0;
+                }
+
                 // Build and (optionally) print the parsing table.
                 map<string, map<string, string>> table = buildParsingTable();
                 for (auto &nonterm : table) {
@@ -90,16 +129,230 @@ int main(int argc, char **argv) {
                                 cout << "Parsing completed successfully. Building AST..." << endl;
 
                                 try {
+                                        // Share identical expression subtrees with -hashcons
+                                        setHashConsing(has_flag(argc, argv, "-hashcons"));
+
                                         // Add this line to build the AST
                                         buildASTFromTokens();
 
                                         // Then get the root from the AST builder module
                                         ASTNode *ast = getASTRoot();
                                         if (ast != nullptr) {
-                                                // Print the AST to a file
-                                                string astOutputFile = "./output/" + filepath + ".ast";
-                                                printAST(ast, astOutputFile);
-                                                cout << "AST has been written to " << astOutputFile << endl;
+                                                // Print the AST to a file, as text or with -dot as a Graphviz graph
+                                                if (has_flag(argc, argv, "-dot")) {
+                                                        string dotOutputFile = "./output/" + filepath + ".dot";
+                                                        printDOT(ast, getASTContext(), dotOutputFile);
+                                                        cout << "AST graph has been written to " << dotOutputFile << endl;
+                                                } else {
+                                                        string astOutputFile = "./output/" + filepath + ".ast";
+                                                        printAST(ast, getASTContext(), astOutputFile);
+                                                        cout << "AST has been written to " << astOutputFile << endl;
+                                                }
+
+                                                // Symbol tables, then the function bodies type checked against
+                                                // them on -threads N workers (one per core by default)
+                                                SymbolTables symbolTables;
+                                                TypeTable types(getASTContext());
+                                                vector<Diagnostic> diagnostics;
+                                                string threads = parse_args(argc, argv, "-threads");
+                                                unsigned workers = threads.empty() ? 0u : static_cast<unsigned>(stoul(threads));
+                                                checkSemantics(ast, getASTContext(), symbolTables, types, diagnostics, workers);
+                                                string symbolTableFile = "./output/" + filepath + ".outsymboltables";
+                                                if (writeSymbolTables(symbolTables, getASTContext(), symbolTableFile)) {
+                                                        cout << "Symbol tables have been written to " << symbolTableFile << endl;
+                                                }
+
+                                                // Evaluate constant subexpressions so later stages see fewer nodes
+                                                FoldStats folding = foldConstants(ast, getASTContext());
+
+                                                // Lower a program without semantic errors to IR, dumped with -ir
+                                                bool valid = std::none_of(diagnostics.begin(), diagnostics.end(),
+                                                        [](const Diagnostic &d) { return d.severity == Severity::Error; });
+                                                IRProgram ir;
+                                                if (valid) {
+                                                        size_t reported = diagnostics.size();
+                                                        ir = lowerProgram(ast, getASTContext(), symbolTables, types, diagnostics);
+                                                        if (diagnostics.size() != reported) {
+                                                                ir = IRProgram();
+                                                        }
+                                                }
+                                                // -inline replaces calls to small leaf functions by their bodies
+                                                InlineStats inlining;
+                                                if (has_flag(argc, argv, "-inline")) {
+                                                        inlining = inlineFunctions(ir);
+                                                }
+                                                // -loops hoists loop-invariant code and strength-reduces the
+                                                // multiplications of induction variables
+                                                LoopStats loopOptimization;
+                                                if (has_flag(argc, argv, "-loops")) {
+                                                        loopOptimization = optimizeLoops(ir);
+                                                }
+                                                // -O puts the IR in SSA form to propagate constants and
+                                                // remove dead code, then takes it back out
+                                                SSAStats optimization;
+                                                if (has_flag(argc, argv, "-O")) {
+                                                        optimization = optimizeProgram(ir);
+                                                }
+
+                                                LineTable lines(string_view(reader.getCharPointer(), reader.size()));
+                                                writeDiagnostics(diagnostics, lines, "./errors/" + filepath + ".outsemanticerrors");
+
+                                                if (has_flag(argc, argv, "-ir") && !ir.functions.empty()) {
+                                                        string irOutputFile = "./output/" + filepath + ".ir";
+                                                        if (printIR(ir, irOutputFile)) {
+                                                                cout << "IR has been written to " << irOutputFile << endl;
+                                                        }
+                                                }
+
+                                                // -moon writes Moon assembly, registers allocated by
+                                                // linear scan and cleaned up by the peephole pass;
+                                                // -stats compares it with the same code keeping every
+                                                // value in memory
+                                                MoonStats moonNaive, moonAllocated;
+                                                PeepholeStats peephole;
+                                                bool moon = has_flag(argc, argv, "-moon") && !ir.functions.empty();
+                                                if (moon) {
+                                                        MoonProgram code;
+                                                        string error;
+                                                        if (has_flag(argc, argv, "-stats")) {
+                                                                generateMoon(ir, false, code, moonNaive, error);
+                                                        }
+                                                        if (generateMoon(ir, true, code, moonAllocated, error)) {
+                                                                peephole = optimizeMoon(code);
+                                                                countMoon(code, moonAllocated);
+                                                                string moonOutputFile = "./output/" + filepath + ".moon";
+                                                                if (printMoon(code, moonOutputFile)) {
+                                                                        cout << "Moon code has been written to " << moonOutputFile << endl;
+                                                                }
+                                                        } else {
+                                                                cerr << "Cannot generate Moon code: " << error << endl;
+                                                                moon = false;
+                                                        }
+                                                }
+
+                                                // -run interprets the checked tree, reading from standard input
+                                                InterpreterStats interpretation;
+                                                double runSeconds = 0;
+                                                bool ran = has_flag(argc, argv, "-run") && valid;
+                                                if (ran) {
+                                                        string output, error;
+                                                        auto started = chrono::steady_clock::now();
+                                                        bool finished = interpret(ast, getASTContext(), symbolTables, types, cin, output, interpretation, error);
+                                                        runSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+                                                        cout << output;
+                                                        if (!finished) {
+                                                                cerr << "Runtime error: " << error << endl;
+                                                        }
+                                                }
+
+                                                // -vm compiles the IR to register bytecode and runs that instead
+                                                Bytecode bytecode;
+                                                BytecodeStats vmStats;
+                                                double vmSeconds = 0;
+                                                bool vm = has_flag(argc, argv, "-vm") && !ir.functions.empty();
+                                                if (vm) {
+                                                        string output, error;
+                                                        if (compileBytecode(ir, bytecode, error)) {
+                                                                auto started = chrono::steady_clock::now();
+                                                                bool finished = runBytecode(bytecode, cin, output, vmStats, error);
+                                                                vmSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+                                                                cout << output;
+                                                                if (!finished) {
+                                                                        cerr << "Runtime error: " << error << endl;
+                                                                }
+                                                        } else {
+                                                                cerr << "Cannot compile bytecode: " << error << endl;
+                                                                vm = false;
+                                                        }
+                                                }
+
+                                                // Cache the tree as a binary AST file that -load can map later
+                                                if (has_flag(argc, argv, "-binary")) {
+                                                        string binaryOutputFile = "./output/" + filepath + ".astb";
+                                                        if (writeASTFile(flattenAST(ast), getASTContext(), binaryOutputFile)) {
+                                                                cout << "Binary AST has been written to " << binaryOutputFile << endl;
+                                                        }
+                                                }
+
+                                                if (has_flag(argc, argv, "-stats")) {
+                                                        const ASTContext &context = getASTContext();
+                                                        cout << "AST arena: " << context.nodeCount() << " nodes, "
+                                                             << context.bytesUsed() << " bytes used, "
+                                                             << context.bytesReserved() << " bytes reserved, "
+                                                             << context.symbolCount() << " distinct symbols" << endl;
+                                                        cout << "Symbol tables: " << symbolTables.tableCount() << " scopes, "
+                                                             << symbolTables.symbolCount() << " entries, "
+                                                             << diagnostics.size() << " semantic errors and warnings" << endl;
+
+                                                        cout << "Constant folding: " << folding.folded << " operators evaluated, "
+                                                             << folding.simplified << " identities simplified, "
+                                                             << folding.removed << " nodes removed" << endl;
+
+                                                        if (has_flag(argc, argv, "-hashcons")) {
+                                                                cout << "Hash-consing: " << getExprTable().size() << " distinct expressions, "
+                                                                     << getExprTable().duplicates() << " duplicate nodes eliminated" << endl;
+                                                        }
+
+                                                        cout << "IR: " << ir.functions.size() << " functions, "
+                                                             << ir.blockCount() << " blocks, "
+                                                             << ir.instructionCount() << " instructions" << endl;
+
+                                                        if (has_flag(argc, argv, "-inline")) {
+                                                                cout << "Inlining: " << inlining.calls << " calls inlined, "
+                                                                     << inlining.instructionsBefore << " instructions before and "
+                                                                     << inlining.instructionsAfter << " after" << endl;
+                                                        }
+
+                                                        if (has_flag(argc, argv, "-loops")) {
+                                                                cout << "Loops: " << loopOptimization.loops << " loops, "
+                                                                     << loopOptimization.preheaders << " preheaders added, "
+                                                                     << loopOptimization.hoisted << " instructions hoisted, "
+                                                                     << loopOptimization.reduced << " multiplications reduced" << endl;
+                                                        }
+
+                                                        if (has_flag(argc, argv, "-O")) {
+                                                                cout << "SSA: " << optimization.phis << " phis, "
+                                                                     << optimization.constants << " constants propagated, "
+                                                                     << optimization.branchesFolded << " branches folded, "
+                                                                     << optimization.blocksRemoved << " blocks and "
+                                                                     << optimization.instructionsRemoved << " instructions removed" << endl;
+                                                        }
+
+                                                        if (moon) {
+                                                                cout << "Moon: " << moonAllocated.instructions << " instructions, "
+                                                                     << moonAllocated.loads << " loads, "
+                                                                     << moonAllocated.stores << " stores; "
+                                                                     << moonAllocated.allocated << " values in registers, "
+                                                                     << moonAllocated.spilled << " spilled" << endl;
+                                                                cout << "Moon peephole: " << peephole.rewrites << " rewrites, "
+                                                                     << peephole.removed << " instructions removed, about "
+                                                                     << peephole.cycles << " cycles saved" << endl;
+                                                                cout << "Moon without allocation: " << moonNaive.instructions << " instructions, "
+                                                                     << moonNaive.loads << " loads, "
+                                                                     << moonNaive.stores << " stores" << endl;
+                                                        }
+
+                                                        if (ran) {
+                                                                cout << "Interpreter: " << interpretation.nodes << " nodes, "
+                                                                     << interpretation.operations << " operations and "
+                                                                     << interpretation.calls << " calls in " << runSeconds * 1e3 << " ms, "
+                                                                     << (runSeconds > 0 ? interpretation.operations / runSeconds / 1e6 : 0.0)
+                                                                     << " million operations per second" << endl;
+                                                        }
+
+                                                        if (vm) {
+                                                                cout << "Bytecode VM: " << bytecode.instructions << " instructions in "
+                                                                     << bytecode.code.size() << " words, "
+                                                                     << vmStats.executed << " executed and "
+                                                                     << vmStats.calls << " calls in " << vmSeconds * 1e3 << " ms, "
+                                                                     << (vmSeconds > 0 ? vmStats.executed / vmSeconds / 1e6 : 0.0)
+                                                                     << " million instructions per second" << endl;
+                                                        }
+
+                                                        FlatAST flat = flattenAST(ast);
+                                                        cout << "Flat AST: " << flat.size() << " nodes, "
+                                                             << flat.bytes() << " bytes" << endl;
+                                                }
                                         } else {
                                                 cout << "Failed to build AST: AST root is null" << endl;
                                         }
@@ -0,0 +1,126 @@
+#include "../include/moon.h"
+#include "../include/output_buffer.h"
+
+namespace {
+
+// Indexed by MoonOp
+constexpr std::string_view opNames[] = {
+    "add", "sub", "mul", "div", "mod", "and", "or",
+    "ceq", "cne", "clt", "cle", "cgt", "cge",
+    "addi", "subi", "muli", "divi", "modi", "andi", "ori",
+    "ceqi", "cnei", "clti", "clei", "cgti", "cgei",
+    "not", "sl", "sr", "lw", "sw", "getc", "putc",
+    "bz", "bnz", "j", "jr", "jl", "nop", "hlt",
+    "entry", "align", "res", "",
+};
+
+constexpr int labelWidth = 16;
+
+void reg(OutputBuffer& out, std::uint8_t r) {
+    out << 'r' << static_cast<unsigned>(r);
+}
+
+void immediate(OutputBuffer& out, const MoonProgram& program, const MoonInstr& instr) {
+    if (instr.label != MoonInstr::none) {
+        out << program.labels[instr.label];
+    } else {
+        out << static_cast<int>(instr.k);
+    }
+}
+
+} // namespace
+
+std::string_view moonOpName(MoonOp op) {
+    return opNames[static_cast<std::size_t>(op)];
+}
+
+bool printMoon(const MoonProgram& program, const std::string& path) {
+    OutputBuffer out;
+    std::size_t column = 0;  // characters of a label already on the line
+    for (const MoonInstr& instr : program.code) {
+        if (instr.op == MoonOp::Label) {
+            if (column != 0) {
+                out << '\n';
+            }
+            const std::string& name = program.labels[instr.label];
+            out << name;
+            column = name.size();
+            continue;
+        }
+
+        // Pad past the label column, or to it when there is no label
+        std::size_t pad = column < labelWidth ? labelWidth - column : 1;
+        for (std::size_t i = 0; i < pad; ++i) {
+            out << ' ';
+        }
+        column = 0;
+        out << moonOpName(instr.op);
+
+        switch (instr.op) {
+        case MoonOp::Addi: case MoonOp::Subi: case MoonOp::Muli: case MoonOp::Divi:
+        case MoonOp::Modi: case MoonOp::Andi: case MoonOp::Ori:
+        case MoonOp::Ceqi: case MoonOp::Cnei: case MoonOp::Clti: case MoonOp::Clei:
+        case MoonOp::Cgti: case MoonOp::Cgei:
+            out << ' ';
+            reg(out, instr.ri);
+            out << ',';
+            reg(out, instr.rj);
+            out << ',';
+            immediate(out, program, instr);
+            break;
+        case MoonOp::Not:
+            out << ' ';
+            reg(out, instr.ri);
+            out << ',';
+            reg(out, instr.rj);
+            break;
+        case MoonOp::Sl: case MoonOp::Sr: case MoonOp::Bz: case MoonOp::Bnz: case MoonOp::Jl:
+            out << ' ';
+            reg(out, instr.ri);
+            out << ',';
+            immediate(out, program, instr);
+            break;
+        case MoonOp::Lw:
+            out << ' ';
+            reg(out, instr.ri);
+            out << ',';
+            immediate(out, program, instr);
+            out << '(';
+            reg(out, instr.rj);
+            out << ')';
+            break;
+        case MoonOp::Sw:
+            out << ' ';
+            immediate(out, program, instr);
+            out << '(';
+            reg(out, instr.rj);
+            out << "),";
+            reg(out, instr.ri);
+            break;
+        case MoonOp::Getc: case MoonOp::Putc: case MoonOp::Jr:
+            out << ' ';
+            reg(out, instr.ri);
+            break;
+        case MoonOp::J: case MoonOp::Res:
+            out << ' ';
+            immediate(out, program, instr);
+            break;
+        case MoonOp::Nop: case MoonOp::Hlt: case MoonOp::Entry: case MoonOp::Align:
+            break;
+        default:
+            // Three registers
+            out << ' ';
+            reg(out, instr.ri);
+            out << ',';
+            reg(out, instr.rj);
+            out << ',';
+            reg(out, instr.rk);
+            break;
+        }
+        out << '\n';
+    }
+    if (column != 0) {
+        out << '\n';
+    }
+    return out.writeTo(path);
+}
@@ -0,0 +1,870 @@
+#include "../include/moon_codegen.h"
+#include "../include/ir_cfg.h"
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+constexpr std::uint32_t none = Instr::none;
+
+// Registers with a fixed role; r1 .. r10 are allocated
+constexpr std::uint8_t zero = 0;
+constexpr std::uint8_t allocatable = 10;
+constexpr std::uint8_t scratchA = 11;
+constexpr std::uint8_t scratchB = 12;
+constexpr std::uint8_t result = 13;
+constexpr std::uint8_t framePointer = 14;
+constexpr std::uint8_t link = 15;
+
+bool fitsImmediate(std::int64_t value) {
+    return value >= -32768 && value <= 32767;
+}
+
+// Moon operator for an int IR operator on two registers
+MoonOp registerForm(Opcode op) {
+    switch (op) {
+    case Opcode::Add: return MoonOp::Add;
+    case Opcode::Sub: return MoonOp::Sub;
+    case Opcode::Mul: return MoonOp::Mul;
+    case Opcode::Div: return MoonOp::Div;
+    case Opcode::And: return MoonOp::And;
+    case Opcode::Or: return MoonOp::Or;
+    case Opcode::Eq: return MoonOp::Ceq;
+    case Opcode::NotEq: return MoonOp::Cne;
+    case Opcode::Lt: return MoonOp::Clt;
+    case Opcode::Gt: return MoonOp::Cgt;
+    case Opcode::LtEq: return MoonOp::Cle;
+    default: return MoonOp::Cge;
+    }
+}
+
+// Moon operator for an int IR operator whose second operand is a constant;
+// and and or are left out, their operands need normalizing to 0 or 1
+bool immediateForm(Opcode op, MoonOp& form) {
+    switch (op) {
+    case Opcode::Add: form = MoonOp::Addi; return true;
+    case Opcode::Sub: form = MoonOp::Subi; return true;
+    case Opcode::Mul: form = MoonOp::Muli; return true;
+    case Opcode::Div: form = MoonOp::Divi; return true;
+    case Opcode::Eq: form = MoonOp::Ceqi; return true;
+    case Opcode::NotEq: form = MoonOp::Cnei; return true;
+    case Opcode::Lt: form = MoonOp::Clti; return true;
+    case Opcode::Gt: form = MoonOp::Cgti; return true;
+    case Opcode::LtEq: form = MoonOp::Clei; return true;
+    case Opcode::GtEq: form = MoonOp::Cgei; return true;
+    default: return false;
+    }
+}
+
+// The operator computing the same with its operands exchanged, if any
+bool swapOperands(Opcode op, Opcode& swapped) {
+    switch (op) {
+    case Opcode::Add: case Opcode::Mul: case Opcode::Eq: case Opcode::NotEq: swapped = op; return true;
+    case Opcode::Lt: swapped = Opcode::Gt; return true;
+    case Opcode::Gt: swapped = Opcode::Lt; return true;
+    case Opcode::LtEq: swapped = Opcode::GtEq; return true;
+    case Opcode::GtEq: swapped = Opcode::LtEq; return true;
+    default: return false;
+    }
+}
+
+bool producesBoolean(Opcode op) {
+    return (op >= Opcode::Eq && op <= Opcode::GtEq) || op == Opcode::And || op == Opcode::Or || op == Opcode::Not;
+}
+
+// Label names, kept apart from each other and from the mnemonics and
+// register names the assembler would read them as
+class Labels {
+public:
+    explicit Labels(MoonProgram& out) : out(out) {
+        for (int op = 0; op < static_cast<int>(MoonOp::Label); ++op) {
+            taken.insert(std::string(moonOpName(static_cast<MoonOp>(op))));
+        }
+        for (int r = 0; r < 16; ++r) {
+            taken.insert("r" + std::to_string(r));
+        }
+    }
+
+    std::uint32_t make(const std::string& wanted) {
+        std::string name;
+        for (char c : wanted) {
+            bool word = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+            name += word ? c : '_';
+        }
+        if (name.empty() || !((name[0] >= 'a' && name[0] <= 'z') || (name[0] >= 'A' && name[0] <= 'Z'))) {
+            name = "L" + name;
+        }
+        std::string unique = name;
+        for (int n = 2; !taken.insert(unique).second; ++n) {
+            unique = name + "_" + std::to_string(n);
+        }
+        out.labels.push_back(unique);
+        return static_cast<std::uint32_t>(out.labels.size() - 1);
+    }
+
+private:
+    MoonProgram& out;
+    std::unordered_set<std::string> taken;
+};
+
+// Labels of the I/O routines, made when first called
+struct Runtime {
+    std::uint32_t putint = none;
+    std::uint32_t getint = none;
+};
+
+class FunctionGenerator {
+public:
+    FunctionGenerator(const IRFunction& function, std::uint32_t label, const std::vector<std::uint32_t>& functionLabels,
+                      MoonProgram& out, Labels& labels, Runtime& runtime, MoonStats& stats)
+        : function(function), label(label), functionLabels(functionLabels), out(out), labels(labels), runtime(runtime),
+          stats(stats), regs(static_cast<std::uint32_t>(function.regs.size())) {}
+
+    void generate(bool allocate) {
+        CFG cfg(function);
+        findConstants(cfg);
+        regOf.assign(regs, 0);
+        slotOf.assign(regs, none);
+        for (std::uint32_t p = 0; p < function.params; ++p) {
+            slotOf[p] = 4 + 4 * p;
+        }
+        slots = 0;
+        if (allocate) {
+            buildIntervals(cfg);
+            scan();
+        } else {
+            for (std::uint32_t v = function.params; v < regs; ++v) {
+                if (needed[v]) {
+                    slotOf[v] = nextSlot();
+                    ++stats.spilled;
+                }
+            }
+            stats.spilled += function.params;
+        }
+        frameBase = 4 + 4 * function.params + 4 * slots;
+        frameSize = frameBase + function.frameSize;
+        emitCode();
+    }
+
+private:
+    const IRFunction& function;
+    std::uint32_t label;
+    const std::vector<std::uint32_t>& functionLabels;
+    MoonProgram& out;
+    Labels& labels;
+    Runtime& runtime;
+    MoonStats& stats;
+    std::uint32_t regs;
+
+    std::vector<std::uint32_t> blockOf;
+    std::vector<std::int32_t> constant;   // value of each register in isConstant
+    std::vector<bool> isConstant;         // written once by a Const that reaches every read
+    std::vector<bool> isBoolean;          // only ever 0 or 1
+    std::vector<bool> needed;             // read from a register or written
+    std::vector<std::uint8_t> immediate;  // per instruction: operand (1 for a, 2 for b) folded into the opcode
+
+    std::vector<std::uint32_t> start, end;  // live intervals: a read at 2i, a write at 2i + 1
+    std::vector<std::uint8_t> regOf;        // machine register, or 0 for a slot
+    std::vector<std::uint32_t> slotOf;      // frame offset of the slot, or none
+    std::vector<std::uint32_t> saveBegin, saves;  // per call, the registers to save around it
+    std::uint32_t slots = 0;
+    std::uint32_t frameBase = 0;  // where the IR frame starts
+    std::uint32_t frameSize = 0;
+
+    std::uint32_t nextSlot() {
+        return 4 + 4 * function.params + 4 * slots++;
+    }
+
+    // Call f on each register an instruction reads from a register, leaving
+    // out folded constants and zeros read from r0
+    template <typename F>
+    void forEachRead(std::uint32_t i, F f) const {
+        const Instr& instr = function.code[i];
+        unsigned operands = registerOperands(instr);
+        if ((operands & 1) && immediate[i] != 1 && !isZero(instr.a)) {
+            f(instr.a);
+        }
+        if ((operands & 2) && immediate[i] != 2 && !isZero(instr.b)) {
+            f(instr.b);
+        }
+    }
+
+    bool isZero(std::uint32_t v) const { return isConstant[v] && constant[v] == 0; }
+
+    // Writes the code keeps; a Const all of whose reads were folded is dropped
+    bool writes(std::uint32_t i) const {
+        const Instr& instr = function.code[i];
+        return instr.dst != none && definesRegister(instr.op) && (instr.op != Opcode::Const || needed[instr.dst]);
+    }
+
+    void findConstants(const CFG& cfg) {
+        Dominators dom(cfg);
+        std::uint32_t size = static_cast<std::uint32_t>(function.code.size());
+        blockOf.assign(size, 0);
+        std::vector<std::uint32_t> defs(regs, 0), defAt(regs, none);
+        isBoolean.assign(regs, true);
+        for (std::uint32_t b = 0; b < function.blocks.size(); ++b) {
+            for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+                blockOf[i] = b;
+                const Instr& instr = function.code[i];
+                if (instr.dst != none && definesRegister(instr.op)) {
+                    ++defs[instr.dst];
+                    defAt[instr.dst] = i;
+                    bool boolean = producesBoolean(instr.op) ||
+                                   (instr.op == Opcode::Const && (instr.a == 0 || instr.a == 1));
+                    isBoolean[instr.dst] = isBoolean[instr.dst] && boolean;
+                }
+            }
+        }
+        for (std::uint32_t p = 0; p < function.params; ++p) {
+            isBoolean[p] = false;
+        }
+
+        // A constant only stands for its register where its one Const has
+        // run, which otherwise needs a read before it to see zero
+        isConstant.assign(regs, false);
+        constant.assign(regs, 0);
+        for (std::uint32_t v = 0; v < regs; ++v) {
+            if (defs[v] == 1 && function.code[defAt[v]].op == Opcode::Const && function.regs[v] == IRType::Int &&
+                fitsImmediate(static_cast<std::int32_t>(function.code[defAt[v]].a))) {
+                isConstant[v] = true;
+                constant[v] = static_cast<std::int32_t>(function.code[defAt[v]].a);
+            }
+        }
+        for (std::uint32_t i = 0; i < size; ++i) {
+            const Instr& instr = function.code[i];
+            unsigned operands = registerOperands(instr);
+            for (std::uint32_t v : {operands & 1 ? instr.a : none, operands & 2 ? instr.b : none}) {
+                if (v != none && isConstant[v]) {
+                    std::uint32_t d = blockOf[defAt[v]];
+                    if (!dom.reachable(blockOf[i])) {
+                        continue;
+                    }
+                    if (d == blockOf[i] ? defAt[v] > i : !dom.reachable(d) || !dom.dominates(d, blockOf[i])) {
+                        isConstant[v] = false;
+                    }
+                }
+            }
+        }
+
+        immediate.assign(size, 0);
+        needed.assign(regs, false);
+        for (std::uint32_t i = 0; i < size; ++i) {
+            const Instr& instr = function.code[i];
+            MoonOp form;
+            Opcode swapped;
+            if (instr.op >= Opcode::Add && instr.op <= Opcode::GtEq && immediateForm(instr.op, form)) {
+                if (isConstant[instr.b]) {
+                    immediate[i] = 2;
+                } else if (isConstant[instr.a] && swapOperands(instr.op, swapped)) {
+                    immediate[i] = 1;
+                }
+            }
+            forEachRead(i, [&](std::uint32_t v) { needed[v] = true; });
+            if (instr.dst != none && definesRegister(instr.op) && instr.op != Opcode::Const) {
+                needed[instr.dst] = true;
+            }
+        }
+    }
+
+    // Live intervals in code order, coarse: from the first point a
+    // register is live to the last. A register read before it is written
+    // in a block is live into it, and so out of each predecessor and into
+    // those that do not write it; the walk visits each block once per
+    // register, so the cost is the total size of the live ranges.
+    void buildIntervals(const CFG& cfg) {
+        std::uint32_t blocks = static_cast<std::uint32_t>(function.blocks.size());
+        start.assign(regs, none);
+        end.assign(regs, 0);
+        std::vector<std::uint32_t> writtenIn(regs, none), exposedIn(regs, none);
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> exposed, defSites;
+        for (std::uint32_t b = 0; b < blocks; ++b) {
+            for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+                forEachRead(i, [&](std::uint32_t v) {
+                    end[v] = std::max(end[v], 2 * i);
+                    if (writtenIn[v] != b && exposedIn[v] != b) {
+                        exposedIn[v] = b;
+                        exposed.push_back({v, b});
+                    }
+                });
+                if (writes(i)) {
+                    std::uint32_t v = function.code[i].dst;
+                    start[v] = std::min(start[v], 2 * i + 1);
+                    end[v] = std::max(end[v], 2 * i + 1);
+                    if (writtenIn[v] != b) {
+                        writtenIn[v] = b;
+                        defSites.push_back({v, b});
+                    }
+                }
+            }
+        }
+        for (std::uint32_t p = 0; p < function.params; ++p) {
+            if (needed[p]) {
+                start[p] = 0;
+            }
+        }
+
+        std::sort(exposed.begin(), exposed.end());
+        std::sort(defSites.begin(), defSites.end());
+        std::vector<std::uint32_t> definedIn(blocks, none), liveIn(blocks, none), work;
+        std::size_t site = 0;
+        for (std::size_t k = 0; k < exposed.size();) {
+            std::uint32_t v = exposed[k].first;
+            while (site < defSites.size() && defSites[site].first < v) {
+                ++site;
+            }
+            for (; site < defSites.size() && defSites[site].first == v; ++site) {
+                definedIn[defSites[site].second] = v;
+            }
+            for (; k < exposed.size() && exposed[k].first == v; ++k) {
+                liveIn[exposed[k].second] = v;
+                work.push_back(exposed[k].second);
+            }
+            while (!work.empty()) {
+                std::uint32_t b = work.back();
+                work.pop_back();
+                start[v] = std::min(start[v], 2 * function.blocks[b].begin);
+                for (std::uint32_t p : cfg.predecessors(b)) {
+                    end[v] = std::max(end[v], 2 * function.blocks[p].end - 1);
+                    if (definedIn[p] != v && liveIn[p] != v) {
+                        liveIn[p] = v;
+                        work.push_back(p);
+                    }
+                }
+            }
+        }
+    }
+
+    void scan() {
+        std::vector<std::uint32_t> order;
+        for (std::uint32_t v = 0; v < regs; ++v) {
+            if (start[v] != none) {
+                order.push_back(v);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](std::uint32_t x, std::uint32_t y) { return start[x] < start[y]; });
+
+        std::vector<std::uint32_t> active;  // by increasing end
+        std::vector<std::uint8_t> free;
+        for (std::uint8_t r = allocatable; r >= 1; --r) {
+            free.push_back(r);
+        }
+        auto activate = [&](std::uint32_t v) {
+            auto at = std::upper_bound(active.begin(), active.end(), v, [&](std::uint32_t x, std::uint32_t y) { return end[x] < end[y]; });
+            active.insert(at, v);
+        };
+        auto spill = [&](std::uint32_t v) {
+            regOf[v] = 0;
+            if (slotOf[v] == none) {
+                slotOf[v] = nextSlot();
+            }
+            ++stats.spilled;
+        };
+        for (std::uint32_t v : order) {
+            while (!active.empty() && end[active.front()] < start[v]) {
+                free.push_back(regOf[active.front()]);
+                active.erase(active.begin());
+            }
+            if (!free.empty()) {
+                regOf[v] = free.back();
+                free.pop_back();
+                activate(v);
+                continue;
+            }
+            std::uint32_t last = active.back();
+            if (end[last] > end[v]) {
+                regOf[v] = regOf[last];
+                active.pop_back();
+                spill(last);
+                activate(v);
+            } else {
+                spill(v);
+            }
+        }
+        for (std::uint32_t v : order) {
+            stats.allocated += regOf[v] != 0;
+        }
+
+        // Registers live across a call are saved to their slots around it
+        std::vector<std::uint32_t> calls;
+        for (std::uint32_t i = 0; i < function.code.size(); ++i) {
+            if (function.code[i].op == Opcode::Call) {
+                calls.push_back(2 * i + 1);
+            }
+        }
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+        for (std::uint32_t v : order) {
+            if (regOf[v] == 0) {
+                continue;
+            }
+            for (auto c = std::upper_bound(calls.begin(), calls.end(), start[v]); c != calls.end() && *c < end[v]; ++c) {
+                pairs.push_back({static_cast<std::uint32_t>(c - calls.begin()), v});
+                if (slotOf[v] == none) {
+                    slotOf[v] = nextSlot();
+                }
+            }
+        }
+        saveBegin.assign(calls.size() + 1, 0);
+        for (const auto& pair : pairs) {
+            ++saveBegin[pair.first + 1];
+        }
+        for (std::size_t c = 0; c < calls.size(); ++c) {
+            saveBegin[c + 1] += saveBegin[c];
+        }
+        saves.resize(pairs.size());
+        std::vector<std::uint32_t> next(saveBegin.begin(), saveBegin.end() - 1);
+        for (const auto& pair : pairs) {
+            saves[next[pair.first]++] = pair.second;
+        }
+    }
+
+    void emit(MoonOp op, std::uint8_t ri = 0, std::uint8_t rj = 0, std::uint8_t rk = 0, std::int32_t k = 0,
+              std::uint32_t target = none) {
+        out.code.push_back({op, ri, rj, rk, k, target});
+    }
+
+    void place(std::uint32_t target) {
+        out.code.push_back({MoonOp::Label, 0, 0, 0, 0, target});
+    }
+
+    // The register holding v, loading it into scratch from its slot if needed
+    std::uint8_t read(std::uint32_t v, std::uint8_t scratch) {
+        if (isZero(v)) {
+            return zero;
+        }
+        if (regOf[v] != 0) {
+            return regOf[v];
+        }
+        access(MoonOp::Lw, scratch, framePointer, slotOf[v]);
+        return scratch;
+    }
+
+    // The register to compute v into; finish with written()
+    std::uint8_t target(std::uint32_t v) const {
+        return regOf[v] != 0 ? regOf[v] : scratchA;
+    }
+
+    void written(std::uint32_t v, std::uint8_t from) {
+        if (regOf[v] == 0) {
+            access(MoonOp::Sw, from, framePointer, slotOf[v]);
+        } else if (regOf[v] != from) {
+            emit(MoonOp::Add, regOf[v], from, zero);
+        }
+    }
+
+    void loadConstant(std::uint8_t r, std::int32_t value) {
+        if (fitsImmediate(value)) {
+            emit(MoonOp::Addi, r, zero, 0, value);
+            return;
+        }
+        // The high half, shifted, plus the sign-extended low half
+        std::int32_t low = static_cast<std::int16_t>(value & 0xFFFF);
+        std::int32_t high = static_cast<std::int16_t>((static_cast<std::uint32_t>(value) - static_cast<std::uint32_t>(low)) >> 16);
+        emit(MoonOp::Addi, r, zero, 0, high);
+        emit(MoonOp::Sl, r, 0, 0, 16);
+        if (low != 0) {
+            emit(MoonOp::Addi, r, r, 0, low);
+        }
+    }
+
+    // ri = rj + value. A value too large for K is loaded into r15 first,
+    // which is free in a body once the prologue has saved the return
+    // address.
+    void addImmediate(std::uint8_t ri, std::uint8_t rj, std::int64_t value) {
+        if (fitsImmediate(value)) {
+            emit(MoonOp::Addi, ri, rj, 0, static_cast<std::int32_t>(value));
+            return;
+        }
+        loadConstant(link, static_cast<std::int32_t>(value));
+        emit(MoonOp::Add, ri, rj, link);
+    }
+
+    // Load or store ri at offset from rj, adding an offset too large for K
+    // to rj in r15 first
+    void access(MoonOp op, std::uint8_t ri, std::uint8_t rj, std::int64_t offset) {
+        if (fitsImmediate(offset)) {
+            emit(op, ri, rj, 0, static_cast<std::int32_t>(offset));
+            return;
+        }
+        loadConstant(link, static_cast<std::int32_t>(offset));
+        emit(MoonOp::Add, link, link, rj);
+        emit(op, ri, link, 0, 0);
+    }
+
+    void callRuntime(std::uint32_t& routine, const char* name) {
+        if (routine == none) {
+            routine = labels.make(name);
+        }
+        emit(MoonOp::Jl, link, 0, 0, 0, routine);
+    }
+
+    void emitCode() {
+        std::uint32_t blocks = static_cast<std::uint32_t>(function.blocks.size());
+        std::vector<std::uint32_t> blockLabel(blocks, label);
+        for (std::uint32_t b = 1; b < blocks; ++b) {
+            blockLabel[b] = labels.make(out.labels[label] + "_" + std::to_string(b));
+        }
+
+        place(label);
+        emit(MoonOp::Sw, link, framePointer, 0, 0);
+        clearLocals();
+        for (std::uint32_t p = 0; p < function.params; ++p) {
+            if (regOf[p] != 0) {
+                access(MoonOp::Lw, regOf[p], framePointer, slotOf[p]);
+            }
+        }
+
+        std::uint32_t args = 0, calls = 0;
+        for (std::uint32_t b = 0; b < blocks; ++b) {
+            if (b != 0) {
+                place(blockLabel[b]);
+            }
+            for (std::uint32_t i = function.blocks[b].begin; i < function.blocks[b].end; ++i) {
+                const Instr& instr = function.code[i];
+                switch (instr.op) {
+                case Opcode::Const:
+                    if (needed[instr.dst]) {
+                        std::uint8_t d = target(instr.dst);
+                        loadConstant(d, static_cast<std::int32_t>(instr.a));
+                        written(instr.dst, d);
+                    }
+                    break;
+                case Opcode::Copy: {
+                    written(instr.dst, read(instr.a, scratchA));
+                    break;
+                }
+                case Opcode::Frame: {
+                    std::uint8_t d = target(instr.dst);
+                    addImmediate(d, framePointer, std::int64_t(frameBase) + instr.c);
+                    written(instr.dst, d);
+                    break;
+                }
+                case Opcode::Load: {
+                    std::uint8_t x = read(instr.a, scratchA);
+                    std::uint8_t d = target(instr.dst);
+                    access(MoonOp::Lw, d, x, static_cast<std::int32_t>(instr.c));
+                    written(instr.dst, d);
+                    break;
+                }
+                case Opcode::Store: {
+                    std::uint8_t x = read(instr.a, scratchA);
+                    std::uint8_t y = read(instr.b, scratchB);
+                    access(MoonOp::Sw, y, x, static_cast<std::int32_t>(instr.c));
+                    break;
+                }
+                case Opcode::Move:
+                    move(instr);
+                    break;
+                case Opcode::Neg: {
+                    std::uint8_t x = read(instr.a, scratchA);
+                    std::uint8_t d = target(instr.dst);
+                    emit(MoonOp::Sub, d, zero, x);
+                    written(instr.dst, d);
+                    break;
+                }
+                case Opcode::Not: {
+                    std::uint8_t x = read(instr.a, scratchA);
+                    std::uint8_t d = target(instr.dst);
+                    emit(MoonOp::Ceq, d, x, zero);
+                    written(instr.dst, d);
+                    break;
+                }
+                case Opcode::Arg: {
+                    std::uint8_t x = read(instr.a, scratchA);
+                    access(MoonOp::Sw, x, framePointer, std::int64_t(frameSize) + 4 + 4 * args++);
+                    break;
+                }
+                case Opcode::Call:
+                    call(instr, calls++);
+                    args = 0;
+                    break;
+                case Opcode::Read:
+                    callRuntime(runtime.getint, "getint");
+                    written(instr.dst, result);
+                    break;
+                case Opcode::Write:
+                case Opcode::Put: {
+                    std::uint8_t x = read(instr.a, result);
+                    if (x != result) {
+                        emit(MoonOp::Add, result, x, zero);
+                    }
+                    callRuntime(runtime.putint, "putint");
+                    if (instr.op == Opcode::Write) {
+                        emit(MoonOp::Addi, result, zero, 0, '\n');
+                        emit(MoonOp::Putc, result);
+                    }
+                    break;
+                }
+                case Opcode::Jump:
+                    emit(MoonOp::J, 0, 0, 0, 0, blockLabel[instr.a]);
+                    break;
+                case Opcode::Branch:
+                    if (instr.b != instr.c) {
+                        emit(MoonOp::Bz, read(instr.a, scratchA), 0, 0, 0, blockLabel[instr.c]);
+                    }
+                    emit(MoonOp::J, 0, 0, 0, 0, blockLabel[instr.b]);
+                    break;
+                case Opcode::Ret:
+                    if (instr.a != none) {
+                        std::uint8_t x = read(instr.a, result);
+                        if (x != result) {
+                            emit(MoonOp::Add, result, x, zero);
+                        }
+                    }
+                    emit(MoonOp::Lw, link, framePointer, 0, 0);
+                    emit(MoonOp::Jr, link);
+                    break;
+                default:
+                    binary(instr, immediate[i]);
+                    break;
+                }
+            }
+        }
+    }
+
+    void binary(const Instr& instr, std::uint8_t folded) {
+        MoonOp form;
+        Opcode op = instr.op;
+        if (folded != 0) {
+            std::uint32_t v = instr.a, k = instr.b;
+            if (folded == 1) {
+                swapOperands(instr.op, op);
+                std::swap(v, k);
+            }
+            immediateForm(op, form);
+            std::uint8_t x = read(v, scratchA);
+            std::uint8_t d = target(instr.dst);
+            emit(form, d, x, 0, constant[k]);
+            written(instr.dst, d);
+            return;
+        }
+
+        std::uint8_t x = read(instr.a, scratchA);
+        std::uint8_t y = read(instr.b, scratchB);
+        if (op == Opcode::And || op == Opcode::Or) {
+            // Moon's and and or work on bits; IR's on truth values
+            if (!isBoolean[instr.a] && x != zero) {
+                emit(MoonOp::Cne, scratchA, x, zero);
+                x = scratchA;
+            }
+            if (!isBoolean[instr.b] && y != zero) {
+                emit(MoonOp::Cne, scratchB, y, zero);
+                y = scratchB;
+            }
+        }
+        std::uint8_t d = target(instr.dst);
+        emit(registerForm(op), d, x, y);
+        written(instr.dst, d);
+    }
+
+    // Start the locals at zero as a call in the interpreter does: the
+    // registers that may be read before they are written, then the IR
+    // frame. A register sharing a machine register with a parameter is
+    // zeroed before the parameter is loaded.
+    void clearLocals() {
+        for (std::uint32_t v : exposedRegisters(function)) {
+            if (!needed[v] || isZero(v)) {
+                continue;
+            }
+            if (regOf[v] != 0) {
+                emit(MoonOp::Add, regOf[v], zero, zero);
+            } else {
+                access(MoonOp::Sw, zero, framePointer, slotOf[v]);
+            }
+        }
+        std::int32_t words = static_cast<std::int32_t>((function.frameSize + 3) / 4);
+        if (words <= 8) {
+            for (std::int32_t w = 0; w < words; ++w) {
+                access(MoonOp::Sw, zero, framePointer, std::int64_t(frameBase) + 4 * w);
+            }
+            return;
+        }
+        // r11 walks the words up to the end in r13
+        addImmediate(scratchA, framePointer, frameBase);
+        addImmediate(result, scratchA, 4 * std::int64_t(words));
+        std::uint32_t loop = labels.make(out.labels[label] + "_clear");
+        place(loop);
+        emit(MoonOp::Sw, zero, scratchA);
+        emit(MoonOp::Addi, scratchA, scratchA, 0, 4);
+        emit(MoonOp::Cne, scratchB, scratchA, result);
+        emit(MoonOp::Bnz, scratchB, 0, 0, 0, loop);
+    }
+
+    // Copy a block of words, unrolled when short
+    void move(const Instr& instr) {
+        std::uint8_t to = read(instr.a, scratchB);
+        std::uint8_t from = read(instr.b, scratchA);
+        std::int32_t words = static_cast<std::int32_t>(instr.c / 4);
+        if (words <= 8) {
+            for (std::int32_t w = 0; w < words; ++w) {
+                emit(MoonOp::Lw, result, from, 0, 4 * w);
+                emit(MoonOp::Sw, result, to, 0, 4 * w);
+            }
+            return;
+        }
+        // r11 and r12 walk the words up to the end in r13, r15 carries them
+        if (from != scratchA) {
+            emit(MoonOp::Add, scratchA, from, zero);
+        }
+        if (to != scratchB) {
+            emit(MoonOp::Add, scratchB, to, zero);
+        }
+        addImmediate(result, scratchA, 4 * std::int64_t(words));
+        std::uint32_t loop = labels.make(out.labels[label] + "_copy");
+        place(loop);
+        emit(MoonOp::Lw, link, scratchA);
+        emit(MoonOp::Sw, link, scratchB);
+        emit(MoonOp::Addi, scratchA, scratchA, 0, 4);
+        emit(MoonOp::Addi, scratchB, scratchB, 0, 4);
+        emit(MoonOp::Cne, link, scratchA, result);
+        emit(MoonOp::Bnz, link, 0, 0, 0, loop);
+    }
+
+    void call(const Instr& instr, std::uint32_t index) {
+        std::uint32_t first = saves.empty() ? 0 : saveBegin[index], last = saves.empty() ? 0 : saveBegin[index + 1];
+        for (std::uint32_t k = first; k < last; ++k) {
+            access(MoonOp::Sw, regOf[saves[k]], framePointer, slotOf[saves[k]]);
+        }
+        addImmediate(framePointer, framePointer, frameSize);
+        emit(MoonOp::Jl, link, 0, 0, 0, functionLabels[instr.a]);
+        addImmediate(framePointer, framePointer, -std::int64_t(frameSize));
+        for (std::uint32_t k = first; k < last; ++k) {
+            access(MoonOp::Lw, regOf[saves[k]], framePointer, slotOf[saves[k]]);
+        }
+        if (instr.dst != none) {
+            written(instr.dst, result);
+        }
+    }
+};
+
+// Print r13 in decimal: the digits go to a buffer lowest first and are
+// printed back from its end
+void putint(MoonProgram& out, Labels& labels, std::uint32_t label) {
+    std::uint32_t positive = labels.make("putint_positive");
+    std::uint32_t digit = labels.make("putint_digit");
+    std::uint32_t print = labels.make("putint_print");
+    std::uint32_t buffer = labels.make("putint_buffer");
+    out.code.insert(out.code.end(), {
+        {MoonOp::Label, 0, 0, 0, 0, label},
+        {MoonOp::Cge, scratchA, result, zero},
+        {MoonOp::Bnz, scratchA, 0, 0, 0, positive},
+        {MoonOp::Addi, scratchA, zero, 0, '-'},
+        {MoonOp::Putc, scratchA},
+        {MoonOp::Sub, result, zero, result},
+        {MoonOp::Label, 0, 0, 0, 0, positive},
+        {MoonOp::Addi, scratchB, zero, 0, 0, buffer},
+        {MoonOp::Label, 0, 0, 0, 0, digit},
+        {MoonOp::Modi, scratchA, result, 0, 10},
+        {MoonOp::Addi, scratchA, scratchA, 0, '0'},
+        {MoonOp::Sw, scratchA, scratchB},
+        {MoonOp::Addi, scratchB, scratchB, 0, 4},
+        {MoonOp::Divi, result, result, 0, 10},
+        {MoonOp::Bnz, result, 0, 0, 0, digit},
+        {MoonOp::Label, 0, 0, 0, 0, print},
+        {MoonOp::Subi, scratchB, scratchB, 0, 4},
+        {MoonOp::Lw, scratchA, scratchB},
+        {MoonOp::Putc, scratchA},
+        {MoonOp::Cnei, scratchA, scratchB, 0, 0, buffer},
+        {MoonOp::Bnz, scratchA, 0, 0, 0, print},
+        {MoonOp::Jr, link},
+        {MoonOp::Label, 0, 0, 0, 0, buffer},
+        {MoonOp::Res, 0, 0, 0, 48},
+    });
+}
+
+// Read a decimal integer into r13, skipping leading blanks; r15 is
+// borrowed for the tests and the return address kept in memory
+void getint(MoonProgram& out, Labels& labels, std::uint32_t label) {
+    std::uint32_t skip = labels.make("getint_skip");
+    std::uint32_t digits = labels.make("getint_digits");
+    std::uint32_t done = labels.make("getint_done");
+    std::uint32_t ret = labels.make("getint_return");
+    out.code.insert(out.code.end(), {
+        {MoonOp::Label, 0, 0, 0, 0, label},
+        {MoonOp::Sw, link, zero, 0, 0, ret},
+        {MoonOp::Addi, result, zero, 0, 0},
+        {MoonOp::Addi, scratchB, zero, 0, 1},
+        {MoonOp::Label, 0, 0, 0, 0, skip},
+        {MoonOp::Getc, scratchA},
+        {MoonOp::Clei, link, scratchA, 0, ' '},
+        {MoonOp::Bnz, link, 0, 0, 0, skip},
+        {MoonOp::Cnei, link, scratchA, 0, '-'},
+        {MoonOp::Bnz, link, 0, 0, 0, digits},
+        {MoonOp::Addi, scratchB, zero, 0, -1},
+        {MoonOp::Getc, scratchA},
+        {MoonOp::Label, 0, 0, 0, 0, digits},
+        {MoonOp::Clti, link, scratchA, 0, '0'},
+        {MoonOp::Bnz, link, 0, 0, 0, done},
+        {MoonOp::Cgti, link, scratchA, 0, '9'},
+        {MoonOp::Bnz, link, 0, 0, 0, done},
+        {MoonOp::Muli, result, result, 0, 10},
+        {MoonOp::Subi, scratchA, scratchA, 0, '0'},
+        {MoonOp::Add, result, result, scratchA},
+        {MoonOp::Getc, scratchA},
+        {MoonOp::J, 0, 0, 0, 0, digits},
+        {MoonOp::Label, 0, 0, 0, 0, done},
+        {MoonOp::Mul, result, result, scratchB},
+        {MoonOp::Lw, link, zero, 0, 0, ret},
+        {MoonOp::Jr, link},
+        {MoonOp::Label, 0, 0, 0, 0, ret},
+        {MoonOp::Res, 0, 0, 0, 4},
+    });
+}
+
+} // namespace
+
+void countMoon(const MoonProgram& program, MoonStats& stats) {
+    stats.instructions = stats.loads = stats.stores = 0;
+    for (const MoonInstr& instr : program.code) {
+        stats.instructions += instr.executes();
+        stats.loads += instr.op == MoonOp::Lw;
+        stats.stores += instr.op == MoonOp::Sw;
+    }
+}
+
+bool generateMoon(const IRProgram& program, bool allocate, MoonProgram& out, MoonStats& stats, std::string& error) {
+    for (const IRFunction& function : program.functions) {
+        if (std::find(function.regs.begin(), function.regs.end(), IRType::Float) != function.regs.end()) {
+            error = "function " + function.name + " uses float values, which Moon has no instructions for";
+            return false;
+        }
+    }
+    if (program.entry == none) {
+        error = "the program has neither a program block nor a main function";
+        return false;
+    }
+
+    out = MoonProgram();
+    stats = MoonStats();
+    Labels labels(out);
+    std::vector<std::uint32_t> functionLabels;
+    functionLabels.reserve(program.functions.size());
+    for (const IRFunction& function : program.functions) {
+        functionLabels.push_back(labels.make(function.name));
+    }
+    std::uint32_t stack = labels.make("stack");
+
+    // Start with the stack after the code and data, call the entry and stop
+    out.code.push_back({MoonOp::Entry});
+    out.code.push_back({MoonOp::Addi, framePointer, zero, 0, 0, stack});
+    out.code.push_back({MoonOp::Jl, link, 0, 0, 0, functionLabels[program.entry]});
+    out.code.push_back({MoonOp::Hlt});
+
+    Runtime runtime;
+    for (std::size_t f = 0; f < program.functions.size(); ++f) {
+        FunctionGenerator(program.functions[f], functionLabels[f], functionLabels, out, labels, runtime, stats).generate(allocate);
+    }
+    if (runtime.putint != none) {
+        putint(out, labels, runtime.putint);
+    }
+    if (runtime.getint != none) {
+        getint(out, labels, runtime.getint);
+    }
+    out.code.push_back({MoonOp::Align});
+    out.code.push_back({MoonOp::Label, 0, 0, 0, 0, stack});
+    out.code.push_back({MoonOp::Res, 0, 0, 0, 4});
+
+    countMoon(out, stats);
+    return true;
+}
@@ -0,0 +1,262 @@
+#include "../include/moon_peephole.h"
+#include <cstdint>
+
+namespace {
+
+constexpr std::size_t maxWindow = 4;
+constexpr std::uint8_t zero = 0;
+
+// What replaces the last length entries of the kept instructions
+struct Rewrite {
+    std::size_t length = 0;
+    std::size_t count = 0;
+    MoonInstr with[maxWindow];
+};
+
+// A pattern reads the kept instructions ending at end, size of them,
+// and is only tried when the op of the newest is among ends
+struct Pattern {
+    std::uint64_t ends;
+    bool (*match)(const MoonInstr* end, std::size_t size, Rewrite& rewrite);
+};
+
+constexpr std::uint64_t bit(MoonOp op) {
+    return std::uint64_t(1) << static_cast<unsigned>(op);
+}
+
+constexpr std::uint64_t executable = bit(MoonOp::Entry) - 1;
+
+bool sameAddress(const MoonInstr& x, const MoonInstr& y) {
+    return x.rj == y.rj && x.k == y.k && x.label == y.label;
+}
+
+bool isCopy(const MoonInstr& instr) {
+    return instr.op == MoonOp::Add && instr.rk == zero;
+}
+
+// sw K(rj),ri; lw rk,K(rj): the load reads back ri
+bool loadAfterStore(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    if (size < 2 || end[-2].op != MoonOp::Sw || !sameAddress(end[-2], end[-1])) {
+        return false;
+    }
+    rewrite.length = 2;
+    rewrite.with[rewrite.count++] = end[-2];
+    if (end[-1].ri != end[-2].ri) {
+        rewrite.with[rewrite.count++] = {MoonOp::Add, end[-1].ri, end[-2].ri, zero};
+    }
+    return true;
+}
+
+// lw ri,K(rj); sw K(rj),ri: the word already holds ri, unless loading
+// changed rj
+bool storeAfterLoad(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    const MoonInstr& load = end[-2];
+    if (size < 2 || load.op != MoonOp::Lw || load.ri == load.rj || load.ri != end[-1].ri || !sameAddress(load, end[-1])) {
+        return false;
+    }
+    rewrite.length = 2;
+    rewrite.with[rewrite.count++] = load;
+    return true;
+}
+
+// sw K(rj),ri; sw K(rj),rk: the first store is overwritten
+bool storeAfterStore(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    if (size < 2 || end[-2].op != MoonOp::Sw || !sameAddress(end[-2], end[-1])) {
+        return false;
+    }
+    rewrite.length = 2;
+    rewrite.with[rewrite.count++] = end[-1];
+    return true;
+}
+
+// j L followed by labels that include L
+bool jumpToNext(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    std::size_t labels = 0;
+    while (labels < size && labels < maxWindow - 1 && end[-1 - static_cast<std::ptrdiff_t>(labels)].op == MoonOp::Label) {
+        ++labels;
+    }
+    if (labels == size || labels == maxWindow - 1) {
+        return false;
+    }
+    const MoonInstr* jump = end - labels - 1;
+    if (jump->op != MoonOp::J) {
+        return false;
+    }
+    bool next = false;
+    for (std::size_t i = 1; i <= labels; ++i) {
+        next = next || jump[i].label == jump->label;
+    }
+    if (!next) {
+        return false;
+    }
+    rewrite.length = labels + 1;
+    for (std::size_t i = 1; i <= labels; ++i) {
+        rewrite.with[rewrite.count++] = jump[i];
+    }
+    return true;
+}
+
+// bz ri,L1; j L2; L1: branches to L2 on the opposite condition
+bool branchOverJump(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    if (size < 3 || end[-2].op != MoonOp::J) {
+        return false;
+    }
+    const MoonInstr& branch = end[-3];
+    if ((branch.op != MoonOp::Bz && branch.op != MoonOp::Bnz) || branch.label != end[-1].label) {
+        return false;
+    }
+    rewrite.length = 3;
+    rewrite.with[rewrite.count++] = {branch.op == MoonOp::Bz ? MoonOp::Bnz : MoonOp::Bz, branch.ri, 0, 0, 0, end[-2].label};
+    rewrite.with[rewrite.count++] = end[-1];
+    return true;
+}
+
+// An instruction right after j, jr or hlt, with no label to reach it
+bool unreachable(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    if (size < 2 || (end[-2].op != MoonOp::J && end[-2].op != MoonOp::Jr && end[-2].op != MoonOp::Hlt)) {
+        return false;
+    }
+    rewrite.length = 2;
+    rewrite.with[rewrite.count++] = end[-2];
+    return true;
+}
+
+// bz r0,L always branches; bnz r0,L never does
+bool branchOnZero(const MoonInstr* end, std::size_t, Rewrite& rewrite) {
+    if (end[-1].ri != zero) {
+        return false;
+    }
+    rewrite.length = 1;
+    if (end[-1].op == MoonOp::Bz) {
+        rewrite.with[rewrite.count++] = {MoonOp::J, 0, 0, 0, 0, end[-1].label};
+    }
+    return true;
+}
+
+// addi ri,ri,0, add ri,ri,r0, muli ri,ri,1 and the like
+bool identity(const MoonInstr* end, std::size_t, Rewrite& rewrite) {
+    const MoonInstr& instr = end[-1];
+    bool same = false;
+    switch (instr.op) {
+    case MoonOp::Add: case MoonOp::Or:
+        same = (instr.ri == instr.rj && instr.rk == zero) || (instr.ri == instr.rk && instr.rj == zero);
+        break;
+    case MoonOp::Sub:
+        same = instr.ri == instr.rj && instr.rk == zero;
+        break;
+    case MoonOp::Addi: case MoonOp::Subi: case MoonOp::Ori:
+        same = instr.ri == instr.rj && instr.k == 0 && instr.label == MoonInstr::none;
+        break;
+    case MoonOp::Muli: case MoonOp::Divi:
+        same = instr.ri == instr.rj && instr.k == 1 && instr.label == MoonInstr::none;
+        break;
+    default:
+        break;
+    }
+    if (!same || instr.ri == zero) {
+        return false;
+    }
+    rewrite.length = 1;
+    return true;
+}
+
+// add ri,rj,r0; add rj,ri,r0: rj already holds the value
+bool copyBack(const MoonInstr* end, std::size_t size, Rewrite& rewrite) {
+    if (size < 2 || !isCopy(end[-2]) || !isCopy(end[-1]) || end[-2].ri != end[-1].rj || end[-2].rj != end[-1].ri) {
+        return false;
+    }
+    rewrite.length = 2;
+    rewrite.with[rewrite.count++] = end[-2];
+    return true;
+}
+
+constexpr Pattern patterns[] = {
+    {bit(MoonOp::Lw), loadAfterStore},
+    {bit(MoonOp::Sw), storeAfterLoad},
+    {bit(MoonOp::Sw), storeAfterStore},
+    {bit(MoonOp::Label), jumpToNext},
+    {bit(MoonOp::Label), branchOverJump},
+    {executable, unreachable},
+    {bit(MoonOp::Bz) | bit(MoonOp::Bnz), branchOnZero},
+    {bit(MoonOp::Add) | bit(MoonOp::Sub) | bit(MoonOp::Or) | bit(MoonOp::Addi) | bit(MoonOp::Subi) | bit(MoonOp::Ori) |
+         bit(MoonOp::Muli) | bit(MoonOp::Divi),
+     identity},
+    {bit(MoonOp::Add), copyBack},
+};
+
+constexpr std::size_t patternCount = sizeof(patterns) / sizeof(patterns[0]);
+constexpr std::size_t opCount = static_cast<std::size_t>(MoonOp::Label) + 1;
+
+// For each op, the indices of the patterns that can end with it, followed
+// by patternCount
+struct Dispatch {
+    std::uint8_t patterns[opCount][patternCount + 1];
+};
+
+constexpr Dispatch buildDispatch() {
+    Dispatch dispatch{};
+    for (std::size_t op = 0; op < opCount; ++op) {
+        std::size_t n = 0;
+        for (std::size_t p = 0; p < patternCount; ++p) {
+            if (patterns[p].ends & (std::uint64_t(1) << op)) {
+                dispatch.patterns[op][n++] = static_cast<std::uint8_t>(p);
+            }
+        }
+        dispatch.patterns[op][n] = patternCount;
+    }
+    return dispatch;
+}
+
+constexpr Dispatch dispatch = buildDispatch();
+
+static_assert(opCount <= 64, "ends is a bit per op");
+
+} // namespace
+
+int moonCycles(MoonOp op) {
+    if (op == MoonOp::Lw || op == MoonOp::Sw) {
+        return 11;
+    }
+    return op < MoonOp::Entry ? 1 : 0;
+}
+
+PeepholeStats optimizeMoon(MoonProgram& program) {
+    PeepholeStats stats;
+    std::vector<MoonInstr>& code = program.code;
+
+    // A rewrite never lengthens the tail, so the kept prefix is compacted
+    // in place behind the instructions still to read
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < code.size(); ++i) {
+        code[kept++] = code[i];
+        bool rewritten = true;
+        while (rewritten && kept > 0) {
+            rewritten = false;
+            const MoonInstr* end = code.data() + kept;
+            for (const std::uint8_t* p = dispatch.patterns[static_cast<std::size_t>(end[-1].op)]; *p != patternCount; ++p) {
+                Rewrite rewrite;
+                if (!patterns[*p].match(end, kept, rewrite)) {
+                    continue;
+                }
+                std::size_t before = 0, cost = 0;
+                for (std::size_t k = kept - rewrite.length; k < kept; ++k) {
+                    before += code[k].executes();
+                    cost += moonCycles(code[k].op);
+                }
+                kept -= rewrite.length;
+                for (std::size_t k = 0; k < rewrite.count; ++k) {
+                    before -= rewrite.with[k].executes();
+                    cost -= moonCycles(rewrite.with[k].op);
+                    code[kept++] = rewrite.with[k];
+                }
+                ++stats.rewrites;
+                stats.removed += before;
+                stats.cycles += cost;
+                rewritten = true;
+                break;
+            }
+        }
+    }
+    code.resize(kept);
+    return stats;
+}
@@ -0,0 +1,55 @@
+#include "../include/object_layout.h"
+
+std::uint32_t Layout::size(TypeId type) {
+    switch (types.kind(type)) {
+    case TypeKind::Class:
+        return of(classTable(type)).size;
+    case TypeKind::Array:
+        return types.arraySize(type) * size(types.element(type));
+    default:
+        return 4;
+    }
+}
+
+std::uint32_t Layout::baseOffset(const SymbolTable* cls, const SymbolTable* base) {
+    if (cls == base) {
+        return 0;
+    }
+    for (const auto& [table, offset] : of(cls).bases) {
+        if (table == base) {
+            return offset;
+        }
+    }
+    return 0;
+}
+
+std::uint32_t Layout::attributeOffset(const SymbolTable* owner, const SymbolEntry& attribute) {
+    of(owner);
+    return attributes[&attribute];
+}
+
+// Base class parts first, in inheritance order, then the attributes; the
+// inheritance graph has no cycles left after the symbol table pass
+const Layout::ClassLayout& Layout::of(const SymbolTable* cls) {
+    auto found = classes.find(cls);
+    if (found != classes.end()) {
+        return found->second;
+    }
+
+    ClassLayout layout;
+    for (const SymbolTable* base : cls->bases) {
+        const ClassLayout& inner = of(base);
+        layout.bases.push_back({base, layout.size});
+        for (const auto& [table, offset] : inner.bases) {
+            layout.bases.push_back({table, layout.size + offset});
+        }
+        layout.size += inner.size;
+    }
+    for (const SymbolEntry& entry : cls->all()) {
+        if (entry.kind == SymbolKind::Attribute) {
+            attributes[&entry] = layout.size;
+            layout.size += size(entry.type);
+        }
+    }
+    return classes[cls] = std::move(layout);
+}
@@ -0,0 +1,77 @@
+#include "../include/output_buffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+OutputBuffer& OutputBuffer::operator<<(int value) {
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    data.append(digits, result.ptr);
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(unsigned value) {
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    data.append(digits, result.ptr);
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(float value) {
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+    data.append(digits, result.ptr);
+    return *this;
+}
+
+void OutputBuffer::indent(int level) {
+    std::size_t width = 2 * static_cast<std::size_t>(level);
+    if (spaces.size() < width) {
+        spaces.assign(std::max(width, 2 * spaces.size()), ' ');
+    }
+    data.append(spaces, 0, width);
+}
+
+// Write all of [next, next + remaining), retrying only on short writes
+static bool writeAll(int fd, const char* next, std::size_t remaining) {
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, next, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error writing output: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        next += written;
+        remaining -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+int openOutputFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error opening file for writing: " << path << " (" << std::strerror(errno) << ")" << std::endl;
+    }
+    return fd;
+}
+
+bool OutputBuffer::writeTo(const std::string& path) const {
+    int fd = openOutputFile(path);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = writeAll(fd, data.data(), data.size());
+    return ::close(fd) == 0 && ok;
+}
+
+bool OutputBuffer::flushTo(int fd) {
+    bool ok = writeAll(fd, data.data(), data.size());
+    data.clear();
+    return ok;
+}
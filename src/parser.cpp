@@ -22,6 +22,11 @@ vector<string> splitProduction(const string &prod) {
 map<string, map<string, string>> buildParsingTable() {
   map<string, map<string, string>> table;
 
+  // Tokens that can follow a factor, where the optional parts of a variable
+  // or call (indices, .member, arguments) end
+  const vector<string> factorFollow = {";", ")", ",", "]", "+", "-", "or", "*", "/", "and",
+                                       "==", "<>", "<", ">", "<=", ">="};
+
   // START -> PROG
   table["START"]["class"] = "PROG";
   table["START"]["implementation"] = "PROG";
@@ -51,8 +56,14 @@ map<string, map<string, string>> buildParsingTable() {
   table["CLASSIMPLFUNC"]["function"] = "FUNCDEF";
   table["CLASSIMPLFUNC"]["constructor"] = "FUNCDEF";
 
-  // CLASSDECL -> class id ISA1 lbrace VISMEMBERDECL rbrace
-  table["CLASSDECL"]["class"] = "class id ISA1 { VISMEMBERDECL }";
+  // CLASSDECL -> class id ISA1 lbrace VISMEMBERDECL rbrace CLASSEND
+  table["CLASSDECL"]["class"] = "class id ISA1 { VISMEMBERDECL } CLASSEND";
+
+  // CLASSEND -> semicolon | EPSILON (older sources omit the semicolon)
+  table["CLASSEND"][";"] = ";";
+  for (const char *next : {"class", "implementation", "function", "constructor", "int", "float", "program", "$"}) {
+    table["CLASSEND"][next] = "EPSILON";
+  }
 
   // VISMEMBERDECL -> VISIBILITY MEMDECL VISMEMBERDECL | EPSILON
   table["VISMEMBERDECL"]["public"] = "VISIBILITY MEMDECL VISMEMBERDECL";
@@ -134,14 +145,18 @@ map<string, map<string, string>> buildParsingTable() {
   table["STATEMENTS"]["put"] = "STATEMENT STATEMENTS";
   table["STATEMENTS"]["float"] = "VARDECL STATEMENTS";
   table["STATEMENTS"]["int"] = "VARDECL STATEMENTS";
+  table["STATEMENTS"]["local"] = "LOCALVARDECL STATEMENTS";
   table["STATEMENTS"]["}"] = "EPSILON";
 
+  // LOCALVARDECL -> local VARDECL
+  table["LOCALVARDECL"]["local"] = "local VARDECL";
+
   // STATEMENT -> ASSIGNMENT | if lparen RELEXPR rparen then STATBLOCK else STATBLOCK semicolon |
   //              while lparen RELEXPR rparen STATBLOCK semicolon | read lparen VARIABLE rparen semicolon |
   //              write lparen EXPR rparen semicolon | return lparen EXPR rparen semicolon |
   //              put lparen EXPR rparen semicolon
-  table["STATEMENT"]["id"] = "ASSIGNMENT";
-  table["STATEMENT"]["self"] = "ASSIGNMENT";
+  table["STATEMENT"]["id"] = "FUNCALLORASSIGN ;";
+  table["STATEMENT"]["self"] = "FUNCALLORASSIGN ;";
   table["STATEMENT"]["if"] = "if ( RELEXPR ) then STATBLOCK else STATBLOCK ;";
   table["STATEMENT"]["while"] = "while ( RELEXPR ) STATBLOCK ;";
   table["STATEMENT"]["read"] = "read ( VARIABLE ) ;";
@@ -149,9 +164,40 @@ map<string, map<string, string>> buildParsingTable() {
   table["STATEMENT"]["put"] = "put ( EXPR ) ;";
   table["STATEMENT"]["return"] = "return ( EXPR ) ;";
 
-  // ASSIGNMENT -> id = EXPR ;
-  table["ASSIGNMENT"]["id"] = "id = EXPR ;";
-  table["ASSIGNMENT"]["self"] = "self = EXPR ;";
+  // FUNCALLORASSIGN -> IDORSELF FUNCALLORASSIGN2
+  table["FUNCALLORASSIGN"]["id"] = "id FUNCALLORASSIGN2";
+  table["FUNCALLORASSIGN"]["self"] = "self FUNCALLORASSIGN2";
+
+  // FUNCALLORASSIGN2 -> INDICES FUNCALLORASSIGN3 | lparen APARAMS rparen FUNCALLORASSIGN4
+  for (const char *next : {"[", ".", ":=", "="}) {
+    table["FUNCALLORASSIGN2"][next] = "INDICES FUNCALLORASSIGN3";
+  }
+  table["FUNCALLORASSIGN2"]["("] = "( ARGS ) FUNCALLORASSIGN4";
+
+  // FUNCALLORASSIGN3 -> ASSIGNOP EXPR | dot id FUNCALLORASSIGN2
+  table["FUNCALLORASSIGN3"][":="] = "ASSIGNOP EXPR";
+  table["FUNCALLORASSIGN3"]["="] = "ASSIGNOP EXPR";
+  table["FUNCALLORASSIGN3"]["."] = ". id FUNCALLORASSIGN2";
+
+  // FUNCALLORASSIGN4 -> dot id FUNCALLORASSIGN2 | EPSILON
+  table["FUNCALLORASSIGN4"]["."] = ". id FUNCALLORASSIGN2";
+  table["FUNCALLORASSIGN4"][";"] = "EPSILON";
+
+  // ASSIGNOP -> assign (older sources use '=')
+  table["ASSIGNOP"][":="] = ":=";
+  table["ASSIGNOP"]["="] = "=";
+
+  // INDICES -> INDICE INDICES | EPSILON
+  table["INDICES"]["["] = "INDICE INDICES";
+  for (const string &next : factorFollow) {
+    table["INDICES"][next] = "EPSILON";
+  }
+  for (const char *next : {".", ":=", "="}) {
+    table["INDICES"][next] = "EPSILON";
+  }
+
+  // INDICE -> lsqbr ARITHEXPR rsqbr
+  table["INDICE"]["["] = "[ ARITHEXPR ]";
 
   // STATBLOCK -> lbrace STATEMENTS rbrace | STATEMENT | EPSILON
   table["STATBLOCK"]["{"] = "{ STATEMENTS }";
@@ -164,6 +210,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["STATBLOCK"]["put"] = "STATEMENT";
   table["STATBLOCK"]["return"] = "STATEMENT";
   table["STATBLOCK"][";"] = "EPSILON"; // For the while statement's optional STATBLOCK
+  table["STATBLOCK"]["else"] = "EPSILON"; // Empty then branch
 
   // EXPR -> ARITHEXPR EXPR2
   table["EXPR"]["id"] = "ARITHEXPR EXPR2";
@@ -192,6 +239,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["RELEXPR"]["id"] = "ARITHEXPR RELOP ARITHEXPR";
   table["RELEXPR"]["self"] = "ARITHEXPR RELOP ARITHEXPR";
   table["RELEXPR"]["floatlit"] = "ARITHEXPR RELOP ARITHEXPR";
+  table["RELEXPR"]["float"] = "ARITHEXPR RELOP ARITHEXPR";
   table["RELEXPR"]["intlit"] = "ARITHEXPR RELOP ARITHEXPR";
   table["RELEXPR"]["("] = "ARITHEXPR RELOP ARITHEXPR";
   table["RELEXPR"]["not"] = "ARITHEXPR RELOP ARITHEXPR";
@@ -202,6 +250,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["ARITHEXPR"]["id"] = "TERM RIGHTRECARITHEXPR";
   table["ARITHEXPR"]["self"] = "TERM RIGHTRECARITHEXPR";
   table["ARITHEXPR"]["floatlit"] = "TERM RIGHTRECARITHEXPR";
+  table["ARITHEXPR"]["float"] = "TERM RIGHTRECARITHEXPR";
   table["ARITHEXPR"]["intlit"] = "TERM RIGHTRECARITHEXPR";
   table["ARITHEXPR"]["integer"] = "TERM RIGHTRECARITHEXPR";
   table["ARITHEXPR"]["("] = "TERM RIGHTRECARITHEXPR";
@@ -216,6 +265,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["RIGHTRECARITHEXPR"][")"] = "EPSILON";
   table["RIGHTRECARITHEXPR"][";"] = "EPSILON";
   table["RIGHTRECARITHEXPR"][","] = "EPSILON";
+  table["RIGHTRECARITHEXPR"]["]"] = "EPSILON";
   table["RIGHTRECARITHEXPR"]["=="] = "EPSILON";
   table["RIGHTRECARITHEXPR"]["<>"] = "EPSILON";
   table["RIGHTRECARITHEXPR"]["<"] = "EPSILON";
@@ -231,6 +281,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["TERM"]["id"] = "FACTOR RIGHTRECTERM";
   table["TERM"]["self"] = "FACTOR RIGHTRECTERM";
   table["TERM"]["floatlit"] = "FACTOR RIGHTRECTERM";
+  table["TERM"]["float"] = "FACTOR RIGHTRECTERM";
   table["TERM"]["intlit"] = "FACTOR RIGHTRECTERM";
   table["TERM"]["integer"] = "FACTOR RIGHTRECTERM";
   table["TERM"]["("] = "FACTOR RIGHTRECTERM";
@@ -248,6 +299,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["RIGHTRECTERM"][")"] = "EPSILON";
   table["RIGHTRECTERM"][";"] = "EPSILON";
   table["RIGHTRECTERM"][","] = "EPSILON";
+  table["RIGHTRECTERM"]["]"] = "EPSILON";
   table["RIGHTRECTERM"]["=="] = "EPSILON";
   table["RIGHTRECTERM"]["<>"] = "EPSILON";
   table["RIGHTRECTERM"]["<"] = "EPSILON";
@@ -256,11 +308,11 @@ map<string, map<string, string>> buildParsingTable() {
   table["RIGHTRECTERM"][">="] = "EPSILON";
   table["RIGHTRECTERM"]["("] = "EPSILON"; // Accept '(' for function calls
 
-  // FACTOR -> id | floatlit | intlit | lparen ARITHEXPR rparen | not FACTOR | SIGN FACTOR
-  // Replace existing rule to support function calls
-  table["FACTOR"]["id"] = "IDNEST";
-  table["FACTOR"]["self"] = "self";
+  // FACTOR -> IDORSELF FACTOR2 REPTVARIABLEORFUNCTIONCALL | floatlit | intlit | lparen ARITHEXPR rparen | not FACTOR | SIGN FACTOR
+  table["FACTOR"]["id"] = "id FACTOR2 REPTVARIABLEORFUNCTIONCALL";
+  table["FACTOR"]["self"] = "self FACTOR2 REPTVARIABLEORFUNCTIONCALL";
   table["FACTOR"]["floatlit"] = "floatlit";
+  table["FACTOR"]["float"] = "float";
   table["FACTOR"]["intlit"] = "intlit";
   table["FACTOR"]["integer"] = "integer";
   table["FACTOR"]["("] = "( ARITHEXPR )";
@@ -268,26 +320,30 @@ map<string, map<string, string>> buildParsingTable() {
   table["FACTOR"]["+"] = "SIGN FACTOR";
   table["FACTOR"]["-"] = "SIGN FACTOR";
 
-  // IDNEST rule for both simple identifiers and function calls
-  table["IDNEST"]["id"] = "id IDNESTOP";
-
-  // IDNESTOP can be either empty (simple variable) or open paren (function call)
-  table["IDNESTOP"]["("] = "( ARGS )";
-  table["IDNESTOP"]["+"] = "EPSILON";
-  table["IDNESTOP"]["-"] = "EPSILON";
-  table["IDNESTOP"]["*"] = "EPSILON";
-  table["IDNESTOP"]["/"] = "EPSILON";
-  table["IDNESTOP"][";"] = "EPSILON";
-  table["IDNESTOP"][")"] = "EPSILON";
-  table["IDNESTOP"][","] = "EPSILON";
-  table["IDNESTOP"]["=="] = "EPSILON";
-  table["IDNESTOP"]["<>"] = "EPSILON";
-  table["IDNESTOP"]["<"] = "EPSILON";
-  table["IDNESTOP"][">"] = "EPSILON";
-  table["IDNESTOP"]["<="] = "EPSILON";
-  table["IDNESTOP"][">="] = "EPSILON";
-  table["IDNESTOP"]["and"] = "EPSILON";
-  table["IDNESTOP"]["or"] = "EPSILON";
+  // FACTOR2 -> lparen APARAMS rparen | INDICES
+  table["FACTOR2"]["("] = "( ARGS )";
+  table["FACTOR2"]["["] = "INDICES";
+  table["FACTOR2"]["."] = "EPSILON";
+  for (const string &next : factorFollow) {
+    table["FACTOR2"][next] = "EPSILON";
+  }
+
+  // REPTVARIABLEORFUNCTIONCALL -> IDNEST REPTVARIABLEORFUNCTIONCALL | EPSILON
+  table["REPTVARIABLEORFUNCTIONCALL"]["."] = "IDNEST REPTVARIABLEORFUNCTIONCALL";
+  for (const string &next : factorFollow) {
+    table["REPTVARIABLEORFUNCTIONCALL"][next] = "EPSILON";
+  }
+
+  // IDNEST -> dot id IDNEST2
+  table["IDNEST"]["."] = ". id IDNEST2";
+
+  // IDNEST2 -> lparen APARAMS rparen | INDICES
+  table["IDNEST2"]["("] = "( ARGS )";
+  table["IDNEST2"]["["] = "INDICES";
+  table["IDNEST2"]["."] = "EPSILON";
+  for (const string &next : factorFollow) {
+    table["IDNEST2"][next] = "EPSILON";
+  }
 
   // Add rules for function arguments
   table["ARGS"]["id"] = "EXPR ARGSTAIL";
@@ -295,6 +351,7 @@ map<string, map<string, string>> buildParsingTable() {
   table["ARGS"]["("] = "EXPR ARGSTAIL";
   table["ARGS"]["integer"] = "EXPR ARGSTAIL";
   table["ARGS"]["floatlit"] = "EXPR ARGSTAIL";
+  table["ARGS"]["float"] = "EXPR ARGSTAIL";
   table["ARGS"]["intlit"] = "EXPR ARGSTAIL";
   table["ARGS"]["+"] = "EXPR ARGSTAIL";
   table["ARGS"]["-"] = "EXPR ARGSTAIL";
@@ -305,9 +362,16 @@ map<string, map<string, string>> buildParsingTable() {
   table["ARGSTAIL"][","] = ", EXPR ARGSTAIL";
   table["ARGSTAIL"][")"] = "EPSILON";
 
-  // VARIABLE -> IDORSELF
-  table["VARIABLE"]["id"] = "id";
-  table["VARIABLE"]["self"] = "self";
+  // VARIABLE -> IDORSELF INDICES REPTVARIABLE
+  table["VARIABLE"]["id"] = "id INDICES REPTVARIABLE";
+  table["VARIABLE"]["self"] = "self INDICES REPTVARIABLE";
+
+  // REPTVARIABLE -> VARIDNEST REPTVARIABLE | EPSILON
+  table["REPTVARIABLE"]["."] = "VARIDNEST REPTVARIABLE";
+  table["REPTVARIABLE"][")"] = "EPSILON";
+
+  // VARIDNEST -> dot id INDICES
+  table["VARIDNEST"]["."] = ". id INDICES";
 
   // ARRAYSIZE -> lsqbr ARRAYSIZE2
   table["ARRAYSIZE"]["["] = "[ ARRAYSIZE2";
@@ -0,0 +1,443 @@
+#include "../include/semantic_check.h"
+#include "../include/ast_walker.h"
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace {
+
+// A body to check and the scope its names resolve in
+struct Job {
+    ASTNode* body;
+    const SymbolTable* scope;
+    const SymbolTable* cls;  // class of a member function, or null
+    TypeId returnType;
+};
+
+// Give every entry its type id, interning all the types a body can name;
+// after this the type table is only read
+void assignTypes(SymbolTable& table, const SymbolTable& global, TypeTable& types,
+                 const ASTContext& context, std::vector<Diagnostic>& diagnostics) {
+    auto typeOf = [&](const Type* node) {
+        if (!node) {
+            return TypeTable::voidType;
+        }
+        TypeId type = types.fromNode(*node);
+        TypeId base = type;
+        while (types.isArray(base)) {
+            base = types.element(base);
+        }
+        if (types.kind(base) == TypeKind::Class) {
+            const SymbolEntry* cls = global.find(types.className(base));
+            if (!cls || cls->kind != SymbolKind::Class) {
+                diagnostics.push_back({node->span.offset, Severity::Error,
+                                       "undeclared type " + std::string(context.spelling(node->name))});
+                return TypeTable::error;
+            }
+        }
+        return type;
+    };
+
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        SymbolEntry& entry = table.at(i);
+        switch (entry.kind) {
+        case SymbolKind::Class:
+            entry.type = types.classType(entry.name);
+            break;
+        case SymbolKind::Function:
+            entry.type = typeOf(static_cast<const FuncDecl&>(*entry.decl).returnType);
+            break;
+        default:
+            entry.type = typeOf(static_cast<const VarDecl&>(*entry.decl).type);
+            break;
+        }
+        if (entry.table) {
+            assignTypes(*entry.table, global, types, context, diagnostics);
+        }
+    }
+}
+
+// Resolves the names of one body at a time and computes the type of each of
+// its expressions bottom-up, in leave(), storing it in the node. Each worker
+// has its own checker, and with it its own walker stack; the tables and the
+// rest of the tree are shared read-only.
+class BodyChecker : public ASTWalker<BodyChecker> {
+public:
+    using ASTWalker<BodyChecker>::enter;
+    using ASTWalker<BodyChecker>::leave;
+
+    BodyChecker(const ASTContext& context, const SymbolTables& tables, const TypeTable& types)
+        : context(context), global(tables.global()), types(types), self(context.find("self")),
+          read(context.find("read")), write(context.find("write")), put(context.find("put")) {}
+
+    void check(const Job& job, std::vector<Diagnostic>& found) {
+        scope = job.scope;
+        cls = job.cls;
+        returnType = job.returnType;
+        diagnostics = &found;
+        callee = nullptr;
+        walk(job.body);
+    }
+
+    // Declarations were handled by the symbol table pass
+    bool enter(VarDecl&) { return false; }
+
+    bool enter(CallExpression& node) {
+        if (node.callee->kind == NodeKind::Identifier) {
+            callee = node.callee;
+        }
+        return true;
+    }
+
+    bool enter(Identifier& node) {
+        if (&node == callee) {
+            // Typed with the call, once the arguments are known
+            callee = nullptr;
+        } else {
+            node.type = variable(node);
+        }
+        return false;
+    }
+
+    bool enter(IntegerLiteral& node) {
+        node.type = TypeTable::intType;
+        return false;
+    }
+
+    bool enter(FloatLiteral& node) {
+        node.type = TypeTable::floatType;
+        return false;
+    }
+
+    void leave(BinaryExpression& node) {
+        TypeId left = node.left->type;
+        TypeId right = node.right->type;
+        if (left == TypeTable::error || right == TypeTable::error) {
+            node.type = TypeTable::error;
+            return;
+        }
+
+        switch (info(node.op).opClass) {
+        case OpClass::Arithmetic:
+        case OpClass::Relational:
+            if (left == right && types.isNumeric(left)) {
+                node.type = info(node.op).opClass == OpClass::Arithmetic ? left : TypeTable::intType;
+                return;
+            }
+            break;
+        case OpClass::Logical:
+            if (left == TypeTable::intType && right == TypeTable::intType) {
+                node.type = TypeTable::intType;
+                return;
+            }
+            break;
+        }
+        report(node, "type mismatch: " + types.spelling(left) + " " + std::string(spelling(node.op)) + " " +
+                     types.spelling(right));
+        node.type = TypeTable::error;
+    }
+
+    void leave(UnaryExpression& node) {
+        TypeId operand = node.expr->type;
+        bool valid = node.op == UnOp::Not ? operand == TypeTable::intType : types.isNumeric(operand);
+        if (operand != TypeTable::error && !valid) {
+            report(node, "type mismatch: " + std::string(spelling(node.op)) + " " + types.spelling(operand));
+        }
+        node.type = valid ? operand : TypeTable::error;
+    }
+
+    void leave(IndexExpression& node) {
+        TypeId base = node.base->type;
+        TypeId index = node.index->type;
+        if (index != TypeTable::intType && index != TypeTable::error) {
+            report(*node.index, "array index of type " + types.spelling(index) + ", expected int", &node);
+        }
+        if (base == TypeTable::error) {
+            node.type = TypeTable::error;
+        } else if (!types.isArray(base)) {
+            report(node, "indexing a value of type " + types.spelling(base));
+            node.type = TypeTable::error;
+        } else {
+            node.type = types.element(base);
+        }
+    }
+
+    void leave(MemberExpression& node) {
+        const SymbolTable* table = nullptr;
+        const SymbolEntry* member = this->member(node, &table);
+        node.type = member ? member->type : TypeTable::error;
+    }
+
+    void leave(CallExpression& node) {
+        if (node.callee->kind == NodeKind::Identifier) {
+            Identifier& name = static_cast<Identifier&>(*node.callee);
+            if (name.name == read || name.name == write || name.name == put) {
+                if (node.args.size() != 1) {
+                    report(name, this->name(name.name) + " takes one argument");
+                }
+                node.type = name.type = TypeTable::voidType;
+                return;
+            }
+            const SymbolTable* table = nullptr;
+            const SymbolEntry* entry = function(name, &table);
+            node.type = name.type = entry ? resolve(node, name.name, *entry, *table) : TypeTable::error;
+        } else if (node.callee->kind == NodeKind::MemberExpression && node.callee->type != TypeTable::error) {
+            MemberExpression& method = static_cast<MemberExpression&>(*node.callee);
+            const SymbolTable* table = nullptr;
+            const SymbolEntry* entry = member(method, &table, false);
+            if (entry && entry->kind != SymbolKind::Function) {
+                report(method, name(method.member) + " is not a member function");
+                entry = nullptr;
+            }
+            node.type = method.type = entry ? resolve(node, method.member, *entry, *table) : TypeTable::error;
+        } else {
+            node.type = TypeTable::error;
+        }
+    }
+
+    void leave(AssignStatement& node) {
+        TypeId target = node.lhs->type;
+        TypeId value = node.rhs->type;
+        if (target != TypeTable::error && value != TypeTable::error && !types.accepts(target, value)) {
+            report(node, "type mismatch in assignment: " + types.spelling(target) + " := " + types.spelling(value));
+        }
+    }
+
+    void leave(ReturnStatement& node) {
+        TypeId value = node.expression ? node.expression->type : TypeTable::voidType;
+        if (returnType == TypeTable::voidType) {
+            report(node, "return from a function returning void");
+        } else if (value != TypeTable::error && returnType != TypeTable::error && !types.accepts(returnType, value)) {
+            report(node, "returning " + types.spelling(value) + " from a function returning " + types.spelling(returnType));
+        }
+    }
+
+    void leave(IfStatement& node) { condition(node.condition, node); }
+    void leave(WhileStatement& node) { condition(node.condition, node); }
+
+private:
+    const ASTContext& context;
+    const SymbolTable& global;
+    const TypeTable& types;
+    const Symbol self, read, write, put;
+    const SymbolTable* scope = nullptr;
+    const SymbolTable* cls = nullptr;
+    TypeId returnType = TypeTable::voidType;
+    std::vector<Diagnostic>* diagnostics = nullptr;
+    const ASTNode* callee = nullptr;  // the identifier of the call being entered
+    std::vector<TypeId> expected;     // scratch for parameter types
+
+    // Report at node or, when it has no span because hash-consing shares
+    // it, at the closest node around it that has one. A node reported from
+    // the hooks of its parent names that parent too, since the walker has
+    // already left it.
+    void report(const ASTNode& node, std::string message, const ASTNode* parent = nullptr) {
+        const ASTNode* at = node.span.length == 0 && parent ? parent : &node;
+        for (std::size_t depth = 0; at && at->span.length == 0; ++depth) {
+            at = ancestor(depth);
+        }
+        diagnostics->push_back({at ? at->span.offset : node.span.offset, Severity::Error, std::move(message)});
+    }
+
+    std::string name(Symbol symbol) const { return std::string(context.spelling(symbol)); }
+
+    void condition(const Expression* expr, const Statement& statement) {
+        if (expr && expr->type != TypeTable::intType && expr->type != TypeTable::error) {
+            report(*expr, "condition of type " + types.spelling(expr->type) + ", expected int", &statement);
+        }
+    }
+
+    TypeId variable(const Identifier& node) {
+        if (node.name == self) {
+            if (!cls) {
+                report(node, "self used outside a member function");
+                return TypeTable::error;
+            }
+            return global.find(cls->name)->type;
+        }
+
+        const SymbolEntry* entry = scope->lookup(node.name);
+        if (!entry) {
+            report(node, "use of undeclared identifier " + name(node.name));
+            return TypeTable::error;
+        }
+        if (entry->kind == SymbolKind::Class || entry->kind == SymbolKind::Function) {
+            report(node, name(node.name) + " is not a variable");
+            return TypeTable::error;
+        }
+        return entry->type;
+    }
+
+    const SymbolEntry* function(const Identifier& node, const SymbolTable** table) {
+        const SymbolEntry* entry = scope->lookup(node.name, table);
+        if (!entry) {
+            report(node, "call to undeclared function " + name(node.name));
+            return nullptr;
+        }
+        if (entry->kind != SymbolKind::Function) {
+            report(node, name(node.name) + " is not a function");
+            return nullptr;
+        }
+        return entry;
+    }
+
+    // The member named by node in the class of its object. A private member
+    // is visible only to the member functions of its own class.
+    const SymbolEntry* member(const MemberExpression& node, const SymbolTable** table, bool report = true) {
+        TypeId object = node.object->type;
+        if (object == TypeTable::error) {
+            return nullptr;
+        }
+        if (types.kind(object) != TypeKind::Class) {
+            this->report(node, "member access on a value of type " + types.spelling(object));
+            return nullptr;
+        }
+
+        const SymbolTable* members = global.find(types.className(object))->table;
+        const SymbolEntry* entry = members->findMember(node.member, table);
+        if (!entry) {
+            this->report(node, "class " + types.spelling(object) + " has no member " + name(node.member));
+            return nullptr;
+        }
+        if (report && entry->visibility == Visibility::Private && *table != cls) {
+            this->report(node, name(node.member) + " is private to class " + name((*table)->name));
+        }
+        return entry;
+    }
+
+    // The return type of the overload of entry, in table, that accepts the
+    // arguments of call, which records it as its target
+    TypeId resolve(CallExpression& call, Symbol name, const SymbolEntry& entry, const SymbolTable& table) {
+        // An argument already reported gives no reliable overload to report on
+        for (const Expression* argument : call.args) {
+            if (argument->type == TypeTable::error) {
+                return entry.type;
+            }
+        }
+
+        std::size_t sameArity = 0;
+        std::size_t overloads = 0;
+        std::size_t params = 0;
+        for (const SymbolEntry* candidate = &entry; candidate; candidate = table.previous(*candidate)) {
+            const FuncDecl& func = static_cast<const FuncDecl&>(*candidate->decl);
+            ++overloads;
+            params = func.params.size();
+            if (params != call.args.size()) {
+                continue;
+            }
+            ++sameArity;
+
+            bool matches = true;
+            for (std::size_t i = 0; matches && i < params; ++i) {
+                const SymbolEntry* param = candidate->table->find(func.params[i]->name);
+                matches = param && types.accepts(param->type, call.args[i]->type);
+            }
+            if (matches) {
+                call.target = static_cast<FuncDecl*>(candidate->decl);
+                return candidate->type;
+            }
+        }
+
+        if (sameArity > 0) {
+            std::string message = "no overload of " + this->name(name) + " takes (";
+            for (std::size_t i = 0; i < call.args.size(); ++i) {
+                message += (i ? ", " : "") + types.spelling(call.args[i]->type);
+            }
+            report(call, message + ")");
+        } else if (overloads == 1) {
+            report(call, this->name(name) + " takes " + std::to_string(params) + " arguments but is called with " +
+                         std::to_string(call.args.size()));
+        } else {
+            report(call, "no overload of " + this->name(name) + " takes " + std::to_string(call.args.size()) + " arguments");
+        }
+        return TypeTable::error;
+    }
+};
+
+// Function bodies in the order of the symbol tables, which is declaration
+// order, then the statements of the program block
+std::vector<Job> collectJobs(ASTNode* root, const SymbolTables& tables) {
+    std::vector<Job> jobs;
+    auto addFunctions = [&](const SymbolTable& table, const SymbolTable* cls) {
+        for (const SymbolEntry& entry : table.all()) {
+            if (entry.kind != SymbolKind::Function || !entry.defined) {
+                continue;
+            }
+            const FuncDecl& func = static_cast<const FuncDecl&>(*entry.decl);
+            if (func.body) {
+                jobs.push_back({func.body, entry.table, cls, entry.type});
+            }
+        }
+    };
+
+    addFunctions(tables.global(), nullptr);
+    for (const SymbolEntry& entry : tables.global().all()) {
+        if (entry.kind == SymbolKind::Class) {
+            addFunctions(*entry.table, entry.table);
+        }
+    }
+
+    for (ASTNode* decl : static_cast<Program&>(*root).declarations) {
+        if (decl->kind != NodeKind::ClassDecl && decl->kind != NodeKind::ImplDecl &&
+            decl->kind != NodeKind::FuncDecl && decl->kind != NodeKind::VarDecl) {
+            jobs.push_back({decl, &tables.global(), nullptr, TypeTable::voidType});
+        }
+    }
+    return jobs;
+}
+
+// Run work(worker, job) for every job in [0, count) on threads workers, the
+// calling thread being worker 0. Jobs are handed out one at a time from a
+// shared counter, so a long body does not hold up a fixed share of others.
+template <typename Work>
+void parallelFor(std::size_t count, unsigned threads, Work work) {
+    std::atomic<std::size_t> next{0};
+    auto run = [&](unsigned worker) {
+        for (std::size_t job; (job = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            work(worker, job);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned worker = 1; worker < threads; ++worker) {
+        pool.emplace_back(run, worker);
+    }
+    run(0);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+} // namespace
+
+void checkSemantics(ASTNode* root, const ASTContext& context, SymbolTables& tables, TypeTable& types,
+                    std::vector<Diagnostic>& diagnostics, unsigned threads) {
+    buildSymbolTables(root, context, tables, diagnostics);
+    if (!root || root->kind != NodeKind::Program) {
+        return;
+    }
+    assignTypes(tables.global(), tables.global(), types, context, diagnostics);
+
+    // From here on the tables are frozen
+    const SymbolTables& frozen = tables;
+    const TypeTable& frozenTypes = types;
+    std::vector<Job> jobs = collectJobs(root, frozen);
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, std::max<std::size_t>(jobs.size(), 1)));
+
+    std::vector<BodyChecker> checkers(threads, BodyChecker(context, frozen, frozenTypes));
+    std::vector<std::vector<Diagnostic>> found(jobs.size());
+    parallelFor(jobs.size(), threads, [&](unsigned worker, std::size_t job) {
+        checkers[worker].check(jobs[job], found[job]);
+    });
+
+    for (std::vector<Diagnostic>& list : found) {
+        diagnostics.insert(diagnostics.end(), std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()));
+    }
+    std::stable_sort(diagnostics.begin(), diagnostics.end(),
+        [](const Diagnostic& a, const Diagnostic& b) { return a.offset < b.offset; });
+}
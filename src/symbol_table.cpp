@@ -0,0 +1,577 @@
+#include "../include/symbol_table.h"
+#include "../include/ast_walker.h"
+#include "../include/output_buffer.h"
+#include <type_traits>
+#include <unordered_map>
+
+// Fibonacci hashing; interned ids are small consecutive integers, which the
+// multiplication spreads over the high bits
+static std::size_t slotOf(Symbol name, std::size_t mask) {
+    return static_cast<std::size_t>((name.id * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+}
+
+std::uint32_t SymbolTable::indexOf(Symbol name) const {
+    if (slots.empty()) {
+        return SymbolEntry::none;
+    }
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = slotOf(name, mask); slots[i] != 0; i = (i + 1) & mask) {
+        if (entries[slots[i] - 1].name == name) {
+            return slots[i] - 1;
+        }
+    }
+    return SymbolEntry::none;
+}
+
+SymbolEntry& SymbolTable::insert(const SymbolEntry& entry) {
+    // Keep the load factor at or below one half
+    if (2 * (entries.size() + 1) > slots.size()) {
+        grow();
+    }
+
+    std::uint32_t index = static_cast<std::uint32_t>(entries.size());
+    entries.push_back(entry);
+    entries.back().overloaded = SymbolEntry::none;
+
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = slotOf(entry.name, mask);
+    for (; slots[i] != 0; i = (i + 1) & mask) {
+        if (entries[slots[i] - 1].name == entry.name) {
+            entries.back().overloaded = slots[i] - 1;
+            break;
+        }
+    }
+    slots[i] = index + 1;
+    return entries.back();
+}
+
+// Only the latest entry of each name has a slot, so reinsert those
+void SymbolTable::grow() {
+    std::vector<std::uint32_t> old(slots.empty() ? 8 : 2 * slots.size(), 0);
+    old.swap(slots);
+
+    std::size_t mask = slots.size() - 1;
+    for (std::uint32_t slot : old) {
+        if (slot == 0) {
+            continue;
+        }
+        std::size_t i = slotOf(entries[slot - 1].name, mask);
+        while (slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
+
+SymbolEntry* SymbolTable::find(Symbol name) {
+    std::uint32_t index = indexOf(name);
+    return index == SymbolEntry::none ? nullptr : &entries[index];
+}
+
+const SymbolEntry* SymbolTable::find(Symbol name) const {
+    std::uint32_t index = indexOf(name);
+    return index == SymbolEntry::none ? nullptr : &entries[index];
+}
+
+// Circular inheritance is cut by the builder, so this terminates
+const SymbolEntry* SymbolTable::findInBases(Symbol name, const SymbolTable** where) const {
+    for (const SymbolTable* base : bases) {
+        if (const SymbolEntry* entry = base->find(name)) {
+            if (where) {
+                *where = base;
+            }
+            return entry;
+        }
+        if (const SymbolEntry* entry = base->findInBases(name, where)) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+const SymbolEntry* SymbolTable::findMember(Symbol name, const SymbolTable** where) const {
+    if (const SymbolEntry* entry = find(name)) {
+        if (where) {
+            *where = this;
+        }
+        return entry;
+    }
+    return findInBases(name, where);
+}
+
+const SymbolEntry* SymbolTable::lookup(Symbol name, const SymbolTable** where) const {
+    for (const SymbolTable* table = this; table; table = table->parent) {
+        if (const SymbolEntry* entry = table->find(name)) {
+            if (where) {
+                *where = table;
+            }
+            return entry;
+        }
+        if (const SymbolEntry* entry = table->findInBases(name, where)) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+SymbolTable& SymbolTables::push(Symbol name) {
+    tables.emplace_back(name, scope);
+    scope = &tables.back();
+    return *scope;
+}
+
+std::size_t SymbolTables::symbolCount() const {
+    std::size_t count = 0;
+    for (const SymbolTable& table : tables) {
+        count += table.size();
+    }
+    return count;
+}
+
+void SymbolTables::clear() {
+    tables.clear();
+    tables.emplace_back(Symbol{}, nullptr);
+    scope = &tables.front();
+}
+
+static const char* kindName(SymbolKind kind) {
+    switch (kind) {
+    case SymbolKind::Class: return "class";
+    case SymbolKind::Function: return "function";
+    case SymbolKind::Parameter: return "param";
+    case SymbolKind::Local: return "local";
+    case SymbolKind::Attribute: return "data";
+    case SymbolKind::Variable: return "variable";
+    }
+    return "";
+}
+
+// Functions overload on the number of parameters and the names and ranks
+// of their types; array sizes and the return type do not count
+static bool sameSignature(const FuncDecl& a, const FuncDecl& b) {
+    if (a.params.size() != b.params.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.params.size(); ++i) {
+        const Type* x = a.params[i]->type;
+        const Type* y = b.params[i]->type;
+        if (x->name != y->name || x->dimCount != y->dimCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fills the tables with one walk per function body; the structure above the
+// bodies (classes, implementations, the program) is only a few levels deep
+// and is followed directly
+class SymbolTableBuilder : public ASTWalker<SymbolTableBuilder> {
+public:
+    using ASTWalker<SymbolTableBuilder>::enter;
+    using ASTWalker<SymbolTableBuilder>::leave;
+
+    SymbolTableBuilder(const ASTContext& context, SymbolTables& tables, std::vector<Diagnostic>& diagnostics)
+        : context(context), tables(tables), diagnostics(diagnostics) {}
+
+    void build(Program& program);
+
+    // Variables declared in a body; expressions declare nothing
+    bool enter(VarDecl& node) {
+        declare(node, bodyKind, Visibility::Public);
+        return false;
+    }
+
+    // Only blocks, ifs and whiles nest declarations
+    bool enter(AssignStatement&) { return false; }
+    bool enter(ReturnStatement&) { return false; }
+    bool enter(CallStatement&) { return false; }
+
+    template <typename Node>
+    bool enter(Node&) { return !std::is_base_of<Expression, Node>::value; }
+
+private:
+    const ASTContext& context;
+    SymbolTables& tables;
+    std::vector<Diagnostic>& diagnostics;
+    SymbolKind bodyKind = SymbolKind::Local;  // what a VarDecl met in a walk declares
+    const SymbolTable* currentClass = nullptr;
+    std::vector<SymbolTable*> classes;  // in declaration order; entries may move, tables do not
+
+    void declareClass(ClassDecl& cls);
+    void resolveBases(SymbolTable& table);
+    void checkCycles();
+    void defineImpl(ImplDecl& impl);
+    void declareFunction(FuncDecl& func, Visibility visibility);
+    void declare(VarDecl& var, SymbolKind kind, Visibility visibility);
+    void walkBody(Statement* body, SymbolTable& table);
+
+    void report(const ASTNode& node, Severity severity, std::string message) {
+        diagnostics.push_back({node.span.offset, severity, std::move(message)});
+    }
+
+    std::string name(Symbol symbol) const { return std::string(context.spelling(symbol)); }
+};
+
+void SymbolTableBuilder::build(Program& program) {
+    // Classes first, so implementations and base lists may name a class
+    // declared further down
+    for (ASTNode* decl : program.declarations) {
+        if (decl->kind == NodeKind::ClassDecl) {
+            declareClass(static_cast<ClassDecl&>(*decl));
+        }
+    }
+    for (SymbolTable* table : classes) {
+        resolveBases(*table);
+    }
+    checkCycles();
+
+    for (ASTNode* decl : program.declarations) {
+        switch (decl->kind) {
+        case NodeKind::ClassDecl:
+            break;
+        case NodeKind::ImplDecl:
+            defineImpl(static_cast<ImplDecl&>(*decl));
+            break;
+        case NodeKind::FuncDecl:
+            declareFunction(static_cast<FuncDecl&>(*decl), Visibility::Public);
+            break;
+        default:
+            // Variables and statements of the program block
+            bodyKind = SymbolKind::Variable;
+            walk(decl);
+            break;
+        }
+    }
+
+    for (const SymbolTable* cls : classes) {
+        for (const SymbolEntry& member : cls->all()) {
+            if (member.kind == SymbolKind::Function && !member.defined) {
+                report(*member.decl, Severity::Error, "member function " + name(cls->name) + "::" + name(member.name) +
+                                                      " is declared but not defined");
+            }
+        }
+    }
+}
+
+void SymbolTableBuilder::declareClass(ClassDecl& cls) {
+    SymbolTable& global = tables.global();
+    if (global.find(cls.name)) {
+        report(cls, Severity::Error, "multiply declared class " + name(cls.name));
+        return;
+    }
+
+    SymbolEntry& entry = global.insert({cls.name, SymbolKind::Class, Visibility::Public, true, &cls});
+    entry.table = &tables.push(cls.name);
+    classes.push_back(entry.table);
+    currentClass = entry.table;
+    for (std::size_t i = 0; i < cls.members.size(); ++i) {
+        Visibility visibility = i < cls.memberVisibility.size() ? cls.memberVisibility[i] : Visibility::Public;
+        ASTNode* member = cls.members[i];
+        if (member->kind == NodeKind::VarDecl) {
+            declare(static_cast<VarDecl&>(*member), SymbolKind::Attribute, visibility);
+        } else if (member->kind == NodeKind::FuncDecl) {
+            declareFunction(static_cast<FuncDecl&>(*member), visibility);
+        }
+    }
+    currentClass = nullptr;
+    tables.pop();
+}
+
+void SymbolTableBuilder::resolveBases(SymbolTable& table) {
+    const ClassDecl& cls = static_cast<const ClassDecl&>(*tables.global().find(table.name)->decl);
+    for (Type* parent : cls.parents) {
+        const SymbolEntry* base = tables.global().find(parent->name);
+        if (!base || base->kind != SymbolKind::Class) {
+            report(*parent, Severity::Error, "class " + name(cls.name) + " inherits from undeclared class " + name(parent->name));
+            continue;
+        }
+        table.bases.push_back(base->table);
+    }
+}
+
+// Depth-first search over the base lists; an edge back to a class still on
+// the path closes a cycle and is removed, so lookups always terminate
+void SymbolTableBuilder::checkCycles() {
+    enum State : std::uint8_t { Unvisited, OnPath, Done };
+    std::unordered_map<const SymbolTable*, State> state;
+    struct Frame {
+        SymbolTable* table;
+        std::size_t next;
+    };
+    std::vector<Frame> path;
+
+    for (SymbolTable* cls : classes) {
+        if (state[cls] != Unvisited) {
+            continue;
+        }
+        state[cls] = OnPath;
+        path.push_back({cls, 0});
+        while (!path.empty()) {
+            Frame& top = path.back();
+            if (top.next == top.table->bases.size()) {
+                state[top.table] = Done;
+                path.pop_back();
+                continue;
+            }
+            SymbolTable* base = top.table->bases[top.next];
+            State& seen = state[base];
+            if (seen == OnPath) {
+                const ASTNode& decl = *tables.global().find(top.table->name)->decl;
+                report(decl, Severity::Error, "circular inheritance between " + name(top.table->name) + " and " + name(base->name));
+                top.table->bases.erase(top.table->bases.begin() + top.next);
+            } else if (seen == Unvisited) {
+                seen = OnPath;
+                ++top.next;
+                path.push_back({base, 0});
+            } else {
+                ++top.next;
+            }
+        }
+    }
+
+    // A data member hiding one of a base class
+    for (const SymbolTable* cls : classes) {
+        for (const SymbolEntry& member : cls->all()) {
+            if (member.kind != SymbolKind::Attribute) {
+                continue;
+            }
+            for (const SymbolTable* base : cls->bases) {
+                const SymbolEntry* hidden = base->lookup(member.name);
+                if (hidden && hidden->kind == SymbolKind::Attribute) {
+                    report(*member.decl, Severity::Warning, "data member " + name(cls->name) + "::" + name(member.name) +
+                                                            " shadows a member of " + name(base->name));
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void SymbolTableBuilder::defineImpl(ImplDecl& impl) {
+    SymbolEntry* cls = tables.global().find(impl.name);
+    if (!cls || cls->kind != SymbolKind::Class) {
+        report(impl, Severity::Error, "implementation of undeclared class " + name(impl.name));
+        return;
+    }
+
+    SymbolTable& table = *cls->table;
+    currentClass = &table;
+    for (FuncDecl* func : impl.functions) {
+        SymbolEntry* declared = table.find(func->name);
+        while (declared && (declared->kind != SymbolKind::Function ||
+                            !sameSignature(*func, static_cast<FuncDecl&>(*declared->decl)))) {
+            declared = table.previous(*declared);
+        }
+
+        if (!declared) {
+            report(*func, Severity::Error, "definition of undeclared member function " + name(impl.name) + "::" + name(func->name));
+            continue;
+        }
+        if (declared->defined) {
+            report(*func, Severity::Error, "multiply defined member function " + name(impl.name) + "::" + name(func->name));
+            continue;
+        }
+
+        // Parameters were declared with the member; the body brings the locals
+        declared->defined = true;
+        declared->decl = func;
+        walkBody(func->body, *declared->table);
+    }
+    currentClass = nullptr;
+}
+
+void SymbolTableBuilder::declareFunction(FuncDecl& func, Visibility visibility) {
+    SymbolTable& scope = tables.current();
+    SymbolEntry* previous = scope.find(func.name);
+    for (SymbolEntry* other = previous; other; other = scope.previous(*other)) {
+        if (other->kind != SymbolKind::Function) {
+            report(func, Severity::Error, "multiply declared identifier " + name(func.name));
+            return;
+        }
+        if (sameSignature(func, static_cast<FuncDecl&>(*other->decl))) {
+            report(func, Severity::Error, "multiply declared function " + name(func.name));
+            return;
+        }
+    }
+    if (previous) {
+        report(func, Severity::Warning, "overloaded function " + name(func.name));
+    }
+
+    SymbolEntry& entry = scope.insert({func.name, SymbolKind::Function, visibility, func.body != nullptr, &func});
+    SymbolTable& table = tables.push(func.name);
+    entry.table = &table;
+    for (VarDecl* param : func.params) {
+        declare(*param, SymbolKind::Parameter, Visibility::Public);
+    }
+    tables.pop();
+
+    walkBody(func.body, table);
+}
+
+void SymbolTableBuilder::declare(VarDecl& var, SymbolKind kind, Visibility visibility) {
+    SymbolTable& scope = tables.current();
+    if (scope.find(var.name)) {
+        report(var, Severity::Error, "multiply declared identifier " + name(var.name));
+        return;
+    }
+
+    // Parameters and locals of a member function can hide a data member
+    if ((kind == SymbolKind::Local || kind == SymbolKind::Parameter) && currentClass) {
+        const SymbolEntry* member = currentClass->lookup(var.name);
+        if (member && member->kind == SymbolKind::Attribute) {
+            report(var, Severity::Warning, std::string(kindName(kind)) + " " + name(var.name) + " shadows a data member");
+        }
+    }
+
+    scope.insert({var.name, kind, visibility, false, &var});
+}
+
+void SymbolTableBuilder::walkBody(Statement* body, SymbolTable& table) {
+    if (!body) {
+        return;
+    }
+    SymbolTable& outer = tables.current();
+    tables.reopen(table);
+    bodyKind = SymbolKind::Local;
+    walk(body);
+    tables.reopen(outer);
+}
+
+void buildSymbolTables(ASTNode* root, const ASTContext& context, SymbolTables& tables, std::vector<Diagnostic>& diagnostics) {
+    tables.clear();
+    if (!root || root->kind != NodeKind::Program) {
+        return;
+    }
+    SymbolTableBuilder builder(context, tables, diagnostics);
+    builder.build(static_cast<Program&>(*root));
+}
+
+// Nested boxes in the layout of the course's reference output: every table
+// is framed by rules and indented one "|    " per level, one row per entry
+class SymbolTableWriter {
+public:
+    OutputBuffer out;
+
+    explicit SymbolTableWriter(const ASTContext& context) : context(context) {}
+
+    // members is set for the table of a class, which lists base classes
+    // and the visibility of each entry
+    void table(const SymbolTable& table, const std::string& title, bool members = false) {
+        rule();
+        out << prefix << "| table: " << title << '\n';
+        rule();
+        if (members) {
+            out << prefix;
+            cell("| inherit", kindWidth);
+            out << "| ";
+            if (table.bases.empty()) {
+                out << "none";
+            }
+            for (std::size_t i = 0; i < table.bases.size(); ++i) {
+                out << (i ? ", " : "") << context.spelling(table.bases[i]->name);
+            }
+            out << '\n';
+        }
+
+        for (const SymbolEntry& entry : table.all()) {
+            row(entry, members);
+            if (entry.table) {
+                prefix += "|    ";
+                this->table(*entry.table, qualified(table, entry), entry.kind == SymbolKind::Class);
+                prefix.resize(prefix.size() - 5);
+            }
+        }
+        rule();
+    }
+
+private:
+    static constexpr std::size_t width = 70;
+    static constexpr std::size_t kindWidth = 12;
+    static constexpr std::size_t nameWidth = 14;
+
+    const ASTContext& context;
+    std::string prefix;
+    std::string text;  // scratch for the type column
+
+    void rule() {
+        out << prefix;
+        for (std::size_t i = prefix.size(); i < width; ++i) {
+            out << '=';
+        }
+        out << '\n';
+    }
+
+    // Pad to size, with at least one space after a longer value
+    void cell(std::string_view value, std::size_t size) {
+        out << value << ' ';
+        for (std::size_t i = value.size() + 1; i < size; ++i) {
+            out << ' ';
+        }
+    }
+
+    void row(const SymbolEntry& entry, bool member) {
+        out << prefix << "| ";
+        cell(kindName(entry.kind), kindWidth - 2);
+        out << "| ";
+        if (entry.kind == SymbolKind::Class) {
+            out << context.spelling(entry.name) << '\n';
+            return;
+        }
+        cell(context.spelling(entry.name), nameWidth);
+
+        text.clear();
+        if (entry.kind == SymbolKind::Function) {
+            const FuncDecl& func = static_cast<const FuncDecl&>(*entry.decl);
+            text += '(';
+            for (std::size_t i = 0; i < func.params.size(); ++i) {
+                if (i) {
+                    text += ", ";
+                }
+                appendType(func.params[i]->type);
+            }
+            text += "):";
+            appendType(func.returnType);
+        } else {
+            appendType(static_cast<const VarDecl&>(*entry.decl).type);
+        }
+        out << "| ";
+        if (member) {
+            cell(text, nameWidth + 6);
+            out << "| " << (entry.visibility == Visibility::Private ? "private" : "public");
+        } else {
+            out << text;
+        }
+        out << '\n';
+    }
+
+    void appendType(const Type* type) {
+        if (!type) {
+            return;
+        }
+        text += context.spelling(type->name);
+        for (std::uint32_t i = 0; i < type->dimCount; ++i) {
+            text += '[';
+            if (type->dims[i] != 0) {
+                text += std::to_string(type->dims[i]);
+            }
+            text += ']';
+        }
+    }
+
+    // Member functions are named after their class, as in POLYNOMIAL::evaluate
+    std::string qualified(const SymbolTable& table, const SymbolEntry& entry) const {
+        std::string title;
+        if (table.parent) {
+            title += context.spelling(table.name);
+            title += "::";
+        }
+        title += context.spelling(entry.name);
+        return title;
+    }
+};
+
+bool writeSymbolTables(const SymbolTables& tables, const ASTContext& context, const std::string& path) {
+    SymbolTableWriter writer(context);
+    writer.table(tables.global(), "global");
+    return writer.out.writeTo(path);
+}
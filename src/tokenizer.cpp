@@ -36,22 +36,24 @@ Tokenizer::Tokenizer(string filename) {
 
 // IngestChar now returns a Lexeme.
 // If whitespace is found, it returns a token of type "whitespace" along with the length.
-// Otherwise, it calls NewToken.
+// Otherwise, it calls NewToken. Either way the token records its source offset.
 Lexeme Tokenizer::IngestChar(const char *c) {
         cmatch match;
         regex whitespace_or_newline("^[\\s\\n]+");
+        Lexeme lex;
         if (regex_search(c, match, whitespace_or_newline)) {
                 // Create a Lexeme with token type "whitespace" and the matched string.
                 Token t;
                 t.type = "whitespace";
                 t.value = match.str();
-                Lexeme lex;
                 lex.token = t;
                 lex.length = match.length();
-                return lex;
         } else {
-                return NewToken(c);
+                lex = NewToken(c);
         }
+        lex.token.offset = static_cast<uint32_t>(position);
+        position += lex.length;
+        return lex;
 }
 
 // NewToken returns a Lexeme containing the token and the length consumed.
@@ -59,10 +61,12 @@ Lexeme Tokenizer::NewToken(const char *c) {
         // Define regex patterns anchored at the start.
         regex id_token("^[a-zA-Z][a-zA-Z0-9_]*\\b");
         regex interger_token("^(0|[1-9][0-9]*)\\b");
-        regex float_token("^(0|[1-9][0-9]*)(\\.[0-9]+)?(e[+-]?[0-9]+)?\\b");
+        // A float needs its fraction, so it is tried before a plain integer.
+        regex float_token("^(0|[1-9][0-9]*)\\.[0-9]+(e[+-]?[0-9]+)?\\b");
         // Fraction: a dot followed by one or more digits.
         regex fraction("^\\.[0-9]+\\b");
-        regex single_line_comment("^//.*\\n");
+        // Runs to the end of the line, which may be CRLF or the end of the file.
+        regex single_line_comment("^//[^\\n]*(\\n|$)");
         // Multi-line comment: matches comments that span multiple lines.
         regex multi_line_comment("^/\\*[\\s\\S]*?\\*/");
         // Operator pattern.
@@ -118,13 +122,6 @@ Lexeme Tokenizer::NewToken(const char *c) {
                         lex.length = match.length();
                         return lex;
                 }
-        } else if (regex_search(c, match, interger_token)) {
-                cout << "[integer , " << match.str() << "]" << endl;
-                writeTokens("integer", match.str());
-                lex.token.type = "integer";
-                lex.token.value = match.str();
-                lex.length = match.length();
-                return lex;
         } else if (regex_search(c, match, float_token)) {
                 cout << "[float , " << match.str() << "]" << endl;
                 writeTokens("float", match.str());
@@ -132,6 +129,13 @@ Lexeme Tokenizer::NewToken(const char *c) {
                 lex.token.value = match.str();
                 lex.length = match.length();
                 return lex;
+        } else if (regex_search(c, match, interger_token)) {
+                cout << "[integer , " << match.str() << "]" << endl;
+                writeTokens("integer", match.str());
+                lex.token.type = "integer";
+                lex.token.value = match.str();
+                lex.length = match.length();
+                return lex;
         } else {
                 cerr << "[Bad token : [" << c << "]" << endl;
                 writeErrors(c);
@@ -0,0 +1,120 @@
+#include "../include/type_table.h"
+
+static std::size_t slotOf(TypeKind kind, std::uint32_t operand, std::uint32_t size, std::size_t mask) {
+    std::uint64_t key = (static_cast<std::uint64_t>(operand) << 32 | size) ^ static_cast<std::uint64_t>(kind) << 59;
+    key *= 0x9e3779b97f4a7c15ull;
+    return static_cast<std::size_t>(key >> 32) & mask;
+}
+
+TypeTable::TypeTable(const ASTContext& context)
+    : context(context), intName(context.find("int")), floatName(context.find("float")), voidName(context.find("void")) {
+    // In the order of the fixed ids
+    for (TypeKind kind : {TypeKind::None, TypeKind::Error, TypeKind::Void, TypeKind::Int, TypeKind::Float}) {
+        intern(kind, 0, 0);
+    }
+}
+
+TypeId TypeTable::intern(TypeKind kind, std::uint32_t operand, std::uint32_t size) {
+    // Keep the load factor at or below one half
+    if (2 * (types.size() + 1) > slots.size()) {
+        grow();
+    }
+
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = slotOf(kind, operand, size, mask);
+    for (; slots[i] != 0; i = (i + 1) & mask) {
+        const Info& info = types[slots[i]];
+        if (info.kind == kind && info.operand == operand && info.size == size) {
+            return slots[i];
+        }
+    }
+
+    TypeId id = static_cast<TypeId>(types.size());
+    types.push_back({kind, operand, size});
+    // Id 0 is never looked up, and a 0 slot means empty
+    if (id != none) {
+        slots[i] = id;
+    }
+    return id;
+}
+
+void TypeTable::grow() {
+    std::vector<std::uint32_t> old(slots.empty() ? 16 : 2 * slots.size(), 0);
+    old.swap(slots);
+
+    std::size_t mask = slots.size() - 1;
+    for (std::uint32_t id : old) {
+        if (id == 0) {
+            continue;
+        }
+        const Info& info = types[id];
+        std::size_t i = slotOf(info.kind, info.operand, info.size, mask);
+        while (slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = id;
+    }
+}
+
+TypeId TypeTable::classType(Symbol name) {
+    return intern(TypeKind::Class, name.id, 0);
+}
+
+TypeId TypeTable::arrayOf(TypeId element, std::uint32_t size) {
+    return intern(TypeKind::Array, element, size);
+}
+
+TypeId TypeTable::fromNode(const Type& node) {
+    TypeId type;
+    if (node.name == intName) {
+        type = intType;
+    } else if (node.name == floatName) {
+        type = floatType;
+    } else if (node.name == voidName) {
+        type = voidType;
+    } else {
+        type = classType(node.name);
+    }
+
+    // The last dimension is the innermost array
+    for (std::uint32_t i = node.dimCount; i-- > 0;) {
+        type = arrayOf(type, node.dims[i]);
+    }
+    return type;
+}
+
+bool TypeTable::accepts(TypeId target, TypeId value) const {
+    while (target != value) {
+        if (!isArray(target) || !isArray(value)) {
+            return false;
+        }
+        if (arraySize(target) != 0 && arraySize(target) != arraySize(value)) {
+            return false;
+        }
+        target = element(target);
+        value = element(value);
+    }
+    return true;
+}
+
+std::string TypeTable::spelling(TypeId type) const {
+    std::string dims;
+    for (; isArray(type); type = element(type)) {
+        dims += '[';
+        if (arraySize(type) != 0) {
+            dims += std::to_string(arraySize(type));
+        }
+        dims += ']';
+    }
+
+    switch (kind(type)) {
+    case TypeKind::None: return "<unchecked>" + dims;
+    case TypeKind::Error: return "<error>" + dims;
+    case TypeKind::Void: return "void" + dims;
+    case TypeKind::Int: return "int" + dims;
+    case TypeKind::Float: return "float" + dims;
+    case TypeKind::Class: return std::string(context.spelling(className(type))) + dims;
+    case TypeKind::Array: break;
+    }
+    return dims;
+}
@@ -0,0 +1,1105 @@
+// Focused tests of the front end and of the AST layouts and passes built on
+// it. Each case builds small programs and checks one component against
+// what it must produce.
+//
+//   ast_test           run every case
+//   ast_test NAME...   run the named cases
+#include "front_end.h"
+#include "../include/ast.h"
+#include "../include/ast_builder.h"
+#include "../include/ast_context.h"
+#include "../include/ast_file.h"
+#include "../include/ast_walker.h"
+#include "../include/constant_fold.h"
+#include "../include/flat_ast.h"
+#include "../include/line_table.h"
+#include "../include/symbol_table.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+std::size_t failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++failures;
+        std::cout << "  FAIL " << what << "\n";
+    }
+}
+
+// A program using every kind of node the builder makes
+const char* const sample = R"(
+class SHAPE { public function area() => float; };
+class SQUARE isa SHAPE {
+  private attribute side: float;
+  private attribute marks: int[4][];
+  public function area() => float;
+};
+implementation SQUARE {
+  function area() => float {
+    return (side * side);
+  }
+}
+function scale(v: int[], n: int, k: int) => int {
+  local i: int;
+  local total: int;
+  i := 0;
+  total := -k;
+  while (i < n) {
+    if (v[i] and not i <> 3) then v[i] := v[i] * k + 1; else ;
+    total := total + v[i] / 2 - 1;
+    i := i + 1;
+  };
+  return (total);
+}
+function main() => void {
+  local sq: SQUARE;
+  local values: int[8];
+  values[2] := 7;
+  write(scale(values, 8, 3));
+  write(sq.area() + 2.5);
+}
+)";
+
+// Tokens of source, which must parse
+std::vector<token::Token> tokensOf(const std::string& source) {
+    std::vector<token::Token> tokens;
+    std::string error;
+    if (!tokenize(source, tokens, error)) {
+        std::cout << "  cannot tokenize a test program: " << error << "\n";
+        std::exit(2);
+    }
+    return tokens;
+}
+
+ASTNode* build(const std::string& source, ASTContext& context) {
+    std::vector<token::Token> tokens = tokensOf(source);
+    Silence silence;
+    return buildAST(tokens, context);
+}
+
+std::string readBack(const std::string& path) {
+    std::string text;
+    readFile(path, text);
+    std::remove(path.c_str());
+    return text;
+}
+
+std::string printed(ASTNode* root, const ASTContext& context) {
+    printAST(root, context, "ast_test.ast");
+    return readBack("ast_test.ast");
+}
+
+std::string printed(const MappedAST& mapped) {
+    printAST(mapped, "ast_test.ast");
+    return readBack("ast_test.ast");
+}
+
+bool openQuietly(MappedAST& mapped, const std::string& path) {
+    Silence silence;
+    return mapped.open(path);
+}
+
+// Offsets of the sections of an AST file with n nodes and s symbols
+struct FileLayout {
+    std::size_t firstChild, nextSibling, payload, kinds;
+
+    FileLayout(std::size_t n, std::size_t s)
+        : firstChild(24), nextSibling(24 + 4 * n), payload(24 + 8 * n), kinds(24 + 4 * (3 * n + s + 1)) {}
+};
+
+void writeBytes(const std::string& path, const std::string& bytes) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+}
+
+void put32(std::string& bytes, std::size_t offset, std::uint32_t value) {
+    std::memcpy(&bytes[offset], &value, sizeof(value));
+}
+
+// The printer printAST() replaced: virtual double dispatch through
+// ASTVisitor, writing to an ostream as the baseline ASTPrintVisitor did,
+// with the node kinds the tree has gained since printed the way printAST()
+// documents them
+class VirtualPrinter : public ASTVisitor {
+public:
+    std::ostringstream out;
+    const ASTContext& context;
+    int indentLevel = 0;
+
+    explicit VirtualPrinter(const ASTContext& context) : context(context) {}
+
+    void indent() {
+        for (int i = 0; i < indentLevel; ++i) {
+            out << "  ";
+        }
+    }
+
+    void line(const std::string& text, std::string_view name = {}) {
+        indent();
+        out << text << name << "\n";
+    }
+
+    void child(ASTNode* node) {
+        if (node) {
+            ++indentLevel;
+            node->accept(*this);
+            --indentLevel;
+        }
+    }
+
+    template <typename Nodes>
+    void children(const Nodes& nodes) {
+        for (ASTNode* node : nodes) {
+            child(node);
+        }
+    }
+
+    void visit(Program& node) override {
+        out << "Program\n";
+        children(node.declarations);
+    }
+    void visit(ClassDecl& node) override {
+        line("ClassDecl: ", context.spelling(node.name));
+        children(node.parents);
+        children(node.members);
+    }
+    void visit(ImplDecl& node) override {
+        line("ImplDecl: ", context.spelling(node.name));
+        children(node.functions);
+    }
+    void visit(FuncDecl& node) override {
+        line("FuncDecl: ", context.spelling(node.name));
+        children(node.params);
+        child(node.returnType);
+        child(node.body);
+    }
+    void visit(VarDecl& node) override {
+        line("VarDecl: ", context.spelling(node.name));
+        child(node.type);
+    }
+    void visit(Type& node) override {
+        indent();
+        out << "Type: " << context.spelling(node.name);
+        for (std::uint32_t i = 0; i < node.dimCount; ++i) {
+            out << '[';
+            if (node.dims[i] != 0) {
+                out << node.dims[i];
+            }
+            out << ']';
+        }
+        out << "\n";
+    }
+    void visit(Statement&) override {}
+    void visit(IfStatement& node) override {
+        line("IfStatement");
+        child(node.condition);
+        child(node.thenStmt);
+        child(node.elseStmt);
+    }
+    void visit(WhileStatement& node) override {
+        line("WhileStatement");
+        child(node.condition);
+        child(node.body);
+    }
+    void visit(ReturnStatement& node) override {
+        line("ReturnStatement");
+        child(node.expression);
+    }
+    void visit(AssignStatement& node) override {
+        line("AssignStatement");
+        child(node.lhs);
+        child(node.rhs);
+    }
+    void visit(BlockStatement& node) override {
+        line("BlockStatement");
+        children(node);
+    }
+    void visit(CallStatement& node) override {
+        line("CallStatement");
+        child(node.call);
+    }
+    void visit(Expression&) override {}
+    void visit(BinaryExpression& node) override {
+        line("BinaryExpression: ", spelling(node.op));
+        child(node.left);
+        child(node.right);
+    }
+    void visit(UnaryExpression& node) override {
+        line("UnaryExpression: ", spelling(node.op));
+        child(node.expr);
+    }
+    void visit(CallExpression& node) override {
+        line("CallExpression");
+        child(node.callee);
+        children(node.args);
+    }
+    void visit(IndexExpression& node) override {
+        line("IndexExpression");
+        child(node.base);
+        child(node.index);
+    }
+    void visit(MemberExpression& node) override {
+        line("MemberExpression: ", context.spelling(node.member));
+        child(node.object);
+    }
+    void visit(Identifier& node) override { line("Identifier: ", context.spelling(node.name)); }
+    void visit(IntegerLiteral& node) override {
+        indent();
+        out << "IntegerLiteral: " << node.value << "\n";
+    }
+    void visit(FloatLiteral& node) override {
+        indent();
+        out << "FloatLiteral: " << node.value << "\n";
+    }
+};
+
+// Float literals the buffered printer formats itself, and expressions nested
+// deeper than any indentation printed before
+std::string printerProgram() {
+    std::string text = "function main() => void {\n  local x: float; local n: int;\n";
+    for (const char* value : {"0.0", "0.5", "2.5", "0.1", "0.0001", "0.00001", "3.14159265", "100000.0",
+                              "1000000.0", "123456789.0", "16777217.0", "1.0e10", "2.5e-7", "99999.95"}) {
+        text += "  x := " + std::string(value) + ";\n";
+    }
+    text += "  n := 2147483647; n := -2147483647; n := 0;\n  n := ";
+    for (int i = 0; i < 150; ++i) {
+        text += "n + (";
+    }
+    text += "n";
+    text += std::string(150, ')') + ";\n}\n";
+    return text;
+}
+
+// The buffered, statically dispatched printer writes the same bytes as the
+// virtual ostream printer it replaced
+void printerMatchesVirtualPrinter() {
+    for (const std::string& source : {std::string(sample), printerProgram()}) {
+        for (bool hashConsing : {false, true}) {
+            ASTContext context;
+            ExprTable exprs(context);
+            ASTNode* root;
+            {
+                std::vector<token::Token> tokens = tokensOf(source);
+                Silence silence;
+                root = buildAST(tokens, context, hashConsing ? &exprs : nullptr);
+            }
+            VirtualPrinter reference(context);
+            root->accept(reference);
+            std::string what = source == sample ? "the sample" : "literals and deep nesting";
+            std::string listing = printed(root, context);
+            check(listing == reference.out.str(),
+                  what + (hashConsing ? ", hash-consed," : "") + " prints as the virtual printer did");
+            if (source != sample) {
+                std::size_t floats = 0;
+                for (std::size_t at = listing.find("FloatLiteral"); at != std::string::npos;
+                     at = listing.find("FloatLiteral", at + 1)) {
+                    ++floats;
+                }
+                check(floats == 14 && listing.size() > 150 * 300, "every literal and level is printed");
+            }
+        }
+    }
+}
+
+// The listing printAST() writes, rebuilt from the nodes and edges of a DOT
+// graph; empty if the graph is not a well-formed tree in pre-order
+std::string listingOfDot(const std::string& dot) {
+    const std::string header = "digraph AST {\nnode [shape=record];\n";
+    if (dot.compare(0, header.size(), header) != 0 || dot.size() < 2 || dot.compare(dot.size() - 2, 2, "}\n") != 0) {
+        return "";
+    }
+    // Indexed by id; a missing child is a point, with an empty label
+    std::vector<std::string> labels;
+    std::vector<std::vector<std::size_t>> children;
+    std::vector<int> parents;
+    std::istringstream lines(dot.substr(header.size()));
+    std::string line;
+    std::getline(lines, line);  // graph attributes
+    while (std::getline(lines, line) && line != "}") {
+        std::size_t arrow = line.find("->");
+        std::size_t label = line.find("[label=\"");
+        if (arrow != std::string::npos) {
+            std::size_t from = std::stoul(line.substr(0, arrow));
+            std::string to = line.substr(arrow + 2, line.size() - arrow - 3);
+            bool point = to.compare(0, 4, "none") == 0;
+            std::size_t child = std::stoul(point ? to.substr(4) : to);
+            // A node is written right after the edge into it, a point right
+            // before
+            if (from >= child || child != (point ? labels.size() - 1 : labels.size())) {
+                return "";
+            }
+            if (!point) {
+                children[from].push_back(child);
+                parents.push_back(static_cast<int>(from));
+            }
+        } else if (label != std::string::npos && std::stoul(line.substr(0, label)) == labels.size()) {
+            std::string text;
+            for (std::size_t i = label + 8; i + 3 < line.size(); ++i) {
+                if (line[i] == '\\') {
+                    ++i;
+                }
+                text += line[i];
+            }
+            std::size_t bar = text.find(" | ");
+            labels.push_back(bar == std::string::npos ? text : text.substr(0, bar) + ": " + text.substr(bar + 3));
+            children.emplace_back();
+            if (parents.size() < labels.size()) {
+                parents.push_back(-1);
+            }
+        } else if (line == "none" + std::to_string(labels.size()) + "[shape=point];") {
+            labels.emplace_back();
+            children.emplace_back();
+            parents.push_back(-2);
+        } else {
+            return "";
+        }
+    }
+    if (labels.empty() || std::count(parents.begin(), parents.end(), -1) != 1) {
+        return "";
+    }
+
+    std::string listing;
+    std::vector<std::pair<std::size_t, int>> stack{{0, 0}};
+    while (!stack.empty()) {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        listing += std::string(2 * depth, ' ') + labels[node] + "\n";
+        for (auto child = children[node].rbegin(); child != children[node].rend(); ++child) {
+            stack.push_back({*child, depth + 1});
+        }
+    }
+    return listing;
+}
+
+// printDOT() draws the tree printAST() lists, one record per node and an
+// edge from each parent, flushing its buffer as the graph grows
+void dotMatchesListing() {
+    std::string big = "function main() => void {\n  local n: int;\n";
+    for (int i = 0; i < 100; ++i) {
+        big += "  if (n <> " + std::to_string(i) + ") then n := n * 2 + (n - 1) / 3; else write(-n);;\n";
+    }
+    big += "}\n";
+    for (const std::string& source : {std::string(sample), big}) {
+        ASTContext context;
+        ASTNode* root = build(source, context);
+        printDOT(root, context, "ast_test.dot");
+        std::string dot = readBack("ast_test.dot");
+        std::string what = source == sample ? "the sample" : "a graph larger than the buffer";
+        check(listingOfDot(dot) == printed(root, context), what + " is drawn as printAST lists it");
+        if (source == sample) {
+            check(dot.find("[shape=point];") != std::string::npos, "a function without a body has a point for it");
+        }
+        if (source != sample) {
+            check(dot.size() > 64 * 1024, what + " is larger than the buffer");
+        }
+    }
+}
+
+// A flat layout is the tree in pre-order, and inflating it rebuilds the
+// tree it came from, hash-consed or not
+void flatRoundTrip() {
+    ASTContext context;
+    ASTNode* root = build(sample, context);
+    std::string listing = printed(root, context);
+    FlatAST flat = flattenAST(root);
+
+    bool preOrder = flat.root() == 0;
+    std::vector<int> parents(flat.size(), 0);
+    for (std::uint32_t node = 0; node < flat.size(); ++node) {
+        std::uint32_t first = flat.firstChild[node];
+        preOrder = preOrder && (first == FlatAST::none || first == node + 1);
+        flat.forEachChild(node, [&](std::uint32_t child) {
+            preOrder = preOrder && child > node && child < flat.size();
+            ++parents[child];
+        });
+    }
+    for (std::uint32_t node = 1; node < flat.size(); ++node) {
+        preOrder = preOrder && parents[node] == 1;
+    }
+    check(preOrder, "nodes are laid out in pre-order, each the child of one node");
+
+    bool named = false, integer = false, floating = false, empty = false;
+    for (std::uint32_t node = 0; node < flat.size(); ++node) {
+        NodeKind kind = flat.kinds[node];
+        named = named || (kind == NodeKind::Identifier && context.spelling(flat.symbol(node)) == "total");
+        integer = integer || (kind == NodeKind::IntegerLiteral && flat.intValue(node) == 7);
+        floating = floating || (kind == NodeKind::FloatLiteral && flat.floatValue(node) == 2.5f);
+        empty = empty || kind == NodeKind::Empty;
+    }
+    check(named && integer && floating, "payloads hold names and literal values");
+    check(empty, "a function without a body keeps an Empty node");
+
+    // Symbols of a flat AST stay those of the context it was made from
+    ASTNode* copy = inflateAST(flat, context);
+    check(copy != root && printed(copy, context) == listing, "inflating prints the same listing");
+    FlatAST again = flattenAST(copy);
+    check(again.kinds == flat.kinds && again.firstChild == flat.firstChild && again.nextSibling == flat.nextSibling,
+          "flattening the inflated tree gives the same shape");
+
+    ASTContext shared;
+    ExprTable exprs(shared);
+    ASTNode* dag;
+    {
+        std::vector<token::Token> tokens = tokensOf(sample);
+        Silence silence;
+        dag = buildAST(tokens, shared, &exprs);
+    }
+    FlatAST expanded = flattenAST(dag);
+    check(expanded.size() == flat.size() && expanded.kinds == flat.kinds,
+          "a hash-consed tree flattens to one node per occurrence");
+    check(printed(inflateAST(expanded, shared), shared) == listing, "and inflates to the plain tree");
+}
+
+// Checks the span of every node of a tree against its source: inside the
+// source and its parent's span, spelling names and literals, and resolved
+// by a LineTable to the line and column counted from the text itself
+class SpanChecker : public ASTWalker<SpanChecker> {
+public:
+    using ASTWalker<SpanChecker>::enter;
+    using ASTWalker<SpanChecker>::leave;
+
+    const std::string& source;
+    const ASTContext& context;
+    LineTable lines;
+    std::size_t located = 0;
+    bool inSource = true, nested = true, spelled = true, resolved = true;
+    std::vector<std::pair<std::string, LineColumn>> names;  // each name with its position
+
+    SpanChecker(const std::string& source, const ASTContext& context)
+        : source(source), context(context), lines(source) {}
+
+    template <typename Node>
+    bool enter(Node& node) {
+        const SourceSpan& span = node.span;
+        if (span.length == 0) {
+            return true;
+        }
+        ++located;
+        inSource = inSource && span.offset + span.length <= source.size();
+        for (std::size_t depth = 0; ASTNode* parent = ancestor(depth); ++depth) {
+            if (parent->span.length != 0) {
+                nested = nested && parent->span.offset <= span.offset &&
+                         span.offset + span.length <= parent->span.offset + parent->span.length;
+                break;
+            }
+        }
+        std::string text = source.substr(span.offset, span.length);
+        if constexpr (std::is_same_v<Node, Identifier>) {
+            spelled = spelled && text == context.spelling(node.name);
+        } else if constexpr (std::is_same_v<Node, IntegerLiteral>) {
+            spelled = spelled && text == std::to_string(node.value);
+        }
+
+        LineColumn counted{1, 1};
+        for (std::size_t i = 0; i < span.offset; ++i) {
+            counted = source[i] == '\n' ? LineColumn{counted.line + 1, 1} : LineColumn{counted.line, counted.column + 1};
+        }
+        LineColumn position = lines.resolve(span.offset);
+        resolved = resolved && position.line == counted.line && position.column == counted.column;
+        if constexpr (std::is_same_v<Node, Identifier> || std::is_same_v<Node, FloatLiteral>) {
+            names.emplace_back(text, position);
+        }
+        return true;
+    }
+};
+
+// A LineTable maps offsets to 1-based lines and byte columns, and the
+// spans the builder records locate every node where its text is
+void spansMapToLinesAndColumns() {
+    const std::string text = "ab\ncd\n\nxyz";
+    LineTable table(text);
+    const std::uint32_t offsets[] = {0, 2, 3, 6, 7, 9, 10};
+    const LineColumn expected[] = {{1, 1}, {1, 3}, {2, 1}, {3, 1}, {4, 1}, {4, 3}, {4, 4}};
+    bool mapped = table.lineCount() == 4;
+    for (std::size_t i = 0; i < std::size(offsets); ++i) {
+        LineColumn position = table.resolve(offsets[i]);
+        mapped = mapped && position.line == expected[i].line && position.column == expected[i].column;
+    }
+    check(mapped, "offsets map to lines and columns, a newline ending its line");
+    LineTable empty("");
+    LineColumn start = empty.resolve(0);
+    check(empty.lineCount() == 1 && start.line == 1 && start.column == 1, "an empty source has one line");
+
+    const std::string source = sample;
+    ASTContext context;
+    ASTNode* root = build(source, context);
+    SpanChecker checker(source, context);
+    checker.walk(root);
+    check(checker.located > 100, "the builder records spans");
+    check(checker.inSource, "spans lie inside the source");
+    check(checker.nested, "spans lie inside the span of their parent");
+    check(checker.spelled, "names and integers span their spelling");
+    check(checker.resolved, "spans resolve to the line and column of their text");
+
+    // "  return (total);" and "  write(sq.area() + 2.5);" in sample
+    bool total = false, literal = false;
+    for (const auto& [name, position] : checker.names) {
+        total = total || (name == "total" && position.line == 23 && position.column == 11);
+        literal = literal || (name == "2.5" && position.line == 30 && position.column == 21);
+    }
+    check(total && literal, "nodes are found at the line and column they were written");
+}
+
+// Counts a chain of additions, checking each node is entered from its
+// parent and left after all its children
+class ChainWalker : public ASTWalker<ChainWalker> {
+public:
+    using ASTWalker<ChainWalker>::enter;
+    using ASTWalker<ChainWalker>::leave;
+
+    std::size_t entered = 0, left = 0, names = 0;
+    std::size_t stopAfter = 0;  // names to enter before stopping, 0 for all
+    ASTNode* last = nullptr;    // the addition entered most recently
+    bool parented = true;
+
+    bool enter(BinaryExpression& node) {
+        parented = parented && ancestor(0) == last;
+        last = &node;
+        ++entered;
+        return true;
+    }
+    WalkAction enter(Identifier&) {
+        ++names;
+        return names == stopAfter ? WalkAction::Stop : WalkAction::Continue;
+    }
+    void leave(BinaryExpression&) { ++left; }
+};
+
+// A chain depth additions deep, nested on the left as a+a+...+a parses or
+// on the right as a+(a+(...+a))
+Expression* chain(ASTContext& context, std::size_t depth, bool onTheLeft) {
+    Symbol a = context.intern("a");
+    Expression* expr = context.make<Identifier>(a);
+    for (std::size_t i = 0; i < depth; ++i) {
+        Expression* name = context.make<Identifier>(a);
+        expr = onTheLeft ? context.make<BinaryExpression>(BinOp::Add, expr, name)
+                         : context.make<BinaryExpression>(BinOp::Add, name, expr);
+    }
+    return expr;
+}
+
+// A million-deep chain, far deeper than native recursion survives, is
+// walked, stopped, walked again, flattened and inflated
+void walkerSurvivesDeepTree() {
+    const std::size_t depth = 1000000;
+    for (bool onTheLeft : {true, false}) {
+        std::string what = onTheLeft ? "a chain nested on the left" : "a chain nested on the right";
+        ASTContext context;
+        Expression* root = chain(context, depth, onTheLeft);
+
+        ChainWalker walker;
+        check(walker.walk(root), what + " is walked to the end");
+        check(walker.entered == depth && walker.left == depth && walker.names == depth + 1,
+              what + " enters and leaves every node once");
+        check(walker.parented, what + " enters each addition from its parent");
+
+        ChainWalker stopped;
+        stopped.stopAfter = depth / 2;
+        check(!stopped.walk(root) && stopped.names == depth / 2, what + " stops where a hook asks");
+        stopped.stopAfter = 0;
+        stopped.names = stopped.entered = stopped.left = 0;
+        stopped.last = nullptr;
+        check(stopped.walk(root) && stopped.left == depth, "and is walked in full again after stopping");
+
+        FlatAST flat = flattenAST(root);
+        check(flat.size() == 2 * depth + 1, what + " flattens to one node per node");
+        FlatAST again = flattenAST(inflateAST(flat, context));
+        check(again.kinds == flat.kinds && again.firstChild == flat.firstChild &&
+                  again.nextSibling == flat.nextSibling,
+              what + " inflates to the same shape");
+    }
+}
+
+// Classes with a base, member bodies given in implementations and an
+// overloaded free function
+const char* const scopes = R"(
+class A {
+  public attribute x: int;
+  public function f(a: int) => int;
+};
+class B isa A {
+  private attribute y: float[2];
+  public function f(a: int) => int;
+  public function h() => void;
+};
+implementation A {
+  function f(a: int) => int {
+    local t: int;
+    t := a + x;
+    return (t);
+  }
+}
+implementation B {
+  function f(a: int) => int { return (a); }
+  function h() => void { }
+}
+function g(n: int) => int { return (n); }
+function g(n: float, m: int[3][]) => float { return (n); }
+function main() => void {
+  local b: B;
+  write(b.f(1));
+}
+)";
+
+// The tables of scopes as .outsymboltables files lay them out
+const char* const scopesTables = R"(======================================================================
+| table: global
+======================================================================
+| class     | A
+|    =================================================================
+|    | table: A
+|    =================================================================
+|    | inherit   | none
+|    | data      | x             | int                 | public
+|    | function  | f             | (int):int           | public
+|    |    ============================================================
+|    |    | table: A::f
+|    |    ============================================================
+|    |    | param     | a             | int
+|    |    | local     | t             | int
+|    |    ============================================================
+|    =================================================================
+| class     | B
+|    =================================================================
+|    | table: B
+|    =================================================================
+|    | inherit   | A
+|    | data      | y             | float[2]            | private
+|    | function  | f             | (int):int           | public
+|    |    ============================================================
+|    |    | table: B::f
+|    |    ============================================================
+|    |    | param     | a             | int
+|    |    ============================================================
+|    | function  | h             | ():void             | public
+|    |    ============================================================
+|    |    | table: B::h
+|    |    ============================================================
+|    |    ============================================================
+|    =================================================================
+| function  | g             | (int):int
+|    =================================================================
+|    | table: g
+|    =================================================================
+|    | param     | n             | int
+|    =================================================================
+| function  | g             | (float, int[3][]):float
+|    =================================================================
+|    | table: g
+|    =================================================================
+|    | param     | n             | float
+|    | param     | m             | int[3][]
+|    =================================================================
+| function  | main          | ():void
+|    =================================================================
+|    | table: main
+|    =================================================================
+|    | local     | b             | B
+|    =================================================================
+======================================================================
+)";
+
+// Diagnostics as "line:column: message", in the order they were made
+std::vector<std::string> located(const std::vector<Diagnostic>& diagnostics, const std::string& source) {
+    LineTable lines(source);
+    std::vector<std::string> text;
+    for (const Diagnostic& diagnostic : diagnostics) {
+        LineColumn position = lines.resolve(diagnostic.offset);
+        text.push_back(std::to_string(position.line) + ":" + std::to_string(position.column) + ": " +
+                       diagnostic.message);
+    }
+    return text;
+}
+
+// The symbol tables of a program nest as its scopes do, are written in the
+// layout of the .outsymboltables files, resolve names through base classes
+// and enclosing scopes, and report what is declared wrongly
+void symbolTablesOfScopes() {
+    const std::string source = scopes;
+    ASTContext context;
+    ASTNode* root = build(source, context);
+    SymbolTables tables;
+    std::vector<Diagnostic> diagnostics;
+    buildSymbolTables(root, context, tables, diagnostics);
+
+    check(writeSymbolTables(tables, context, "ast_test.tables") && readBack("ast_test.tables") == scopesTables,
+          "the tables are written in the nested layout");
+    check(tables.tableCount() == 9 && tables.symbolCount() == 17, "there is a table per class and function");
+    check(located(diagnostics, source) == std::vector<std::string>{"23:1: overloaded function g"},
+          "an overload is reported as a warning where it is declared");
+    check(diagnostics.size() == 1 && diagnostics[0].severity == Severity::Warning, "and only as a warning");
+
+    const SymbolTable& global = tables.global();
+    const SymbolEntry* b = global.find(context.find("B"));
+    const SymbolTable* where = nullptr;
+    const SymbolEntry* x = b ? b->table->findMember(context.find("x"), &where) : nullptr;
+    check(x && x->kind == SymbolKind::Attribute && where && where->name == context.find("A"),
+          "a member is found in the base class that declares it");
+    const SymbolEntry* f = b ? b->table->find(context.find("f")) : nullptr;
+    const SymbolEntry* t = f ? f->table->lookup(context.find("t")) : nullptr;
+    const SymbolEntry* main = f ? f->table->lookup(context.find("main"), &where) : nullptr;
+    check(f && f->defined && !t, "a body sees none of the locals of the body it overrides");
+    check(main && where == &global, "and finds global names through its enclosing scopes");
+    const SymbolEntry* g = global.find(context.find("g"));
+    const SymbolEntry* first = g ? global.previous(*g) : nullptr;
+    check(g && first && !global.previous(*first) &&
+              static_cast<const FuncDecl*>(g->decl)->params.size() == 2 &&
+              static_cast<const FuncDecl*>(first->decl)->params.size() == 1,
+          "overloads are chained from the latest");
+
+    const std::string wrong = "class C isa D { };\n"
+                              "class E { public attribute z: int; public attribute z: float; };\n"
+                              "function main() => void { }\n";
+    tables.clear();
+    diagnostics.clear();
+    buildSymbolTables(build(wrong, context), context, tables, diagnostics);
+    check(located(diagnostics, wrong) ==
+              std::vector<std::string>{"2:43: multiply declared identifier z",
+                                       "1:13: class C inherits from undeclared class D"},
+          "an unknown base and a repeated member are reported where they are named");
+    check(std::all_of(diagnostics.begin(), diagnostics.end(),
+                      [](const Diagnostic& d) { return d.severity == Severity::Error; }),
+          "as errors");
+}
+
+// A statement before and after foldConstants(), with the operators it
+// must evaluate and the identities it must apply
+struct Fold {
+    const char* before;
+    const char* after;
+    std::size_t folded;
+    std::size_t simplified;
+};
+
+const Fold folds[] = {
+    {"x := 2 * (3 + 4);", "x := 14;", 2, 0},
+    {"y := 1.5 * 2.0;", "y := 3.0;", 1, 0},
+    {"x := 3 < 4;", "x := 1;", 1, 0},
+    {"x := 2.5 >= 3.0;", "x := 0;", 1, 0},
+    {"x := not 0 and 1;", "x := 1;", 2, 0},
+    {"x := 2147483647 + 1 - 2147483647 - 1;", "x := 0;", 3, 0},
+    {"x := - 5 * 2 + 12;", "x := 2;", 3, 0},
+    {"y := - 0.5 + 0.75;", "y := 0.25;", 2, 0},
+    {"x := x + 0;", "x := x;", 0, 1},
+    {"x := 0 + x * 1;", "x := x;", 0, 2},
+    {"x := x / 1 - 0;", "x := x;", 0, 2},
+    {"y := 1.0 * y;", "y := y;", 0, 1},
+    {"x := not not (x and 1);", "x := x and 1;", 0, 1},
+    {"x := not not x;", "x := not not x;", 0, 0},
+    {"x := (1 + 2) * x + 0 * 4;", "x := 3 * x;", 2, 1},
+    {"x := x + 1 + 2;", "x := x + 3;", 1, 0},
+    {"x := x - 3 + 1;", "x := x - 2;", 1, 0},
+    {"x := x + 1 - 1;", "x := x;", 1, 0},
+    {"x := x + 1 + x;", "x := x + x + 1;", 0, 0},
+    {"x := x / 0;", "x := x / 0;", 0, 0},
+    {"y := y / 0.0;", "y := y / 0.0;", 0, 0},
+    {"if (x < 1 + 1) then x := 4 / 2; else y := 0.5 + 0.25;;", "if (x < 2) then x := 2; else y := 0.75;;", 3, 0},
+    {"while (x * 1 < 2 * 3) { x := x + 1; };", "while (x < 6) { x := x + 1; };", 1, 1},
+};
+
+std::string foldBody(const char* statement) {
+    return std::string("function main() => void {\n  local x: int;\n  local y: float;\n  ") + statement + "\n}\n";
+}
+
+// Constant subexpressions are evaluated and identities applied as
+// foldConstants() documents, leaving what run time must decide, and a
+// folded tree has nothing left to fold
+void constantFolding() {
+    for (const Fold& fold : folds) {
+        std::string what = fold.before;
+        ASTContext context;
+        ASTNode* root = build(foldBody(fold.before), context);
+        FoldStats stats = foldConstants(root, context);
+        check(printed(root, context) == printed(build(foldBody(fold.after), context), context),
+              what + " folds to " + fold.after);
+        check(stats.folded == fold.folded && stats.simplified == fold.simplified,
+              what + " evaluates " + std::to_string(fold.folded) + " and simplifies " +
+                  std::to_string(fold.simplified));
+        FoldStats again = foldConstants(root, context);
+        check(again.folded == 0 && again.simplified == 0, what + " has nothing left to fold");
+    }
+
+    // A new literal is located where the expression it replaces was
+    const std::string source = foldBody("x := 2 * (3 + 4);");
+    ASTContext context;
+    ASTNode* root = build(source, context);
+    foldConstants(root, context);
+    struct Literals : ASTWalker<Literals> {
+        using ASTWalker<Literals>::enter;
+        std::vector<SourceSpan> spans;
+        bool enter(IntegerLiteral& node) {
+            spans.push_back(node.span);
+            return true;
+        }
+    } literals;
+    literals.walk(root);
+    check(literals.spans.size() == 1 &&
+              source.substr(literals.spans[0].offset, literals.spans[0].length) == "2 * (3 + 4)",
+          "a folded literal spans the expression it replaces");
+}
+
+// A file written from a tree maps back to the same tree, and printing it
+// in place gives the listing of the tree it came from
+void astFileRoundTrip() {
+    ASTContext context;
+    ASTNode* root = build(sample, context);
+    FlatAST flat = flattenAST(root);
+    check(writeASTFile(flat, context, "ast_test.astb"), "the file is written");
+
+    MappedAST mapped;
+    check(openQuietly(mapped, "ast_test.astb"), "the file written is accepted");
+    check(mapped.size() == flat.size(), "every node is written");
+    bool same = mapped.size() == flat.size();
+    for (std::uint32_t node = 0; same && node < flat.size(); ++node) {
+        same = mapped.kind(node) == flat.kinds[node] && mapped.firstChild(node) == flat.firstChild[node] &&
+               mapped.nextSibling(node) == flat.nextSibling[node] && mapped.payload(node) == flat.payload[node];
+    }
+    check(same, "nodes read back as written");
+    check(mapped.symbolCount() == context.symbolCount() &&
+              mapped.spelling(Symbol{mapped.symbolCount() - 1}) == context.spelling(Symbol{mapped.symbolCount() - 1}),
+          "symbols read back as written");
+
+    std::string listing = printed(root, context);
+    check(printed(mapped) == listing, "printing in place matches printing the tree");
+    ASTContext loaded;
+    check(printed(inflateAST(mapped.toFlat(loaded), loaded), loaded) == listing,
+          "inflating the file rebuilds the tree");
+    std::remove("ast_test.astb");
+}
+
+// Damaged files are rejected by open(), and whatever a damaged file that
+// open() accepts holds can still be inflated and printed
+void astFileRejectsCorruption() {
+    ASTContext context;
+    FlatAST flat = flattenAST(build(sample, context));
+    writeASTFile(flat, context, "ast_test.astb");
+    std::string good = readBack("ast_test.astb");
+    FileLayout layout(flat.size(), context.symbolCount());
+
+    std::uint32_t leaf = 0, binary = 0, unary = 0, parent = 0;
+    for (std::uint32_t node = 0; node < flat.size(); ++node) {
+        NodeKind kind = flat.kinds[node];
+        if (kind == NodeKind::Identifier && leaf == 0) {
+            leaf = node;
+        } else if (kind == NodeKind::BinaryExpression && binary == 0) {
+            binary = node;
+        } else if (kind == NodeKind::UnaryExpression && unary == 0) {
+            unary = node;
+        } else if (kind == NodeKind::AssignStatement && parent == 0) {
+            parent = node;
+        }
+    }
+
+    auto rejected = [&](const std::string& bytes) {
+        writeBytes("ast_test.astb", bytes);
+        MappedAST mapped;
+        bool accepted = openQuietly(mapped, "ast_test.astb");
+        std::remove("ast_test.astb");
+        return !accepted;
+    };
+    auto withKind = [&](std::uint32_t node, NodeKind kind) {
+        std::string bytes = good;
+        bytes[layout.kinds + node] = static_cast<char>(kind);
+        return bytes;
+    };
+    auto withWord = [&](std::size_t section, std::uint32_t node, std::uint32_t value) {
+        std::string bytes = good;
+        put32(bytes, section + 4 * node, value);
+        return bytes;
+    };
+
+    check(!rejected(good), "the file as written is accepted");
+    check(rejected(good.substr(0, good.size() - 1)), "a truncated file is rejected");
+    check(rejected(withKind(leaf, NodeKind::ReturnStatement)), "a leaf made a return is rejected");
+    check(rejected(withKind(leaf, NodeKind::BinaryExpression)), "a leaf made a binary operator is rejected");
+    check(rejected(withKind(leaf, NodeKind::VarDecl)), "a leaf made a declaration is rejected");
+    check(rejected(withKind(binary, NodeKind::CallStatement)), "a binary operator made a call is rejected");
+    check(rejected(withKind(parent, NodeKind::BlockStatement)), "a block of expressions is rejected");
+    check(rejected(withWord(layout.payload, binary, 12)), "a binary operator past the table is rejected");
+    check(rejected(withWord(layout.payload, unary, 3)), "a unary operator past the table is rejected");
+    check(rejected(withWord(layout.payload, leaf, 0xFFFF)), "a symbol past the table is rejected");
+    check(rejected(withWord(layout.firstChild, leaf, 0)), "a child before its parent is rejected");
+    check(rejected(withWord(layout.nextSibling, leaf, leaf - 1)), "a sibling before its node is rejected");
+    check(rejected(withWord(layout.firstChild, leaf, flat.firstChild[parent])), "a shared child is rejected");
+
+    // Any kind and any small payload in any node: accepted files must be
+    // safe to inflate and print
+    std::size_t accepted = 0;
+    for (std::uint32_t node = 0; node < flat.size(); ++node) {
+        for (int kind = 0; kind <= static_cast<int>(NodeKind::Empty) + 1; ++kind) {
+            for (std::uint32_t payload : {flat.payload[node], 0u, 11u, 12u, 40u}) {
+                std::string bytes = withKind(node, static_cast<NodeKind>(kind));
+                put32(bytes, layout.payload + 4 * node, payload);
+                writeBytes("ast_test.astb", bytes);
+                MappedAST mapped;
+                if (openQuietly(mapped, "ast_test.astb")) {
+                    ++accepted;
+                    ASTContext loaded;
+                    printed(inflateAST(mapped.toFlat(loaded), loaded), loaded);
+                    printed(mapped);
+                }
+            }
+        }
+    }
+    std::remove("ast_test.astb");
+    check(accepted > 0, "some changed files are still well formed");
+}
+
+// Kind, span and token ranges of every node of a tree, in walk order
+class Outline : public ASTWalker<Outline> {
+public:
+    std::string text;
+
+    template <typename Node>
+    bool enter(Node& node) {
+        text += std::to_string(static_cast<int>(node.kind)) + "@" + std::to_string(node.span.offset) + "+" +
+                std::to_string(node.span.length);
+        if constexpr (std::is_same<Node, Program>::value) {
+            add(node.ranges);
+        } else if constexpr (std::is_same<Node, ClassDecl>::value) {
+            add(node.memberRanges);
+        } else if constexpr (std::is_same<Node, ImplDecl>::value) {
+            add(node.functionRanges);
+        } else if constexpr (std::is_same<Node, FuncDecl>::value) {
+            add({node.bodyRange});
+        }
+        text += "\n";
+        return true;
+    }
+
+    void missing() { text += "-\n"; }
+
+private:
+    void add(const std::vector<TokenRange>& ranges) {
+        for (const TokenRange& range : ranges) {
+            text += " [" + std::to_string(range.begin) + "," + std::to_string(range.end) + ")";
+        }
+    }
+};
+
+std::string outline(ASTNode* root) {
+    Outline walker;
+    walker.walk(root);
+    return walker.text;
+}
+
+// Edits applied in turn to sample through reparseAST(), each either kept
+// inside one declaration, member or body or crossing them
+struct Edit {
+    const char* before;
+    const char* after;
+    bool incremental;
+};
+
+const Edit edits[] = {
+    {"total + v[i] / 2 - 1;", "total + v[i] / 4 - 1 + k;", true},
+    {"private attribute side: float;", "private attribute side: float; private attribute depth: int;", true},
+    {"return (side * side);", "return (side * side * 2.0);", true},
+    {"values[2] := 7;", "values[2] := 7; values[3] := values[2] * 2;", true},
+    {"function main()", "function extra() => int { return (1); }\nfunction main()", false},
+    {"i := i + 1;\n  };", "i := i + 2;\n  };\n  i := 0;", true},
+    {"function scale(v: int[], n: int, k: int)", "function scale(v: int[], n: int, k: int, m: int)", true},
+};
+
+// A tree updated by reparseAST() after each edit is the tree a fresh build
+// of the edited text gives: same listing, same spans, same token ranges
+void reparseMatchesFreshBuild() {
+    for (bool hashConsing : {false, true}) {
+        std::string source = sample;
+        std::vector<token::Token> tokens = tokensOf(source);
+        setHashConsing(hashConsing);
+        {
+            Silence silence;
+            buildAST(tokens);
+        }
+        for (const Edit& edit : edits) {
+            std::string what = std::string(hashConsing ? "hash-consed, " : "") + "after " + edit.after;
+            source.replace(source.find(edit.before), std::strlen(edit.before), edit.after);
+            std::vector<token::Token> edited = tokensOf(source);
+
+            // The changed tokens, between the longest common prefix and suffix
+            auto same = [](const token::Token& a, const token::Token& b) {
+                return a.type == b.type && a.value == b.value;
+            };
+            std::size_t prefix = 0, suffix = 0;
+            while (prefix < tokens.size() && prefix < edited.size() && same(tokens[prefix], edited[prefix])) {
+                ++prefix;
+            }
+            while (suffix < tokens.size() - prefix && suffix < edited.size() - prefix &&
+                   same(tokens[tokens.size() - 1 - suffix], edited[edited.size() - 1 - suffix])) {
+                ++suffix;
+            }
+
+            ASTNode* old = getASTRoot();
+            ASTNode* root;
+            {
+                Silence silence;
+                root = reparseAST(edited, prefix, tokens.size() - suffix, edited.size() - prefix - suffix);
+            }
+            check((root == old) == edit.incremental,
+                  what + (edit.incremental ? ": reparsed in place" : ": rebuilt"));
+            tokens = std::move(edited);
+
+            ASTContext context;
+            ExprTable exprs(context);
+            ASTNode* fresh;
+            {
+                Silence silence;
+                fresh = buildAST(tokens, context, hashConsing ? &exprs : nullptr);
+            }
+            check(printed(root, getASTContext()) == printed(fresh, context), what + ": same listing");
+            check(outline(root) == outline(fresh), what + ": same spans and token ranges");
+        }
+    }
+    setHashConsing(false);
+}
+
+struct Case {
+    const char* name;
+    std::function<void()> run;
+};
+
+const Case cases[] = {
+    {"flat_round_trip", flatRoundTrip},
+    {"printer_matches_virtual_printer", printerMatchesVirtualPrinter},
+    {"dot_matches_listing", dotMatchesListing},
+    {"spans_map_to_lines_and_columns", spansMapToLinesAndColumns},
+    {"walker_survives_deep_tree", walkerSurvivesDeepTree},
+    {"symbol_tables_of_scopes", symbolTablesOfScopes},
+    {"constant_folding", constantFolding},
+    {"ast_file_round_trip", astFileRoundTrip},
+    {"ast_file_rejects_corruption", astFileRejectsCorruption},
+    {"reparse_matches_fresh_build", reparseMatchesFreshBuild},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t ran = 0;
+    for (const Case& test : cases) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || test.name == std::string(argv[i]);
+        }
+        if (!selected) {
+            continue;
+        }
+        std::size_t before = failures;
+        test.run();
+        std::cout << (failures == before ? "ok   " : "FAIL ") << test.name << "\n";
+        ++ran;
+    }
+    std::cout << ran << " cases, " << failures << " failures\n";
+    return ran > 0 && failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+// Differential test of the ways a program can run. Each program is run by
+// the tree interpreter (-run), by the bytecode VM (-vm) and by a Moon
+// simulator on the generated code (-moon), the last two after every
+// combination of -inline, -loops and -O, and again built with -hashcons.
+// Every run must print the same.
+//
+//   differential_test DIR            each DIR/NAME.src must print
+//                                    DIR/NAME.expected, reading DIR/NAME.in
+//                                    if there is one
+//   differential_test -random N SEED N generated int programs, each run
+//                                    agreeing with the interpreter
+//
+// Programs with float values have no Moon code and skip the simulator, as
+// do programs that must stop on a runtime error.
+#include "front_end.h"
+#include "moon_simulator.h"
+#include "../include/ast_builder.h"
+#include "../include/bytecode_vm.h"
+#include "../include/constant_fold.h"
+#include "../include/interpreter.h"
+#include "../include/ir_builder.h"
+#include "../include/ir_inline.h"
+#include "../include/ir_loops.h"
+#include "../include/ir_ssa.h"
+#include "../include/moon_codegen.h"
+#include "../include/moon_peephole.h"
+#include "../include/semantic_check.h"
+#include <algorithm>
+#include <dirent.h>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Optimizations applied to the IR, in the order main.cpp runs them
+struct Level {
+    const char* name;
+    bool inlining;
+    bool loops;
+    bool optimize;
+};
+
+const Level levels[] = {
+    {"", false, false, false},
+    {" -inline", true, false, false},
+    {" -loops", false, true, false},
+    {" -O", false, false, true},
+    {" -inline -loops", true, true, false},
+    {" -inline -O", true, false, true},
+    {" -loops -O", false, true, true},
+    {" -inline -loops -O", true, true, true},
+};
+
+// A program through the front end and lowering, as main.cpp compiles it
+struct Compilation {
+    ASTContext context;
+    ExprTable exprs{context};
+    std::unique_ptr<TypeTable> types;  // made once the tree has interned its names
+    SymbolTables tables;
+    std::vector<Diagnostic> diagnostics;
+    ASTNode* root = nullptr;
+    IRProgram ir;
+};
+
+bool compile(const std::vector<token::Token>& tokens, bool hashConsing, Compilation& c, std::string& error) {
+    {
+        Silence silence;
+        c.root = buildAST(tokens, c.context, hashConsing ? &c.exprs : nullptr);
+    }
+    if (!c.root) {
+        error = "no tree built";
+        return false;
+    }
+
+    c.types.reset(new TypeTable(c.context));
+    checkSemantics(c.root, c.context, c.tables, *c.types, c.diagnostics);
+    foldConstants(c.root, c.context);
+    for (const Diagnostic& diagnostic : c.diagnostics) {
+        if (diagnostic.severity == Severity::Error) {
+            error = "semantic error: " + diagnostic.message;
+            return false;
+        }
+    }
+    c.ir = lowerProgram(c.root, c.context, c.tables, *c.types, c.diagnostics);
+    if (c.ir.functions.empty() || c.diagnostics.size() != 0) {
+        error = c.diagnostics.empty() ? "nothing lowered" : "lowering error: " + c.diagnostics.back().message;
+        return false;
+    }
+    return true;
+}
+
+// What a run printed, with a marker if it stopped on an error, which
+// every other run must stop on too
+const std::string errorMarker = "<runtime error>";
+
+std::string result(bool finished, const std::string& output) {
+    return finished ? output : output + errorMarker;
+}
+
+class Tester {
+public:
+    std::size_t runs = 0;
+    std::size_t failures = 0;
+    bool verbose = true;
+
+    // Run every configuration of source; expected is what each must print,
+    // or empty to take it from the interpreter
+    void test(const std::string& name, const std::string& source, const std::string& input, std::string expected,
+              bool fromInterpreter) {
+        std::vector<token::Token> tokens;
+        std::string error;
+        if (!tokenize(source, tokens, error)) {
+            fail(name, "tokenize", error, source);
+            return;
+        }
+        for (bool hashConsing : {false, true}) {
+            std::unique_ptr<Compilation> c(new Compilation);
+            if (!compile(tokens, hashConsing, *c, error)) {
+                fail(name, hashConsing ? "compile -hashcons" : "compile", error, source);
+                return;
+            }
+            const char* hashcons = hashConsing ? " -hashcons" : "";
+
+            std::string output;
+            std::istringstream in(input);
+            InterpreterStats interpreterStats;
+            bool finished = interpret(c->root, c->context, c->tables, *c->types, in, output, interpreterStats, error);
+            if (fromInterpreter && !hashConsing) {
+                expected = result(finished, output);
+            }
+            check(name, std::string("-run") + hashcons, result(finished, output), expected, source);
+
+            for (const Level& level : levels) {
+                IRProgram ir = c->ir;
+                if (level.inlining) {
+                    inlineFunctions(ir);
+                }
+                if (level.loops) {
+                    optimizeLoops(ir);
+                }
+                if (level.optimize) {
+                    optimizeProgram(ir);
+                }
+                vm(name, std::string("-vm") + level.name + hashcons, ir, input, expected, source);
+                if (!hashConsing) {
+                    moon(name, std::string("-moon") + level.name, ir, true, input, expected, source);
+                    moon(name, std::string("-moon without allocation") + level.name, ir, false, input, expected, source);
+                }
+            }
+        }
+    }
+
+private:
+    void vm(const std::string& name, const std::string& configuration, const IRProgram& ir, const std::string& input,
+            const std::string& expected, const std::string& source) {
+        Bytecode bytecode;
+        std::string error;
+        if (!compileBytecode(ir, bytecode, error)) {
+            fail(name, configuration, "cannot compile bytecode: " + error, source);
+            return;
+        }
+        std::string output;
+        std::istringstream in(input);
+        BytecodeStats stats;
+        bool finished = runBytecode(bytecode, in, output, stats, error);
+        check(name, configuration, result(finished, output), expected, source);
+    }
+
+    void moon(const std::string& name, const std::string& configuration, const IRProgram& ir, bool allocate,
+              const std::string& input, const std::string& expected, const std::string& source) {
+        bool floats = std::any_of(ir.functions.begin(), ir.functions.end(), [](const IRFunction& function) {
+            return std::find(function.regs.begin(), function.regs.end(), IRType::Float) != function.regs.end();
+        });
+        // The generated code does not check for the errors the interpreter
+        // and the VM stop on, such as calls nested too deep
+        if (floats || (expected.size() >= errorMarker.size() &&
+                       expected.compare(expected.size() - errorMarker.size(), errorMarker.size(), errorMarker) == 0)) {
+            return;
+        }
+        MoonProgram code;
+        MoonStats stats;
+        std::string error;
+        if (!generateMoon(ir, allocate, code, stats, error)) {
+            fail(name, configuration, "cannot generate Moon code: " + error, source);
+            return;
+        }
+        if (allocate) {
+            optimizeMoon(code);
+        }
+        std::string output;
+        MoonRunStats runStats;
+        bool finished = MoonSimulator(code).run(input, output, runStats, error);
+        check(name, configuration, result(finished, output), expected, source);
+    }
+
+    void check(const std::string& name, const std::string& configuration, const std::string& got,
+               const std::string& expected, const std::string& source) {
+        ++runs;
+        if (got != expected) {
+            fail(name, configuration, "printed\n" + got + "\nexpected\n" + expected, source);
+        }
+    }
+
+    void fail(const std::string& name, const std::string& configuration, const std::string& message,
+              const std::string& source) {
+        ++failures;
+        if (verbose || failures <= 3) {
+            std::cout << "FAIL " << name << " " << configuration << ": " << message << "\n";
+            if (!verbose) {
+                std::cout << source << "\n";
+            }
+        } else {
+            std::cout << "FAIL " << name << " " << configuration << "\n";
+        }
+    }
+};
+
+int runDirectory(const std::string& directory) {
+    std::vector<std::string> names;
+    if (DIR* dir = opendir(directory.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            std::string file = entry->d_name;
+            if (file.size() > 4 && file.compare(file.size() - 4, 4, ".src") == 0) {
+                names.push_back(file.substr(0, file.size() - 4));
+            }
+        }
+        closedir(dir);
+    }
+    if (names.empty()) {
+        std::cout << "no programs in " << directory << "\n";
+        return 1;
+    }
+    std::sort(names.begin(), names.end());
+
+    Tester tester;
+    for (const std::string& name : names) {
+        std::string base = directory + "/" + name;
+        std::string source, expected, input;
+        if (!readFile(base + ".src", source) || !readFile(base + ".expected", expected)) {
+            std::cout << "FAIL " << name << ": missing " << base << ".expected\n";
+            ++tester.failures;
+            continue;
+        }
+        readFile(base + ".in", input);
+        tester.test(name, source, input, expected, false);
+    }
+    std::cout << names.size() << " programs, " << tester.runs << " runs, " << tester.failures << " failures\n";
+    return tester.failures == 0 ? 0 : 1;
+}
+
+// Random int programs: functions calling the ones before them, with
+// locals some of which are read before they are ever written, an array,
+// conditionals and counted loops over ints, so every program terminates.
+// Some functions end without a return.
+class Generator {
+public:
+    explicit Generator(unsigned seed) : random(seed) {}
+
+    std::string program() {
+        std::string text;
+        int functions = 1 + pick(4);
+        for (int f = 0; f < functions; ++f) {
+            loopCount = 0;
+            std::string body = pick(2) ? statements(1 + pick(2), 1, f) : statements(4, 2, f);
+            text += "function f" + std::to_string(f) + "(p: int) => int {\n  local arr: int[16];";
+            for (int v = 0; v < variables; ++v) {
+                text += " local v" + std::to_string(v) + ": int;";
+            }
+            for (int i = 0; i < loopCount; ++i) {
+                text += " local i" + std::to_string(i) + ": int;";
+            }
+            text += "\n ";
+            for (int v = 0; v < variables; ++v) {
+                switch (pick(3)) {
+                case 0: text += " v" + std::to_string(v) + " := p;"; break;
+                case 1: text += " v" + std::to_string(v) + " := " + std::to_string(v) + ";"; break;
+                default: break;  // read before written: must be zero
+                }
+            }
+            // Now and then a function falls off its end and returns 0
+            text += "\n  " + body + (pick(4) ? "\n  return (v0);\n}\n" : "\n}\n");
+        }
+        text += "function main() => void {\n  local x: int;\n  x := f" + std::to_string(functions - 1) +
+                "(3);\n  write(x);\n  write(f0(x));\n}\n";
+        return text;
+    }
+
+private:
+    static constexpr int variables = 4;
+    std::mt19937 random;
+    int loopCount = 0;
+
+    int pick(int n) { return static_cast<int>(random() % static_cast<unsigned>(n)); }
+
+    std::string variable() { return "v" + std::to_string(pick(variables)); }
+
+    std::string expression(int depth) {
+        if (depth == 0 || pick(3) == 0) {
+            switch (pick(5)) {
+            case 0: return std::to_string(pick(10));
+            case 1: return std::to_string(pick(100000));
+            case 2: return "p";
+            default: return variable();
+            }
+        }
+        static const char* const operators[] = {"+", "-", "*", "+", "/", "and", "or"};
+        int op = pick(7);
+        if (op == 4) {
+            return "(" + expression(depth - 1) + " / " + std::to_string(1 + pick(9)) + ")";
+        }
+        return "(" + expression(depth - 1) + " " + operators[op] + " " + expression(depth - 1) + ")";
+    }
+
+    // The grammar cannot start a relation with a literal, hence the parentheses
+    std::string condition() {
+        static const char* const relations[] = {"<", ">", "<=", ">=", "==", "<>"};
+        return "(" + expression(1) + ") " + relations[pick(6)] + " " + expression(1);
+    }
+
+    // An index in [0, 16) computed from an arbitrary expression
+    std::string index() {
+        std::string e = expression(1);
+        return "(" + e + ") - ((" + e + ") / 8) * 8 + 7";
+    }
+
+    std::string statements(int count, int depth, int function) {
+        std::string text;
+        for (int s = 0; s < count; ++s) {
+            switch (pick(depth > 0 ? 9 : 5)) {
+            case 0:
+            case 1:
+                text += variable() + " := " + expression(2) + "; ";
+                break;
+            case 2:
+                text += "write(" + expression(1) + "); ";
+                break;
+            case 3:
+                if (function > 0) {
+                    text += variable() + " := " + variable() + " + f" + std::to_string(pick(function)) + "(" +
+                            expression(1) + ") * " + variable() + "; ";
+                } else {
+                    text += "write(" + variable() + "); ";
+                }
+                break;
+            case 4:
+                text += "arr[" + std::to_string(pick(16)) + "] := " + expression(1) + "; " + variable() + " := arr[" +
+                        index() + "]; ";
+                break;
+            case 5:
+            case 6:
+                text += "if (" + condition() + ") then { " + statements(1 + pick(3), depth - 1, function) + "} else { " +
+                        statements(pick(3), depth - 1, function) + "}; ";
+                break;
+            default: {
+                std::string counter = "i" + std::to_string(loopCount++);
+                std::string store = pick(2) ? "arr[" + counter + " * 2 + 1] := arr[" + counter + " + " +
+                                              std::to_string(pick(5)) + "] + " + variable() + " * " +
+                                              std::to_string(pick(9)) + "; "
+                                            : "";
+                text += counter + " := " + std::to_string(pick(3)) + "; while (" + counter + " < " +
+                        std::to_string(1 + pick(6)) + ") { " + store + statements(1 + pick(3), depth - 1, function) +
+                        counter + " := " + counter + " + 1; }; ";
+                break;
+            }
+            }
+        }
+        return text;
+    }
+};
+
+int runRandom(int count, unsigned seed) {
+    Tester tester;
+    tester.verbose = false;
+    for (int n = 0; n < count; ++n) {
+        Generator generator(seed + static_cast<unsigned>(n));
+        tester.test("random program " + std::to_string(seed + n), generator.program(), "", "", true);
+    }
+    std::cout << count << " random programs from seed " << seed << ", " << tester.runs << " runs, "
+              << tester.failures << " failures\n";
+    return tester.failures == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 4 && std::string(argv[1]) == "-random") {
+        return runRandom(std::stoi(argv[2]), static_cast<unsigned>(std::stoul(argv[3])));
+    }
+    if (argc == 2) {
+        return runDirectory(argv[1]);
+    }
+    std::cerr << "usage: differential_test DIR | differential_test -random COUNT SEED" << std::endl;
+    return 2;
+}
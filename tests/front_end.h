@@ -0,0 +1,70 @@
+#ifndef TESTS_FRONT_END_H
+#define TESTS_FRONT_END_H
+
+// Helpers the tests share for reading sources and running the tokenizer
+// and the parser on them, as main.cpp does.
+#include "../include/parser.h"
+#include "../include/tokenizer.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The tokenizer echoes every token to cout and appends it to files under
+// ./output and ./errors; the builder reports to cerr
+class Silence {
+public:
+    Silence() : out(std::cout.rdbuf(sink.rdbuf())), err(std::cerr.rdbuf(sink.rdbuf())) {}
+    ~Silence() {
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+    }
+
+private:
+    std::ostringstream sink;
+    std::streambuf* out;
+    std::streambuf* err;
+};
+
+// The tokens of a program the parser accepts
+inline bool tokenize(const std::string& source, std::vector<token::Token>& tokens, std::string& error) {
+    Silence silence;
+    token::Tokenizer tokenizer("test");
+    const char* content = source.c_str();
+    std::size_t remaining = source.size();
+    while (remaining > 0) {
+        token::Lexeme lex = tokenizer.IngestChar(content);
+        content += lex.length;
+        remaining -= lex.length;
+        if (lex.token.type == "error") {
+            error = "bad token " + lex.token.value.substr(0, 20);
+            return false;
+        }
+        if (lex.token.type != "whitespace" && lex.token.type != "single-line comment" &&
+            lex.token.type != "multi-line comment") {
+            tokens.push_back(lex.token);
+        }
+    }
+    initParserState();
+    for (const token::Token& token : tokens) {
+        if (!feedToken(token)) {
+            error = "syntax error at " + token.value;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool readFile(const std::string& path, std::string& text) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    text = contents.str();
+    return true;
+}
+
+#endif // TESTS_FRONT_END_H
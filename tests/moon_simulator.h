@@ -0,0 +1,216 @@
+#ifndef MOON_SIMULATOR_H
+#define MOON_SIMULATOR_H
+
+#include "../include/moon.h"
+#include "../include/moon_peephole.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct MoonRunStats {
+    std::size_t executed = 0;  // instructions run
+    std::size_t cycles = 0;    // as moonCycles() counts them
+};
+
+// Runs a MoonProgram the way the Moon virtual machine would run its text.
+// Directives are laid out first to give every instruction and label its
+// address, and a program with an immediate K that does not fit 16 bits is
+// rejected; execution then starts at the entry and ends at hlt. Registers
+// other than r0 and all of memory start out holding a pattern rather than
+// zero, so code that reads a register or stack word it never wrote prints
+// garbage instead of passing by chance.
+class MoonSimulator {
+public:
+    static constexpr std::uint32_t memoryBytes = 1u << 24;
+    static constexpr std::int32_t garbage = 0x5A5A5A5A;
+
+    explicit MoonSimulator(const MoonProgram& program) : program(program) {
+        std::uint32_t address = 0;
+        addressOf.resize(program.code.size());
+        labelAddress.assign(program.labels.size(), none);
+        for (std::size_t i = 0; i < program.code.size(); ++i) {
+            const MoonInstr& instr = program.code[i];
+            if (instr.op == MoonOp::Align) {
+                address = (address + 3) & ~3u;
+            }
+            addressOf[i] = address;
+            if (instr.op == MoonOp::Label) {
+                labelAddress[instr.label] = address;
+            } else if (instr.op == MoonOp::Entry) {
+                entry = address;
+            } else if (instr.op == MoonOp::Res) {
+                address += static_cast<std::uint32_t>(instr.k);
+            } else if (instr.executes()) {
+                address += 4;
+            }
+        }
+        instructionAt.assign(address / 4 + 1, none);
+        for (std::size_t i = 0; i < program.code.size(); ++i) {
+            if (program.code[i].executes()) {
+                instructionAt[addressOf[i] / 4] = static_cast<std::uint32_t>(i);
+            }
+        }
+    }
+
+    // Run with getc reading input and putc appending to output; false with
+    // error set on a fault or once limit instructions have run
+    bool run(const std::string& input, std::string& output, MoonRunStats& stats, std::string& error,
+             std::size_t limit = 1000000000) {
+        for (std::uint32_t address : labelAddress) {
+            if (address == none) {
+                error = "undefined label";
+                return false;
+            }
+        }
+        // K is a signed 16-bit field, whether a number or a label
+        for (const MoonInstr& instr : program.code) {
+            std::int64_t k = instr.label != MoonInstr::none ? std::int64_t(labelAddress[instr.label]) : instr.k;
+            if (instr.executes() && (k < -32768 || k > 32767)) {
+                error = "immediate " + std::to_string(k) + " too large for " + std::string(moonOpName(instr.op));
+                return false;
+            }
+        }
+        std::vector<std::int32_t> words(memoryBytes / 4, garbage);
+        std::int32_t r[16];
+        r[0] = 0;
+        for (int i = 1; i < 16; ++i) {
+            r[i] = garbage;
+        }
+        std::size_t read = 0;
+        auto word = [&](std::int64_t address) -> std::int32_t* {
+            if (address < 0 || address % 4 != 0 || address + 4 > memoryBytes) {
+                error = "bad address " + std::to_string(address);
+                return nullptr;
+            }
+            return &words[static_cast<std::size_t>(address / 4)];
+        };
+
+        for (std::uint32_t pc = entry;;) {
+            if (pc % 4 != 0 || pc / 4 >= instructionAt.size() || instructionAt[pc / 4] == none) {
+                error = "jump off the code to " + std::to_string(pc);
+                return false;
+            }
+            if (stats.executed++ == limit) {
+                error = "instruction limit reached";
+                return false;
+            }
+            const MoonInstr& instr = program.code[instructionAt[pc / 4]];
+            stats.cycles += moonCycles(instr.op);
+            std::uint32_t next = pc + 4;
+            std::int32_t j = r[instr.rj];
+            std::int32_t k = r[instr.rk];
+            std::int32_t immediate = instr.label != MoonInstr::none ? static_cast<std::int32_t>(labelAddress[instr.label]) : instr.k;
+            std::int32_t value = 0;
+            bool writes = true;
+            switch (instr.op) {
+            case MoonOp::Add: value = wrap(std::int64_t(j) + k); break;
+            case MoonOp::Sub: value = wrap(std::int64_t(j) - k); break;
+            case MoonOp::Mul: value = wrap(std::int64_t(j) * k); break;
+            case MoonOp::Div:
+            case MoonOp::Mod:
+            case MoonOp::Divi:
+            case MoonOp::Modi: {
+                bool isImmediate = instr.op == MoonOp::Divi || instr.op == MoonOp::Modi;
+                std::int32_t divisor = isImmediate ? immediate : k;
+                if (divisor == 0) {
+                    error = "division by zero";
+                    return false;
+                }
+                bool quotient = instr.op == MoonOp::Div || instr.op == MoonOp::Divi;
+                value = divisor == -1 ? (quotient ? wrap(-std::int64_t(j)) : 0) : (quotient ? j / divisor : j % divisor);
+                break;
+            }
+            case MoonOp::And: value = j & k; break;
+            case MoonOp::Or: value = j | k; break;
+            case MoonOp::Ceq: value = j == k; break;
+            case MoonOp::Cne: value = j != k; break;
+            case MoonOp::Clt: value = j < k; break;
+            case MoonOp::Cle: value = j <= k; break;
+            case MoonOp::Cgt: value = j > k; break;
+            case MoonOp::Cge: value = j >= k; break;
+            case MoonOp::Addi: value = wrap(std::int64_t(j) + immediate); break;
+            case MoonOp::Subi: value = wrap(std::int64_t(j) - immediate); break;
+            case MoonOp::Muli: value = wrap(std::int64_t(j) * immediate); break;
+            case MoonOp::Andi: value = j & immediate; break;
+            case MoonOp::Ori: value = j | immediate; break;
+            case MoonOp::Ceqi: value = j == immediate; break;
+            case MoonOp::Cnei: value = j != immediate; break;
+            case MoonOp::Clti: value = j < immediate; break;
+            case MoonOp::Clei: value = j <= immediate; break;
+            case MoonOp::Cgti: value = j > immediate; break;
+            case MoonOp::Cgei: value = j >= immediate; break;
+            case MoonOp::Not: value = j == 0; break;
+            case MoonOp::Sl: value = static_cast<std::int32_t>(static_cast<std::uint32_t>(r[instr.ri]) << (immediate & 31)); break;
+            case MoonOp::Sr: value = static_cast<std::int32_t>(static_cast<std::uint32_t>(r[instr.ri]) >> (immediate & 31)); break;
+            case MoonOp::Lw: {
+                std::int32_t* at = word(std::int64_t(j) + immediate);
+                if (!at) {
+                    return false;
+                }
+                value = *at;
+                break;
+            }
+            case MoonOp::Sw: {
+                std::int32_t* at = word(std::int64_t(j) + immediate);
+                if (!at) {
+                    return false;
+                }
+                *at = r[instr.ri];
+                writes = false;
+                break;
+            }
+            case MoonOp::Getc: value = read < input.size() ? static_cast<unsigned char>(input[read++]) : 0; break;
+            case MoonOp::Putc:
+                output += static_cast<char>(r[instr.ri] & 0xFF);
+                writes = false;
+                break;
+            case MoonOp::Bz:
+                next = r[instr.ri] == 0 ? static_cast<std::uint32_t>(immediate) : next;
+                writes = false;
+                break;
+            case MoonOp::Bnz:
+                next = r[instr.ri] != 0 ? static_cast<std::uint32_t>(immediate) : next;
+                writes = false;
+                break;
+            case MoonOp::J:
+                next = static_cast<std::uint32_t>(immediate);
+                writes = false;
+                break;
+            case MoonOp::Jr:
+                next = static_cast<std::uint32_t>(r[instr.ri]);
+                writes = false;
+                break;
+            case MoonOp::Jl:
+                value = static_cast<std::int32_t>(next);
+                next = static_cast<std::uint32_t>(immediate);
+                break;
+            case MoonOp::Nop: writes = false; break;
+            case MoonOp::Hlt: return true;
+            default:
+                error = "cannot execute " + std::string(moonOpName(instr.op));
+                return false;
+            }
+            if (writes && instr.ri != 0) {
+                r[instr.ri] = value;
+            }
+            pc = next;
+        }
+    }
+
+private:
+    static constexpr std::uint32_t none = 0xFFFFFFFFu;
+
+    const MoonProgram& program;
+    std::vector<std::uint32_t> addressOf;     // per instruction or directive
+    std::vector<std::uint32_t> labelAddress;  // per label
+    std::vector<std::uint32_t> instructionAt; // per word of code, the instruction there
+    std::uint32_t entry = 0;
+
+    static std::int32_t wrap(std::int64_t value) {
+        return static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+    }
+};
+
+#endif // MOON_SIMULATOR_H